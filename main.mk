@@ -59,7 +59,7 @@ LIBOBJ = attach.o auth.o btree.o build.o date.o delete.o \
          main.o opcodes.o os_mac.o os_unix.o os_win.o \
          pager.o parse.o pragma.o printf.o random.o \
          select.o table.o tokenize.o trigger.o update.o util.o vacuum.o \
-         vdbe.o vdbeapi.o vdbeaux.o vdbemem.o \
+         vdbe.o vdbeapi.o vdbeaux.o vdbeblob.o vdbemem.o vdbesort.o \
          where.o utf.o legacy.o
 
 # All of the source code files.
@@ -105,7 +105,9 @@ SRC = \
   $(TOP)/src/vdbe.h \
   $(TOP)/src/vdbeapi.c \
   $(TOP)/src/vdbeaux.c \
+  $(TOP)/src/vdbeblob.c \
   $(TOP)/src/vdbemem.c \
+  $(TOP)/src/vdbesort.c \
   $(TOP)/src/vdbeInt.h \
   $(TOP)/src/where.c
 
@@ -265,6 +267,11 @@ opcodes.h:	$(TOP)/src/vdbe.h
 	grep '^case OP_' $(TOP)/src/vdbe.c | \
 	  sed -e 's/://' | \
 	  awk '{printf "#define %-30s %3d\n", $$2, ++cnt}' >>opcodes.h
+	echo '#define VDBE_JUMP_TABLE &&L_default, \' >>opcodes.h
+	grep '^case OP_' $(TOP)/src/vdbe.c | \
+	  sed -e 's/://' -e 's/OP_//' | \
+	  awk '{printf "  &&L_%s, \\\n", $$2}' >>opcodes.h
+	echo '' >>opcodes.h
 
 os_mac.o:	$(TOP)/src/os_mac.c $(HDR)
 	$(TCCX) -c $(TOP)/src/os_mac.c
@@ -334,9 +341,15 @@ vdbeapi.o:	$(TOP)/src/vdbeapi.c $(VDBEHDR)
 vdbeaux.o:	$(TOP)/src/vdbeaux.c $(VDBEHDR)
 	$(TCCX) -c $(TOP)/src/vdbeaux.c
 
+vdbeblob.o:	$(TOP)/src/vdbeblob.c $(VDBEHDR)
+	$(TCCX) -c $(TOP)/src/vdbeblob.c
+
 vdbemem.o:	$(TOP)/src/vdbemem.c $(VDBEHDR)
 	$(TCCX) -c $(TOP)/src/vdbemem.c
 
+vdbesort.o:	$(TOP)/src/vdbesort.c $(VDBEHDR)
+	$(TCCX) -c $(TOP)/src/vdbesort.c
+
 where.o:	$(TOP)/src/where.c $(HDR)
 	$(TCCX) -c $(TOP)/src/where.c
 
@@ -1,129 +1,133 @@
-char *sqlite3OpcodeNames[] = {
-  "Goto",
-  "Gosub",
-  "Return",
-  "Halt",
-  "Integer",
-  "Real",
-  "String8",
-  "String",
-  "HexBlob",
-  "Blob",
-  "Variable",
-  "Utf16le_8",
-  "Utf16be_8",
-  "Utf8_16be",
-  "Utf8_16le",
-  "UtfSwab",
-  "Pop",
-  "Dup",
-  "Pull",
-  "Push",
-  "Callback",
-  "Concat",
-  "Add",
-  "Subtract",
-  "Multiply",
-  "Divide",
-  "Remainder",
-  "CollSeq",
-  "Function",
-  "BitAnd",
-  "BitOr",
-  "ShiftLeft",
-  "ShiftRight",
-  "AddImm",
-  "ForceInt",
-  "MustBeInt",
-  "Eq",
-  "Ne",
-  "Lt",
-  "Le",
-  "Gt",
-  "Ge",
-  "And",
-  "Or",
-  "Negative",
-  "AbsValue",
-  "Not",
-  "BitNot",
-  "Noop",
-  "If",
-  "IfNot",
-  "IsNull",
-  "NotNull",
-  "SetNumColumns",
-  "IdxColumn",
-  "Column",
-  "MakeRecord",
-  "Statement",
-  "AutoCommit",
-  "Transaction",
-  "ReadCookie",
-  "SetCookie",
-  "VerifyCookie",
-  "OpenRead",
-  "OpenWrite",
-  "OpenTemp",
-  "OpenPseudo",
-  "Close",
-  "MoveLt",
-  "MoveLe",
-  "MoveGe",
-  "MoveGt",
-  "Distinct",
-  "NotFound",
-  "Found",
-  "IsUnique",
-  "NotExists",
-  "NewRecno",
-  "PutIntKey",
-  "PutStrKey",
-  "Delete",
-  "SetCounts",
-  "KeyAsData",
-  "RowKey",
-  "RowData",
-  "Recno",
-  "FullKey",
-  "NullRow",
-  "Last",
-  "Rewind",
-  "Prev",
-  "Next",
-  "IdxPut",
-  "IdxDelete",
-  "IdxRecno",
-  "IdxLT",
-  "IdxGT",
-  "IdxGE",
-  "IdxIsNull",
-  "Destroy",
-  "Clear",
-  "CreateIndex",
-  "CreateTable",
-  "IntegrityCk",
-  "ListWrite",
-  "ListRewind",
-  "ListRead",
-  "ListReset",
-  "ListPush",
-  "ListPop",
-  "ContextPush",
-  "ContextPop",
-  "SortPut",
-  "Sort",
-  "SortNext",
-  "SortReset",
-  "MemStore",
-  "MemLoad",
-  "MemIncr",
-  "AggReset",
-  "AggInit",
-  "AggFunc",
-  "AggFocus",
-  "AggSet",
-  "AggGet",
-  "AggNext",
-  "Vacuum",
+/* Automatically generated file.  Do not edit */
+char *sqlite3OpcodeNames[] = { "???", 
+  "Goto", 
+  "Gosub", 
+  "Return", 
+  "Halt", 
+  "Integer", 
+  "Real", 
+  "String8", 
+  "String", 
+  "HexBlob", 
+  "Blob", 
+  "Variable", 
+  "Utf16le_8", 
+  "Utf16be_8", 
+  "Utf8_16be", 
+  "Utf8_16le", 
+  "UtfSwab", 
+  "Pop", 
+  "Dup", 
+  "Pull", 
+  "Push", 
+  "Callback", 
+  "Concat", 
+  "Add", 
+  "Subtract", 
+  "Multiply", 
+  "Divide", 
+  "Remainder", 
+  "CollSeq", 
+  "Function", 
+  "BitAnd", 
+  "BitOr", 
+  "ShiftLeft", 
+  "ShiftRight", 
+  "AddImm", 
+  "ForceInt", 
+  "MustBeInt", 
+  "Eq", 
+  "Ne", 
+  "Lt", 
+  "Le", 
+  "Gt", 
+  "Ge", 
+  "And", 
+  "Or", 
+  "Negative", 
+  "AbsValue", 
+  "Not", 
+  "BitNot", 
+  "Noop", 
+  "If", 
+  "IfNot", 
+  "IsNull", 
+  "NotNull", 
+  "SetNumColumns", 
+  "IdxColumn", 
+  "Column", 
+  "MakeRecord", 
+  "Statement", 
+  "AutoCommit", 
+  "Transaction", 
+  "ReadCookie", 
+  "SetCookie", 
+  "VerifyCookie", 
+  "OpenRead", 
+  "OpenWrite", 
+  "OpenTemp", 
+  "OpenPseudo", 
+  "Close", 
+  "MoveLt", 
+  "MoveLe", 
+  "MoveGe", 
+  "MoveGt", 
+  "Distinct", 
+  "NotFound", 
+  "Found", 
+  "IsUnique", 
+  "NotExists", 
+  "NewRecno", 
+  "PutIntKey", 
+  "PutStrKey", 
+  "Delete", 
+  "SetCounts", 
+  "KeyAsData", 
+  "RowKey", 
+  "RowData", 
+  "Recno", 
+  "FullKey", 
+  "NullRow", 
+  "Last", 
+  "Rewind", 
+  "Prev", 
+  "Next", 
+  "IdxPut", 
+  "BulkLoad", 
+  "IdxDelete", 
+  "IdxRecno", 
+  "IdxLT", 
+  "IdxGT", 
+  "IdxGE", 
+  "IdxIsNull", 
+  "Destroy", 
+  "Clear", 
+  "IncrVacuum", 
+  "FillStat", 
+  "CreateIndex", 
+  "CreateTable", 
+  "IntegrityCk", 
+  "ListWrite", 
+  "ListRewind", 
+  "ListRead", 
+  "ListReset", 
+  "ListPush", 
+  "ListPop", 
+  "ContextPush", 
+  "ContextPop", 
+  "SortPut", 
+  "Sort", 
+  "SortNext", 
+  "SortReset", 
+  "MemStore", 
+  "MemLoad", 
+  "MemIncr", 
+  "AggReset", 
+  "AggInit", 
+  "AggFunc", 
+  "AggFocus", 
+  "AggSet", 
+  "AggGet", 
+  "AggNext", 
+  "Vacuum", 
 };
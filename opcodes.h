@@ -1,3 +1,4 @@
+/* Automatically generated file.  Do not edit */
 #define OP_Goto                          1
 #define OP_Gosub                         2
 #define OP_Return                        3
@@ -91,37 +92,172 @@
 #define OP_Prev                         91
 #define OP_Next                         92
 #define OP_IdxPut                       93
-#define OP_IdxDelete                    94
-#define OP_IdxRecno                     95
-#define OP_IdxLT                        96
-#define OP_IdxGT                        97
-#define OP_IdxGE                        98
-#define OP_IdxIsNull                    99
-#define OP_Destroy                     100
-#define OP_Clear                       101
-#define OP_CreateIndex                 102
-#define OP_CreateTable                 103
-#define OP_IntegrityCk                 104
-#define OP_ListWrite                   105
-#define OP_ListRewind                  106
-#define OP_ListRead                    107
-#define OP_ListReset                   108
-#define OP_ListPush                    109
-#define OP_ListPop                     110
-#define OP_ContextPush                 111
-#define OP_ContextPop                  112
-#define OP_SortPut                     113
-#define OP_Sort                        114
-#define OP_SortNext                    115
-#define OP_SortReset                   116
-#define OP_MemStore                    117
-#define OP_MemLoad                     118
-#define OP_MemIncr                     119
-#define OP_AggReset                    120
-#define OP_AggInit                     121
-#define OP_AggFunc                     122
-#define OP_AggFocus                    123
-#define OP_AggSet                      124
-#define OP_AggGet                      125
-#define OP_AggNext                     126
-#define OP_Vacuum                      127
+#define OP_BulkLoad                     94
+#define OP_IdxDelete                    95
+#define OP_IdxRecno                     96
+#define OP_IdxLT                        97
+#define OP_IdxGT                        98
+#define OP_IdxGE                        99
+#define OP_IdxIsNull                   100
+#define OP_Destroy                     101
+#define OP_Clear                       102
+#define OP_IncrVacuum                  103
+#define OP_FillStat                    104
+#define OP_CreateIndex                 105
+#define OP_CreateTable                 106
+#define OP_IntegrityCk                 107
+#define OP_ListWrite                   108
+#define OP_ListRewind                  109
+#define OP_ListRead                    110
+#define OP_ListReset                   111
+#define OP_ListPush                    112
+#define OP_ListPop                     113
+#define OP_ContextPush                 114
+#define OP_ContextPop                  115
+#define OP_SortPut                     116
+#define OP_Sort                        117
+#define OP_SortNext                    118
+#define OP_SortReset                   119
+#define OP_MemStore                    120
+#define OP_MemLoad                     121
+#define OP_MemIncr                     122
+#define OP_AggReset                    123
+#define OP_AggInit                     124
+#define OP_AggFunc                     125
+#define OP_AggFocus                    126
+#define OP_AggSet                      127
+#define OP_AggGet                      128
+#define OP_AggNext                     129
+#define OP_Vacuum                      130
+#define VDBE_JUMP_TABLE &&L_default, \
+  &&L_Goto, \
+  &&L_Gosub, \
+  &&L_Return, \
+  &&L_Halt, \
+  &&L_Integer, \
+  &&L_Real, \
+  &&L_String8, \
+  &&L_String, \
+  &&L_HexBlob, \
+  &&L_Blob, \
+  &&L_Variable, \
+  &&L_Utf16le_8, \
+  &&L_Utf16be_8, \
+  &&L_Utf8_16be, \
+  &&L_Utf8_16le, \
+  &&L_UtfSwab, \
+  &&L_Pop, \
+  &&L_Dup, \
+  &&L_Pull, \
+  &&L_Push, \
+  &&L_Callback, \
+  &&L_Concat, \
+  &&L_Add, \
+  &&L_Subtract, \
+  &&L_Multiply, \
+  &&L_Divide, \
+  &&L_Remainder, \
+  &&L_CollSeq, \
+  &&L_Function, \
+  &&L_BitAnd, \
+  &&L_BitOr, \
+  &&L_ShiftLeft, \
+  &&L_ShiftRight, \
+  &&L_AddImm, \
+  &&L_ForceInt, \
+  &&L_MustBeInt, \
+  &&L_Eq, \
+  &&L_Ne, \
+  &&L_Lt, \
+  &&L_Le, \
+  &&L_Gt, \
+  &&L_Ge, \
+  &&L_And, \
+  &&L_Or, \
+  &&L_Negative, \
+  &&L_AbsValue, \
+  &&L_Not, \
+  &&L_BitNot, \
+  &&L_Noop, \
+  &&L_If, \
+  &&L_IfNot, \
+  &&L_IsNull, \
+  &&L_NotNull, \
+  &&L_SetNumColumns, \
+  &&L_IdxColumn, \
+  &&L_Column, \
+  &&L_MakeRecord, \
+  &&L_Statement, \
+  &&L_AutoCommit, \
+  &&L_Transaction, \
+  &&L_ReadCookie, \
+  &&L_SetCookie, \
+  &&L_VerifyCookie, \
+  &&L_OpenRead, \
+  &&L_OpenWrite, \
+  &&L_OpenTemp, \
+  &&L_OpenPseudo, \
+  &&L_Close, \
+  &&L_MoveLt, \
+  &&L_MoveLe, \
+  &&L_MoveGe, \
+  &&L_MoveGt, \
+  &&L_Distinct, \
+  &&L_NotFound, \
+  &&L_Found, \
+  &&L_IsUnique, \
+  &&L_NotExists, \
+  &&L_NewRecno, \
+  &&L_PutIntKey, \
+  &&L_PutStrKey, \
+  &&L_Delete, \
+  &&L_SetCounts, \
+  &&L_KeyAsData, \
+  &&L_RowKey, \
+  &&L_RowData, \
+  &&L_Recno, \
+  &&L_FullKey, \
+  &&L_NullRow, \
+  &&L_Last, \
+  &&L_Rewind, \
+  &&L_Prev, \
+  &&L_Next, \
+  &&L_IdxPut, \
+  &&L_BulkLoad, \
+  &&L_IdxDelete, \
+  &&L_IdxRecno, \
+  &&L_IdxLT, \
+  &&L_IdxGT, \
+  &&L_IdxGE, \
+  &&L_IdxIsNull, \
+  &&L_Destroy, \
+  &&L_Clear, \
+  &&L_IncrVacuum, \
+  &&L_FillStat, \
+  &&L_CreateIndex, \
+  &&L_CreateTable, \
+  &&L_IntegrityCk, \
+  &&L_ListWrite, \
+  &&L_ListRewind, \
+  &&L_ListRead, \
+  &&L_ListReset, \
+  &&L_ListPush, \
+  &&L_ListPop, \
+  &&L_ContextPush, \
+  &&L_ContextPop, \
+  &&L_SortPut, \
+  &&L_Sort, \
+  &&L_SortNext, \
+  &&L_SortReset, \
+  &&L_MemStore, \
+  &&L_MemLoad, \
+  &&L_MemIncr, \
+  &&L_AggReset, \
+  &&L_AggInit, \
+  &&L_AggFunc, \
+  &&L_AggFocus, \
+  &&L_AggSet, \
+  &&L_AggGet, \
+  &&L_AggNext, \
+  &&L_Vacuum, \
+
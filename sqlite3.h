@@ -1068,6 +1068,91 @@ int sqlite3_collation_needed16(
   void(*)(void*,sqlite3*,int eTextRep,const void*)
 );
 
+/*
+** Enable or disable the shared page cache.  While it is enabled, each
+** database file opened by sqlite3_open() or ATTACH is opened only once
+** per process.  Every connection to that file, in any thread, then uses
+** the same page cache, so hot pages are held in memory only once.
+** The setting affects databases opened after the call and returns
+** SQLITE_OK.  The shared cache is disabled by default.
+**
+** Connections that share a cache use table-level locks between each
+** other instead of file locks.  Only one of them may be writing at a
+** time; the others wait for it using their busy handler.  While a write
+** transaction is open, an attempt by another connection to read a table
+** that it has modified fails with SQLITE_LOCKED, as does an attempt to
+** modify a table that another connection is reading.  The cache_size,
+** synchronous and similar pragmas change the cache for every connection
+** that shares it.  In-memory and temporary databases are never shared.
+*/
+int sqlite3_enable_shared_cache(int);
+
+/*
+** An open handle on one BLOB or TEXT value in the database.  It is
+** created by sqlite3_blob_open() and destroyed by sqlite3_blob_close().
+*/
+typedef struct sqlite3_blob sqlite3_blob;
+
+/*
+** Open a handle on the value of column zColumn in the row with rowid
+** iRow of table zTable in database zDb ("main", "temp" or the name of an
+** attached database, or NULL to search them all).  The value is read
+** with sqlite3_blob_read() and, if flags is non-zero, overwritten with
+** sqlite3_blob_write(), a piece at a time, without ever being held in
+** memory as a whole.  SQLITE_OK is returned and *ppBlob set to the new
+** handle on success.  Otherwise *ppBlob is set to NULL and an error
+** code returned; sqlite3_errmsg() describes what went wrong.
+**
+** Only BLOB and TEXT values can be opened.  A column that belongs to an
+** index cannot be opened for writing.  While the handle is open it holds
+** a transaction on the database, as an unfinished sqlite3_step() would.
+**
+** A handle opened with flags==0 holds a read cursor on the table, so any
+** other statement that tries to change the table while it is open fails
+** with SQLITE_LOCKED ("database table is locked").  A handle opened for
+** writing does not block other writers.  Instead, if any row of the table
+** is inserted, changed or deleted while it is open, the handle is
+** invalidated and later reads and writes through it fail with
+** SQLITE_ABORT.
+*/
+int sqlite3_blob_open(
+  sqlite3*,
+  const char *zDb,
+  const char *zTable,
+  const char *zColumn,
+  long long int iRow,
+  int flags,
+  sqlite3_blob **ppBlob
+);
+
+/*
+** Close a handle opened by sqlite3_blob_open().  If no transaction was
+** open when the handle was opened, anything written through it is
+** committed now, and the error code of the commit, if any, is returned.
+*/
+int sqlite3_blob_close(sqlite3_blob *);
+
+/*
+** Return the size in bytes of the value that a handle refers to.  The
+** size cannot be changed through the handle.
+*/
+int sqlite3_blob_bytes(sqlite3_blob *);
+
+/*
+** Copy n bytes of the value, beginning iOffset bytes from its start,
+** into z[].  SQLITE_ERROR is returned if the range runs past the end of
+** the value.
+*/
+int sqlite3_blob_read(sqlite3_blob *, void *z, int n, int iOffset);
+
+/*
+** Overwrite n bytes of the value, beginning iOffset bytes from its start,
+** with the content of z[].  The handle must have been opened with a
+** non-zero flags argument, and SQLITE_ERROR is returned if the range runs
+** past the end of the value.
+*/
+int sqlite3_blob_write(sqlite3_blob *, const void *z, int n, int iOffset);
+
 
 #ifdef __cplusplus
 }  /* End of the 'extern "C"' block */
@@ -69,10 +69,34 @@
 **     28       4     Reserved for future use
 **     32       4     First freelist page
 **     36       4     Number of freelist pages in the file
-**     40      60     15 4-byte meta values passed to higher layers
+**     40      52     13 4-byte meta values passed to higher layers
+**     92       4     Auto-vacuum mode.  0: none, 1: full, 2: incremental
+**     96       1     Write version outside WAL mode, or 0 if not in WAL mode
+**     97       1     Read version outside WAL mode, or 0 if not in WAL mode
+**     98       2     Reserved for future use
 **
 ** All of the integer values are big-endian (most significant byte first).
 **
+** The write version is the lowest format a library must understand to
+** change the file, and the read version the lowest it must understand to
+** read it.  Format 1 is the original one.  Format 2 adds two things.
+** Auto-vacuum databases keep pointer-map pages, which every writer must
+** keep up to date, so their write version is 2.  Index pages may hold
+** prefix compressed keys, which a reader must know how to decode, so both
+** versions are raised to 2 when the first such index is created.  A
+** library that finds either version above the highest format it knows
+** refuses to open the file.
+**
+** While the database is in WAL mode, committed transactions may exist
+** only in the write-ahead log, which older libraries ignore.  So the
+** first transaction of a connection in WAL mode sets both versions to 2,
+** and saves the versions the file needs otherwise in bytes 96 and 97.
+** That transaction goes through a rollback journal, so that the new
+** versions reach the database file itself.  The first transaction that
+** commits straight into the database file from a connection that is not
+** in WAL mode puts the saved versions back.  This is only possible once
+** the log has been checkpointed.
+**
 ** The file change counter is incremented when the database is changed more
 ** than once within the same second.  This counter, together with the
 ** modification time of the file, allows other processes to know
@@ -118,18 +142,28 @@
 ** The page headers looks like this:
 **
 **   OFFSET   SIZE     DESCRIPTION
-**      0       1      Flags. 1: intkey, 2: zerodata, 4: leafdata, 8: leaf
+**      0       1      Flags. 1: intkey, 2: zerodata, 4: leafdata, 8: leaf,
+**                     16: prefix
 **      1       2      byte offset to the first freeblock
 **      3       2      number of cells on this page
 **      5       2      first byte of the cell content area
 **      7       1      number of fragmented free bytes
 **      8       4      Right child (the Ptr(N+1) value).  Omitted on leaves.
+**      *       2      Offset of the reference key.  Prefix pages only.
 **
 ** The flags define the format of this btree page.  The leaf flag means that
 ** this page has no children.  The zerodata flag means that this page carries
 ** only keys and no data.  The intkey flag means that the key is a single
 ** variable length integer at the beginning of the payload.
 **
+** The prefix flag may be set on zerodata pages that are not intkey.  Such a
+** page may keep a reference key in its cell content area, stored as a 2-byte
+** length followed by the key, at the offset given in the last two bytes of
+** the page header (zero if there is none).  Cells on the page may leave out
+** a run of bytes that their key has in common with the reference key at the
+** same offset.  Keys on one page of an index tend to share a long prefix,
+** so this lets many more of them fit on the page.
+**
 ** The cell pointer array begins on the first byte after the page header.
 ** The cell pointer array contains zero or more 2-byte numbers which are
 ** offsets from the beginning of the page to the cell content in the cell
@@ -183,9 +217,14 @@
 **      4     Page number of the left child. Omitted if leaf flag is set.
 **     var    Number of bytes of data. Omitted if the zerodata flag is set.
 **     var    Number of bytes of key. Or the key itself if intkey flag is set.
-**      *     Payload
+**     var    Bytes taken from the reference key.  Prefix pages only.
+**     var    Offset of those bytes in the key.  Omitted unless there are some.
+**      *     Payload, less any bytes taken from the reference key
 **      4     First page of the overflow chain.  Omitted if no overflow
 **
+** A cell that takes bytes from the reference key always holds the rest of
+** its key locally, so it never has an overflow chain.
+**
 ** Overflow pages form a linked list.  Each page except the last is completely
 ** filled with data (pagesize - 4 bytes).  The last page can have as little
 ** as 1 byte of data.
@@ -203,6 +242,28 @@
 **      4     Page number of next trunk page
 **      4     Number of leaf pointers on this page
 **      *     zero or more pages numbers of leaves
+**
+** POINTER MAP
+**
+** A database in auto-vacuum mode records, for every page other than page 1,
+** what the page is used for and which page points to it.  With this
+** information any page can be moved to a new location, because the one
+** pointer to it that must be changed can be found without searching the
+** file.  Pages are moved from the end of the file into free slots nearer
+** its start so that the file can be truncated.
+**
+** The information is kept on pointer-map pages.  Page 2 is the first
+** pointer-map page.  It holds one 5-byte entry for each of the pages that
+** follow it, as many as fit in the usable space.  The page after the last
+** page it describes is the second pointer-map page, and so on.  An entry
+** looks like this:
+**
+**    SIZE    DESCRIPTION
+**      1     Page type.  One of the PTRMAP_ values below
+**      4     Page number of the parent page.  Zero for root and free pages
+**
+** The page that holds the pending byte (see os.h) is never used.  If a
+** pointer-map page would fall on it, the page after it is used instead.
 */
 #include "sqliteInt.h"
 #include "pager.h"
@@ -212,29 +273,28 @@
 
 
 /* Maximum page size.  The upper bound on this value is 65536 (a limit
-** imposed by the 2-byte size of cell array pointers.)  The
-** maximum page size determines the amount of stack space allocated
-** by many of the routines in this module.  On embedded architectures
-** or any machine where memory and especially stack memory is limited,
-** one may wish to chose a smaller value for the maximum page size.
-*/
-#ifndef MX_PAGE_SIZE
-# define MX_PAGE_SIZE 1024
-#endif
+** imposed by the 2-byte size of cell array pointers.)  The page size
+** of each database is chosen when the database is created and is read
+** from the header, so buffers that hold a page or a cell are allocated
+** from the heap at the size of the actual pages rather than on the stack.
+*/
+#define MX_PAGE_SIZE SQLITE_MAX_PAGE_SIZE
 
-/* The following value is the maximum cell size assuming a maximum page
-** size give above.
+/* The following value is the maximum cell size for the page size of
+** the given btree.
 */
-#define MX_CELL_SIZE  (MX_PAGE_SIZE-8)
+#define MX_CELL_SIZE(pBt)  (pBt->pageSize-8)
 
-/* The maximum number of cells on a single page of the database.  This
+/* The maximum number of cells on a single page of the given btree.  This
 ** assumes a minimum cell size of 3 bytes.  Such small cells will be
 ** exceedingly rare, but they are possible.
 */
-#define MX_CELL ((MX_PAGE_SIZE-8)/3)
+#define MX_CELL(pBt) ((pBt->pageSize-8)/3)
 
 /* Forward declarations */
 typedef struct MemPage MemPage;
+typedef struct BtShared BtShared;
+typedef struct BtLoad BtLoad;
 
 /*
 ** This is a magic string that appears at the beginning of every
@@ -242,6 +302,12 @@ typedef struct MemPage MemPage;
 **                                  123456789 123456 */
 static const char zMagicHeader[] = "SQLite format 3";
 
+/*
+** The highest file format version this library can read and write.
+** See the description of bytes 18 and 19 of the file header above.
+*/
+#define BTREE_FORMAT_MAX  2
+
 /*
 ** Page type flags.  An ORed combination of these flags appear as the
 ** first byte of every BTree page.
@@ -250,6 +316,61 @@ static const char zMagicHeader[] = "SQLite format 3";
 #define PTF_ZERODATA  0x02
 #define PTF_LEAFDATA  0x04
 #define PTF_LEAF      0x08
+#define PTF_PREFIX    0x10
+
+/*
+** The types of page recorded in the pointer map of an auto-vacuum
+** database.  See the POINTER MAP section of the header comment.
+**
+**   PTRMAP_ROOTPAGE   The root of a table or index.  No parent.
+**   PTRMAP_FREEPAGE   A freelist trunk or leaf page.  No parent.
+**   PTRMAP_OVERFLOW1  The first overflow page of a cell.  The parent is
+**                     the btree page that holds the cell.
+**   PTRMAP_OVERFLOW2  A later overflow page.  The parent is the overflow
+**                     page before it in the chain.
+**   PTRMAP_BTREE      A btree page other than a root.  The parent is the
+**                     btree page that holds the pointer to it.
+*/
+#define PTRMAP_ROOTPAGE   1
+#define PTRMAP_FREEPAGE   2
+#define PTRMAP_OVERFLOW1  3
+#define PTRMAP_OVERFLOW2  4
+#define PTRMAP_BTREE      5
+
+/*
+** The page that holds the pending byte, and the offset of the entry for
+** page pgno on the pointer-map page pgptrmap.
+*/
+#define PENDING_BYTE_PAGE(pBt)  ((Pgno)(PENDING_BYTE/(pBt)->pageSize) + 1)
+#define PTRMAP_PTROFFSET(pgptrmap, pgno)  (5*((pgno)-(pgptrmap)-1))
+
+/*
+** True if page pgno of an auto-vacuum database is a pointer-map page.
+*/
+#define PTRMAP_ISPAGE(pBt, pgno)  (ptrmapPageno((pBt), (pgno))==(pgno))
+
+/*
+** An instance of the following structure is used to hold information
+** about a cell.  The parseCellPtr() function fills in this structure
+** based on information extract from the raw disk page.
+*/
+typedef struct CellInfo CellInfo;
+struct CellInfo {
+  u8 *pCell;     /* Pointer to the start of cell content */
+  i64 nKey;      /* The key for INTKEY tables, or number of bytes in key */
+  u32 nData;     /* Number of bytes of data */
+  u16 nHeader;   /* Size of the cell content header in bytes */
+  u16 nLocal;    /* Amount of payload held locally */
+  u16 iOverflow; /* Offset to overflow page number.  Zero if no overflow */
+  u16 nSize;     /* Size of the cell content on the main b-tree page */
+  u16 nShared;   /* Key bytes taken from the page's reference key */
+  u16 iShared;   /* Offset in the key of the bytes in nShared */
+};
+
+/*
+** Number of parsed cells remembered by each MemPage.
+*/
+#define NCELLCACHE 4
 
 /*
 ** As each page of the file is loaded into memory, an instance of the following
@@ -260,6 +381,12 @@ static const char zMagicHeader[] = "SQLite format 3";
 ** walk up the BTree from any leaf to the root.  Care must be taken to
 ** unref() the parent page pointer when this page is no longer referenced.
 ** The pageDestructor() routine handles that chore.
+**
+** Most pages are only ever read, so initPage() leaves nFree at -1 rather
+** than walk the freeblock list.  computeFreeSpace() fills it in, and
+** checks the freeblocks, before the page is changed.  aCell[] holds the
+** cells last parsed by parseCellCached(), one for each of the first few
+** steps of a binary search.  It is emptied whenever the cells move.
 */
 struct MemPage {
   u8 isInit;           /* True if previously initialized. MUST BE FIRST! */
@@ -272,20 +399,25 @@ struct MemPage {
   u8 hasData;          /* True if this page stores data */
   u8 hdrOffset;        /* 100 for page 1.  0 otherwise */
   u8 childPtrSize;     /* 0 if leaf==1.  4 if leaf==0 */
+  u8 prefix;           /* True if keys are compressed against a reference */
   u16 maxLocal;        /* Copy of Btree.maxLocal or Btree.maxLeaf */
   u16 minLocal;        /* Copy of Btree.minLocal or Btree.minLeaf */
   u16 cellOffset;      /* Index in aData of first cell pointer */
   u16 idxParent;       /* Index in parent of this node */
-  u16 nFree;           /* Number of free bytes on the page */
+  u8 nAppend;          /* Recent inserts in a row after the last cell */
+  u8 nPrepend;         /* Recent inserts in a row before the first cell */
+  int nFree;           /* Number of free bytes on the page, or -1 */
   u16 nCell;           /* Number of cells on this page, local and ovfl */
   struct _OvflCell {   /* Cells that will not fit on aData[] */
     u8 *pCell;           /* Pointers to the body of the overflow cell */
     u16 idx;             /* Insert this cell before idx-th non-overflow cell */
   } aOvfl[5];
-  struct Btree *pBt;   /* Pointer back to BTree structure */
+  BtShared *pBt;       /* Pointer back to BTree structure */
   u8 *aData;           /* Pointer back to the start of the page */
   Pgno pgno;           /* Page number for this page */
   MemPage *pParent;    /* The parent of this page.  NULL for root */
+  u16 aCellIdx[NCELLCACHE];    /* 1 + index of the cell in aCell[], or 0 */
+  CellInfo aCell[NCELLCACHE];  /* Recently parsed cells */
 };
 
 /*
@@ -296,9 +428,24 @@ struct MemPage {
 #define EXTRA_SIZE sizeof(MemPage)
 
 /*
-** Everything we need to know about an open database
+** Everything we need to know about an open database file.  When the
+** shared cache is enabled (see sqlite3_enable_shared_cache()) a single
+** BtShared, together with its pager and page cache, is used by every
+** connection in the process that opens the same file.  Each connection
+** then has its own Btree handle that points to the BtShared.
+**
+** The inTrans field is the strongest transaction held by any of the
+** handles.  nTransaction counts the handles that hold a transaction of
+** any kind.  Only one handle may hold a write transaction at a time.
+**
+** Tables modified by the current write transaction are recorded in
+** aWrLock[].  While the write transaction is open, other handles may
+** not open cursors on those tables and so never see uncommitted data.
+** Under group commit a transaction is not durable when it ends, so its
+** tables stay in aWrLock[] until nUnsynced, the number of commits still
+** waiting for the log to be synced, drops back to zero.
 */
-struct Btree {
+struct BtShared {
   Pager *pPager;        /* The page cache */
   BtCursor *pCursor;    /* A list of all open cursors */
   MemPage *pPage1;      /* First page of the database */
@@ -308,37 +455,43 @@ struct Btree {
   u8 maxEmbedFrac;      /* Maximum payload as % of total page size */
   u8 minEmbedFrac;      /* Minimum payload as % of total page size */
   u8 minLeafFrac;       /* Minimum leaf payload as % of total page size */
-  u16 pageSize;         /* Total number of bytes on a page */
-  u16 usableSize;       /* Number of usable bytes on each page */
+  int pageSize;         /* Total number of bytes on a page */
+  int usableSize;       /* Number of usable bytes on each page */
   int maxLocal;         /* Maximum local payload in non-LEAFDATA tables */
   int minLocal;         /* Minimum local payload in non-LEAFDATA tables */
   int maxLeaf;          /* Maximum local payload in a LEAFDATA table */
   int minLeaf;          /* Minimum local payload in a LEAFDATA table */
+  u8 *pTmpCell;         /* pageSize bytes to build a cell in Insert/Delete */
+  u8 *pTmpPage;         /* pageSize bytes of scratch for defragmentPage() */
+  int nRef;             /* Number of Btree handles using this structure */
+  int nTransaction;     /* Number of handles holding a transaction */
+  Btree *pWriter;       /* Handle holding the write transaction, if any */
+  void *pMutex;         /* Recursive mutex.  NULL if not shared */
+  Pgno *aWrLock;        /* Root pages written by the write transaction */
+  int nWrLock;          /* Number of entries used in aWrLock[] */
+  int nWrLockAlloc;     /* Number of slots allocated for aWrLock[] */
+  int nUnsynced;        /* Commits whose tables are still in aWrLock[] */
+  BtShared *pNext;      /* Next on the list of shared BtShared structures */
+  u8 autoVacuum;        /* True if the file has a pointer map */
+  u8 incrVacuum;        /* True to reclaim free pages only on request */
 };
-typedef Btree Bt;
 
 /*
-** Btree.inTrans may take one of the following values.
+** A handle on a database file, one for each connection that opens it.
+** The inTrans field holds the transaction state of this handle only.
 */
-#define TRANS_NONE  0
-#define TRANS_READ  1
-#define TRANS_WRITE 2
+struct Btree {
+  BtShared *pBt;        /* The shared database file and page cache */
+  u8 inTrans;           /* TRANS_NONE, TRANS_READ or TRANS_WRITE */
+  void *pBusyHandler;   /* Busy handler of the owning connection */
+};
 
 /*
-** An instance of the following structure is used to hold information
-** about a cell.  The parseCellPtr() function fills in this structure
-** based on information extract from the raw disk page.
+** Btree.inTrans and BtShared.inTrans may take one of the following values.
 */
-typedef struct CellInfo CellInfo;
-struct CellInfo {
-  u8 *pCell;     /* Pointer to the start of cell content */
-  i64 nKey;      /* The key for INTKEY tables, or number of bytes in key */
-  u32 nData;     /* Number of bytes of data */
-  u16 nHeader;   /* Size of the cell content header in bytes */
-  u16 nLocal;    /* Amount of payload held locally */
-  u16 iOverflow; /* Offset to overflow page number.  Zero if no overflow */
-  u16 nSize;     /* Size of the cell content on the main b-tree page */
-};
+#define TRANS_NONE  0
+#define TRANS_READ  1
+#define TRANS_WRITE 2
 
 /*
 ** A cursor is a pointer to a particular entry in the BTree.
@@ -346,11 +499,14 @@ struct CellInfo {
 ** MemPage.aCell[] of the entry.
 */
 struct BtCursor {
-  Btree *pBt;               /* The Btree to which this cursor belongs */
+  Btree *pBtree;            /* The handle that opened this cursor */
+  BtShared *pBt;            /* The BtShared to which this cursor belongs */
   BtCursor *pNext, *pPrev;  /* Forms a linked list of all cursors */
   BtCursor *pShared;        /* Loop of cursors with the same root page */
   int (*xCompare)(void*,int,const void*,int,const void*); /* Key comp func */
   void *pArg;               /* First arg to xCompare() */
+  int (*xCompareCursor)(void*,BtCursor*,int,int,const void*,int*);
+                            /* Compares a spilled key in place, or NULL */
   Pgno pgnoRoot;            /* The root page of this tree */
   MemPage *pPage;           /* Page that contains the entry */
   int idx;                  /* Index of the entry in pPage->aCell[] */
@@ -358,6 +514,45 @@ struct BtCursor {
   u8 wrFlag;                /* True if writable */
   u8 isValid;               /* TRUE if points to a valid entry */
   u8 status;                /* Set to SQLITE_ABORT if cursors is invalidated */
+  Pgno pgnoPrefetch;        /* Page whose children are being prefetched */
+  int iPrefetch;            /* Last child of pgnoPrefetch prefetched */
+  u8 skipNearby;            /* True if recent lookups were not local */
+  BtLoad *pLoad;            /* Bulk load in progress, or NULL */
+  u8 *aKey;                 /* Space to assemble prefix compressed keys */
+  Pgno *aOverflow;          /* Overflow page numbers of the current cell */
+  int nOverflow;            /* Number of valid entries in aOverflow[] */
+  int nOverflowAlloc;       /* Number of slots allocated for aOverflow[] */
+  u8 isIncrblob;            /* True if used by an sqlite3_blob handle */
+};
+
+/*
+** The maximum number of levels in a tree built by the bulk loader.
+** Interior pages hold at least four cells, so this is far more than
+** a database file can ever need.
+*/
+#define BTLOAD_MX_DEPTH 20
+
+/*
+** A bulk load in progress on a cursor.  See sqlite3BtreeLoadBegin().
+**
+** Each level of the tree is built from left to right, one page at a
+** time.  aLevel[0] is the leaf level.  The root page is always the one
+** page on the highest level begun so far, aLevel[nLevel-1].
+*/
+struct BtLoad {
+  int nLevel;               /* Number of levels begun */
+  u8 flags;                 /* Page flags for interior pages of the tree */
+  u8 hasPrior;              /* True once the first entry has been loaded */
+  i64 nPrior;               /* Key, or length of key, of the last entry */
+  u8 *aPrior;               /* Copy of the last key if not an INTKEY tree */
+  int nPriorAlloc;          /* Number of bytes allocated for aPrior[] */
+  Pgno pgnoLast;            /* The page most recently allocated */
+  int rc;                   /* First error while adding cells to the tree */
+  struct BtLoadLevel {
+    MemPage *pPage;           /* Page being filled, or NULL */
+    u8 *pHeld;                /* Divider waiting to be added to the level above */
+    int nHeld;                /* Size of pHeld[].  0 if nothing is waiting */
+  } aLevel[BTLOAD_MX_DEPTH];
 };
 
 /*
@@ -373,6 +568,15 @@ static void put2byte(unsigned char *p, u32 v){
   p[0] = v>>8;
   p[1] = v;
 }
+
+/*
+** Read the 2-byte offset to the start of the cell content area of a
+** page.  On a 65536-byte page with an empty content area the offset is
+** 65536, which does not fit in two bytes and is stored as zero.
+*/
+static u32 get2byteTop(unsigned char *p){
+  return ((get2byte(p)-1)&0xffff)+1;
+}
 static void put4byte(unsigned char *p, u32 v){
   p[0] = v>>24;
   p[1] = v>>16;
@@ -444,6 +648,27 @@ static void parseCellPtr(
     nPayload = 0;
   }
   n += getVarint(&pCell[n], &pInfo->nKey);
+  pInfo->nShared = 0;
+  pInfo->iShared = 0;
+  if( pPage->prefix ){
+    u32 nShared, iShared;
+    n += getVarint32(&pCell[n], &nShared);
+    if( nShared ){
+      /* The key is local but part of it is in the reference key */
+      n += getVarint32(&pCell[n], &iShared);
+      if( nShared>pInfo->nKey ) nShared = pInfo->nKey;
+      if( iShared>pInfo->nKey-nShared ) iShared = pInfo->nKey-nShared;
+      pInfo->nShared = nShared;
+      pInfo->iShared = iShared;
+      pInfo->nHeader = n;
+      pInfo->nData = 0;
+      pInfo->nLocal = pInfo->nKey;
+      pInfo->iOverflow = 0;
+      n += pInfo->nKey - nShared;
+      pInfo->nSize = n<4 ? 4 : n;
+      return;
+    }
+  }
   pInfo->nHeader = n;
   pInfo->nData = nPayload;
   if( !pPage->intKey ){
@@ -495,6 +720,43 @@ static void parseCell(
   parseCellPtr(pPage, findCell(pPage, iCell), pInfo);
 }
 
+/*
+** A version of parseCell() for the binary search in sqlite3BtreeMoveto().
+** iProbe is the number of cells of pPage the search has already looked
+** at.  Every search of a page starts with the same cell, then moves to
+** one of two others, then one of four, so the cells seen by the first
+** NCELLCACHE probes are remembered on the page, one slot per probe.  On
+** the root and the upper interior pages, which nearly every search
+** passes through, most of these are found there the next time.  Scans
+** touch each cell once and use plain parseCell().
+*/
+static void parseCellCached(
+  MemPage *pPage,         /* Page containing the cell */
+  int iCell,              /* The cell index.  First cell is 0 */
+  int iProbe,             /* Probes of pPage so far in this search */
+  CellInfo *pInfo         /* Fill in this structure */
+){
+  u8 *pCell = findCell(pPage, iCell);
+  if( iProbe>=NCELLCACHE ){
+    parseCellPtr(pPage, pCell, pInfo);
+  }else if( pPage->aCellIdx[iProbe]==iCell+1
+         && pPage->aCell[iProbe].pCell==pCell ){
+    *pInfo = pPage->aCell[iProbe];
+  }else{
+    parseCellPtr(pPage, pCell, pInfo);
+    pPage->aCell[iProbe] = *pInfo;
+    pPage->aCellIdx[iProbe] = iCell+1;
+  }
+}
+
+/*
+** Forget the cells remembered by parseCellCached().  This must be called
+** whenever cells are added to, removed from or moved about pPage.
+*/
+static void clearCellCache(MemPage *pPage){
+  memset(pPage->aCellIdx, 0, sizeof(pPage->aCellIdx));
+}
+
 /*
 ** Compute the total number of bytes that a Cell needs in the cell
 ** data area of the btree-page.  The return number includes the cell
@@ -512,6 +774,232 @@ static int cellSizePtr(MemPage *pPage, u8 *pCell){
   return info.nSize;
 }
 
+/*
+** Return a pointer to the reference key of prefix page pPage and write
+** its length into *pnRef.  NULL is returned if the page has none.
+*/
+static u8 *prefixRefKey(MemPage *pPage, int *pnRef){
+  u8 *data = pPage->aData;
+  int pc;
+
+  assert( pPage->prefix );
+  pc = get2byte(&data[pPage->cellOffset-2]);
+  if( pc==0 || pc+2>pPage->pBt->usableSize ){
+    *pnRef = 0;
+    return 0;
+  }
+  *pnRef = get2byte(&data[pc]);
+  if( pc+2+*pnRef>pPage->pBt->usableSize ){
+    *pnRef = 0;
+    return 0;
+  }
+  return &data[pc+2];
+}
+
+/*
+** pCell is a cell for prefix page pPage that takes nothing from a
+** reference key.  If the whole key is held in the cell, so that it
+** could serve as a reference key, return a pointer to the key and write
+** its length into *pnKey.  Otherwise return NULL.
+*/
+static u8 *prefixPlainKey(MemPage *pPage, u8 *pCell, int *pnKey){
+  CellInfo info;
+  parseCellPtr(pPage, pCell, &info);
+  assert( info.nShared==0 );
+  if( info.iOverflow || info.nKey<=2 ){
+    return 0;
+  }
+  *pnKey = (int)info.nKey;
+  return &pCell[info.nHeader];
+}
+
+/*
+** Cell pCell is sz bytes in size and takes nothing from a reference key.
+** Return the size it has on prefix page pPage once the longest run of
+** bytes its key has in common with aRef[0..nRef-1], at the same offset,
+** is left out.  If pOut is not NULL also write the shortened cell there.
+**
+** The cell is left as it is if the run is too short to save anything or
+** if the key spills onto overflow pages.
+*/
+static int prefixEncode(
+  MemPage *pPage,         /* The prefix page the cell is for */
+  u8 *pCell,              /* The cell, taking nothing from a reference key */
+  int sz,                 /* Size of pCell in bytes */
+  const u8 *aRef,         /* The reference key, or NULL */
+  int nRef,               /* Length of aRef[] */
+  u8 *pOut                /* Write the cell here, if not NULL */
+){
+  CellInfo info;
+  u8 *aKey;               /* The key of pCell */
+  int nKey;               /* Length of aKey[] */
+  int iShared = 0;        /* Offset of the longest common run */
+  int nShared = 0;        /* Length of the longest common run */
+  int nRun = 0;           /* Length of the run ending at aKey[i] */
+  int nOut;               /* Size of the shortened cell */
+  int i, n;
+
+  assert( pPage->prefix );
+  parseCellPtr(pPage, pCell, &info);
+  assert( info.nShared==0 && info.nSize==sz );
+  if( aRef && info.iOverflow==0 ){
+    aKey = &pCell[info.nHeader];
+    nKey = (int)info.nKey;
+    n = nKey<nRef ? nKey : nRef;
+    for(i=0; i<n; i++){
+      if( aKey[i]!=aRef[i] ){
+        nRun = 0;
+      }else if( ++nRun>nShared ){
+        nShared = nRun;
+        iShared = i+1-nRun;
+      }
+    }
+    nOut = pPage->childPtrSize + sqlite3VarintLen(nKey)
+         + sqlite3VarintLen(nShared) + sqlite3VarintLen(iShared)
+         + nKey - nShared;
+    if( nOut<4 ) nOut = 4;
+    if( nShared>0 && nOut<sz ){
+      if( pOut ){
+        n = pPage->childPtrSize;
+        memcpy(pOut, pCell, n);
+        n += putVarint(&pOut[n], nKey);
+        n += putVarint(&pOut[n], nShared);
+        n += putVarint(&pOut[n], iShared);
+        memcpy(&pOut[n], aKey, iShared);
+        memcpy(&pOut[n+iShared], &aKey[iShared+nShared],
+               nKey-iShared-nShared);
+      }
+      return nOut;
+    }
+  }
+  if( pOut ){
+    memcpy(pOut, pCell, sz);
+  }
+  return sz;
+}
+
+/*
+** Copy amt bytes of the key of the cell described by pInfo, beginning
+** "offset" bytes into the key, into pBuf[].  The cell is on prefix page
+** pPage and takes pInfo->nShared bytes of its key from the reference key.
+*/
+static void prefixKeyRange(
+  MemPage *pPage,         /* The page holding the cell */
+  CellInfo *pInfo,        /* A parse of the cell */
+  int offset,             /* First byte of the key to copy */
+  int amt,                /* Number of bytes to copy */
+  u8 *pBuf                /* Write the bytes here */
+){
+  u8 *aStored = &pInfo->pCell[pInfo->nHeader];
+  int iShared = pInfo->iShared;
+  int iEnd = iShared + pInfo->nShared;
+  int nRef;
+  u8 *aRef = prefixRefKey(pPage, &nRef);
+
+  assert( offset>=0 && offset+amt<=pInfo->nKey );
+  while( amt>0 ){
+    const u8 *pSrc;
+    int a;
+    if( offset<iShared ){
+      a = iShared - offset;
+      pSrc = &aStored[offset];
+    }else if( offset<iEnd ){
+      a = iEnd - offset;
+      pSrc = (aRef && iEnd<=nRef) ? &aRef[offset] : 0;
+    }else{
+      a = amt;
+      pSrc = &aStored[offset-pInfo->nShared];
+    }
+    if( a>amt ) a = amt;
+    if( pSrc ){
+      memcpy(pBuf, pSrc, a);
+    }else{
+      memset(pBuf, 0, a);  /* Corrupt page: there is no reference key */
+    }
+    pBuf += a;
+    offset += a;
+    amt -= a;
+  }
+}
+
+/*
+** Copy cell pCell of page pPage into pOut[] and return its size.  A cell
+** that takes part of its key from the reference key of a prefix page is
+** written out whole, as it would be stored without a reference key, so
+** that the copy can be moved to any other page.  Any other cell is copied
+** as it is.
+*/
+static int decodeCell(MemPage *pPage, u8 *pCell, u8 *pOut){
+  CellInfo info;
+  int n;
+
+  parseCellPtr(pPage, pCell, &info);
+  if( info.nShared==0 ){
+    memcpy(pOut, pCell, info.nSize);
+    return info.nSize;
+  }
+  n = pPage->childPtrSize;
+  memcpy(pOut, pCell, n);
+  n += putVarint(&pOut[n], info.nKey);
+  pOut[n++] = 0;
+  prefixKeyRange(pPage, &info, 0, (int)info.nKey, &pOut[n]);
+  n += info.nKey;
+  return n<4 ? 4 : n;
+}
+
+/*
+** Return the number of bytes cell pCell, which is sz bytes in size and
+** takes nothing from a reference key, would occupy if it were inserted
+** on page pPage now.
+*/
+static int cellSizeOnPage(MemPage *pPage, u8 *pCell, int sz){
+  if( pPage->prefix ){
+    int nRef;
+    u8 *aRef = prefixRefKey(pPage, &nRef);
+    if( aRef ){
+      return prefixEncode(pPage, pCell, sz, aRef, nRef, 0);
+    }
+  }
+  return sz;
+}
+
+/*
+** Return the number of bytes that the nCell cells in apCell[], whose
+** sizes are in szCell[] and which take nothing from a reference key,
+** would use on an empty prefix page like pPage.  This includes the cell
+** pointers and the 2-byte reference key offset in the page header.
+**
+** assemblePage() makes the key of the first cell the reference key of
+** the page if that saves space, and sets *pUseRef to say so.  Otherwise
+** the cells are stored as they are.
+*/
+static int prefixPageSize(
+  MemPage *pPage,         /* A page with the format of the new page */
+  u8 **apCell,            /* The cells */
+  int *szCell,            /* Their sizes */
+  int nCell,              /* Number of cells */
+  int *pUseRef            /* OUT: True if the reference key is worthwhile */
+){
+  int szPlain = 2;        /* Size without a reference key */
+  int szRef;              /* Size with the first key as the reference */
+  u8 *aRef = 0;
+  int nRef = 0;
+  int i;
+
+  if( nCell>0 ){
+    aRef = prefixPlainKey(pPage, apCell[0], &nRef);
+  }
+  szRef = 4 + nRef;
+  for(i=0; i<nCell; i++){
+    szPlain += szCell[i] + 2;
+    if( aRef ){
+      szRef += prefixEncode(pPage, apCell[i], szCell[i], aRef, nRef, 0) + 2;
+    }
+  }
+  *pUseRef = aRef!=0 && szRef<szPlain;
+  return *pUseRef ? szRef : szPlain;
+}
+
 /*
 ** Do sanity checking on a page.  Throw an exception if anything is
 ** not right.
@@ -541,7 +1029,8 @@ static void _pageIntegrity(MemPage *pPage){
     assert( pPage->intKey == ((c & (PTF_INTKEY|PTF_LEAFDATA))!=0) );
     assert( pPage->hasData ==
              !(pPage->zeroData || (!pPage->leaf && pPage->leafData)) );
-    assert( pPage->cellOffset==pPage->hdrOffset+12-4*pPage->leaf );
+    assert( pPage->cellOffset==pPage->hdrOffset+12-4*pPage->leaf
+                               +2*pPage->prefix );
     assert( pPage->nCell = get2byte(&pPage->aData[hdr+3]) );
   }
   data = pPage->aData;
@@ -563,8 +1052,8 @@ static void _pageIntegrity(MemPage *pPage){
   }
   idx = 0;
   nCell = get2byte(&data[hdr+3]);
-  cellLimit = get2byte(&data[hdr+5]);
-  assert( pPage->isInit==0 
+  cellLimit = get2byteTop(&data[hdr+5]);
+  assert( pPage->isInit==0 || pPage->nFree<0
          || pPage->nFree==nFree+data[hdr+7]+cellLimit-(cellOffset+2*nCell) );
   cellOffset = pPage->cellOffset;
   for(i=0; i<nCell; i++){
@@ -609,20 +1098,22 @@ static void defragmentPage(MemPage *pPage){
   int cellOffset;            /* Offset to the cell pointer array */
   int brk;                   /* Offset to the cell content area */
   int nCell;                 /* Number of cells on the page */
-  unsigned char *data;               /* The page data */
-  unsigned char temp[MX_PAGE_SIZE];  /* Temp holding area for cell content */
+  unsigned char *data;       /* The page data */
+  unsigned char *temp;       /* Temp holding area for cell content */
 
   assert( sqlite3pager_iswriteable(pPage->aData) );
   assert( pPage->pBt!=0 );
   assert( pPage->pBt->usableSize <= MX_PAGE_SIZE );
   assert( pPage->nOverflow==0 );
+  clearCellCache(pPage);
+  temp = pPage->pBt->pTmpPage;
   data = pPage->aData;
   hdr = pPage->hdrOffset;
   cellOffset = pPage->cellOffset;
   nCell = pPage->nCell;
   assert( nCell==get2byte(&data[hdr+3]) );
   usableSize = pPage->pBt->usableSize;
-  brk = get2byte(&data[hdr+5]);
+  brk = get2byteTop(&data[hdr+5]);
   memcpy(&temp[brk], &data[brk], usableSize - brk);
   brk = usableSize;
   for(i=0; i<nCell; i++){
@@ -635,6 +1126,13 @@ static void defragmentPage(MemPage *pPage){
     memcpy(&data[brk], &temp[pc], size);
     put2byte(pAddr, brk);
   }
+  if( pPage->prefix && (pc = get2byte(&data[cellOffset-2]))>0 ){
+    /* The reference key of a prefix page moves with the cells */
+    size = 2 + get2byte(&temp[pc]);
+    brk -= size;
+    memcpy(&data[brk], &temp[pc], size);
+    put2byte(&data[cellOffset-2], brk);
+  }
   assert( brk>=cellOffset+2*nCell );
   put2byte(&data[hdr+5], brk);
   data[hdr+1] = 0;
@@ -668,6 +1166,7 @@ static int allocateSpace(MemPage *pPage, int nByte){
   data = pPage->aData;
   assert( sqlite3pager_iswriteable(data) );
   assert( pPage->pBt );
+  assert( pPage->nFree>=0 );
   if( nByte<4 ) nByte = 4;
   if( pPage->nFree<nByte || pPage->nOverflow>0 ) return 0;
   pPage->nFree -= nByte;
@@ -697,12 +1196,12 @@ static int allocateSpace(MemPage *pPage, int nByte){
   /* Allocate memory from the gap in between the cell pointer array
   ** and the cell content area.
   */
-  top = get2byte(&data[hdr+5]);
+  top = get2byteTop(&data[hdr+5]);
   nCell = get2byte(&data[hdr+3]);
   cellOffset = pPage->cellOffset;
   if( nFrag>=60 || cellOffset + 2*nCell > top - nByte ){
     defragmentPage(pPage);
-    top = get2byte(&data[hdr+5]);
+    top = get2byteTop(&data[hdr+5]);
   }
   top -= nByte;
   assert( cellOffset + 2*nCell <= top );
@@ -727,6 +1226,7 @@ static void freeSpace(MemPage *pPage, int start, int size){
   assert( sqlite3pager_iswriteable(data) );
   assert( start>=pPage->hdrOffset+6+(pPage->leaf?0:4) );
   assert( end<=pPage->pBt->usableSize );
+  assert( pPage->nFree>=0 );
   if( size<4 ) size = 4;
 
   /* Add the space back into the linked list of freeblocks */
@@ -768,23 +1268,58 @@ static void freeSpace(MemPage *pPage, int start, int size){
     int top;
     pbegin = get2byte(&data[hdr+1]);
     memcpy(&data[hdr+1], &data[pbegin], 2);
-    top = get2byte(&data[hdr+5]);
+    top = get2byteTop(&data[hdr+5]);
     put2byte(&data[hdr+5], top + get2byte(&data[pbegin+2]));
   }
 }
 
+/*
+** Make aKey[0..nKey-1] the reference key of prefix page pPage, which
+** must not have one already.  Nothing is done if the page lacks room.
+*/
+static void prefixSetRef(MemPage *pPage, const u8 *aKey, int nKey){
+  u8 *data = pPage->aData;
+  int pc;
+
+  assert( pPage->prefix && nKey>2 );
+  assert( get2byte(&data[pPage->cellOffset-2])==0 );
+  if( pPage->nOverflow>0 || pPage->nFree<nKey+2 ) return;
+  pc = allocateSpace(pPage, nKey+2);
+  if( pc==0 ) return;
+  put2byte(&data[pc], nKey);
+  memcpy(&data[pc+2], aKey, nKey);
+  put2byte(&data[pPage->cellOffset-2], pc);
+}
+
+/*
+** Free the reference key of prefix page pPage, which holds no cells.
+*/
+static void prefixClearRef(MemPage *pPage){
+  u8 *data = pPage->aData;
+  int pc;
+
+  assert( pPage->prefix && pPage->nCell==0 );
+  pc = get2byte(&data[pPage->cellOffset-2]);
+  if( pc ){
+    freeSpace(pPage, pc, 2 + get2byte(&data[pc]));
+    put2byte(&data[pPage->cellOffset-2], 0);
+  }
+}
+
 /*
 ** Decode the flags byte (the first byte of the header) for a page
 ** and initialize fields of the MemPage structure accordingly.
 */
 static void decodeFlags(MemPage *pPage, int flagByte){
-  Btree *pBt;     /* A copy of pPage->pBt */
+  BtShared *pBt;  /* A copy of pPage->pBt */
 
   assert( pPage->hdrOffset==(pPage->pgno==1 ? 100 : 0) );
   pPage->intKey = (flagByte & (PTF_INTKEY|PTF_LEAFDATA))!=0;
   pPage->zeroData = (flagByte & PTF_ZERODATA)!=0;
   pPage->leaf = (flagByte & PTF_LEAF)!=0;
   pPage->childPtrSize = 4*(pPage->leaf==0);
+  pPage->prefix = (flagByte & PTF_PREFIX)!=0 && pPage->zeroData
+                     && !pPage->intKey;
   pBt = pPage->pBt;
   if( flagByte & PTF_LEAFDATA ){
     pPage->leafData = 1;
@@ -798,6 +1333,44 @@ static void decodeFlags(MemPage *pPage, int flagByte){
   pPage->hasData = !(pPage->zeroData || (!pPage->leaf && pPage->leafData));
 }
 
+/*
+** Check the reference key and the cells of prefix page pPage, which
+** initPage() has just decoded.  The key of a cell that takes bytes from
+** the reference key is put together without further checks, so a page
+** that was changed by a library that does not know the prefix format
+** could otherwise send those copies outside the page.  Return
+** SQLITE_CORRUPT if the reference key or any cell does not lie within
+** the cell content area, or if a cell takes bytes the reference key
+** does not have.
+*/
+static int prefixCheckPage(MemPage *pPage){
+  u8 *data = pPage->aData;
+  int usableSize = pPage->pBt->usableSize;
+  int iFirst = pPage->cellOffset + 2*pPage->nCell;
+  int nRef = 0;
+  int pc, i;
+
+  pc = get2byte(&data[pPage->cellOffset-2]);
+  if( pc ){
+    if( pc<iFirst || pc+2>usableSize ) return SQLITE_CORRUPT;
+    nRef = get2byte(&data[pc]);
+    if( nRef<=2 || pc+2+nRef>usableSize ) return SQLITE_CORRUPT;
+  }
+  for(i=0; i<pPage->nCell; i++){
+    CellInfo info;
+    pc = get2byte(&data[pPage->cellOffset+2*i]);
+    if( pc<iFirst || pc>usableSize-4 ) return SQLITE_CORRUPT;
+    parseCellPtr(pPage, &data[pc], &info);
+    if( info.nShared ){
+      if( info.nKey>usableSize || info.iShared+info.nShared>nRef ){
+        return SQLITE_CORRUPT;
+      }
+    }
+    if( pc+info.nSize>usableSize ) return SQLITE_CORRUPT;
+  }
+  return SQLITE_OK;
+}
+
 /*
 ** Initialize the auxiliary information for a disk block.
 **
@@ -815,14 +1388,9 @@ static int initPage(
   MemPage *pPage,        /* The page to be initialized */
   MemPage *pParent       /* The parent.  Might be NULL */
 ){
-  int pc;            /* Address of a freeblock within pPage->aData[] */
-  int i;             /* Loop counter */
   int hdr;           /* Offset to beginning of page header */
   u8 *data;          /* Equal to pPage->aData */
-  int usableSize;    /* Amount of usable space on each page */
   int cellOffset;    /* Offset from start of page to first cell pointer */
-  int nFree;         /* Number of unused bytes on the page */
-  int top;           /* First byte of the cell content area */
 
   assert( pPage->pBt!=0 );
   assert( pParent==0 || pParent->pBt==pPage->pBt );
@@ -840,14 +1408,45 @@ static int initPage(
   decodeFlags(pPage, data[hdr]);
   pPage->nOverflow = 0;
   pPage->idxShift = 0;
-  usableSize = pPage->pBt->usableSize;
-  pPage->cellOffset = cellOffset = hdr + 12 - 4*pPage->leaf;
-  top = get2byte(&data[hdr+5]);
+  pPage->cellOffset = cellOffset = hdr + 12 - 4*pPage->leaf + 2*pPage->prefix;
   pPage->nCell = get2byte(&data[hdr+3]);
+  if( cellOffset + 2*pPage->nCell > pPage->pBt->usableSize ){
+    return SQLITE_CORRUPT;
+  }
+  if( pPage->prefix && prefixCheckPage(pPage) ){
+    return SQLITE_CORRUPT;
+  }
+  pPage->nFree = -1;
+  clearCellCache(pPage);
+
+  pPage->isInit = 1;
+  pageIntegrity(pPage);
+  return SQLITE_OK;
+}
+
+/*
+** Set pPage->nFree to the number of unused bytes on pPage, if initPage()
+** left it unknown.  The freeblock list is checked along the way, and
+** SQLITE_CORRUPT returned if it is not sound.  This must be done before
+** anything is added to or removed from the page.
+*/
+static int computeFreeSpace(MemPage *pPage){
+  int pc;            /* Address of a freeblock within pPage->aData[] */
+  int i;             /* Loop counter */
+  int hdr;           /* Offset to beginning of page header */
+  u8 *data;          /* Equal to pPage->aData */
+  int usableSize;    /* Amount of usable space on each page */
+  int nFree;         /* Number of unused bytes on the page */
+  int top;           /* First byte of the cell content area */
 
-  /* Compute the total free space on the page */
+  assert( pPage->isInit );
+  if( pPage->nFree>=0 ) return SQLITE_OK;
+  hdr = pPage->hdrOffset;
+  data = pPage->aData;
+  usableSize = pPage->pBt->usableSize;
+  top = get2byteTop(&data[hdr+5]);
   pc = get2byte(&data[hdr+1]);
-  nFree = data[hdr+7] + top - (cellOffset + 2*pPage->nCell);
+  nFree = data[hdr+7] + top - (pPage->cellOffset + 2*pPage->nCell);
   i = 0;
   while( pc>0 ){
     int next, size;
@@ -859,11 +1458,8 @@ static int initPage(
     nFree += size;
     pc = next;
   }
+  if( nFree>=usableSize || nFree<0 ) return SQLITE_CORRUPT;
   pPage->nFree = nFree;
-  if( nFree>=usableSize ) return SQLITE_CORRUPT;
-
-  pPage->isInit = 1;
-  pageIntegrity(pPage);
   return SQLITE_OK;
 }
 
@@ -873,7 +1469,7 @@ static int initPage(
 */
 static void zeroPage(MemPage *pPage, int flags){
   unsigned char *data = pPage->aData;
-  Btree *pBt = pPage->pBt;
+  BtShared *pBt = pPage->pBt;
   int hdr = pPage->hdrOffset;
   int first;
 
@@ -882,17 +1478,20 @@ static void zeroPage(MemPage *pPage, int flags){
   assert( sqlite3pager_iswriteable(data) );
   memset(&data[hdr], 0, pBt->usableSize - hdr);
   data[hdr] = flags;
-  first = hdr + 8 + 4*((flags&PTF_LEAF)==0);
   memset(&data[hdr+1], 0, 4);
   data[hdr+7] = 0;
   put2byte(&data[hdr+5], pBt->usableSize);
-  pPage->nFree = pBt->usableSize - first;
   decodeFlags(pPage, flags);
+  first = hdr + 8 + 4*((flags&PTF_LEAF)==0) + 2*pPage->prefix;
+  pPage->nFree = pBt->usableSize - first;
   pPage->hdrOffset = hdr;
   pPage->cellOffset = first;
   pPage->nOverflow = 0;
   pPage->idxShift = 0;
   pPage->nCell = 0;
+  pPage->nAppend = 0;
+  pPage->nPrepend = 0;
+  clearCellCache(pPage);
   pPage->isInit = 1;
   pageIntegrity(pPage);
 }
@@ -901,7 +1500,7 @@ static void zeroPage(MemPage *pPage, int flags){
 ** Get a page from the pager.  Initialize the MemPage.pBt and
 ** MemPage.aData elements if needed.
 */
-static int getPage(Btree *pBt, Pgno pgno, MemPage **ppPage){
+static int getPage(BtShared *pBt, Pgno pgno, MemPage **ppPage){
   int rc;
   unsigned char *aData;
   MemPage *pPage;
@@ -922,7 +1521,7 @@ static int getPage(Btree *pBt, Pgno pgno, MemPage **ppPage){
 ** getPage() and initPage().
 */
 static int getAndInitPage(
-  Btree *pBt,          /* The database file */
+  BtShared *pBt,      /* The database file */
   Pgno pgno,           /* Number of the page to get */
   MemPage **ppPage,    /* Write the page pointer here */
   MemPage *pParent     /* Parent of the page */
@@ -979,6 +1578,48 @@ static void pageReinit(void *pData, int pageSize){
   }
 }
 
+/*
+** Set the page size of the database and of its pager to pageSize bytes,
+** nReserve of which are left unused at the end of each page.  The
+** scratch buffers that must hold a whole cell or page are resized to
+** match.  This must only be called while no pages are referenced.
+*/
+static int setPageSize(BtShared *pBt, int pageSize, int nReserve){
+  u8 *pTmp;
+  if( pBt->pTmpCell==0 || pageSize!=pBt->pageSize ){
+    if( sqlite3pager_set_pagesize(pBt->pPager, pageSize)!=pageSize ){
+      return SQLITE_CORRUPT;
+    }
+    pTmp = sqliteMallocRaw( pageSize*2 );
+    if( pTmp==0 ) return SQLITE_NOMEM;
+    sqliteFree(pBt->pTmpCell);
+    pBt->pTmpCell = pTmp;
+    pBt->pTmpPage = &pTmp[pageSize];
+    pBt->pageSize = pageSize;
+  }
+  pBt->usableSize = pageSize - nReserve;
+  return SQLITE_OK;
+}
+
+/*
+** True if database files opened from now on should use the shared cache,
+** and the list of BtShared structures that are available to be shared.
+** Both are protected by the global mutex, sqlite3OsEnterMutex().
+*/
+static int sharedCacheEnabled = 0;
+static BtShared *pSharedList = 0;
+
+/*
+** Enable or disable the shared cache for database files opened after
+** this call.  See the description in sqlite.h.
+*/
+int sqlite3_enable_shared_cache(int enable){
+  sqlite3OsEnterMutex();
+  sharedCacheEnabled = enable;
+  sqlite3OsLeaveMutex();
+  return SQLITE_OK;
+}
+
 /*
 ** Open a new database.
 **
@@ -997,7 +1638,9 @@ int sqlite3BtreeOpen(
   int flags,              /* Options */
   void *pBusyHandler      /* Busy callback info passed to pager layer */
 ){
-  Btree *pBt;
+  Btree *p;
+  BtShared *pBt;
+  char *zFullPathname = 0;
   int rc;
 
   /*
@@ -1013,43 +1656,187 @@ int sqlite3BtreeOpen(
   assert( sizeof(ptr)==sizeof(char*) );
   assert( sizeof(uptr)==sizeof(ptr) );
 
-  pBt = sqliteMalloc( sizeof(*pBt) );
-  if( pBt==0 ){
-    *ppBtree = 0;
+  *ppBtree = 0;
+  p = sqliteMalloc( sizeof(*p) );
+  if( p==0 ){
     return SQLITE_NOMEM;
   }
-  if( nCache<10 ) nCache = 10;
-  rc = sqlite3pager_open(&pBt->pPager, zFilename, nCache, EXTRA_SIZE,
-                        (flags & BTREE_OMIT_JOURNAL)==0, pBusyHandler);
-  if( rc!=SQLITE_OK ){
-    if( pBt->pPager ) sqlite3pager_close(pBt->pPager);
-    sqliteFree(pBt);
-    *ppBtree = 0;
-    return rc;
-  }
-  sqlite3pager_set_destructor(pBt->pPager, pageDestructor);
-  sqlite3pager_set_reiniter(pBt->pPager, pageReinit);
+  p->pBusyHandler = pBusyHandler;
+
+  /* If the shared cache is enabled and some other connection already
+  ** has this file open, use its BtShared.
+  */
+  if( sharedCacheEnabled && zFilename && zFilename[0]
+       && strcmp(zFilename, ":memory:")!=0
+       && (flags & (BTREE_MEMORY|BTREE_OMIT_JOURNAL))==0 ){
+    zFullPathname = sqlite3OsFullPathname(zFilename);
+    if( zFullPathname==0 ){
+      sqliteFree(p);
+      return SQLITE_NOMEM;
+    }
+    sqlite3OsEnterMutex();
+    for(pBt=pSharedList; pBt; pBt=pBt->pNext){
+      if( strcmp(zFullPathname, sqlite3pager_filename(pBt->pPager))==0 ){
+        pBt->nRef++;
+        break;
+      }
+    }
+    sqlite3OsLeaveMutex();
+    if( pBt ){
+      sqliteFree(zFullPathname);
+      p->pBt = pBt;
+      *ppBtree = p;
+      return SQLITE_OK;
+    }
+  }
+
+  pBt = sqliteMalloc( sizeof(*pBt) );
+  if( pBt==0 ){
+    sqliteFree(zFullPathname);
+    sqliteFree(p);
+    return SQLITE_NOMEM;
+  }
+  if( nCache<10 ) nCache = 10;
+  rc = sqlite3pager_open(&pBt->pPager, zFilename, nCache, EXTRA_SIZE,
+                        (flags & BTREE_OMIT_JOURNAL)==0, pBusyHandler);
+  if( rc!=SQLITE_OK ){
+    if( pBt->pPager ) sqlite3pager_close(pBt->pPager);
+    goto open_failed;
+  }
+  sqlite3pager_set_destructor(pBt->pPager, pageDestructor);
+  sqlite3pager_set_reiniter(pBt->pPager, pageReinit);
   pBt->pCursor = 0;
   pBt->pPage1 = 0;
   pBt->readOnly = sqlite3pager_isreadonly(pBt->pPager);
-  pBt->pageSize = SQLITE_PAGE_SIZE;  /* FIX ME - read from header */
-  pBt->usableSize = pBt->pageSize;
-  pBt->maxEmbedFrac = 64;            /* FIX ME - read from header */
-  pBt->minEmbedFrac = 32;            /* FIX ME - read from header */
-  pBt->minLeafFrac = 32;             /* FIX ME - read from header */
+  pBt->maxEmbedFrac = 64;            /* Overridden by the header */
+  pBt->minEmbedFrac = 32;            /* Overridden by the header */
+  pBt->minLeafFrac = 32;             /* Overridden by the header */
+  pBt->nRef = 1;
+  rc = setPageSize(pBt, sqlite3pager_set_pagesize(pBt->pPager, 0), 0);
+  if( rc!=SQLITE_OK ){
+    sqlite3pager_close(pBt->pPager);
+    goto open_failed;
+  }
+
+  /* Make the new BtShared available to other connections.  Another
+  ** thread may have opened the same file in the meantime, in which case
+  ** that thread's BtShared is used and this one is discarded.
+  */
+  if( zFullPathname ){
+    BtShared *pOther;
+    pBt->pMutex = sqlite3OsMutexAlloc();
+    if( pBt->pMutex==0 ){
+      sqlite3pager_close(pBt->pPager);
+      sqliteFree(pBt->pTmpCell);
+      rc = SQLITE_NOMEM;
+      goto open_failed;
+    }
+    sqlite3OsEnterMutex();
+    for(pOther=pSharedList; pOther; pOther=pOther->pNext){
+      if( strcmp(zFullPathname, sqlite3pager_filename(pOther->pPager))==0 ){
+        pOther->nRef++;
+        break;
+      }
+    }
+    if( pOther==0 ){
+      pBt->pNext = pSharedList;
+      pSharedList = pBt;
+    }
+    sqlite3OsLeaveMutex();
+    sqliteFree(zFullPathname);
+    if( pOther ){
+      sqlite3pager_close(pBt->pPager);
+      sqlite3OsMutexFree(pBt->pMutex);
+      sqliteFree(pBt->pTmpCell);
+      sqliteFree(pBt);
+      pBt = pOther;
+    }
+  }
 
-  *ppBtree = pBt;
+  p->pBt = pBt;
+  *ppBtree = p;
   return SQLITE_OK;
+
+open_failed:
+  sqliteFree(zFullPathname);
+  sqliteFree(pBt);
+  sqliteFree(p);
+  return rc;
+}
+
+/*
+** Obtain exclusive use of the BtShared that handle p refers to, for the
+** duration of one call into this module.  This is a no-op unless the
+** BtShared is shared with other connections.  While a connection is
+** using the shared pager, it is that connection's busy handler that is
+** invoked if the file is locked by another process.
+**
+** Public routines that reach the pager or change the BtShared either
+** call this directly or are thin wrappers around a static routine of
+** the same name (btreeNext() for sqlite3BtreeNext() and so on).  The
+** mutex is recursive, so public routines may call one another.
+*/
+static void btreeEnter(Btree *p){
+  BtShared *pBt = p->pBt;
+  if( pBt->pMutex ){
+    sqlite3OsMutexEnter(pBt->pMutex);
+    sqlite3pager_set_busyhandler(pBt->pPager, p->pBusyHandler);
+  }
+}
+
+/*
+** Release the BtShared obtained by btreeEnter().
+*/
+static void btreeLeave(Btree *p){
+  if( p->pBt->pMutex ){
+    sqlite3OsMutexLeave(p->pBt->pMutex);
+  }
 }
 
 /*
-** Close an open database and invalidate all cursors.
+** Close a database handle.  Cursors opened through the handle are closed
+** and any transaction it holds is rolled back.  The database file and its
+** cache are closed when the last handle that uses them is closed.
 */
-int sqlite3BtreeClose(Btree *pBt){
-  while( pBt->pCursor ){
-    sqlite3BtreeCloseCursor(pBt->pCursor);
+int sqlite3BtreeClose(Btree *p){
+  BtShared *pBt = p->pBt;
+  BtCursor *pCur;
+  int nRef;
+
+  btreeEnter(p);
+  pCur = pBt->pCursor;
+  while( pCur ){
+    BtCursor *pNext = pCur->pNext;
+    if( pCur->pBtree==p ){
+      sqlite3BtreeCloseCursor(pCur);
+    }
+    pCur = pNext;
+  }
+  sqlite3BtreeRollback(p);
+  btreeLeave(p);
+  sqliteFree(p);
+
+  /* Unlink the BtShared from the list of shared structures before the
+  ** reference count reaches zero, so that no other thread can find it
+  ** while it is being destroyed.
+  */
+  sqlite3OsEnterMutex();
+  nRef = --pBt->nRef;
+  if( nRef==0 && pBt->pMutex ){
+    BtShared **pp;
+    for(pp=&pSharedList; *pp!=pBt; pp=&(*pp)->pNext){}
+    *pp = pBt->pNext;
+  }
+  sqlite3OsLeaveMutex();
+  if( nRef>0 ){
+    return SQLITE_OK;
   }
+
+  assert( pBt->pCursor==0 );
   sqlite3pager_close(pBt->pPager);
+  sqlite3OsMutexFree(pBt->pMutex);
+  sqliteFree(pBt->aWrLock);
+  sqliteFree(pBt->pTmpCell);
   sqliteFree(pBt);
   return SQLITE_OK;
 }
@@ -1069,8 +1856,10 @@ int sqlite3BtreeClose(Btree *pBt){
 ** Synchronous is on by default so database corruption is not
 ** normally a worry.
 */
-int sqlite3BtreeSetCacheSize(Btree *pBt, int mxPage){
-  sqlite3pager_set_cachesize(pBt->pPager, mxPage);
+int sqlite3BtreeSetCacheSize(Btree *p, int mxPage){
+  btreeEnter(p);
+  sqlite3pager_set_cachesize(p->pBt->pPager, mxPage);
+  btreeLeave(p);
   return SQLITE_OK;
 }
 
@@ -1082,11 +1871,129 @@ int sqlite3BtreeSetCacheSize(Btree *pBt, int mxPage){
 ** is a very low but non-zero probability of damage.  Level 3 reduces the
 ** probability of damage to near zero but with a write performance reduction.
 */
-int sqlite3BtreeSetSafetyLevel(Btree *pBt, int level){
-  sqlite3pager_set_safety_level(pBt->pPager, level);
+int sqlite3BtreeSetSafetyLevel(Btree *p, int level){
+  btreeEnter(p);
+  sqlite3pager_set_safety_level(p->pBt->pPager, level);
+  btreeLeave(p);
   return SQLITE_OK;
 }
 
+/*
+** Get or set the journaling mode of the database.  A mode of 0 uses a
+** rollback journal and 1 uses a write-ahead log (see the PAGER_JOURNALMODE_
+** constants in pager.h).  A negative mode leaves the setting unchanged.
+** The mode actually in effect is returned.
+*/
+int sqlite3BtreeSetJournalMode(Btree *p, int eMode){
+  int rc;
+  btreeEnter(p);
+  rc = sqlite3pager_journal_mode(p->pBt->pPager, eMode);
+  btreeLeave(p);
+  return rc;
+}
+
+/*
+** Get or set the group commit window in milliseconds.  Zero disables
+** group commit and a negative value leaves the window unchanged.  The
+** window in effect is returned.
+*/
+int sqlite3BtreeSetGroupCommit(Btree *p, int nMs){
+  int rc;
+  btreeEnter(p);
+  rc = sqlite3pager_group_commit(p->pBt->pPager, nMs);
+  btreeLeave(p);
+  return rc;
+}
+
+/*
+** Get or set the page replacement policy of the page cache, one of the
+** PAGER_CACHE_ constants in pager.h.  A negative value leaves the policy
+** unchanged.  The policy actually in effect is returned.
+*/
+int sqlite3BtreeSetCachePolicy(Btree *p, int ePolicy){
+  int rc;
+  btreeEnter(p);
+  rc = sqlite3pager_cache_policy(p->pBt->pPager, ePolicy);
+  btreeLeave(p);
+  return rc;
+}
+
+/*
+** Change the maximum number of bytes of the database file that are read
+** through a memory map.  Zero disables memory mapping and a negative
+** value leaves the setting unchanged.  The setting in effect is returned.
+*/
+i64 sqlite3BtreeSetMmapSize(Btree *p, i64 nByte){
+  i64 rc;
+  btreeEnter(p);
+  rc = sqlite3pager_mmap_size(p->pBt->pPager, nByte);
+  btreeLeave(p);
+  return rc;
+}
+
+/*
+** Get or set the number of pages read ahead of a scan.  Zero
+** disables read-ahead and a negative value leaves the setting unchanged.
+** The setting in effect is returned.
+*/
+int sqlite3BtreeSetReadAhead(Btree *p, int nPage){
+  int rc;
+  btreeEnter(p);
+  rc = sqlite3pager_readahead(p->pBt->pPager, nPage);
+  btreeLeave(p);
+  return rc;
+}
+
+/*
+** Get or set the page size of the database.  The page size is recorded
+** in the header when the database is created, so it can only be changed
+** while the file is still empty and no transaction is open.  A size that
+** is not a power of two between SQLITE_MIN_PAGE_SIZE and
+** SQLITE_MAX_PAGE_SIZE leaves the setting unchanged.  The page size in
+** effect is returned.
+*/
+int sqlite3BtreeSetPageSize(Btree *p, int pageSize){
+  BtShared *pBt = p->pBt;
+  btreeEnter(p);
+  if( pageSize>0 && pBt->pPage1==0
+       && sqlite3pager_pagecount(pBt->pPager)==0 ){
+    setPageSize(pBt, pageSize, pBt->pageSize - pBt->usableSize);
+  }
+  pageSize = pBt->pageSize;
+  btreeLeave(p);
+  return pageSize;
+}
+
+/*
+** Get or set the auto-vacuum mode of the database, one of the
+** BTREE_AUTOVACUUM_ values.  Like the page size, the mode is recorded in
+** the header when the database is created and can only be changed
+** while the file is still empty.  A negative value leaves the mode
+** unchanged.  In-memory databases are never auto-vacuumed.  The mode in
+** effect is returned.
+*/
+int sqlite3BtreeSetAutoVacuum(Btree *p, int eMode){
+  BtShared *pBt = p->pBt;
+  const char *zFilename;
+  btreeEnter(p);
+  zFilename = sqlite3pager_filename(pBt->pPager);
+  if( eMode>=BTREE_AUTOVACUUM_NONE && eMode<=BTREE_AUTOVACUUM_INCR
+       && zFilename && zFilename[0] && pBt->pPage1==0
+       && sqlite3pager_pagecount(pBt->pPager)==0 ){
+    pBt->autoVacuum = eMode!=BTREE_AUTOVACUUM_NONE;
+    pBt->incrVacuum = eMode==BTREE_AUTOVACUUM_INCR;
+  }
+  if( !pBt->autoVacuum ){
+    eMode = BTREE_AUTOVACUUM_NONE;
+  }else if( pBt->incrVacuum ){
+    eMode = BTREE_AUTOVACUUM_INCR;
+  }else{
+    eMode = BTREE_AUTOVACUUM_FULL;
+  }
+  btreeLeave(p);
+  return eMode;
+}
+
 /*
 ** Get a reference to pPage1 of the database file.  This will
 ** also acquire a readlock on that file.
@@ -1097,35 +2004,69 @@ int sqlite3BtreeSetSafetyLevel(Btree *pBt, int level){
 ** is returned if we run out of memory.  SQLITE_PROTOCOL is returned
 ** if there is a locking protocol violation.
 */
-static int lockBtree(Btree *pBt){
+static int lockBtree(BtShared *pBt){
   int rc;
   MemPage *pPage1;
+  u8 *page1;
+  int pageSize;
+  int nReserve;
   if( pBt->pPage1 ) return SQLITE_OK;
-  rc = getPage(pBt, 1, &pPage1);
+
+  /* Fetch the raw image of page 1 first.  Acquiring the first page may
+  ** play back a hot journal or read a write-ahead log, either of which
+  ** switches the pager to the page size recorded there.
+  */
+  rc = sqlite3pager_get(pBt->pPager, 1, (void**)&page1);
   if( rc!=SQLITE_OK ) return rc;
-  
+  pageSize = sqlite3pager_set_pagesize(pBt->pPager, 0);
+  nReserve = pBt->pageSize - pBt->usableSize;
 
   /* Do some checking to help insure the file we opened really is
   ** a valid database file. 
   */
   rc = SQLITE_NOTADB;
   if( sqlite3pager_pagecount(pBt->pPager)>0 ){
-    u8 *page1 = pPage1->aData;
     if( memcmp(page1, zMagicHeader, 16)!=0 ){
-      goto page1_init_failed;
+      goto page1_read_failed;
+    }
+    if( page1[18]>BTREE_FORMAT_MAX || page1[19]>BTREE_FORMAT_MAX ){
+      goto page1_read_failed;
     }
-    if( page1[18]>1 || page1[19]>1 ){
-      goto page1_init_failed;
+    pageSize = get2byte(&page1[16]);
+    if( pageSize==1 ) pageSize = 65536;
+    if( pageSize<SQLITE_MIN_PAGE_SIZE || pageSize>SQLITE_MAX_PAGE_SIZE
+         || (pageSize & (pageSize-1))!=0 ){
+      goto page1_read_failed;
     }
-    pBt->pageSize = get2byte(&page1[16]);
-    pBt->usableSize = pBt->pageSize - page1[20];
-    if( pBt->usableSize<500 ){
-      goto page1_init_failed;
+    nReserve = page1[20];
+    if( pageSize-nReserve<500 ){
+      goto page1_read_failed;
     }
     pBt->maxEmbedFrac = page1[21];
     pBt->minEmbedFrac = page1[22];
     pBt->minLeafFrac = page1[23];
+    pBt->autoVacuum = get4byte(&page1[92])!=BTREE_AUTOVACUUM_NONE;
+    pBt->incrVacuum = get4byte(&page1[92])==BTREE_AUTOVACUUM_INCR;
+  }
+
+  /* If the header records a page size other than the one the pager has
+  ** been reading with, drop page 1 (which empties the cache) and start
+  ** over with the page size of the file.
+  */
+  if( pageSize!=sqlite3pager_set_pagesize(pBt->pPager, 0) ){
+    sqlite3pager_unref(page1);
+    rc = setPageSize(pBt, pageSize, nReserve);
+    if( rc!=SQLITE_OK ) return rc;
+    return lockBtree(pBt);
+  }
+  rc = setPageSize(pBt, pageSize, nReserve);
+  if( rc!=SQLITE_OK ){
+    goto page1_read_failed;
   }
+  rc = getPage(pBt, 1, &pPage1);
+  sqlite3pager_unref(page1);
+  if( rc!=SQLITE_OK ) return rc;
+  rc = SQLITE_NOTADB;
 
   /* maxLocal is the maximum amount of payload to store locally for
   ** a cell.  Make sure it is small enough so that at least minFanout
@@ -1147,7 +2088,7 @@ static int lockBtree(Btree *pBt){
   if( pBt->minLocal>pBt->maxLocal || pBt->maxLocal<0 ){
     goto page1_init_failed;
   }
-  assert( pBt->maxLeaf + 23 <= MX_CELL_SIZE );
+  assert( pBt->maxLeaf + 23 <= MX_CELL_SIZE(pBt) );
   pBt->pPage1 = pPage1;
   return SQLITE_OK;
 
@@ -1155,6 +2096,10 @@ page1_init_failed:
   releasePage(pPage1);
   pBt->pPage1 = 0;
   return rc;
+
+page1_read_failed:
+  sqlite3pager_unref(page1);
+  return rc;
 }
 
 /*
@@ -1167,7 +2112,7 @@ page1_init_failed:
 **
 ** If there is a transaction in progress, this routine is a no-op.
 */
-static void unlockBtreeIfUnused(Btree *pBt){
+static void unlockBtreeIfUnused(BtShared *pBt){
   if( pBt->inTrans==TRANS_NONE && pBt->pCursor==0 && pBt->pPage1!=0 ){
     if( pBt->pPage1->aData==0 ){
       MemPage *pPage = pBt->pPage1;
@@ -1181,11 +2126,56 @@ static void unlockBtreeIfUnused(Btree *pBt){
   }
 }
 
+/*
+** Raise the file format write version in the header of page 1 to at
+** least iWrite and the read version to at least iRead.  Page 1 is only
+** written if one of them changes.
+*/
+static int raiseFileFormat(BtShared *pBt, int iWrite, int iRead){
+  u8 *data = pBt->pPage1->aData;
+  u8 *aVers = data[96] ? &data[96] : &data[18];
+  int rc;
+
+  assert( iWrite<=BTREE_FORMAT_MAX && iRead<=BTREE_FORMAT_MAX );
+  if( aVers[0]>=iWrite && aVers[1]>=iRead ) return SQLITE_OK;
+  rc = sqlite3pager_write(data);
+  if( rc ) return rc;
+  if( aVers[0]<iWrite ) aVers[0] = iWrite;
+  if( aVers[1]<iRead ) aVers[1] = iRead;
+  return SQLITE_OK;
+}
+
+/*
+** Mark the header of page 1 as belonging to a database in WAL mode if
+** isWal is true, or restore the versions saved in bytes 96 and 97 if it
+** is false.  Page 1 is only written if the mark changes.
+*/
+static int setWalFormat(BtShared *pBt, int isWal){
+  u8 *data = pBt->pPage1->aData;
+  int rc;
+
+  if( (data[96]!=0)==(isWal!=0) ) return SQLITE_OK;
+  rc = sqlite3pager_write(data);
+  if( rc ) return rc;
+  if( isWal ){
+    data[96] = data[18];
+    data[97] = data[19];
+    data[18] = 2;
+    data[19] = 2;
+  }else{
+    data[18] = data[96];
+    data[19] = data[97];
+    data[96] = 0;
+    data[97] = 0;
+  }
+  return SQLITE_OK;
+}
+
 /*
 ** Create a new database by initializing the first page of the
 ** file.
 */
-static int newDatabase(Btree *pBt){
+static int newDatabase(BtShared *pBt){
   MemPage *pP1;
   unsigned char *data;
   int rc;
@@ -1197,14 +2187,18 @@ static int newDatabase(Btree *pBt){
   if( rc ) return rc;
   memcpy(data, zMagicHeader, sizeof(zMagicHeader));
   assert( sizeof(zMagicHeader)==16 );
-  put2byte(&data[16], pBt->pageSize);
-  data[18] = 1;
+  put2byte(&data[16], pBt->pageSize<65536 ? pBt->pageSize : 1);
+  data[18] = pBt->autoVacuum ? 2 : 1;
   data[19] = 1;
   data[20] = pBt->pageSize - pBt->usableSize;
   data[21] = pBt->maxEmbedFrac;
   data[22] = pBt->minEmbedFrac;
   data[23] = pBt->minLeafFrac;
   memset(&data[24], 0, 100-24);
+  if( pBt->autoVacuum ){
+    put4byte(&data[92], pBt->incrVacuum ? BTREE_AUTOVACUUM_INCR
+                                        : BTREE_AUTOVACUUM_FULL);
+  }
   zeroPage(pP1, PTF_INTKEY|PTF_LEAF|PTF_LEAFDATA );
   return SQLITE_OK;
 }
@@ -1230,56 +2224,193 @@ static int newDatabase(Btree *pBt){
 ** a master journal file name supplied later via sqlite3BtreeSync().
 ** This is so that appropriate space can be allocated in the journal file
 ** when it is created..
+**
+** If the database cache is shared and another connection holds the
+** write transaction, a request for a write-transaction waits for it
+** to finish using the busy handler of this connection.  SQLITE_BUSY
+** is returned if the busy handler gives up.
 */
-int sqlite3BtreeBeginTrans(Btree *pBt, int wrflag, int nMaster){
+int sqlite3BtreeBeginTrans(Btree *p, int wrflag, int nMaster){
+  BtShared *pBt = p->pBt;
   int rc = SQLITE_OK;
+  int busy = 0;
 
-  /* If the btree is already in a write-transaction, or it
+  btreeEnter(p);
+
+  /* If the handle is already in a write-transaction, or it
   ** is already in a read-transaction and a read-transaction
   ** is requested, this is a no-op.
   */
-  if( pBt->inTrans==TRANS_WRITE || 
-      (pBt->inTrans==TRANS_READ && !wrflag) ){
-    return SQLITE_OK;
+  if( p->inTrans==TRANS_WRITE || 
+      (p->inTrans==TRANS_READ && !wrflag) ){
+    goto begin_trans_out;
   }
   if( pBt->readOnly && wrflag ){
-    return SQLITE_READONLY;
+    rc = SQLITE_READONLY;
+    goto begin_trans_out;
+  }
+
+  /* Wait for any other handle to finish its write-transaction.  The
+  ** BtShared is released while the busy handler runs so that the
+  ** writer is able to commit.
+  */
+  while( wrflag && pBt->pWriter!=0 ){
+    BusyHandler *pH = (BusyHandler*)p->pBusyHandler;
+    btreeLeave(p);
+    if( pH==0 || pH->xFunc==0 || pH->xFunc(pH->pArg, busy++)==0 ){
+      return SQLITE_BUSY;
+    }
+    btreeEnter(p);
   }
 
   if( pBt->pPage1==0 ){
+    /* A new snapshot for a write transaction must include commits that
+    ** are still waiting for a group commit sync. */
+    sqlite3pager_write_snapshot(pBt->pPager, wrflag);
     rc = lockBtree(pBt);
+    sqlite3pager_write_snapshot(pBt->pPager, 0);
   }
 
   if( rc==SQLITE_OK && wrflag ){
+    Pager *pPager = pBt->pPager;
+    int isWal = sqlite3pager_journal_mode(pPager, PAGER_JOURNALMODE_QUERY)
+                   ==PAGER_JOURNALMODE_WAL;
+    if( isWal && pBt->pPage1->aData[96]==0 ){
+      /* The header must be marked in the database file itself */
+      sqlite3pager_journal_once(pPager);
+    }
     rc = sqlite3pager_begin(pBt->pPage1->aData, nMaster);
     if( rc==SQLITE_OK ){
       rc = newDatabase(pBt);
     }
+    if( rc==SQLITE_OK && pBt->autoVacuum ){
+      /* Auto-vacuum files written before the format was raised */
+      rc = raiseFileFormat(pBt, 2, 1);
+    }
+    if( rc==SQLITE_OK && (isWal || !sqlite3pager_uses_wal(pPager)) ){
+      rc = setWalFormat(pBt, isWal);
+    }
   }
 
   if( rc==SQLITE_OK ){
-    pBt->inTrans = (wrflag?TRANS_WRITE:TRANS_READ);
-    if( wrflag ) pBt->inStmt = 0;
+    if( p->inTrans==TRANS_NONE ) pBt->nTransaction++;
+    p->inTrans = (wrflag?TRANS_WRITE:TRANS_READ);
+    if( p->inTrans>pBt->inTrans ) pBt->inTrans = p->inTrans;
+    if( wrflag ){
+      pBt->pWriter = p;
+      if( pBt->nUnsynced==0 ) pBt->nWrLock = 0;
+      pBt->inStmt = 0;
+    }
   }else{
     unlockBtreeIfUnused(pBt);
   }
+
+begin_trans_out:
+  btreeLeave(p);
   return rc;
 }
 
+/*
+** End the transaction held by handle p, if any, after it has been
+** committed or rolled back.  The transaction state of the BtShared
+** becomes the strongest state still held by one of its handles.
+*/
+static void endTransaction(Btree *p){
+  BtShared *pBt = p->pBt;
+  if( p->inTrans!=TRANS_NONE ){
+    pBt->nTransaction--;
+  }
+  if( pBt->pWriter==p ){
+    pBt->pWriter = 0;
+    if( pBt->nUnsynced==0 ) pBt->nWrLock = 0;
+    pBt->inStmt = 0;
+  }
+  p->inTrans = TRANS_NONE;
+  if( pBt->pWriter ){
+    pBt->inTrans = TRANS_WRITE;
+  }else if( pBt->nTransaction>0 ){
+    pBt->inTrans = TRANS_READ;
+  }else{
+    pBt->inTrans = TRANS_NONE;
+  }
+  unlockBtreeIfUnused(pBt);
+}
+
+/*
+** Record that the write-transaction of handle p has modified the
+** table rooted at page iTable.  Other handles cannot read the table
+** until the transaction ends.  Nothing needs to be recorded if the
+** database is not shared.
+*/
+static int setWriteLock(Btree *p, Pgno iTable){
+  BtShared *pBt = p->pBt;
+  int i;
+  assert( pBt->pWriter==p );
+  if( pBt->pMutex==0 ) return SQLITE_OK;
+  for(i=0; i<pBt->nWrLock; i++){
+    if( pBt->aWrLock[i]==iTable ) return SQLITE_OK;
+  }
+  if( pBt->nWrLock>=pBt->nWrLockAlloc ){
+    int nNew = pBt->nWrLockAlloc*2 + 8;
+    Pgno *aNew = sqliteRealloc(pBt->aWrLock, nNew*sizeof(Pgno));
+    if( aNew==0 ) return SQLITE_NOMEM;
+    pBt->aWrLock = aNew;
+    pBt->nWrLockAlloc = nNew;
+  }
+  pBt->aWrLock[pBt->nWrLock++] = iTable;
+  return SQLITE_OK;
+}
+
+/*
+** Return true if the table rooted at page iTable has been modified by
+** the write-transaction of a handle other than p, or by a commit that
+** is not yet durable.
+*/
+static int isWriteLocked(Btree *p, Pgno iTable){
+  BtShared *pBt = p->pBt;
+  int i;
+  if( pBt->pWriter==p ) return 0;
+  if( pBt->pWriter==0 && pBt->nUnsynced==0 ) return 0;
+  for(i=0; i<pBt->nWrLock; i++){
+    if( pBt->aWrLock[i]==iTable ) return 1;
+  }
+  return 0;
+}
+
 /*
 ** Commit the transaction currently in progress.
 **
 ** This will release the write lock on the database file.  If there
 ** are no active cursors, it also releases the read lock.
+**
+** Under group commit the log is synced after the BtShared is released,
+** so that other handles sharing the cache can commit into the same
+** group while this one waits.  Other handles still cannot read the
+** tables this transaction wrote until the sync is done.
 */
-int sqlite3BtreeCommit(Btree *pBt){
+int sqlite3BtreeCommit(Btree *p){
+  BtShared *pBt = p->pBt;
   int rc = SQLITE_OK;
-  if( pBt->inTrans==TRANS_WRITE ){
-    rc = sqlite3pager_commit(pBt->pPager);
+  int iCommit = 0;
+  Pager *pPager = pBt->pPager;
+  btreeEnter(p);
+  if( p->inTrans==TRANS_WRITE ){
+    rc = sqlite3pager_commit(pPager);
+    iCommit = sqlite3pager_commit_id(pPager);
+    if( iCommit ) pBt->nUnsynced++;
+  }
+  endTransaction(p);
+  btreeLeave(p);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3pager_commit_wait(pPager, iCommit);
+  }
+  if( iCommit ){
+    btreeEnter(p);
+    if( --pBt->nUnsynced==0 && pBt->pWriter==0 ){
+      pBt->nWrLock = 0;
+    }
+    btreeLeave(p);
   }
-  pBt->inTrans = TRANS_NONE;
-  pBt->inStmt = 0;
-  unlockBtreeIfUnused(pBt);
   return rc;
 }
 
@@ -1289,7 +2420,7 @@ int sqlite3BtreeCommit(Btree *pBt){
 ** in assert() expressions, so it is only compiled if NDEBUG is not
 ** defined.
 */
-static int countWriteCursors(Btree *pBt){
+static int countWriteCursors(BtShared *pBt){
   BtCursor *pCur;
   int r = 0;
   for(pCur=pBt->pCursor; pCur; pCur=pCur->pNext){
@@ -1303,7 +2434,7 @@ static int countWriteCursors(Btree *pBt){
 /*
 ** Invalidate all cursors
 */
-static void invalidateCursors(Btree *pBt){
+static void invalidateCursors(BtShared *pBt){
   BtCursor *pCur;
   for(pCur=pBt->pCursor; pCur; pCur=pCur->pNext){
     MemPage *pPage = pCur->pPage;
@@ -1322,7 +2453,8 @@ static void invalidateCursors(Btree *pBt){
 /*
 ** Print debugging information about all cursors to standard output.
 */
-void sqlite3BtreeCursorList(Btree *pBt){
+void sqlite3BtreeCursorList(Btree *p){
+  BtShared *pBt = p->pBt;
   BtCursor *pCur;
   for(pCur=pBt->pCursor; pCur; pCur=pCur->pNext){
     MemPage *pPage = pCur->pPage;
@@ -1345,10 +2477,12 @@ void sqlite3BtreeCursorList(Btree *pBt){
 ** This will release the write lock on the database file.  If there
 ** are no active cursors, it also releases the read lock.
 */
-int sqlite3BtreeRollback(Btree *pBt){
+int sqlite3BtreeRollback(Btree *p){
+  BtShared *pBt = p->pBt;
   int rc = SQLITE_OK;
   MemPage *pPage1;
-  if( pBt->inTrans==TRANS_WRITE ){
+  btreeEnter(p);
+  if( p->inTrans==TRANS_WRITE ){
     rc = sqlite3pager_rollback(pBt->pPager);
     /* The rollback may have destroyed the pPage1->aData value.  So
     ** call getPage() on page 1 again to make sure pPage1->aData is
@@ -1358,9 +2492,8 @@ int sqlite3BtreeRollback(Btree *pBt){
     }
     assert( countWriteCursors(pBt)==0 );
   }
-  pBt->inTrans = TRANS_NONE;
-  pBt->inStmt = 0;
-  unlockBtreeIfUnused(pBt);
+  endTransaction(p);
+  btreeLeave(p);
   return rc;
 }
 
@@ -1379,13 +2512,17 @@ int sqlite3BtreeRollback(Btree *pBt){
 ** error occurs within the statement, the effect of that one statement
 ** can be rolled back without having to rollback the entire transaction.
 */
-int sqlite3BtreeBeginStmt(Btree *pBt){
+int sqlite3BtreeBeginStmt(Btree *p){
+  BtShared *pBt = p->pBt;
   int rc;
-  if( (pBt->inTrans!=TRANS_WRITE) || pBt->inStmt ){
-    return pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
+  btreeEnter(p);
+  if( (p->inTrans!=TRANS_WRITE) || pBt->inStmt ){
+    rc = pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
+  }else{
+    rc = pBt->readOnly ? SQLITE_OK : sqlite3pager_stmt_begin(pBt->pPager);
+    pBt->inStmt = 1;
   }
-  rc = pBt->readOnly ? SQLITE_OK : sqlite3pager_stmt_begin(pBt->pPager);
-  pBt->inStmt = 1;
+  btreeLeave(p);
   return rc;
 }
 
@@ -1394,14 +2531,21 @@ int sqlite3BtreeBeginStmt(Btree *pBt){
 ** Commit the statment subtransaction currently in progress.  If no
 ** subtransaction is active, this is a no-op.
 */
-int sqlite3BtreeCommitStmt(Btree *pBt){
+int sqlite3BtreeCommitStmt(Btree *p){
+  BtShared *pBt = p->pBt;
   int rc;
-  if( pBt->inStmt && !pBt->readOnly ){
+  btreeEnter(p);
+  if( p->inTrans!=TRANS_WRITE ){
+    rc = SQLITE_OK;
+  }else if( pBt->inStmt && !pBt->readOnly ){
     rc = sqlite3pager_stmt_commit(pBt->pPager);
   }else{
     rc = SQLITE_OK;
   }
-  pBt->inStmt = 0;
+  if( p->inTrans==TRANS_WRITE ){
+    pBt->inStmt = 0;
+  }
+  btreeLeave(p);
   return rc;
 }
 
@@ -1413,12 +2557,16 @@ int sqlite3BtreeCommitStmt(Btree *pBt){
 ** to use a cursor that was open at the beginning of this operation
 ** will result in an error.
 */
-int sqlite3BtreeRollbackStmt(Btree *pBt){
-  int rc;
-  if( pBt->inStmt==0 || pBt->readOnly ) return SQLITE_OK;
-  rc = sqlite3pager_stmt_rollback(pBt->pPager);
-  assert( countWriteCursors(pBt)==0 );
-  pBt->inStmt = 0;
+int sqlite3BtreeRollbackStmt(Btree *p){
+  BtShared *pBt = p->pBt;
+  int rc = SQLITE_OK;
+  btreeEnter(p);
+  if( p->inTrans==TRANS_WRITE && pBt->inStmt && !pBt->readOnly ){
+    rc = sqlite3pager_stmt_rollback(pBt->pPager);
+    assert( countWriteCursors(pBt)==0 );
+    pBt->inStmt = 0;
+  }
+  btreeLeave(p);
   return rc;
 }
 
@@ -1480,15 +2628,21 @@ static int dfltCompare(
 ** in incorrect operations.  If the comparison function is NULL, a
 ** default comparison function is used.  The comparison function is
 ** always ignored for INTKEY tables.
+**
+** If the database cache is shared, the cursors of all connections are
+** subject to the read-lock described above.  In addition, SQLITE_LOCKED
+** is returned if another connection has modified table iTable in a
+** write transaction that is still open.
 */
 int sqlite3BtreeCursor(
-  Btree *pBt,                                 /* The btree */
+  Btree *p,                                   /* The btree */
   int iTable,                                 /* Root page of table to open */
   int wrFlag,                                 /* 1 to write. 0 read-only */
   int (*xCmp)(void*,int,const void*,int,const void*), /* Key Comparison func */
   void *pArg,                                 /* First arg to xCompare() */
   BtCursor **ppCur                            /* Write new cursor here */
 ){
+  BtShared *pBt = p->pBt;
   int rc;
   BtCursor *pCur, *pRing;
 
@@ -1496,9 +2650,16 @@ int sqlite3BtreeCursor(
     *ppCur = 0;
     return SQLITE_READONLY;
   }
+  btreeEnter(p);
+  if( isWriteLocked(p, (Pgno)iTable) ){
+    btreeLeave(p);
+    *ppCur = 0;
+    return SQLITE_LOCKED;
+  }
   if( pBt->pPage1==0 ){
     rc = lockBtree(pBt);
     if( rc!=SQLITE_OK ){
+      btreeLeave(p);
       *ppCur = 0;
       return rc;
     }
@@ -1520,10 +2681,20 @@ int sqlite3BtreeCursor(
     goto create_cursor_exception;
   }
   pCur->xCompare = xCmp ? xCmp : dfltCompare;
+  pCur->xCompareCursor = 0;
   pCur->pArg = pArg;
+  pCur->pBtree = p;
   pCur->pBt = pBt;
   pCur->wrFlag = wrFlag;
   pCur->idx = 0;
+  pCur->pgnoPrefetch = 0;
+  pCur->skipNearby = 0;
+  pCur->pLoad = 0;
+  pCur->aKey = 0;
+  pCur->aOverflow = 0;
+  pCur->nOverflow = 0;
+  pCur->nOverflowAlloc = 0;
+  pCur->isIncrblob = 0;
   memset(&pCur->info, 0, sizeof(pCur->info));
   pCur->pNext = pBt->pCursor;
   if( pCur->pNext ){
@@ -1542,6 +2713,7 @@ int sqlite3BtreeCursor(
   pCur->isValid = 0;
   pCur->status = SQLITE_OK;
   *ppCur = pCur;
+  btreeLeave(p);
   return SQLITE_OK;
 
 create_cursor_exception:
@@ -1551,6 +2723,7 @@ create_cursor_exception:
     sqliteFree(pCur);
   }
   unlockBtreeIfUnused(pBt);
+  btreeLeave(p);
   return rc;
 }
 
@@ -1568,12 +2741,31 @@ void sqlite3BtreeSetCompare(
 }
 #endif
 
+/*
+** Give the cursor a second comparison function for keys that are too big
+** to fit on a single page.  xCmp(pArg, pCur, nCellKey, nKey, pKey, &c)
+** compares the key of the entry pCur points to against pKey, reading the
+** key through the cursor, and returns SQLITE_OK or an error code.  Without
+** it, sqlite3BtreeMoveto() copies each such key into a buffer of its own
+** before handing it to the ordinary comparison function.
+*/
+void sqlite3BtreeSetStreamCompare(
+  BtCursor *pCur,
+  int(*xCmp)(void*,BtCursor*,int,int,const void*,int*)
+){
+  pCur->xCompareCursor = xCmp;
+}
+
+static void loadAbandon(BtCursor*);
+
 /*
 ** Close a cursor.  The read lock on the database file is released
 ** when the last cursor is closed.
 */
 int sqlite3BtreeCloseCursor(BtCursor *pCur){
-  Btree *pBt = pCur->pBt;
+  BtShared *pBt = pCur->pBt;
+  Btree *p = pCur->pBtree;
+  btreeEnter(p);
   if( pCur->pPrev ){
     pCur->pPrev->pNext = pCur->pNext;
   }else{
@@ -1582,6 +2774,7 @@ int sqlite3BtreeCloseCursor(BtCursor *pCur){
   if( pCur->pNext ){
     pCur->pNext->pPrev = pCur->pPrev;
   }
+  loadAbandon(pCur);
   releasePage(pCur->pPage);
   if( pCur->pShared!=pCur ){
     BtCursor *pRing = pCur->pShared;
@@ -1589,6 +2782,9 @@ int sqlite3BtreeCloseCursor(BtCursor *pCur){
     pRing->pShared = pCur->pShared;
   }
   unlockBtreeIfUnused(pBt);
+  btreeLeave(p);
+  sqliteFree(pCur->aKey);
+  sqliteFree(pCur->aOverflow);
   sqliteFree(pCur);
   return SQLITE_OK;
 }
@@ -1601,6 +2797,10 @@ static void getTempCursor(BtCursor *pCur, BtCursor *pTempCur){
   memcpy(pTempCur, pCur, sizeof(*pCur));
   pTempCur->pNext = 0;
   pTempCur->pPrev = 0;
+  pTempCur->aKey = 0;
+  pTempCur->aOverflow = 0;
+  pTempCur->nOverflow = 0;
+  pTempCur->nOverflowAlloc = 0;
   if( pTempCur->pPage ){
     sqlite3pager_ref(pTempCur->pPage->aData);
   }
@@ -1614,6 +2814,8 @@ static void releaseTempCursor(BtCursor *pCur){
   if( pCur->pPage ){
     sqlite3pager_unref(pCur->pPage->aData);
   }
+  sqliteFree(pCur->aKey);
+  sqliteFree(pCur->aOverflow);
 }
 
 /*
@@ -1621,11 +2823,14 @@ static void releaseTempCursor(BtCursor *pCur){
 ** If it is not already valid, call parseCell() to fill it in.
 **
 ** BtCursor.info is a cache of the information in the current cell.
-** Using this cache reduces the number of calls to parseCell().
+** Using this cache reduces the number of calls to parseCell().  The
+** overflow page list in BtCursor.aOverflow[] belongs to the same cell,
+** so it is forgotten whenever the cell is parsed afresh.
 */
 static void getCellInfo(BtCursor *pCur){
   if( pCur->info.nSize==0 ){
     parseCell(pCur->pPage, pCur->idx, &pCur->info);
+    pCur->nOverflow = 0;
   }else{
 #ifndef NDEBUG
     CellInfo info;
@@ -1674,26 +2879,40 @@ int sqlite3BtreeDataSize(BtCursor *pCur, u32 *pSize){
 
 /*
 ** Read payload information from the entry that the pCur cursor is
-** pointing to.  Begin reading the payload at "offset" and read
-** a total of "amt" bytes.  Put the result in zBuf.
+** pointing to, or overwrite it if eOp is non-zero.  Begin at "offset"
+** and transfer a total of "amt" bytes between the payload and pBuf.
 **
 ** This routine does not make a distinction between key and data.
 ** It just reads bytes from the payload area.  Data might appear
 ** on the main page or be scattered out on multiple overflow pages.
+**
+** The overflow chain is a linked list, so finding the page that holds
+** a given offset means following the chain from its start.  The page
+** numbers met along the way are remembered in pCur->aOverflow[], and
+** later accesses to the same cell begin at the page they need, or at
+** the furthest page known so far.  Reading a large value piece by
+** piece from front to back therefore visits each overflow page once
+** rather than once per piece.
+**
+** Only the bytes of the payload are overwritten when eOp is non-zero.
+** The size of the payload and the shape of the cell never change, so
+** no other cursor needs to be moved.
 */
-static int getPayload(
+static int accessPayload(
   BtCursor *pCur,      /* Cursor pointing to entry to read from */
   int offset,          /* Begin reading this far into payload */
   int amt,             /* Read this many bytes */
   unsigned char *pBuf, /* Write the bytes into this buffer */ 
-  int skipKey          /* offset begins at data if this is true */
+  int skipKey,         /* offset begins at data if this is true */
+  int eOp              /* zero to read.  non-zero to write */
 ){
   unsigned char *aPayload;
-  Pgno nextPage;
   int rc;
   MemPage *pPage;
-  Btree *pBt;
+  BtShared *pBt;
   int ovflSize;
+  int nOvfl;
+  int iOvfl;
   u32 nKey;
 
   assert( pCur!=0 && pCur->pPage!=0 );
@@ -1717,12 +2936,23 @@ static int getPayload(
   if( offset+amt > nKey+pCur->info.nData ){
     return SQLITE_ERROR;
   }
+  if( pCur->info.nShared ){
+    if( eOp ) return SQLITE_ERROR;
+    prefixKeyRange(pPage, &pCur->info, offset, amt, pBuf);
+    return SQLITE_OK;
+  }
   if( offset<pCur->info.nLocal ){
     int a = amt;
     if( a+offset>pCur->info.nLocal ){
       a = pCur->info.nLocal - offset;
     }
-    memcpy(pBuf, &aPayload[offset], a);
+    if( eOp ){
+      rc = sqlite3pager_write(pPage->aData);
+      if( rc!=SQLITE_OK ) return rc;
+      memcpy(&aPayload[offset], pBuf, a);
+    }else{
+      memcpy(pBuf, &aPayload[offset], a);
+    }
     if( a==amt ){
       return SQLITE_OK;
     }
@@ -1732,33 +2962,69 @@ static int getPayload(
   }else{
     offset -= pCur->info.nLocal;
   }
+  if( amt==0 ){
+    return SQLITE_OK;
+  }
+
+  /* Make sure aOverflow[] has room for every page of the chain and
+  ** holds at least its first page.
+  */
   ovflSize = pBt->usableSize - 4;
-  if( amt>0 ){
-    nextPage = get4byte(&aPayload[pCur->info.nLocal]);
-    while( amt>0 && nextPage ){
-      rc = sqlite3pager_get(pBt->pPager, nextPage, (void**)&aPayload);
-      if( rc!=0 ){
-        return rc;
+  nOvfl = (nKey + pCur->info.nData - pCur->info.nLocal + ovflSize - 1)/ovflSize;
+  if( nOvfl>pCur->nOverflowAlloc ){
+    Pgno *aNew = sqliteRealloc(pCur->aOverflow, nOvfl*sizeof(Pgno));
+    if( aNew==0 ) return SQLITE_NOMEM;
+    pCur->aOverflow = aNew;
+    pCur->nOverflowAlloc = nOvfl;
+  }
+  if( pCur->nOverflow==0 ){
+    pCur->aOverflow[0] = get4byte(&aPayload[pCur->info.nLocal]);
+    pCur->nOverflow = 1;
+  }
+
+  /* Start at the page that holds offset if it is known, or else at the
+  ** last known page of the chain.
+  */
+  iOvfl = offset/ovflSize;
+  if( iOvfl>=pCur->nOverflow ){
+    iOvfl = pCur->nOverflow - 1;
+  }
+  offset -= iOvfl*ovflSize;
+  while( amt>0 ){
+    Pgno pgno;
+    if( iOvfl>=nOvfl || (pgno = pCur->aOverflow[iOvfl])==0 ){
+      return SQLITE_CORRUPT;
+    }
+    rc = sqlite3pager_get(pBt->pPager, pgno, (void**)&aPayload);
+    if( rc!=0 ){
+      return rc;
+    }
+    if( iOvfl+1==pCur->nOverflow && iOvfl+1<nOvfl ){
+      pCur->aOverflow[pCur->nOverflow++] = get4byte(aPayload);
+    }
+    if( offset<ovflSize ){
+      int a = amt;
+      if( a + offset > ovflSize ){
+        a = ovflSize - offset;
       }
-      nextPage = get4byte(aPayload);
-      if( offset<ovflSize ){
-        int a = amt;
-        if( a + offset > ovflSize ){
-          a = ovflSize - offset;
+      if( eOp ){
+        rc = sqlite3pager_write(aPayload);
+        if( rc!=SQLITE_OK ){
+          sqlite3pager_unref(aPayload);
+          return rc;
         }
-        memcpy(pBuf, &aPayload[offset+4], a);
-        offset = 0;
-        amt -= a;
-        pBuf += a;
+        memcpy(&aPayload[offset+4], pBuf, a);
       }else{
-        offset -= ovflSize;
+        memcpy(pBuf, &aPayload[offset+4], a);
       }
-      sqlite3pager_unref(aPayload);
+      offset = 0;
+      amt -= a;
+      pBuf += a;
+    }else{
+      offset -= ovflSize;
     }
-  }
-
-  if( amt>0 ){
-    return SQLITE_CORRUPT;
+    sqlite3pager_unref(aPayload);
+    iOvfl++;
   }
   return SQLITE_OK;
 }
@@ -1772,7 +3038,7 @@ static int getPayload(
 ** wrong.  An error is returned if "offset+amt" is larger than
 ** the available payload.
 */
-int sqlite3BtreeKey(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
+static int btreeKey(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
   assert( amt>=0 );
   assert( offset>=0 );
   if( pCur->isValid==0 ){
@@ -1781,7 +3047,18 @@ int sqlite3BtreeKey(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
   assert( pCur->pPage!=0 );
   assert( pCur->pPage->intKey==0 );
   assert( pCur->idx>=0 && pCur->idx<pCur->pPage->nCell );
-  return getPayload(pCur, offset, amt, (unsigned char*)pBuf, 0);
+  return accessPayload(pCur, offset, amt, (unsigned char*)pBuf, 0, 0);
+}
+
+/*
+** Read part of the key of the entry that pCur points to.
+*/
+int sqlite3BtreeKey(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeKey(pCur, offset, amt, pBuf);
+  btreeLeave(pCur->pBtree);
+  return rc;
 }
 
 /*
@@ -1793,7 +3070,7 @@ int sqlite3BtreeKey(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
 ** wrong.  An error is returned if "offset+amt" is larger than
 ** the available payload.
 */
-int sqlite3BtreeData(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
+static int btreeData(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
   if( !pCur->isValid ){
     return pCur->status ? pCur->status : SQLITE_INTERNAL;
   }
@@ -1801,7 +3078,37 @@ int sqlite3BtreeData(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
   assert( offset>=0 );
   assert( pCur->pPage!=0 );
   assert( pCur->idx>=0 && pCur->idx<pCur->pPage->nCell );
-  return getPayload(pCur, offset, amt, pBuf, 1);
+  return accessPayload(pCur, offset, amt, pBuf, 1, 0);
+}
+
+/*
+** Read part of the data of the entry that pCur points to.
+*/
+int sqlite3BtreeData(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeData(pCur, offset, amt, pBuf);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
+/*
+** Return a pointer to the key of the cell described by pInfo, which is on
+** page pPage and is entirely local.  If the cell takes part of its key
+** from the reference key of a prefix page, the key is put together in
+** pCur->aKey[], which is allocated the first time it is needed.  NULL is
+** returned if that allocation fails.
+*/
+static u8 *cellKey(BtCursor *pCur, MemPage *pPage, CellInfo *pInfo){
+  if( pInfo->nShared==0 ){
+    return &pInfo->pCell[pInfo->nHeader];
+  }
+  if( pCur->aKey==0 ){
+    pCur->aKey = sqliteMallocRaw( pCur->pBt->pageSize );
+    if( pCur->aKey==0 ) return 0;
+  }
+  prefixKeyRange(pPage, pInfo, 0, (int)pInfo->nKey, pCur->aKey);
+  return pCur->aKey;
 }
 
 /*
@@ -1816,7 +3123,7 @@ int sqlite3BtreeData(BtCursor *pCur, u32 offset, u32 amt, void *pBuf){
 ** and data to fit on the local page and for there to be no overflow
 ** pages.  When that is so, this routine can be used to access the
 ** key and data without making a copy.  If the key and/or data spills
-** onto overflow pages, then getPayload() must be used to reassembly
+** onto overflow pages, then accessPayload() must be used to reassembly
 ** the key/data and copy it into a preallocated buffer.
 **
 ** The pointer returned by this routine looks directly into the cached
@@ -1830,7 +3137,7 @@ static const unsigned char *fetchPayload(
 ){
   unsigned char *aPayload;
   MemPage *pPage;
-  Btree *pBt;
+  BtShared *pBt;
   u32 nKey;
   int nLocal;
 
@@ -1841,8 +3148,11 @@ static const unsigned char *fetchPayload(
   pageIntegrity(pPage);
   assert( pCur->idx>=0 && pCur->idx<pPage->nCell );
   getCellInfo(pCur);
-  aPayload = pCur->info.pCell;
-  aPayload += pCur->info.nHeader;
+  aPayload = cellKey(pCur, pPage, &pCur->info);
+  if( aPayload==0 ){
+    *pAmt = 0;
+    return 0;
+  }
   if( pPage->intKey ){
     nKey = 0;
   }else{
@@ -1889,7 +3199,7 @@ static int moveToChild(BtCursor *pCur, u32 newPgno){
   int rc;
   MemPage *pNewPage;
   MemPage *pOldPage;
-  Btree *pBt = pCur->pBt;
+  BtShared *pBt = pCur->pBt;
 
   assert( pCur->isValid );
   rc = getAndInitPage(pBt, newPgno, &pNewPage, pCur->pPage);
@@ -1957,13 +3267,59 @@ static void moveToParent(BtCursor *pCur){
   pCur->idx = idxParent;
 }
 
+/*
+** A scan by cursor pCur has just climbed back to an internal page.  The
+** scan will next descend into the children of that page numbered iChild,
+** iChild+dir, iChild+2*dir and so on, where dir is 1 for a forward scan
+** and -1 for a backward one.  Hint the pager to start reading those
+** children, which need not be adjacent in the file, up to the pager's
+** read-ahead distance.  Children that are adjacent in the file are
+** hinted together.  The window is topped up each time half of it has
+** been used, so that each child is hinted only once.
+*/
+static void prefetchChildren(BtCursor *pCur, int iChild, int dir){
+  MemPage *pPage = pCur->pPage;
+  Pager *pPager = pCur->pBt->pPager;
+  int nWindow = sqlite3pager_readahead(pPager, -1);
+  int i, iLast;
+  Pgno pgno;
+  Pgno pgnoRun = 0;           /* First page of a run of adjacent children */
+  int nRun = 0;               /* Number of pages in the run */
+
+  if( nWindow<=0 ) return;
+  if( pCur->pgnoPrefetch!=pPage->pgno ){
+    pCur->pgnoPrefetch = pPage->pgno;
+    pCur->iPrefetch = iChild - dir;
+  }
+  if( (pCur->iPrefetch - iChild)*dir>=nWindow/2 ) return;
+  iLast = iChild + (nWindow-1)*dir;
+  if( iLast>pPage->nCell ) iLast = pPage->nCell;
+  if( iLast<0 ) iLast = 0;
+  for(i=pCur->iPrefetch+dir; (iLast-i)*dir>=0; i+=dir){
+    if( i<pPage->nCell ){
+      pgno = get4byte(findCell(pPage, i));
+    }else{
+      pgno = get4byte(&pPage->aData[pPage->hdrOffset+8]);
+    }
+    if( nRun>0 && pgno==pgnoRun+nRun ){
+      nRun++;
+    }else{
+      if( nRun>0 ) sqlite3pager_prefetch(pPager, pgnoRun, nRun);
+      pgnoRun = pgno;
+      nRun = 1;
+    }
+  }
+  if( nRun>0 ) sqlite3pager_prefetch(pPager, pgnoRun, nRun);
+  pCur->iPrefetch = iLast;
+}
+
 /*
 ** Move the cursor to the root page
 */
 static int moveToRoot(BtCursor *pCur){
   MemPage *pRoot;
   int rc;
-  Btree *pBt = pCur->pBt;
+  BtShared *pBt = pCur->pBt;
 
   rc = getAndInitPage(pBt, pCur->pgnoRoot, &pRoot, 0);
   if( rc ){
@@ -2034,7 +3390,7 @@ static int moveToRightmost(BtCursor *pCur){
 ** on success.  Set *pRes to 0 if the cursor actually points to something
 ** or set *pRes to 1 if the table is empty.
 */
-int sqlite3BtreeFirst(BtCursor *pCur, int *pRes){
+static int btreeFirst(BtCursor *pCur, int *pRes){
   int rc;
   if( pCur->status ){
     return pCur->status;
@@ -2052,11 +3408,22 @@ int sqlite3BtreeFirst(BtCursor *pCur, int *pRes){
   return rc;
 }
 
+/*
+** Move pCur to the first entry of its table.
+*/
+int sqlite3BtreeFirst(BtCursor *pCur, int *pRes){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeFirst(pCur, pRes);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
 /* Move the cursor to the last entry in the table.  Return SQLITE_OK
 ** on success.  Set *pRes to 0 if the cursor actually points to something
 ** or set *pRes to 1 if the table is empty.
 */
-int sqlite3BtreeLast(BtCursor *pCur, int *pRes){
+static int btreeLast(BtCursor *pCur, int *pRes){
   int rc;
   if( pCur->status ){
     return pCur->status;
@@ -2074,6 +3441,151 @@ int sqlite3BtreeLast(BtCursor *pCur, int *pRes){
   return rc;
 }
 
+/*
+** Move pCur to the last entry of its table.
+*/
+int sqlite3BtreeLast(BtCursor *pCur, int *pRes){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeLast(pCur, pRes);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
+/*
+** Compare the key of cell iCell on pPage with pKey/nKey.  *pC is set
+** to a negative value, zero or a positive value as the cell key is
+** less than, equal to or greater than pKey/nKey.  Return 0 without
+** setting *pC if the cell key spills onto overflow pages, since the
+** callers would rather give up than read them.
+*/
+static int compareCellKey(
+  BtCursor *pCur,          /* Cursor supplying the comparison function */
+  MemPage *pPage,          /* Page holding the cell */
+  int iCell,               /* The cell to compare */
+  const void *pKey,        /* Key to compare against (unused for INTKEY) */
+  i64 nKey,                /* Size of pKey, or the key itself for INTKEY */
+  int *pC                  /* Write the result here */
+){
+  CellInfo info;
+  u8 *aCellKey;
+  parseCell(pPage, iCell, &info);
+  if( pPage->intKey ){
+    *pC = info.nKey<nKey ? -1 : info.nKey>nKey;
+    return 1;
+  }
+  if( info.nLocal<info.nKey || (aCellKey = cellKey(pCur, pPage, &info))==0 ){
+    return 0;
+  }
+  *pC = pCur->xCompare(pCur->pArg, info.nKey, aCellKey, nKey, pKey);
+  return 1;
+}
+
+/*
+** Return true if the entry pKey/nKey belongs in the subtree rooted at
+** pPage, which is the page the cursor points into or an ancestor of it.
+** The subtree covers the keys between the nearest divider cells to its
+** left and right in the ancestors of pPage.  These are found by
+** following parent pointers toward the root, checking at each step that
+** the parent still points down to the child.
+**
+** Zero is returned if the answer is not certain: if a parent has been
+** changed since the cursor last descended from it, or if a divider
+** key is too large to compare without reading overflow pages.
+*/
+static int pageCoversKey(
+  BtCursor *pCur,          /* The cursor doing the search */
+  MemPage *pPage,          /* Root of the subtree */
+  const void *pKey,        /* Key to find (unused for INTKEY) */
+  i64 nKey                 /* Size of pKey, or the key itself for INTKEY */
+){
+  int needLower = 1;       /* True until the left divider is found */
+  int needUpper = 1;       /* True until the right divider is found */
+  MemPage *p = pPage;
+  int c;
+
+  while( needLower || needUpper ){
+    MemPage *pParent = p->pParent;
+    int idx = p->idxParent;
+    Pgno pgnoChild;
+    if( isRootPage(p) ){
+      /* The key is unbounded on the sides still unchecked */
+      return p->pgno==pCur->pgnoRoot
+          || (pParent!=0 && pParent->pgno==pCur->pgnoRoot);
+    }
+    if( !pParent->isInit || pParent->idxShift || pParent->nOverflow
+     || idx>pParent->nCell ){
+      return 0;
+    }
+    if( idx<pParent->nCell ){
+      pgnoChild = get4byte(findCell(pParent, idx));
+    }else{
+      pgnoChild = get4byte(&pParent->aData[pParent->hdrOffset+8]);
+    }
+    if( pgnoChild!=p->pgno ) return 0;
+    if( needLower && idx>0 ){
+      if( !compareCellKey(pCur, pParent, idx-1, pKey, nKey, &c) || c>=0 ){
+        return 0;
+      }
+      needLower = 0;
+    }
+    if( needUpper && idx<pParent->nCell ){
+      /* A key equal to the divider is found in the left subtree if the
+      ** divider is only a copy of a leaf key.  Otherwise the divider is
+      ** itself the entry.
+      */
+      if( !compareCellKey(pCur, pParent, idx, pKey, nKey, &c)
+       || c<0 || (c==0 && !pParent->leafData) ){
+        return 0;
+      }
+      needUpper = 0;
+    }
+    p = pParent;
+  }
+  return 1;
+}
+
+/*
+** Lookups often land near the entry the cursor already points to:
+** ordered lookups, joins on sorted keys and rowid probes in ascending
+** order all do.  If pKey/nKey belongs on the leaf the cursor is on, or
+** beneath the parent of that leaf, leave the cursor on that page (after
+** moving up to the parent in the second case) and return 1, so that the
+** search can start there.  Otherwise return 0 and let the caller start
+** from the root.
+**
+** The check costs a few key comparisons, which are wasted when lookups
+** are scattered.  So it is skipped while pCur->skipNearby is set, which
+** btreeMoveto() does after a search from the root lands under a
+** different parent than the previous one.
+*/
+static int moveToNearby(BtCursor *pCur, const void *pKey, i64 nKey){
+  MemPage *pPage = pCur->pPage;
+  if( pCur->skipNearby || !pCur->isValid || !pPage->isInit || !pPage->leaf
+   || pPage->nCell==0 || pPage->nOverflow ){
+    return 0;
+  }
+  if( pageCoversKey(pCur, pPage, pKey, nKey) ){
+    return 1;
+  }
+  if( isRootPage(pPage) || pPage->pParent->idxShift
+   || !pageCoversKey(pCur, pPage->pParent, pKey, nKey) ){
+    return 0;
+  }
+  moveToParent(pCur);
+  return 1;
+}
+
+/*
+** A search from the root has just finished.  Decide whether the next
+** search should try moveToNearby() first: only if this search ended up
+** under the same parent as the previous one, pgnoOldParent.
+*/
+static void setSkipNearby(BtCursor *pCur, Pgno pgnoOldParent){
+  MemPage *pParent = pCur->pPage->pParent;
+  pCur->skipNearby = (pParent ? pParent->pgno : 0)!=pgnoOldParent;
+}
+
 /* Move the cursor so that it points to an entry near pKey/nKey.
 ** Return a success code.
 **
@@ -2101,26 +3613,35 @@ int sqlite3BtreeLast(BtCursor *pCur, int *pRes){
 **     *pRes>0      The cursor is left pointing at an entry that
 **                  is larger than pKey.
 */
-int sqlite3BtreeMoveto(BtCursor *pCur, const void *pKey, i64 nKey, int *pRes){
+static int btreeMoveto(BtCursor *pCur, const void *pKey, i64 nKey, int *pRes){
   int rc;
+  int fromRoot = 0;           /* True if the search starts at the root */
+  Pgno pgnoOldParent = 0;     /* Parent of the page the cursor was on */
 
   if( pCur->status ){
     return pCur->status;
   }
-  rc = moveToRoot(pCur);
-  if( rc ) return rc;
-  assert( pCur->pPage );
-  assert( pCur->pPage->isInit );
-  if( pCur->isValid==0 ){
-    *pRes = -1;
-    assert( pCur->pPage->nCell==0 );
-    return SQLITE_OK;
+  if( !moveToNearby(pCur, pKey, nKey) ){
+    if( pCur->pPage && pCur->pPage->pParent ){
+      pgnoOldParent = pCur->pPage->pParent->pgno;
+    }
+    fromRoot = 1;
+    rc = moveToRoot(pCur);
+    if( rc ) return rc;
+    assert( pCur->pPage );
+    assert( pCur->pPage->isInit );
+    if( pCur->isValid==0 ){
+      *pRes = -1;
+      assert( pCur->pPage->nCell==0 );
+      return SQLITE_OK;
+    }
   }
   for(;;){
     int lwr, upr;
     Pgno chldPg;
     MemPage *pPage = pCur->pPage;
     int c = -1;  /* pRes return if table is empty must be -1 */
+    int nProbe = 0;
     lwr = 0;
     upr = pPage->nCell-1;
     pageIntegrity(pPage);
@@ -2128,8 +3649,9 @@ int sqlite3BtreeMoveto(BtCursor *pCur, const void *pKey, i64 nKey, int *pRes){
       void *pCellKey;
       i64 nCellKey;
       pCur->idx = (lwr+upr)/2;
-      pCur->info.nSize = 0;
-      sqlite3BtreeKeySize(pCur, &nCellKey);
+      parseCellCached(pPage, pCur->idx, nProbe++, &pCur->info);
+      pCur->nOverflow = 0;
+      nCellKey = pCur->info.nKey;
       if( pPage->intKey ){
         if( nCellKey<nKey ){
           c = -1;
@@ -2143,6 +3665,9 @@ int sqlite3BtreeMoveto(BtCursor *pCur, const void *pKey, i64 nKey, int *pRes){
         pCellKey = (void *)fetchPayload(pCur, &available, 0);
         if( available>=nCellKey ){
           c = pCur->xCompare(pCur->pArg, nCellKey, pCellKey, nKey, pKey);
+        }else if( pCur->xCompareCursor ){
+          rc = pCur->xCompareCursor(pCur->pArg, pCur, nCellKey, nKey, pKey, &c);
+          if( rc ) return rc;
         }else{
           pCellKey = sqliteMallocRaw( nCellKey );
           if( pCellKey==0 ) return SQLITE_NOMEM;
@@ -2158,6 +3683,7 @@ int sqlite3BtreeMoveto(BtCursor *pCur, const void *pKey, i64 nKey, int *pRes){
           upr = lwr - 1;
           break;
         }else{
+          if( fromRoot ) setSkipNearby(pCur, pgnoOldParent);
           if( pRes ) *pRes = 0;
           return SQLITE_OK;
         }
@@ -2179,6 +3705,7 @@ int sqlite3BtreeMoveto(BtCursor *pCur, const void *pKey, i64 nKey, int *pRes){
     }
     if( chldPg==0 ){
       assert( pCur->idx>=0 && pCur->idx<pCur->pPage->nCell );
+      if( fromRoot ) setSkipNearby(pCur, pgnoOldParent);
       if( pRes ) *pRes = c;
       return SQLITE_OK;
     }
@@ -2192,6 +3719,17 @@ int sqlite3BtreeMoveto(BtCursor *pCur, const void *pKey, i64 nKey, int *pRes){
   /* NOT REACHED */
 }
 
+/*
+** Move pCur to the entry nearest to pKey/nKey.
+*/
+int sqlite3BtreeMoveto(BtCursor *pCur, const void *pKey, i64 nKey, int *pRes){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeMoveto(pCur, pKey, nKey, pRes);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
 /*
 ** Return TRUE if the cursor is not pointing at an entry of the table.
 **
@@ -2209,7 +3747,7 @@ int sqlite3BtreeEof(BtCursor *pCur){
 ** was already pointing to the last entry in the database before
 ** this routine was called, then set *pRes=1.
 */
-int sqlite3BtreeNext(BtCursor *pCur, int *pRes){
+static int btreeNext(BtCursor *pCur, int *pRes){
   int rc;
   MemPage *pPage = pCur->pPage;
 
@@ -2239,6 +3777,7 @@ int sqlite3BtreeNext(BtCursor *pCur, int *pRes){
       moveToParent(pCur);
       pPage = pCur->pPage;
     }while( pCur->idx>=pPage->nCell );
+    prefetchChildren(pCur, pCur->idx+1, 1);
     *pRes = 0;
     if( pPage->leafData ){
       rc = sqlite3BtreeNext(pCur, pRes);
@@ -2255,13 +3794,24 @@ int sqlite3BtreeNext(BtCursor *pCur, int *pRes){
   return rc;
 }
 
+/*
+** Advance pCur to the next entry.
+*/
+int sqlite3BtreeNext(BtCursor *pCur, int *pRes){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeNext(pCur, pRes);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
 /*
 ** Step the cursor to the back to the previous entry in the database.  If
 ** successful then set *pRes=0.  If the cursor
 ** was already pointing to the first entry in the database before
 ** this routine was called, then set *pRes=1.
 */
-int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
+static int btreePrevious(BtCursor *pCur, int *pRes){
   int rc;
   Pgno pgno;
   MemPage *pPage;
@@ -2289,6 +3839,7 @@ int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
     }
     pCur->idx--;
     pCur->info.nSize = 0;
+    prefetchChildren(pCur, pCur->idx, -1);
     if( pPage->leafData ){
       rc = sqlite3BtreePrevious(pCur, pRes);
     }else{
@@ -2299,6 +3850,17 @@ int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
   return rc;
 }
 
+/*
+** Step pCur back to the previous entry.
+*/
+int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreePrevious(pCur, pRes);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
 /*
 ** The TRACE macro will print high-level status information about the
 ** btree operation when the global variable sqlite3_btree_trace is
@@ -2312,6 +3874,87 @@ int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
 #endif
 int sqlite3_btree_trace=0;  /* True to enable tracing */
 
+/*
+** Return the number of the pointer-map page that holds the entry for
+** page pgno of an auto-vacuum database.  If pgno is itself a pointer-map
+** page, pgno is returned.
+*/
+static Pgno ptrmapPageno(BtShared *pBt, Pgno pgno){
+  int nPagesPerMapPage = pBt->usableSize/5 + 1;
+  Pgno iPtrmap;
+  assert( pgno>=2 );
+  iPtrmap = ((pgno-2)/nPagesPerMapPage)*nPagesPerMapPage + 2;
+  if( iPtrmap==PENDING_BYTE_PAGE(pBt) ){
+    iPtrmap++;
+  }
+  return iPtrmap;
+}
+
+/*
+** Record in the pointer map that page pgno is of type eType and that
+** the pointer to it is on page pgnoParent.  The pointer-map page is
+** only made writeable if the entry actually changes.
+*/
+static int ptrmapPut(BtShared *pBt, Pgno pgno, u8 eType, Pgno pgnoParent){
+  u8 *pPtrmap;
+  Pgno iPtrmap;
+  int offset;
+  int rc;
+
+  assert( pBt->autoVacuum );
+  assert( pgno>2 && !PTRMAP_ISPAGE(pBt, pgno) );
+  assert( pgno!=PENDING_BYTE_PAGE(pBt) );
+  iPtrmap = ptrmapPageno(pBt, pgno);
+  rc = sqlite3pager_get(pBt->pPager, iPtrmap, (void**)&pPtrmap);
+  if( rc ) return rc;
+  offset = PTRMAP_PTROFFSET(iPtrmap, pgno);
+  if( pPtrmap[offset]!=eType || get4byte(&pPtrmap[offset+1])!=pgnoParent ){
+    TRACE(("PTRMAP: %d is type %d with parent %d\n", pgno, eType, pgnoParent));
+    rc = sqlite3pager_write(pPtrmap);
+    if( rc==SQLITE_OK ){
+      pPtrmap[offset] = eType;
+      put4byte(&pPtrmap[offset+1], pgnoParent);
+    }
+  }
+  sqlite3pager_unref(pPtrmap);
+  return rc;
+}
+
+/*
+** Read the pointer-map entry for page pgno.  SQLITE_CORRUPT is returned
+** if the entry does not hold a valid page type.
+*/
+static int ptrmapGet(BtShared *pBt, Pgno pgno, u8 *peType, Pgno *pPgnoParent){
+  u8 *pPtrmap;
+  Pgno iPtrmap;
+  int offset;
+  int rc;
+
+  assert( pBt->autoVacuum );
+  assert( pgno>2 && !PTRMAP_ISPAGE(pBt, pgno) );
+  iPtrmap = ptrmapPageno(pBt, pgno);
+  rc = sqlite3pager_get(pBt->pPager, iPtrmap, (void**)&pPtrmap);
+  if( rc ) return rc;
+  offset = PTRMAP_PTROFFSET(iPtrmap, pgno);
+  *peType = pPtrmap[offset];
+  *pPgnoParent = get4byte(&pPtrmap[offset+1]);
+  sqlite3pager_unref(pPtrmap);
+  if( *peType<PTRMAP_ROOTPAGE || *peType>PTRMAP_BTREE ) return SQLITE_CORRUPT;
+  return SQLITE_OK;
+}
+
+/*
+** If the cell pCell on page pPage spills onto overflow pages, record
+** pPage as the parent of the first of them.
+*/
+static int ptrmapPutOvfl(MemPage *pPage, u8 *pCell){
+  CellInfo info;
+  parseCellPtr(pPage, pCell, &info);
+  if( info.iOverflow==0 ) return SQLITE_OK;
+  return ptrmapPut(pPage->pBt, get4byte(&pCell[info.iOverflow]),
+                   PTRMAP_OVERFLOW1, pPage->pgno);
+}
+
 /*
 ** Allocate a new page from the database file.
 **
@@ -2329,7 +3972,7 @@ int sqlite3_btree_trace=0;  /* True to enable tracing */
 ** attempt to keep related pages close to each other in the database file,
 ** which in turn can make database access faster.
 */
-static int allocatePage(Btree *pBt, MemPage **ppPage, Pgno *pPgno, Pgno nearby){
+static int allocatePage(BtShared *pBt, MemPage **ppPage, Pgno *pPgno, Pgno nearby){
   MemPage *pPage1;
   int rc;
   int n;     /* Number of pages on the freelist */
@@ -2391,8 +4034,26 @@ static int allocatePage(Btree *pBt, MemPage **ppPage, Pgno *pPgno, Pgno nearby){
     }
   }else{
     /* There are no pages on the freelist, so create a new page at the
-    ** end of the file */
+    ** end of the file.  In an auto-vacuum database the pending-byte page
+    ** is never used, and a pointer-map page is cleared and passed over. */
     *pPgno = sqlite3pager_pagecount(pBt->pPager) + 1;
+    if( pBt->autoVacuum && *pPgno==PENDING_BYTE_PAGE(pBt) ){
+      (*pPgno)++;
+    }
+    if( pBt->autoVacuum && PTRMAP_ISPAGE(pBt, *pPgno) ){
+      u8 *pPtrmap;
+      TRACE(("ALLOCATE: %d is a pointer-map page\n", *pPgno));
+      rc = sqlite3pager_get(pBt->pPager, *pPgno, (void**)&pPtrmap);
+      if( rc ) return rc;
+      rc = sqlite3pager_write(pPtrmap);
+      if( rc==SQLITE_OK ){
+        memset(pPtrmap, 0, pBt->pageSize);
+      }
+      sqlite3pager_unref(pPtrmap);
+      if( rc ) return rc;
+      (*pPgno)++;
+      if( *pPgno==PENDING_BYTE_PAGE(pBt) ) (*pPgno)++;
+    }
     rc = getPage(pBt, *pPgno, ppPage);
     if( rc ) return rc;
     rc = sqlite3pager_write((*ppPage)->aData);
@@ -2407,7 +4068,7 @@ static int allocatePage(Btree *pBt, MemPage **ppPage, Pgno *pPgno, Pgno nearby){
 ** sqlite3pager_unref() is NOT called for pPage.
 */
 static int freePage(MemPage *pPage){
-  Btree *pBt = pPage->pBt;
+  BtShared *pBt = pPage->pBt;
   MemPage *pPage1 = pBt->pPage1;
   int rc, n, k;
 
@@ -2423,6 +4084,11 @@ static int freePage(MemPage *pPage){
   n = get4byte(&pPage1->aData[36]);
   put4byte(&pPage1->aData[36], n+1);
 
+  if( pBt->autoVacuum ){
+    rc = ptrmapPut(pBt, pPage->pgno, PTRMAP_FREEPAGE, 0);
+    if( rc ) return rc;
+  }
+
   if( n==0 ){
     /* This is the first free page */
     rc = sqlite3pager_write(pPage->aData);
@@ -2465,7 +4131,7 @@ static int freePage(MemPage *pPage){
 ** Free any overflow pages associated with the given Cell.
 */
 static int clearCell(MemPage *pPage, unsigned char *pCell){
-  Btree *pBt = pPage->pBt;
+  BtShared *pBt = pPage->pBt;
   CellInfo info;
   Pgno ovflPgno;
   int rc;
@@ -2514,7 +4180,7 @@ static int fillInCell(
   MemPage *pToRelease = 0;
   unsigned char *pPrior;
   unsigned char *pPayload;
-  Btree *pBt = pPage->pBt;
+  BtShared *pBt = pPage->pBt;
   Pgno pgnoOvfl = 0;
   int nHeader;
   CellInfo info;
@@ -2530,6 +4196,9 @@ static int fillInCell(
     nData = 0;
   }
   nHeader += putVarint(&pCell[nHeader], *(u64*)&nKey);
+  if( pPage->prefix ){
+    pCell[nHeader++] = 0;  /* Nothing is taken from a reference key */
+  }
   parseCellPtr(pPage, pCell, &info);
   assert( info.nHeader==nHeader );
   assert( info.nKey==nKey );
@@ -2553,7 +4222,19 @@ static int fillInCell(
 
   while( nPayload>0 ){
     if( spaceLeft==0 ){
+      Pgno pgnoPrior = pgnoOvfl;
       rc =  allocatePage(pBt, &pOvfl, &pgnoOvfl, pgnoOvfl);
+      if( rc==SQLITE_OK && pBt->autoVacuum ){
+        /* The first overflow page is pointed to from the cell, which is
+        ** recorded against pPage for now.  insertCell() and the balance
+        ** routines correct this if the cell ends up on another page. */
+        if( pgnoPrior ){
+          rc = ptrmapPut(pBt, pgnoOvfl, PTRMAP_OVERFLOW2, pgnoPrior);
+        }else{
+          rc = ptrmapPut(pBt, pgnoOvfl, PTRMAP_OVERFLOW1, pPage->pgno);
+        }
+        if( rc ) releasePage(pOvfl);
+      }
       if( rc ){
         releasePage(pToRelease);
         clearCell(pPage, pCell);
@@ -2588,14 +4269,19 @@ static int fillInCell(
 /*
 ** Change the MemPage.pParent pointer on the page whose number is
 ** given in the second argument so that MemPage.pParent holds the
-** pointer in the third argument.
+** pointer in the third argument.  In an auto-vacuum database the
+** pointer map is updated to match.
 */
-static void reparentPage(Btree *pBt, Pgno pgno, MemPage *pNewParent, int idx){
+static int reparentPage(BtShared *pBt, Pgno pgno, MemPage *pNewParent, int idx){
   MemPage *pThis;
   unsigned char *aData;
 
-  if( pgno==0 ) return;
+  if( pgno==0 ) return SQLITE_OK;
   assert( pBt->pPager!=0 );
+  if( pBt->autoVacuum ){
+    int rc = ptrmapPut(pBt, pgno, PTRMAP_BTREE, pNewParent->pgno);
+    if( rc ) return rc;
+  }
   aData = sqlite3pager_lookup(pBt->pPager, pgno);
   if( aData ){
     pThis = (MemPage*)&aData[pBt->usableSize];
@@ -2609,6 +4295,7 @@ static void reparentPage(Btree *pBt, Pgno pgno, MemPage *pNewParent, int idx){
     }
     sqlite3pager_unref(aData);
   }
+  return SQLITE_OK;
 }
 
 /*
@@ -2619,19 +4306,29 @@ static void reparentPage(Btree *pBt, Pgno pgno, MemPage *pNewParent, int idx){
 ** to make sure that each child knows that pPage is its parent.
 **
 ** This routine gets called after you memcpy() one page into
-** another.
+** another.  In an auto-vacuum database it also records pPage as the
+** parent of the overflow chains of its cells, leaf or not.
 */
-static void reparentChildPages(MemPage *pPage){
+static int reparentChildPages(MemPage *pPage){
   int i;
-  Btree *pBt;
+  BtShared *pBt = pPage->pBt;
+  int rc;
 
-  if( pPage->leaf ) return;
-  pBt = pPage->pBt;
+  if( pBt->autoVacuum ){
+    for(i=0; i<pPage->nCell; i++){
+      rc = ptrmapPutOvfl(pPage, findCell(pPage,i));
+      if( rc ) return rc;
+    }
+  }
+  if( pPage->leaf ) return SQLITE_OK;
   for(i=0; i<pPage->nCell; i++){
-    reparentPage(pBt, get4byte(findCell(pPage,i)), pPage, i);
+    rc = reparentPage(pBt, get4byte(findCell(pPage,i)), pPage, i);
+    if( rc ) return rc;
   }
-  reparentPage(pBt, get4byte(&pPage->aData[pPage->hdrOffset+8]), pPage, i);
+  rc = reparentPage(pBt, get4byte(&pPage->aData[pPage->hdrOffset+8]), pPage, i);
+  if( rc ) return rc;
   pPage->idxShift = 0;
+  return SQLITE_OK;
 }
 
 /*
@@ -2651,6 +4348,7 @@ static void dropCell(MemPage *pPage, int idx, int sz){
   assert( idx>=0 && idx<pPage->nCell );
   assert( sz==cellSize(pPage, idx) );
   assert( sqlite3pager_iswriteable(pPage->aData) );
+  clearCellCache(pPage);
   data = pPage->aData;
   ptr = &data[pPage->cellOffset + 2*idx];
   pc = get2byte(ptr);
@@ -2664,6 +4362,10 @@ static void dropCell(MemPage *pPage, int idx, int sz){
   put2byte(&data[pPage->hdrOffset+3], pPage->nCell);
   pPage->nFree += 2;
   pPage->idxShift = 1;
+  if( pPage->prefix && pPage->nCell==0 ){
+    /* Let the next cell inserted choose a new reference key */
+    prefixClearRef(pPage);
+  }
 }
 
 /*
@@ -2677,8 +4379,18 @@ static void dropCell(MemPage *pPage, int idx, int sz){
 ** in pTemp or the original pCell) and also record its index. 
 ** Allocating a new entry in pPage->aCell[] implies that 
 ** pPage->nOverflow is incremented.
+**
+** pCell must not take any of its key from a reference key.  On a prefix
+** page the cell is shortened against the reference key of the page as
+** it is copied in.  The first cell put on an empty prefix page supplies
+** the reference key.
+**
+** In an auto-vacuum database, a cell placed on the page that has an
+** overflow chain is recorded in the pointer map as its parent.  The
+** child pointer of the cell is not, as the caller may not have set it
+** yet.
 */
-static void insertCell(
+static int insertCell(
   MemPage *pPage,   /* Page into which we are copying */
   int i,            /* New cell becomes the i-th cell of the page */
   u8 *pCell,        /* Content of the new cell */
@@ -2686,6 +4398,7 @@ static void insertCell(
   u8 *pTemp         /* Temp storage space for pCell, if needed */
 ){
   int idx;          /* Where to write new cell content in data[] */
+  int szPage;       /* Size of the cell once it is on the page */
   int j;            /* Loop counter */
   int top;          /* First byte of content for any cell in data[] */
   int end;          /* First byte past the last cell pointer in data[] */
@@ -2698,7 +4411,17 @@ static void insertCell(
   assert( i>=0 && i<=pPage->nCell+pPage->nOverflow );
   assert( sz==cellSizePtr(pPage, pCell) );
   assert( sqlite3pager_iswriteable(pPage->aData) );
-  if( pPage->nOverflow || sz+2>pPage->nFree ){
+  if( computeFreeSpace(pPage) ) return SQLITE_CORRUPT;
+  clearCellCache(pPage);
+  if( pPage->prefix && pPage->nCell==0 && pPage->nOverflow==0 ){
+    int nKey;
+    u8 *aKey = prefixPlainKey(pPage, pCell, &nKey);
+    if( aKey && get2byte(&pPage->aData[pPage->cellOffset-2])==0 ){
+      prefixSetRef(pPage, aKey, nKey);
+    }
+  }
+  szPage = cellSizeOnPage(pPage, pCell, sz);
+  if( pPage->nOverflow || szPage+2>pPage->nFree ){
     if( pTemp ){
       memcpy(pTemp, pCell, sz);
       pCell = pTemp;
@@ -2711,21 +4434,27 @@ static void insertCell(
   }else{
     data = pPage->aData;
     hdr = pPage->hdrOffset;
-    top = get2byte(&data[hdr+5]);
+    top = get2byteTop(&data[hdr+5]);
     cellOffset = pPage->cellOffset;
     end = cellOffset + 2*pPage->nCell + 2;
     ins = cellOffset + 2*i;
-    if( end > top - sz ){
+    if( end > top - szPage ){
       defragmentPage(pPage);
-      top = get2byte(&data[hdr+5]);
-      assert( end + sz <= top );
+      top = get2byteTop(&data[hdr+5]);
+      assert( end + szPage <= top );
     }
-    idx = allocateSpace(pPage, sz);
+    idx = allocateSpace(pPage, szPage);
     assert( idx>0 );
-    assert( end <= get2byte(&data[hdr+5]) );
+    assert( end <= get2byteTop(&data[hdr+5]) );
     pPage->nCell++;
     pPage->nFree -= 2;
-    memcpy(&data[idx], pCell, sz);
+    if( szPage!=sz ){
+      int nRef;
+      u8 *aRef = prefixRefKey(pPage, &nRef);
+      prefixEncode(pPage, pCell, sz, aRef, nRef, &data[idx]);
+    }else{
+      memcpy(&data[idx], pCell, sz);
+    }
     for(j=end-2, ptr=&data[j]; j>ins; j-=2, ptr-=2){
       ptr[0] = ptr[-2];
       ptr[1] = ptr[-1];
@@ -2734,12 +4463,20 @@ static void insertCell(
     put2byte(&data[hdr+3], pPage->nCell);
     pPage->idxShift = 1;
     pageIntegrity(pPage);
+    if( pPage->pBt->autoVacuum ){
+      return ptrmapPutOvfl(pPage, &data[idx]);
+    }
   }
+  return SQLITE_OK;
 }
 
 /*
 ** Add a list of cells to a page.  The page should be initially empty.
 ** The cells are guaranteed to fit on the page.
+**
+** None of the cells may take part of its key from a reference key.  When
+** prefixPageSize() finds that the page is smaller with the first key as
+** its reference key, the cells are shortened against it.
 */
 static void assemblePage(
   MemPage *pPage,   /* The page to be assemblied */
@@ -2753,14 +4490,25 @@ static void assemblePage(
   int cellptr;      /* Address of next cell pointer */
   int cellbody;     /* Address of next cell body */
   u8 *data;         /* Data for the page */
+  u8 *aRef = 0;     /* Reference key for a prefix page */
+  int nRef = 0;     /* Length of aRef[] */
 
   assert( pPage->nOverflow==0 );
+  if( pPage->prefix ){
+    int useRef;
+    prefixPageSize(pPage, apCell, aSize, nCell, &useRef);
+    if( useRef ){
+      aRef = prefixPlainKey(pPage, apCell[0], &nRef);
+    }
+  }
   totalSize = 0;
   for(i=0; i<nCell; i++){
-    totalSize += aSize[i];
+    totalSize += aRef ? prefixEncode(pPage, apCell[i], aSize[i], aRef, nRef, 0)
+                      : aSize[i];
   }
-  assert( totalSize+2*nCell<=pPage->nFree );
+  assert( totalSize+2*nCell+(aRef ? nRef+2 : 0)<=pPage->nFree );
   assert( pPage->nCell==0 );
+  clearCellCache(pPage);
   cellptr = pPage->cellOffset;
   data = pPage->aData;
   hdr = pPage->hdrOffset;
@@ -2771,12 +4519,20 @@ static void assemblePage(
   pPage->nFree -= 2*nCell;
   for(i=0; i<nCell; i++){
     put2byte(&data[cellptr], cellbody);
-    memcpy(&data[cellbody], apCell[i], aSize[i]);
+    if( aRef ){
+      cellbody += prefixEncode(pPage, apCell[i], aSize[i], aRef, nRef,
+                               &data[cellbody]);
+    }else{
+      memcpy(&data[cellbody], apCell[i], aSize[i]);
+      cellbody += aSize[i];
+    }
     cellptr += 2;
-    cellbody += aSize[i];
   }
   assert( cellbody==pPage->pBt->usableSize );
   pPage->nCell = nCell;
+  if( aRef ){
+    prefixSetRef(pPage, aRef, nRef);
+  }
 }
 
 /*
@@ -2787,6 +4543,35 @@ static void assemblePage(
 #define offsetof(STRUCTURE,FIELD) ((int)((char*)&((STRUCTURE*)0)->FIELD))
 #endif
 
+/*
+** Record that a new entry is about to become cell idx of pPage.  Runs of
+** entries added after the last cell of the page are counted in
+** pPage->nAppend and runs added in front of the first cell in
+** pPage->nPrepend.  Any other insert ends both runs.  The counts are
+** kept only while the page stays in the cache.
+*/
+static void noteInsert(MemPage *pPage, int idx){
+  if( pPage->nCell==0 ) return;
+  if( idx>=pPage->nCell ){
+    if( pPage->nAppend<255 ) pPage->nAppend++;
+    pPage->nPrepend = 0;
+  }else if( idx==0 ){
+    if( pPage->nPrepend<255 ) pPage->nPrepend++;
+    pPage->nAppend = 0;
+  }else{
+    pPage->nAppend = 0;
+    pPage->nPrepend = 0;
+  }
+}
+
+/*
+** A page that overflows after at least SEQ_SPLIT inserts in a row at
+** the same end of it is taken to be filled in key order.  Such a page is
+** split so that the pages behind the insert point are left full, rather
+** than sharing the cells out evenly (see balance_nonroot()).
+*/
+#define SEQ_SPLIT 4
+
 /*
 ** The following parameters determine how many adjacent pages get involved
 ** in a balancing operation.  NN is the number of neighbors on either side
@@ -2803,7 +4588,7 @@ static void assemblePage(
 #define NB (NN*2+1)      /* Total pages involved in the balance */
 
 /* Forward reference */
-static int balance(MemPage*);
+static int balance(MemPage*, int);
 
 /*
 ** This routine redistributes Cells on pPage and up to NN*2 siblings
@@ -2830,13 +4615,20 @@ static int balance(MemPage*);
 ** might become overfull or underfull.  If that happens, then this routine
 ** is called recursively on the parent.
 **
+** If pPage overflowed after a run of appends, keys are arriving in
+** ascending order and no later insert will land on the siblings to its
+** left, so those are packed full and only the right-most sibling is
+** left with free space.  A run of prepends packs the siblings to the
+** right instead.  The parent is only ever filled by the splits of its
+** children, so it inherits the insert pattern of pPage.
+**
 ** If this routine fails for any reason, it might leave the database
 ** in a corrupted state.  So if this routine fails, the database should
 ** be rolled back.
 */
 static int balance_nonroot(MemPage *pPage){
   MemPage *pParent;            /* The parent of pPage */
-  Btree *pBt;                  /* The whole database */
+  BtShared *pBt;               /* The whole database */
   int nCell = 0;               /* Number of cells in aCell[] */
   int nOld;                    /* Number of pages in apOld[] */
   int nNew;                    /* Number of pages in apNew[] */
@@ -2851,6 +4643,7 @@ static int balance_nonroot(MemPage *pPage){
   int pageFlags;               /* Value of pPage->aData[0] */
   int subtotal;                /* Subtotal of bytes in cells on one page */
   int iSpace = 0;              /* First unused byte of aSpace[] */
+  int nMaxCells = 0;           /* Allocated size of apCell[] and szCell[] */
   MemPage *apOld[NB];          /* pPage and up to two siblings */
   Pgno pgnoOld[NB];            /* Page numbers for each page in apOld[] */
   MemPage *apCopy[NB];         /* Private copies of apOld[] pages */
@@ -2860,10 +4653,16 @@ static int balance_nonroot(MemPage *pPage){
   u8 *apDiv[NB];               /* Divider cells in pParent */
   int cntNew[NB+2];            /* Index in aCell[] of cell after i-th page */
   int szNew[NB+2];             /* Combined size of cells place on i-th page */
-  u8 *apCell[(MX_CELL+2)*NB];  /* All cells from pages being balanced */
-  int szCell[(MX_CELL+2)*NB];  /* Local size of all cells */
-  u8 aCopy[NB][MX_PAGE_SIZE+sizeof(MemPage)];  /* Space for apCopy[] */
-  u8 aSpace[MX_PAGE_SIZE*5];   /* Space to copies of divider cells */
+  u8 **apCell;                 /* All cells from pages being balanced */
+  int *szCell;                 /* Local size of all cells */
+  u8 *aCopy = 0;               /* Space for apCopy[] */
+  u8 *aSpace;                  /* Space to copies of divider cells */
+  u8 *aDecode = 0;             /* Space for whole copies of prefix cells */
+  int nDecode = 0;             /* Bytes needed for aDecode[] */
+  int iDecode = 0;             /* First unused byte of aDecode[] */
+  int bias = 0;                /* 1: pack left, -1: pack right, 0: even */
+  u8 nAppend;                  /* Saved value of pPage->nAppend */
+  u8 nPrepend;                 /* Saved value of pPage->nPrepend */
 
   /* 
   ** Find the parent page.
@@ -2874,7 +4673,19 @@ static int balance_nonroot(MemPage *pPage){
   pParent = pPage->pParent;
   sqlite3pager_write(pParent->aData);
   assert( pParent );
+  rc = computeFreeSpace(pParent);
+  if( rc ) return rc;
   TRACE(("BALANCE: begin page %d child of %d\n", pPage->pgno, pParent->pgno));
+  nAppend = nPrepend = 0;
+  if( pPage->nOverflow>0 ){
+    nAppend = pPage->nAppend;
+    nPrepend = pPage->nPrepend;
+    if( nAppend>=SEQ_SPLIT ){
+      bias = 1;
+    }else if( nPrepend>=SEQ_SPLIT ){
+      bias = -1;
+    }
+  }
   
   /*
   ** Find the cell in the parent page whose left child points back
@@ -2936,7 +4747,40 @@ static int balance_nonroot(MemPage *pPage){
     apCopy[i] = 0;
     assert( i==nOld );
     nOld++;
+    nMaxCells += 1+apOld[i]->nCell+apOld[i]->nOverflow;
+    if( pPage->prefix ){
+      MemPage *pOld = apOld[i];
+      CellInfo info;
+      for(j=0; j<pOld->nCell; j++){
+        parseCell(pOld, j, &info);
+        nDecode += 4 + info.nSize + info.nShared;
+      }
+      for(j=0; j<pOld->nOverflow; j++){
+        nDecode += 4 + cellSizePtr(pOld, pOld->aOvfl[j].pCell);
+      }
+    }
+  }
+
+  /*
+  ** The page copies, the cell arrays and the divider cell space all scale
+  ** with the page size, so they come from a single allocation rather than
+  ** the stack.  The page copies go first so that the MemPage structure
+  ** that follows each one is suitably aligned.
+  */
+  aCopy = sqliteMallocRaw(
+       NB*(pBt->pageSize+sizeof(MemPage))
+     + nMaxCells*(sizeof(u8*)+sizeof(int))
+     + pBt->pageSize*5
+     + nDecode
+  );
+  if( aCopy==0 ){
+    rc = SQLITE_NOMEM;
+    goto balance_cleanup;
   }
+  apCell = (u8**)&aCopy[NB*(pBt->pageSize+sizeof(MemPage))];
+  szCell = (int*)&apCell[nMaxCells];
+  aSpace = (u8*)&szCell[nMaxCells];
+  aDecode = &aSpace[pBt->pageSize*5];
 
   /*
   ** Make copies of the content of pPage and its siblings into aOld[].
@@ -2945,7 +4789,8 @@ static int balance_nonroot(MemPage *pPage){
   ** process of being overwritten.
   */
   for(i=0; i<nOld; i++){
-    MemPage *p = apCopy[i] = (MemPage*)&aCopy[i+1][-sizeof(MemPage)];
+    MemPage *p = apCopy[i] =
+        (MemPage*)&aCopy[i*(pBt->pageSize+sizeof(MemPage))+pBt->pageSize];
     p->aData = &((u8*)p)[-pBt->pageSize];
     memcpy(p->aData, apOld[i]->aData, pBt->pageSize + sizeof(MemPage));
     p->aData = &((u8*)p)[-pBt->pageSize];
@@ -2966,6 +4811,13 @@ static int balance_nonroot(MemPage *pPage){
   **
   ** leafCorrection:  4 if pPage is a leaf.  0 if pPage is not a leaf.
   **       leafData:  1 if pPage holds key+data and pParent holds only keys.
+  **
+  ** Cells on prefix pages may take part of their key from the reference
+  ** key of the page they are on, which does not go with them.  Whole
+  ** copies of those cells are made in aDecode[], and of dividers from a
+  ** prefix parent in aSpace[].  Each copy in aDecode[] has 4 spare bytes
+  ** in front of it, just as a cell on a page has, for the child pointer
+  ** written in front of a leaf cell that moves up into pParent.
   */
   nCell = 0;
   leafCorrection = pPage->leaf*4;
@@ -2975,7 +4827,15 @@ static int balance_nonroot(MemPage *pPage){
     int limit = pOld->nCell+pOld->nOverflow;
     for(j=0; j<limit; j++){
       apCell[nCell] = findOverflowCell(pOld, j);
-      szCell[nCell] = cellSizePtr(pOld, apCell[nCell]);
+      if( pOld->prefix ){
+        u8 *pCopy = &aDecode[iDecode+4];
+        szCell[nCell] = decodeCell(pOld, apCell[nCell], pCopy);
+        apCell[nCell] = pCopy;
+        iDecode += 4 + szCell[nCell];
+        assert( iDecode<=nDecode );
+      }else{
+        szCell[nCell] = cellSizePtr(pOld, apCell[nCell]);
+      }
       nCell++;
     }
     if( i<nOld-1 ){
@@ -2989,11 +4849,12 @@ static int balance_nonroot(MemPage *pPage){
         dropCell(pParent, nxDiv, sz);
       }else{
         u8 *pTemp;
-        szCell[nCell] = sz;
+        int szCopy;
         pTemp = &aSpace[iSpace];
-        iSpace += sz;
-        assert( iSpace<=sizeof(aSpace) );
-        memcpy(pTemp, apDiv[i], sz);
+        szCopy = decodeCell(pParent, apDiv[i], pTemp);
+        szCell[nCell] = szCopy;
+        iSpace += szCopy;
+        assert( iSpace<=pBt->pageSize*5 );
         apCell[nCell] = pTemp+leafCorrection;
         dropCell(pParent, nxDiv, sz);
         szCell[nCell] -= leafCorrection;
@@ -3028,14 +4889,48 @@ static int balance_nonroot(MemPage *pPage){
   ** 
   */
   usableSpace = pBt->usableSize - 12 + leafCorrection;
-  for(subtotal=k=i=0; i<nCell; i++){
-    subtotal += szCell[i] + 2;
-    if( subtotal > usableSpace ){
-      szNew[k] = subtotal - szCell[i];
-      cntNew[k] = i;
-      if( leafData ){ i--; }
-      subtotal = 0;
-      k++;
+  if( pPage->prefix ){
+    /* On prefix pages the size of a cell depends on the first cell of
+    ** its page, whose key becomes the reference key.  The sizes here
+    ** must agree with prefixPageSize().
+    */
+    int szPlain = 0;           /* Size of this page without a reference */
+    int szRef = 0;             /* Size with the first key as reference */
+    u8 *aRef = 0;              /* Key of the first cell on this page */
+    int nRef = 0;              /* Length of aRef[] */
+    int iFirst = 0;            /* First cell on this page */
+    assert( !leafData );
+    for(subtotal=k=i=0; i<nCell; i++){
+      int szPrior = subtotal;
+      if( i==iFirst ){
+        aRef = prefixPlainKey(apCopy[0], apCell[i], &nRef);
+        szPlain = 2;
+        szRef = 4 + nRef;
+      }
+      szPlain += szCell[i] + 2;
+      if( aRef ){
+        szRef += prefixEncode(apCopy[0], apCell[i], szCell[i], aRef, nRef, 0)
+                 + 2;
+      }
+      subtotal = (aRef && szRef<szPlain) ? szRef : szPlain;
+      if( subtotal > usableSpace ){
+        szNew[k] = szPrior;
+        cntNew[k] = i;
+        subtotal = 0;
+        iFirst = i+1;
+        k++;
+      }
+    }
+  }else{
+    for(subtotal=k=i=0; i<nCell; i++){
+      subtotal += szCell[i] + 2;
+      if( subtotal > usableSpace ){
+        szNew[k] = subtotal - szCell[i];
+        cntNew[k] = i;
+        if( leafData ){ i--; }
+        subtotal = 0;
+        k++;
+      }
     }
   }
   szNew[k] = subtotal;
@@ -3051,16 +4946,47 @@ static int balance_nonroot(MemPage *pPage){
   ** This adjustment is more than an optimization.  The packing above might
   ** be so out of balance as to be illegal.  For example, the right-most
   ** sibling might be completely empty.  This adjustment is not optional.
+  **
+  ** When the siblings are being filled in ascending key order (bias==1)
+  ** the packing is kept as it is, apart from giving an empty right-most
+  ** sibling a cell.  In descending order (bias==-1) cells are moved right
+  ** for as long as they fit, so that it is the left-most sibling that
+  ** holds what is left over.
   */
   for(i=k-1; i>0; i--){
     int szRight = szNew[i];  /* Size of sibling on the right */
     int szLeft = szNew[i-1]; /* Size of sibling on the left */
     int r;              /* Index of right-most cell in left sibling */
     int d;              /* Index of first cell to the left of right sibling */
+    int iStart;         /* Index of the first cell in the left sibling */
 
     r = cntNew[i-1] - 1;
     d = r + 1 - leafData;
-    while( szRight==0 || szRight+szCell[d]+2<=szLeft-(szCell[r]+2) ){
+    if( pPage->prefix ){
+      /* Moving a cell changes the first cell, and so the reference key,
+      ** of the right sibling.  Its size has to be worked out afresh. */
+      int iLeft = i>1 ? cntNew[i-2]+1 : 0;
+      int notUsed;
+      while( r>iLeft ){
+        int szL = prefixPageSize(apCopy[0], &apCell[iLeft], &szCell[iLeft],
+                                 r-iLeft, &notUsed);
+        int szR = prefixPageSize(apCopy[0], &apCell[d], &szCell[d],
+                                 cntNew[i]-d, &notUsed);
+        if( szRight!=0 && szR>szL ) break;
+        szRight = szR;
+        szLeft = szL;
+        cntNew[i-1]--;
+        r = cntNew[i-1] - 1;
+        d = r + 1;
+      }
+      szNew[i] = szRight;
+      szNew[i-1] = szLeft;
+      continue;
+    }
+    iStart = i>1 ? cntNew[i-2]+1-leafData : 0;
+    while( szRight==0
+       || (bias==0 && szRight+szCell[d]+2<=szLeft-(szCell[r]+2))
+       || (bias<0 && r>iStart && szRight+szCell[d]+2<=usableSpace) ){
       szRight += szCell[d] + 2;
       szLeft -= szCell[r] + 2;
       cntNew[i-1]--;
@@ -3176,15 +5102,16 @@ static int balance_nonroot(MemPage *pPage){
         pCell = &aSpace[iSpace];
         fillInCell(pParent, pCell, 0, info.nKey, 0, 0, &sz);
         iSpace += sz;
-        assert( iSpace<=sizeof(aSpace) );
+        assert( iSpace<=pBt->pageSize*5 );
         pTemp = 0;
       }else{
         pCell -= 4;
         pTemp = &aSpace[iSpace];
         iSpace += sz;
-        assert( iSpace<=sizeof(aSpace) );
+        assert( iSpace<=pBt->pageSize*5 );
       }
-      insertCell(pParent, nxDiv, pCell, sz, pTemp);
+      rc = insertCell(pParent, nxDiv, pCell, sz, pTemp);
+      if( rc!=SQLITE_OK ) goto balance_cleanup;
       put4byte(findOverflowCell(pParent,nxDiv), pNew->pgno);
       j++;
       nxDiv++;
@@ -3207,9 +5134,23 @@ static int balance_nonroot(MemPage *pPage){
   ** Reparent children of all cells.
   */
   for(i=0; i<nNew; i++){
-    reparentChildPages(apNew[i]);
+    rc = reparentChildPages(apNew[i]);
+    if( rc!=SQLITE_OK ) goto balance_cleanup;
+  }
+  rc = reparentChildPages(pParent);
+  if( rc!=SQLITE_OK ) goto balance_cleanup;
+
+  /*
+  ** The sibling that now holds the end being added to carries on the run
+  ** of inserts, so that its own split is decided the same way.
+  */
+  if( bias>0 ){
+    apNew[nNew-1]->nAppend = nAppend;
+  }else if( bias<0 ){
+    apNew[0]->nPrepend = nPrepend;
   }
-  reparentChildPages(pParent);
+  pParent->nAppend = nAppend;
+  pParent->nPrepend = nPrepend;
 
   /*
   ** Balance the parent page.  Note that the current page (pPage) might
@@ -3219,12 +5160,13 @@ static int balance_nonroot(MemPage *pPage){
   assert( pParent->isInit );
   /* assert( pPage->isInit ); // No! pPage might have been added to freelist */
   /* pageIntegrity(pPage);    // No! pPage might have been added to freelist */ 
-  rc = balance(pParent);
+  rc = balance(pParent, 0);
   
   /*
   ** Cleanup before returning.
   */
 balance_cleanup:
+  sqliteFree(aCopy);
   for(i=0; i<nOld; i++){
     releasePage(apOld[i]);
   }
@@ -3246,8 +5188,8 @@ static int balance_shallower(MemPage *pPage){
   MemPage *pChild;             /* The only child page of pPage */
   Pgno pgnoChild;              /* Page number for pChild */
   int rc;                      /* Return code from subprocedures */
-  u8 *apCell[(MX_CELL+2)*NB];  /* All cells from pages being balanced */
-  int szCell[(MX_CELL+2)*NB];  /* Local size of all cells */
+  u8 **apCell;                 /* All cells from the child page */
+  int *szCell;                 /* Local size of all cells */
 
   assert( pPage->pParent==0 );
   assert( pPage->nCell==0 );
@@ -3274,18 +5216,26 @@ static int balance_shallower(MemPage *pPage){
     if( rc ) return rc;
     if( pPage->pgno==1 ){
       rc = initPage(pChild, pPage);
+      if( rc==SQLITE_OK ) rc = computeFreeSpace(pChild);
       if( rc ) return rc;
       assert( pChild->nOverflow==0 );
       if( pChild->nFree>=100 ){
         /* The child information will fit on the root page, so do the
         ** copy */
         int i;
+        apCell = sqliteMallocRaw((pChild->nCell+1)*(sizeof(u8*)+sizeof(int)));
+        if( apCell==0 ){
+          releasePage(pChild);
+          return SQLITE_NOMEM;
+        }
+        szCell = (int*)&apCell[pChild->nCell];
         zeroPage(pPage, pChild->aData[0]);
         for(i=0; i<pChild->nCell; i++){
           apCell[i] = findCell(pChild,i);
           szCell[i] = cellSizePtr(pChild, apCell[i]);
         }
         assemblePage(pPage, pChild->nCell, apCell, szCell);
+        sqliteFree(apCell);
         freePage(pChild);
         TRACE(("BALANCE: child %d transfer to page 1\n", pChild->pgno));
       }else{
@@ -3303,8 +5253,9 @@ static int balance_shallower(MemPage *pPage){
       TRACE(("BALANCE: transfer child %d into root %d\n",
               pChild->pgno, pPage->pgno));
     }
-    reparentChildPages(pPage);
+    rc = reparentChildPages(pPage);
     releasePage(pChild);
+    if( rc ) return rc;
   }
   return SQLITE_OK;
 }
@@ -3316,14 +5267,14 @@ static int balance_shallower(MemPage *pPage){
 ** When this happens, Create a new child page and copy the
 ** contents of the root into the child.  Then make the root
 ** page an empty page with rightChild pointing to the new
-** child.   Finally, call balance_internal() on the new child
-** to cause it to split.
+** child.   Finally, call balance() on the new child to cause
+** it to split.  The insert flag is passed through to balance().
 */
-static int balance_deeper(MemPage *pPage){
+static int balance_deeper(MemPage *pPage, int insert){
   int rc;             /* Return value from subprocedures */
   MemPage *pChild;    /* Pointer to a new child page */
   Pgno pgnoChild;     /* Page number of the new child page */
-  Btree *pBt;         /* The BTree */
+  BtShared *pBt;      /* The BTree */
   int usableSize;     /* Total usable size of a page */
   u8 *data;           /* Content of the parent page */
   u8 *cdata;          /* Content of the child page */
@@ -3339,7 +5290,7 @@ static int balance_deeper(MemPage *pPage){
   usableSize = pBt->usableSize;
   data = pPage->aData;
   hdr = pPage->hdrOffset;
-  brk = get2byte(&data[hdr+5]);
+  brk = get2byteTop(&data[hdr+5]);
   cdata = pChild->aData;
   memcpy(cdata, &data[hdr], pPage->cellOffset+2*pPage->nCell-hdr);
   memcpy(&cdata[brk], &data[brk], usableSize-brk);
@@ -3347,6 +5298,8 @@ static int balance_deeper(MemPage *pPage){
   if( rc ) return rc;
   memcpy(pChild->aOvfl, pPage->aOvfl, pPage->nOverflow*sizeof(pPage->aOvfl[0]));
   pChild->nOverflow = pPage->nOverflow;
+  pChild->nAppend = pPage->nAppend;
+  pChild->nPrepend = pPage->nPrepend;
   if( pChild->nOverflow ){
     pChild->nFree = 0;
   }
@@ -3354,26 +5307,118 @@ static int balance_deeper(MemPage *pPage){
   zeroPage(pPage, pChild->aData[0] & ~PTF_LEAF);
   put4byte(&pPage->aData[pPage->hdrOffset+8], pgnoChild);
   TRACE(("BALANCE: copy root %d into %d\n", pPage->pgno, pChild->pgno));
-  rc = balance_nonroot(pChild);
+  pChild->idxParent = 0;
+  if( pBt->autoVacuum ){
+    /* Everything that pointed back to the root now points back to the
+    ** child.  Cells in pChild->aOvfl[] are looked after by balance(). */
+    rc = ptrmapPut(pBt, pgnoChild, PTRMAP_BTREE, pPage->pgno);
+    if( rc==SQLITE_OK ){
+      rc = reparentChildPages(pChild);
+    }
+    if( rc ){
+      releasePage(pChild);
+      return rc;
+    }
+  }
+  rc = balance(pChild, insert);
   releasePage(pChild);
   return rc;
 }
 
+/*
+** This routine is called instead of balance_nonroot() when a new entry
+** has been appended to pPage, which is a leaf of a LEAFDATA tree and
+** the right-most child of its parent.  The new entry is the only
+** overflow cell of pPage and comes after all the cells on it.
+**
+** Tables whose rowids only ever increase are filled this way.  Were the
+** cells shared out evenly, every leaf left behind by the growing table
+** would be half empty and would never be filled again.  Instead, pPage
+** is left as it is, completely full, and the new entry is put on a new
+** page that becomes the right-most child of the parent.  The largest
+** key on pPage becomes the new divider cell in the parent, which is
+** then balanced in turn in case the divider overfilled it.
+*/
+static int balance_quick(MemPage *pPage, MemPage *pParent){
+  int rc;
+  MemPage *pNew;           /* The new right-most leaf */
+  Pgno pgnoNew;            /* Page number of pNew */
+  BtShared *pBt = pPage->pBt;
+  u8 *pCell;               /* The new entry */
+  int szCell;              /* Size of the new entry */
+  int idx;                 /* Index of the new divider cell in pParent */
+  int szDiv;               /* Size of the new divider cell */
+  u8 aDiv[16];             /* The new divider cell: child pointer and key */
+  CellInfo info;
+
+  assert( pPage->leaf && pPage->leafData && pPage->nOverflow==1 );
+  assert( pPage->aOvfl[0].idx==pPage->nCell && pPage->nCell>0 );
+  rc = sqlite3pager_write(pParent->aData);
+  if( rc ) return rc;
+  rc = allocatePage(pBt, &pNew, &pgnoNew, pPage->pgno);
+  if( rc ) return rc;
+  TRACE(("BALANCE: append to %d moves the new entry to %d\n",
+          pPage->pgno, pgnoNew));
+  pCell = pPage->aOvfl[0].pCell;
+  szCell = cellSizePtr(pPage, pCell);
+  zeroPage(pNew, pPage->aData[0]);
+  assemblePage(pNew, 1, &pCell, &szCell);
+
+  /* Drop the overflow cell from pPage and recompute its free space */
+  pPage->isInit = 0;
+  rc = initPage(pPage, pParent);
+  if( rc==SQLITE_OK ){
+    parseCell(pPage, pPage->nCell-1, &info);
+    fillInCell(pParent, aDiv, 0, info.nKey, 0, 0, &szDiv);
+    assert( szDiv<=sizeof(aDiv) );
+    idx = pParent->nCell;
+    noteInsert(pParent, idx);
+    rc = insertCell(pParent, idx, aDiv, szDiv, 0);
+  }
+  if( rc==SQLITE_OK ){
+    put4byte(findOverflowCell(pParent, idx), pPage->pgno);
+    put4byte(&pParent->aData[pParent->hdrOffset+8], pgnoNew);
+    rc = reparentPage(pBt, pgnoNew, pParent, idx+1);
+  }
+  if( rc==SQLITE_OK ){
+    /* In an auto-vacuum database, the overflow chain of the new entry
+    ** is now pointed to from pNew */
+    rc = reparentChildPages(pNew);
+  }
+  if( rc==SQLITE_OK ){
+    pPage->idxParent = idx;
+    rc = balance(pParent, 0);
+  }
+  releasePage(pNew);
+  return rc;
+}
+
 /*
 ** Decide if the page pPage needs to be balanced.  If balancing is
 ** required, call the appropriate balancing routine.
+**
+** The insert flag is true if pPage has just had a cell inserted.  An
+** insert only makes a page fuller, so pages that are less than a third
+** full are only balanced with their siblings after a delete.
 */
-static int balance(MemPage *pPage){
-  int rc = SQLITE_OK;
+static int balance(MemPage *pPage, int insert){
+  int rc = computeFreeSpace(pPage);
+  if( rc ) return rc;
   if( pPage->pParent==0 ){
     if( pPage->nOverflow>0 ){
-      rc = balance_deeper(pPage);
+      rc = balance_deeper(pPage, insert);
     }
     if( pPage->nCell==0 ){
       rc = balance_shallower(pPage);
     }
   }else{
-    if( pPage->nOverflow>0 || pPage->nFree>pPage->pBt->usableSize*2/3 ){
+    MemPage *pParent = pPage->pParent;
+    if( insert && pPage->leaf && pPage->leafData && pPage->nOverflow==1
+     && pPage->aOvfl[0].idx==pPage->nCell && pParent->pgno!=1
+     && get4byte(&pParent->aData[pParent->hdrOffset+8])==pPage->pgno ){
+      rc = balance_quick(pPage, pParent);
+    }else if( pPage->nOverflow>0
+           || (!insert && pPage->nFree>pPage->pBt->usableSize*2/3) ){
       rc = balance_nonroot(pPage);
     }
   }
@@ -3394,6 +5439,10 @@ static int balance(MemPage *pPage){
 ** or delete might change the number of cells on a page or delete
 ** a page entirely and we do not want to leave any cursors 
 ** pointing to non-existant pages or cells.
+**
+** A cursor that belongs to an sqlite3_blob handle cannot be moved, since
+** the handle refers to one row only.  It is invalidated instead, and any
+** further use of it fails with SQLITE_ABORT.
 */
 static int checkReadLocks(BtCursor *pCur){
   BtCursor *p;
@@ -3403,7 +5452,11 @@ static int checkReadLocks(BtCursor *pCur){
     assert( p->pgnoRoot==pCur->pgnoRoot );
     assert( p->pPage->pgno==sqlite3pager_pagenumber(p->pPage->aData) );
     if( p->wrFlag==0 ) return SQLITE_LOCKED;
-    if( p->pPage->pgno!=p->pgnoRoot ){
+    p->nOverflow = 0;
+    if( p->isIncrblob ){
+      p->isValid = 0;
+      p->status = SQLITE_ABORT;
+    }else if( p->pPage->pgno!=p->pgnoRoot ){
       moveToRoot(p);
     }
   }
@@ -3419,7 +5472,7 @@ static int checkReadLocks(BtCursor *pCur){
 ** For an INTKEY table, only the nKey value of the key is used.  pKey is
 ** ignored.  For a ZERODATA table, the pData and nData are both ignored.
 */
-int sqlite3BtreeInsert(
+static int btreeInsert(
   BtCursor *pCur,                /* Insert data into the table of this cursor */
   const void *pKey, i64 nKey,    /* The key of the new record */
   const void *pData, int nData   /* The data of the new record */
@@ -3428,14 +5481,14 @@ int sqlite3BtreeInsert(
   int loc;
   int szNew;
   MemPage *pPage;
-  Btree *pBt = pCur->pBt;
+  BtShared *pBt = pCur->pBt;
   unsigned char *oldCell;
-  unsigned char newCell[MX_CELL_SIZE];
+  unsigned char *newCell;
 
   if( pCur->status ){
     return pCur->status;  /* A rollback destroyed this cursor */
   }
-  if( pBt->inTrans!=TRANS_WRITE ){
+  if( pCur->pBtree->inTrans!=TRANS_WRITE ){
     /* Must start a transaction before doing an insert */
     return pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
   }
@@ -3446,6 +5499,8 @@ int sqlite3BtreeInsert(
   if( checkReadLocks(pCur) ){
     return SQLITE_LOCKED; /* The table pCur points to has a read lock */
   }
+  rc = setWriteLock(pCur->pBtree, pCur->pgnoRoot);
+  if( rc ) return rc;
   rc = sqlite3BtreeMoveto(pCur, pKey, nKey, &loc);
   if( rc ) return rc;
   pPage = pCur->pPage;
@@ -3456,11 +5511,13 @@ int sqlite3BtreeInsert(
           loc==0 ? "overwrite" : "new entry"));
   assert( pPage->isInit );
   rc = sqlite3pager_write(pPage->aData);
+  if( rc==SQLITE_OK ) rc = computeFreeSpace(pPage);
   if( rc ) return rc;
+  newCell = pBt->pTmpCell;
   rc = fillInCell(pPage, newCell, pKey, nKey, pData, nData, &szNew);
   if( rc ) return rc;
   assert( szNew==cellSizePtr(pPage, newCell) );
-  assert( szNew<=sizeof(newCell) );
+  assert( szNew<=MX_CELL_SIZE(pBt) );
   if( loc==0 && pCur->isValid ){
     int szOld;
     assert( pCur->idx>=0 && pCur->idx<pPage->nCell );
@@ -3479,8 +5536,21 @@ int sqlite3BtreeInsert(
   }else{
     assert( pPage->leaf );
   }
-  insertCell(pPage, pCur->idx, newCell, szNew, 0);
-  rc = balance(pPage);
+  if( loc!=0 || !pCur->isValid ){
+    noteInsert(pPage, pCur->idx);
+  }
+  rc = insertCell(pPage, pCur->idx, newCell, szNew, 0);
+  if( rc ) return rc;
+  if( pPage->nOverflow==0 ){
+    /* The new cell fit on the page, so nothing needs balancing.  Leave
+    ** the cursor pointing at the new entry, so that a following insert
+    ** of the next key in order need not search from the root.
+    */
+    pCur->isValid = 1;
+    pCur->info.nSize = 0;
+    return SQLITE_OK;
+  }
+  rc = balance(pPage, 1);
   /* sqlite3BtreePageDump(pCur->pBt, pCur->pgnoRoot, 1); */
   /* fflush(stdout); */
   moveToRoot(pCur);
@@ -3488,21 +5558,460 @@ int sqlite3BtreeInsert(
 }
 
 /*
-** Delete the entry that the cursor is pointing to.  The cursor
-** is left pointing at a random location.
+** Allocate a new page for level iLevel of the tree being bulk loaded
+** by pCur and make it the page being filled on that level.
 */
-int sqlite3BtreeDelete(BtCursor *pCur){
-  MemPage *pPage = pCur->pPage;
-  unsigned char *pCell;
+static int loadNewPage(BtCursor *pCur, int iLevel){
+  BtLoad *pLoad = pCur->pLoad;
+  MemPage *pPage;
+  Pgno pgno;
   int rc;
-  Pgno pgnoChild = 0;
-  Btree *pBt = pCur->pBt;
 
-  assert( pPage->isInit );
-  if( pCur->status ){
-    return pCur->status;  /* A rollback destroyed this cursor */
-  }
-  if( pBt->inTrans!=TRANS_WRITE ){
+  assert( pLoad->aLevel[iLevel].pPage==0 );
+  rc = allocatePage(pCur->pBt, &pPage, &pgno, pLoad->pgnoLast);
+  if( rc ) return rc;
+  zeroPage(pPage, pLoad->flags | (iLevel==0 ? PTF_LEAF : 0));
+  pLoad->pgnoLast = pgno;
+  pLoad->aLevel[iLevel].pPage = pPage;
+  return SQLITE_OK;
+}
+
+/*
+** The root page is the only page on level iLevel and it is full.  Move
+** its content to a new page, which takes its place on level iLevel,
+** and make the root the first page of a new level above.
+*/
+static int loadMoveRoot(BtCursor *pCur, int iLevel){
+  BtLoad *pLoad = pCur->pLoad;
+  MemPage *pRoot = pLoad->aLevel[iLevel].pPage;
+  MemPage *pPage;
+  int rc;
+
+  assert( pRoot->pgno==pCur->pgnoRoot );
+  assert( iLevel==pLoad->nLevel-1 );
+  if( pLoad->nLevel>=BTLOAD_MX_DEPTH ) return SQLITE_CORRUPT;
+  pLoad->aLevel[iLevel].pPage = 0;
+  pLoad->aLevel[iLevel+1].pPage = pRoot;
+  pLoad->nLevel++;
+  rc = loadNewPage(pCur, iLevel);
+  if( rc ) return rc;
+  pPage = pLoad->aLevel[iLevel].pPage;
+  memcpy(pPage->aData, pRoot->aData, pCur->pBt->usableSize);
+  pPage->isInit = 0;
+  rc = initPage(pPage, 0);
+  if( rc ) return rc;
+  zeroPage(pRoot, pLoad->flags);
+  TRACE(("LOAD: root %d moved to %d\n", pRoot->pgno, pPage->pgno));
+  return SQLITE_OK;
+}
+
+/*
+** Page pPage of a bulk load is complete and all of its children are in
+** place.  In an auto-vacuum database, record it in the pointer map as
+** the parent of its children and of the overflow chains of its cells.
+*/
+static int loadFinishPage(MemPage *pPage){
+  if( !pPage->pBt->autoVacuum ) return SQLITE_OK;
+  return reparentChildPages(pPage);
+}
+
+/*
+** Append cell pCell, which is sz bytes in size, to level iLevel of the
+** tree being bulk loaded by pCur.  Cells for the leaf level are formatted
+** as for the leaves of the table.  Cells for the levels above begin with
+** the number of the child page to their left.
+**
+** When the page being filled has no room for pCell, that page is done
+** and a divider for it is added to the level above.  In a LEAFDATA tree
+** the divider holds a copy of the largest key on the page, and pCell
+** goes on a new page.  In other trees pCell itself becomes the divider.
+** It is held back until the next cell for this level arrives, so that
+** no page is begun that might then be left empty by the end of the load.
+*/
+static int loadCell(BtCursor *pCur, int iLevel, u8 *pCell, int sz){
+  BtLoad *pLoad = pCur->pLoad;
+  struct BtLoadLevel *pLevel = &pLoad->aLevel[iLevel];
+  MemPage *pPage;
+  int rc;
+
+  assert( iLevel<pLoad->nLevel );
+  if( pLevel->nHeld ){
+    rc = loadCell(pCur, iLevel+1, pLevel->pHeld, pLevel->nHeld);
+    if( rc ) return rc;
+    pLevel->nHeld = 0;
+  }
+  if( pLevel->pPage==0 ){
+    rc = loadNewPage(pCur, iLevel);
+    if( rc ) return rc;
+  }
+  pPage = pLevel->pPage;
+  rc = computeFreeSpace(pPage);
+  if( rc ) return rc;
+  if( pPage->nCell==0 || cellSizeOnPage(pPage, pCell, sz)+2<=pPage->nFree ){
+    return insertCell(pPage, pPage->nCell, pCell, sz, 0);
+  }
+  if( pPage->pgno==pCur->pgnoRoot ){
+    rc = loadMoveRoot(pCur, iLevel);
+    if( rc ) return rc;
+    pPage = pLevel->pPage;
+  }
+  if( iLevel==0 && pPage->leafData ){
+    u8 aDiv[13];
+    int szDiv;
+    CellInfo info;
+    parseCell(pPage, pPage->nCell-1, &info);
+    put4byte(aDiv, pPage->pgno);
+    szDiv = 4 + putVarint(&aDiv[4], *(u64*)&info.nKey);
+    rc = loadCell(pCur, 1, aDiv, szDiv);
+    if( rc ) return rc;
+    rc = loadFinishPage(pPage);
+    if( rc ) return rc;
+    releasePage(pPage);
+    pLevel->pPage = 0;
+    rc = loadNewPage(pCur, 0);
+    if( rc ) return rc;
+    rc = insertCell(pLevel->pPage, 0, pCell, sz, 0);
+    if( rc ) return rc;
+  }else{
+    if( pLevel->pHeld==0 ){
+      pLevel->pHeld = sqliteMallocRaw( pCur->pBt->pageSize );
+      if( pLevel->pHeld==0 ) return SQLITE_NOMEM;
+    }
+    if( iLevel==0 ){
+      memcpy(&pLevel->pHeld[4], pCell, sz);
+      sz += 4;
+    }else{
+      memcpy(pLevel->pHeld, pCell, sz);
+      put4byte(&pPage->aData[pPage->hdrOffset+8], get4byte(pCell));
+    }
+    put4byte(pLevel->pHeld, pPage->pgno);
+    pLevel->nHeld = sz;
+    rc = loadFinishPage(pPage);
+    if( rc ) return rc;
+    releasePage(pPage);
+    pLevel->pPage = 0;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** The load is over but a divider is still held back on level iLevel.
+** The page to its left is full and no page follows it.  Move the last
+** cell of that page up to the level above in place of the held divider,
+** and put the held cell alone on a new page at the end of the level.
+*/
+static int loadUnhold(BtCursor *pCur, int iLevel){
+  BtLoad *pLoad = pCur->pLoad;
+  struct BtLoadLevel *pLevel = &pLoad->aLevel[iLevel];
+  BtShared *pBt = pCur->pBt;
+  MemPage *pPage;     /* The full page to the left of the held divider */
+  u8 *pCell;          /* The last cell on pPage */
+  u8 *pUp;            /* The divider that goes up in its place */
+  int sz, szUp, rc;
+
+  rc = getAndInitPage(pBt, get4byte(pLevel->pHeld), &pPage, 0);
+  if( rc ) return rc;
+  rc = sqlite3pager_write(pPage->aData);
+  if( rc==SQLITE_OK ) rc = computeFreeSpace(pPage);
+  if( rc ){
+    releasePage(pPage);
+    return rc;
+  }
+  pCell = findCell(pPage, pPage->nCell-1);
+  sz = cellSizePtr(pPage, pCell);
+  pUp = pBt->pTmpCell;
+  if( iLevel==0 ){
+    szUp = decodeCell(pPage, pCell, &pUp[4]) + 4;
+  }else{
+    /* The held cell takes over the right-most child of pPage, and the
+    ** child of the cell that moves up becomes the right-most child */
+    szUp = decodeCell(pPage, pCell, pUp);
+    put4byte(pLevel->pHeld, get4byte(&pPage->aData[pPage->hdrOffset+8]));
+    put4byte(&pPage->aData[pPage->hdrOffset+8], get4byte(pCell));
+  }
+  put4byte(pUp, pPage->pgno);
+  dropCell(pPage, pPage->nCell-1, sz);
+  releasePage(pPage);
+  rc = loadNewPage(pCur, iLevel);
+  if( rc ) return rc;
+  if( iLevel==0 ){
+    rc = insertCell(pLevel->pPage, 0, &pLevel->pHeld[4], pLevel->nHeld-4, 0);
+  }else{
+    rc = insertCell(pLevel->pPage, 0, pLevel->pHeld, pLevel->nHeld, 0);
+  }
+  if( rc ) return rc;
+  pLevel->nHeld = 0;
+  return loadCell(pCur, iLevel+1, pUp, szUp);
+}
+
+/*
+** Complete the tree built by the bulk load on cursor pCur from the
+** cells loaded so far.  Each level is finished from the bottom up, and
+** the last page of each level becomes the right-most child of the last
+** page of the level above.
+*/
+static int loadFinish(BtCursor *pCur){
+  BtLoad *pLoad = pCur->pLoad;
+  Pgno pgnoChild = 0;      /* Right-most page on the level below */
+  int i, rc = SQLITE_OK;
+
+  for(i=0; rc==SQLITE_OK && i<pLoad->nLevel; i++){
+    struct BtLoadLevel *pLevel = &pLoad->aLevel[i];
+    MemPage *pPage;
+    if( pLevel->nHeld ){
+      rc = loadUnhold(pCur, i);
+      if( rc ) break;
+    }
+    pPage = pLevel->pPage;
+    assert( pPage!=0 );
+    if( i>0 ){
+      put4byte(&pPage->aData[pPage->hdrOffset+8], pgnoChild);
+    }
+    rc = loadFinishPage(pPage);
+    pgnoChild = pPage->pgno;
+  }
+  assert( rc!=SQLITE_OK || pgnoChild==pCur->pgnoRoot );
+  TRACE(("LOAD: table %d built with %d levels\n",
+          pCur->pgnoRoot, pLoad->nLevel));
+  return rc;
+}
+
+/*
+** Release the pages and memory held by the bulk load on cursor pCur,
+** if there is one, and take the cursor out of bulk-load mode.
+*/
+static void loadFree(BtCursor *pCur){
+  BtLoad *pLoad = pCur->pLoad;
+  int i;
+
+  if( pLoad==0 ) return;
+  for(i=0; i<BTLOAD_MX_DEPTH; i++){
+    releasePage(pLoad->aLevel[i].pPage);
+    sqliteFree(pLoad->aLevel[i].pHeld);
+  }
+  sqliteFree(pLoad->aPrior);
+  sqliteFree(pLoad);
+  pCur->pLoad = 0;
+}
+
+/*
+** The cursor of a bulk load is being closed before sqlite3BtreeLoadEnd()
+** was called, most likely because the statement doing the load failed.
+** Complete the tree from the entries loaded so far before releasing the
+** load, so that the file is never left holding interior pages whose
+** right-most child is page 0.
+**
+** That cannot be done if adding a cell to the tree failed part way or
+** if a rollback has already restored the pages.  The statement or
+** transaction rollback that follows such an error undoes the tree.
+*/
+static void loadAbandon(BtCursor *pCur){
+  BtLoad *pLoad = pCur->pLoad;
+  if( pLoad==0 ) return;
+  if( pLoad->rc==SQLITE_OK && pCur->status==SQLITE_OK ){
+    loadFinish(pCur);
+  }
+  loadFree(pCur);
+}
+
+/*
+** Add an entry to the tree being bulk loaded by pCur.  Its key must be
+** greater than that of every entry loaded before it.
+*/
+static int loadInsert(
+  BtCursor *pCur,                /* A cursor in bulk-load mode */
+  const void *pKey, i64 nKey,    /* The key of the new record */
+  const void *pData, int nData   /* The data of the new record */
+){
+  BtLoad *pLoad = pCur->pLoad;
+  BtShared *pBt = pCur->pBt;
+  MemPage *pLeaf;
+  int szNew, rc;
+
+  if( pCur->status ){
+    return pCur->status;  /* A rollback destroyed this cursor */
+  }
+  if( pLoad->flags & PTF_INTKEY ){
+    if( pLoad->hasPrior && nKey<=pLoad->nPrior ) return SQLITE_MISUSE;
+  }else{
+    if( pLoad->hasPrior && pCur->xCompare(pCur->pArg, pLoad->nPrior,
+                               pLoad->aPrior, nKey, pKey)>=0 ){
+      return SQLITE_MISUSE;
+    }
+    if( nKey>pLoad->nPriorAlloc ){
+      sqliteFree(pLoad->aPrior);
+      pLoad->nPriorAlloc = nKey + 100;
+      pLoad->aPrior = sqliteMallocRaw( pLoad->nPriorAlloc );
+      if( pLoad->aPrior==0 ){
+        pLoad->nPriorAlloc = 0;
+        pLoad->hasPrior = 0;
+        return SQLITE_NOMEM;
+      }
+    }
+    memcpy(pLoad->aPrior, pKey, nKey);
+  }
+  pLoad->nPrior = nKey;
+  pLoad->hasPrior = 1;
+
+  /* Make sure the leaf level has a page, so that the new cell can be
+  ** formatted for it.
+  */
+  if( pLoad->rc ) return pLoad->rc;
+  if( pLoad->aLevel[0].pPage==0 ){
+    assert( pLoad->aLevel[0].nHeld>0 );
+    rc = loadCell(pCur, 1, pLoad->aLevel[0].pHeld, pLoad->aLevel[0].nHeld);
+    if( rc==SQLITE_OK ){
+      pLoad->aLevel[0].nHeld = 0;
+      rc = loadNewPage(pCur, 0);
+    }
+    if( rc ) return pLoad->rc = rc;
+  }
+  pLeaf = pLoad->aLevel[0].pPage;
+  rc = fillInCell(pLeaf, pBt->pTmpCell, pKey, nKey, pData, nData, &szNew);
+  if( rc==SQLITE_OK ){
+    assert( szNew<=MX_CELL_SIZE(pBt) );
+    rc = loadCell(pCur, 0, pBt->pTmpCell, szNew);
+  }
+  return pLoad->rc = rc;
+}
+
+/*
+** Put cursor pCur into bulk-load mode.  The table of the cursor must be
+** empty and no other cursor may be open on it.  Until the load is ended
+** by sqlite3BtreeLoadEnd(), the only other call that may be made on the
+** cursor is sqlite3BtreeInsert(), and entries must be inserted in
+** ascending key order.
+**
+** Instead of searching the tree and balancing pages for each entry, the
+** loader packs entries onto the leaf pages one after another, starting
+** a new leaf whenever one is full.  The interior pages above are built
+** the same way from the dividers between leaves.  Each page is written
+** once, and pages are allocated in the order they are filled, so a tree
+** built on a file without free pages is laid out in key order.
+*/
+static int btreeLoadBegin(BtCursor *pCur){
+  MemPage *pRoot;
+  BtLoad *pLoad;
+  int rc;
+
+  if( pCur->status ){
+    return pCur->status;  /* A rollback destroyed this cursor */
+  }
+  if( pCur->pBtree->inTrans!=TRANS_WRITE ){
+    return pCur->pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
+  }
+  if( !pCur->wrFlag ){
+    return SQLITE_PERM;   /* Cursor not open for writing */
+  }
+  if( pCur->pLoad || pCur->pShared!=pCur ){
+    return SQLITE_LOCKED; /* Another cursor is using the table */
+  }
+  rc = setWriteLock(pCur->pBtree, pCur->pgnoRoot);
+  if( rc ) return rc;
+  rc = moveToRoot(pCur);
+  if( rc ) return rc;
+  pRoot = pCur->pPage;
+  if( pRoot->pgno==1 || !pRoot->leaf || pRoot->nCell>0 ){
+    return SQLITE_ERROR;  /* The table is not empty */
+  }
+  rc = sqlite3pager_write(pRoot->aData);
+  if( rc ) return rc;
+  pLoad = sqliteMalloc( sizeof(*pLoad) );
+  if( pLoad==0 ) return SQLITE_NOMEM;
+  pLoad->nLevel = 1;
+  pLoad->flags = pRoot->aData[0] & ~PTF_LEAF;
+  pLoad->pgnoLast = pRoot->pgno;
+  sqlite3pager_ref(pRoot->aData);
+  pLoad->aLevel[0].pPage = pRoot;
+  pCur->pLoad = pLoad;
+  pCur->isValid = 0;
+  return SQLITE_OK;
+}
+int sqlite3BtreeLoadBegin(BtCursor *pCur){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeLoadBegin(pCur);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
+/*
+** Complete the tree built by the bulk load on cursor pCur and take the
+** cursor out of bulk-load mode.  The cursor is left on the first entry.
+*/
+static int btreeLoadEnd(BtCursor *pCur){
+  BtLoad *pLoad = pCur->pLoad;
+  int rc;
+
+  if( pLoad==0 ) return SQLITE_MISUSE;
+  rc = pCur->status ? pCur->status : pLoad->rc;
+  if( rc==SQLITE_OK ){
+    rc = loadFinish(pCur);
+  }
+  loadFree(pCur);
+  if( rc==SQLITE_OK ){
+    rc = moveToRoot(pCur);
+  }
+  return rc;
+}
+int sqlite3BtreeLoadEnd(BtCursor *pCur){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeLoadEnd(pCur);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
+/*
+** Return the key of the entry most recently added to the tree being
+** bulk loaded by pCur, and write its length into *pnKey.  NULL is
+** returned if nothing has been loaded yet or the tree is an INTKEY tree.
+*/
+const void *sqlite3BtreeLoadLastKey(BtCursor *pCur, int *pnKey){
+  BtLoad *pLoad = pCur->pLoad;
+  if( pLoad==0 || !pLoad->hasPrior || (pLoad->flags & PTF_INTKEY) ){
+    *pnKey = 0;
+    return 0;
+  }
+  *pnKey = (int)pLoad->nPrior;
+  return pLoad->aPrior;
+}
+
+/*
+** Insert a new record into the table of cursor pCur.
+*/
+int sqlite3BtreeInsert(
+  BtCursor *pCur,                /* Insert data into the table of this cursor */
+  const void *pKey, i64 nKey,    /* The key of the new record */
+  const void *pData, int nData   /* The data of the new record */
+){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  if( pCur->pLoad ){
+    rc = loadInsert(pCur, pKey, nKey, pData, nData);
+  }else{
+    rc = btreeInsert(pCur, pKey, nKey, pData, nData);
+  }
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
+/*
+** Delete the entry that the cursor is pointing to.  The cursor
+** is left pointing at a random location.
+*/
+static int btreeDelete(BtCursor *pCur){
+  MemPage *pPage = pCur->pPage;
+  unsigned char *pCell;
+  int rc;
+  Pgno pgnoChild = 0;
+  BtShared *pBt = pCur->pBt;
+
+  assert( pPage->isInit );
+  if( pCur->status ){
+    return pCur->status;  /* A rollback destroyed this cursor */
+  }
+  if( pCur->pBtree->inTrans!=TRANS_WRITE ){
     /* Must start a transaction before doing a delete */
     return pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
   }
@@ -3516,56 +6025,564 @@ int sqlite3BtreeDelete(BtCursor *pCur){
   if( checkReadLocks(pCur) ){
     return SQLITE_LOCKED; /* The table pCur points to has a read lock */
   }
+  rc = setWriteLock(pCur->pBtree, pCur->pgnoRoot);
+  if( rc ) return rc;
   rc = sqlite3pager_write(pPage->aData);
+  if( rc==SQLITE_OK ) rc = computeFreeSpace(pPage);
   if( rc ) return rc;
   pCell = findCell(pPage, pCur->idx);
   if( !pPage->leaf ){
     pgnoChild = get4byte(pCell);
   }
-  clearCell(pPage, pCell);
-  if( !pPage->leaf ){
-    /*
-    ** The entry we are about to delete is not a leaf so if we do not
-    ** do something we will leave a hole on an internal page.
-    ** We have to fill the hole by moving in a cell from a leaf.  The
-    ** next Cell after the one to be deleted is guaranteed to exist and
-    ** to be a leaf so we can use it.
-    */
-    BtCursor leafCur;
-    unsigned char *pNext;
-    int szNext;
-    int notUsed;
-    unsigned char tempCell[MX_CELL_SIZE];
-    assert( !pPage->leafData );
-    getTempCursor(pCur, &leafCur);
-    rc = sqlite3BtreeNext(&leafCur, &notUsed);
-    if( rc!=SQLITE_OK ){
-      if( rc!=SQLITE_NOMEM ) rc = SQLITE_CORRUPT;
-      return rc;
-    }
-    rc = sqlite3pager_write(leafCur.pPage->aData);
+  clearCell(pPage, pCell);
+  if( !pPage->leaf ){
+    /*
+    ** The entry we are about to delete is not a leaf so if we do not
+    ** do something we will leave a hole on an internal page.
+    ** We have to fill the hole by moving in a cell from a leaf.  The
+    ** next Cell after the one to be deleted is guaranteed to exist and
+    ** to be a leaf so we can use it.
+    */
+    BtCursor leafCur;
+    unsigned char *pNext;
+    int szNext;
+    int notUsed;
+    unsigned char *tempCell = pBt->pTmpCell;
+    assert( !pPage->leafData );
+    getTempCursor(pCur, &leafCur);
+    rc = sqlite3BtreeNext(&leafCur, &notUsed);
+    if( rc!=SQLITE_OK ){
+      if( rc!=SQLITE_NOMEM ) rc = SQLITE_CORRUPT;
+      return rc;
+    }
+    rc = sqlite3pager_write(leafCur.pPage->aData);
+    if( rc ) return rc;
+    TRACE(("DELETE: table=%d delete internal from %d replace from leaf %d\n",
+       pCur->pgnoRoot, pPage->pgno, leafCur.pPage->pgno));
+    dropCell(pPage, pCur->idx, cellSizePtr(pPage, pCell));
+    pNext = findCell(leafCur.pPage, leafCur.idx);
+    szNext = cellSizePtr(leafCur.pPage, pNext);
+    if( leafCur.pPage->prefix ){
+      /* The cell may take part of its key from the reference key of the
+      ** leaf.  Move a whole copy of it, which tempCell[] then holds
+      ** until pPage has been balanced. */
+      int szCopy = decodeCell(leafCur.pPage, pNext, &tempCell[4]);
+      assert( MX_CELL_SIZE(pBt)>=szCopy+4 );
+      rc = insertCell(pPage, pCur->idx, tempCell, szCopy+4, 0);
+    }else{
+      assert( MX_CELL_SIZE(pBt)>=szNext+4 );
+      rc = insertCell(pPage, pCur->idx, pNext-4, szNext+4, tempCell);
+    }
+    if( rc ){
+      releaseTempCursor(&leafCur);
+      return rc;
+    }
+    put4byte(findOverflowCell(pPage, pCur->idx), pgnoChild);
+    rc = balance(pPage, 0);
+    if( rc==SQLITE_OK ) rc = computeFreeSpace(leafCur.pPage);
+    if( rc ){
+      releaseTempCursor(&leafCur);
+      return rc;
+    }
+    dropCell(leafCur.pPage, leafCur.idx, szNext);
+    rc = balance(leafCur.pPage, 0);
+    releaseTempCursor(&leafCur);
+  }else{
+    TRACE(("DELETE: table=%d delete from leaf %d\n",
+       pCur->pgnoRoot, pPage->pgno));
+    dropCell(pPage, pCur->idx, cellSizePtr(pPage, pCell));
+    rc = balance(pPage, 0);
+  }
+  moveToRoot(pCur);
+  return rc;
+}
+
+/*
+** Delete the entry that pCur points to.
+*/
+int sqlite3BtreeDelete(BtCursor *pCur){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreeDelete(pCur);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
+/*
+** Overwrite "amt" bytes of the data of the entry that pCur points to,
+** beginning "offset" bytes into the data, with the content of z[].
+** The size of the entry does not change, so an error is returned if
+** "offset+amt" is larger than the data.
+**
+** Other cursors open on the same table are left where they are, but
+** the write fails with SQLITE_LOCKED if any of them is read-only.
+*/
+static int btreePutData(BtCursor *pCur, u32 offset, u32 amt, void *z){
+  BtCursor *p;
+  int rc;
+
+  if( pCur->status ){
+    return pCur->status;
+  }
+  if( !pCur->isValid ){
+    return SQLITE_INTERNAL;
+  }
+  if( pCur->pBtree->inTrans!=TRANS_WRITE ){
+    return pCur->pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
+  }
+  if( !pCur->wrFlag ){
+    return SQLITE_PERM;
+  }
+  for(p=pCur->pShared; p!=pCur; p=p->pShared){
+    if( p->wrFlag==0 ) return SQLITE_LOCKED;
+  }
+  rc = setWriteLock(pCur->pBtree, pCur->pgnoRoot);
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  return accessPayload(pCur, offset, amt, (unsigned char*)z, 1, 1);
+}
+
+/*
+** Write part of the data of the entry that pCur points to.
+*/
+int sqlite3BtreePutData(BtCursor *pCur, u32 offset, u32 amt, void *z){
+  int rc;
+  btreeEnter(pCur->pBtree);
+  rc = btreePutData(pCur, offset, amt, z);
+  btreeLeave(pCur->pBtree);
+  return rc;
+}
+
+/*
+** Mark pCur as the cursor of an sqlite3_blob handle.  See
+** checkReadLocks() for what that changes.
+*/
+void sqlite3BtreeIncrblobCursor(BtCursor *pCur){
+  btreeEnter(pCur->pBtree);
+  pCur->isIncrblob = 1;
+  btreeLeave(pCur->pBtree);
+}
+
+/*
+** Take page iPage, which must be on the freelist, off the freelist.  If
+** it is a trunk page, its first leaf becomes a trunk page in its place.
+*/
+static int freelistRemove(BtShared *pBt, Pgno iPage){
+  MemPage *pPage1 = pBt->pPage1;
+  MemPage *pPrev = 0;       /* The trunk page before pTrunk */
+  MemPage *pTrunk = 0;      /* The trunk page being searched */
+  Pgno iTrunk;              /* Page number of pTrunk */
+  Pgno iNext;               /* The trunk page that replaces iPage */
+  int found = 0;
+  int i, k, rc;
+
+  rc = sqlite3pager_write(pPage1->aData);
+  if( rc ) return rc;
+  iTrunk = get4byte(&pPage1->aData[32]);
+  while( rc==SQLITE_OK && iTrunk && !found ){
+    rc = getPage(pBt, iTrunk, &pTrunk);
+    if( rc ) break;
+    k = get4byte(&pTrunk->aData[4]);
+    if( iTrunk==iPage ){
+      if( k>0 ){
+        MemPage *pNew;
+        iNext = get4byte(&pTrunk->aData[8]);
+        rc = getPage(pBt, iNext, &pNew);
+        if( rc==SQLITE_OK ){
+          rc = sqlite3pager_write(pNew->aData);
+          if( rc==SQLITE_OK ){
+            memcpy(pNew->aData, pTrunk->aData, 4);
+            put4byte(&pNew->aData[4], k-1);
+            memcpy(&pNew->aData[8], &pTrunk->aData[12], (k-1)*4);
+          }
+          releasePage(pNew);
+        }
+      }else{
+        iNext = get4byte(pTrunk->aData);
+      }
+      if( rc==SQLITE_OK && pPrev ){
+        rc = sqlite3pager_write(pPrev->aData);
+        if( rc==SQLITE_OK ) put4byte(pPrev->aData, iNext);
+      }else if( rc==SQLITE_OK ){
+        put4byte(&pPage1->aData[32], iNext);
+      }
+      found = 1;
+    }else{
+      for(i=0; i<k; i++){
+        if( get4byte(&pTrunk->aData[8+i*4])==iPage ){
+          rc = sqlite3pager_write(pTrunk->aData);
+          if( rc ) break;
+          if( i<k-1 ){
+            memcpy(&pTrunk->aData[8+i*4], &pTrunk->aData[4+k*4], 4);
+          }
+          put4byte(&pTrunk->aData[4], k-1);
+          found = 1;
+          break;
+        }
+      }
+    }
+    releasePage(pPrev);
+    pPrev = pTrunk;
+    iTrunk = get4byte(pTrunk->aData);
+  }
+  releasePage(pPrev);
+  if( rc==SQLITE_OK ){
+    if( !found ) return SQLITE_CORRUPT;
+    put4byte(&pPage1->aData[36], get4byte(&pPage1->aData[36])-1);
+    TRACE(("FREELIST-REMOVE: %d\n", iPage));
+  }
+  return rc;
+}
+
+/*
+** Page iPtrPage holds a pointer of type eType to page iFrom.  Change it
+** to point to iTo instead.
+*/
+static int modifyPagePointer(
+  BtShared *pBt,        /* The database file */
+  Pgno iPtrPage,        /* The page that holds the pointer */
+  Pgno iFrom,           /* The page that has moved */
+  Pgno iTo,             /* Where it moved to */
+  u8 eType              /* PTRMAP_OVERFLOW1, OVERFLOW2 or BTREE */
+){
+  MemPage *pPage;
+  int rc, i;
+
+  rc = getPage(pBt, iPtrPage, &pPage);
+  if( rc ) return rc;
+  rc = sqlite3pager_write(pPage->aData);
+  if( rc==SQLITE_OK && eType==PTRMAP_OVERFLOW2 ){
+    if( get4byte(pPage->aData)==iFrom ){
+      put4byte(pPage->aData, iTo);
+    }else{
+      rc = SQLITE_CORRUPT;
+    }
+    releasePage(pPage);
+    return rc;
+  }
+  if( rc==SQLITE_OK && pPage->isInit==0 ){
+    rc = initPage(pPage, 0);
+  }
+  if( rc ){
+    releasePage(pPage);
+    return rc;
+  }
+  rc = SQLITE_CORRUPT;
+  for(i=0; i<pPage->nCell; i++){
+    u8 *pCell = findCell(pPage, i);
+    if( eType==PTRMAP_OVERFLOW1 ){
+      CellInfo info;
+      parseCellPtr(pPage, pCell, &info);
+      if( info.iOverflow && get4byte(&pCell[info.iOverflow])==iFrom ){
+        put4byte(&pCell[info.iOverflow], iTo);
+        rc = SQLITE_OK;
+        break;
+      }
+    }else if( !pPage->leaf && get4byte(pCell)==iFrom ){
+      put4byte(pCell, iTo);
+      rc = SQLITE_OK;
+      break;
+    }
+  }
+  if( rc && eType==PTRMAP_BTREE && !pPage->leaf
+      && get4byte(&pPage->aData[pPage->hdrOffset+8])==iFrom ){
+    put4byte(&pPage->aData[pPage->hdrOffset+8], iTo);
+    rc = SQLITE_OK;
+  }
+  releasePage(pPage);
+  return rc;
+}
+
+/*
+** Move the content of page pSrc, which is of type eType and is pointed
+** to from page iPtrPage, to page pDest.  pDest has just been allocated.
+** The pointer to the page, the pointers back from its children or
+** the next page of its overflow chain, and the pointer map are all
+** changed to match.  No cursor may be open.
+**
+** pSrc is journalled before it is abandoned, since the file may be
+** truncated beneath it before the transaction commits.
+*/
+static int relocatePage(
+  BtShared *pBt,        /* The database file */
+  MemPage *pSrc,        /* The page to move */
+  u8 eType,             /* Its pointer-map type */
+  Pgno iPtrPage,        /* Its parent in the pointer map */
+  MemPage *pDest        /* Where to move it */
+){
+  Pgno iFrom = pSrc->pgno;
+  Pgno iTo = pDest->pgno;
+  int rc;
+
+  assert( pBt->pCursor==0 );
+  assert( eType==PTRMAP_OVERFLOW1 || eType==PTRMAP_OVERFLOW2
+       || eType==PTRMAP_BTREE );
+  assert( sqlite3pager_iswriteable(pDest->aData) );
+  TRACE(("RELOCATE: %d to %d, type %d, parent %d\n",
+          iFrom, iTo, eType, iPtrPage));
+  rc = sqlite3pager_write(pSrc->aData);
+  if( rc ) return rc;
+  memcpy(pDest->aData, pSrc->aData, pBt->pageSize);
+  pDest->isInit = 0;
+  if( eType==PTRMAP_BTREE ){
+    rc = initPage(pDest, 0);
+    if( rc==SQLITE_OK ){
+      rc = reparentChildPages(pDest);
+    }
+  }else{
+    Pgno iNext = get4byte(pDest->aData);
+    if( iNext ){
+      rc = ptrmapPut(pBt, iNext, PTRMAP_OVERFLOW2, iTo);
+    }
+  }
+  if( rc==SQLITE_OK ){
+    rc = ptrmapPut(pBt, iTo, eType, iPtrPage);
+  }
+  if( rc==SQLITE_OK ){
+    rc = modifyPagePointer(pBt, iPtrPage, iFrom, iTo, eType);
+  }
+  return rc;
+}
+
+/*
+** Reclaim page iLastPg, the last page of an auto-vacuum database that
+** is to be shortened.  A free page is simply taken off the freelist.
+** Any other page is moved to a free page, which must exist.
+**
+** When nFin is not zero, the file is to be truncated to nFin pages
+** at commit and every free page is to be reclaimed.  Free pages past
+** nFin are then left where they are, and the freelist is emptied by
+** the caller once every page past nFin has been dealt with.
+*/
+static int incrVacuumStep(BtShared *pBt, Pgno nFin, Pgno iLastPg){
+  MemPage *pSrc, *pDest;
+  Pgno iDest;
+  Pgno iPtrPage;
+  u8 eType;
+  int rc;
+
+  if( PTRMAP_ISPAGE(pBt, iLastPg) || iLastPg==PENDING_BYTE_PAGE(pBt) ){
+    return SQLITE_OK;
+  }
+  rc = ptrmapGet(pBt, iLastPg, &eType, &iPtrPage);
+  if( rc ) return rc;
+  if( eType==PTRMAP_ROOTPAGE ){
+    return SQLITE_CORRUPT;
+  }
+  if( eType==PTRMAP_FREEPAGE ){
+    return nFin ? SQLITE_OK : freelistRemove(pBt, iLastPg);
+  }
+  do{
+    if( get4byte(&pBt->pPage1->aData[36])==0 ){
+      return SQLITE_CORRUPT;
+    }
+    rc = allocatePage(pBt, &pDest, &iDest, 0);
+    if( rc ) return rc;
+    if( nFin && iDest>nFin ){
+      /* This free page is past the end of the file to be */
+      releasePage(pDest);
+      iDest = 0;
+    }
+  }while( iDest==0 );
+  assert( iDest<iLastPg );
+  rc = getPage(pBt, iLastPg, &pSrc);
+  if( rc==SQLITE_OK ){
+    rc = relocatePage(pBt, pSrc, eType, iPtrPage, pDest);
+    releasePage(pSrc);
+  }
+  releasePage(pDest);
+  return rc;
+}
+
+/*
+** Return the number of pages an auto-vacuum database of nOrig pages,
+** nFree of them free, occupies once every free page is reclaimed.  The
+** pointer-map pages that are no longer needed are counted as reclaimed
+** too.
+*/
+static Pgno finalDbSize(BtShared *pBt, Pgno nOrig, Pgno nFree){
+  int nEntry = pBt->usableSize/5;
+  int nPtrmap;
+  Pgno nFin;
+
+  nPtrmap = ((int)nFree - (int)nOrig + (int)ptrmapPageno(pBt, nOrig) + nEntry)
+              / nEntry;
+  nFin = nOrig - nFree - nPtrmap;
+  if( nOrig>PENDING_BYTE_PAGE(pBt) && nFin<PENDING_BYTE_PAGE(pBt) ){
+    nFin--;
+  }
+  while( nFin>1
+         && (PTRMAP_ISPAGE(pBt, nFin) || nFin==PENDING_BYTE_PAGE(pBt)) ){
+    nFin--;
+  }
+  return nFin;
+}
+
+/*
+** Reclaim up to nPage free pages of an auto-vacuum database, or all of
+** them if nPage is not positive, by moving the pages at the end of the
+** file into free pages nearer its start and truncating it.  The work
+** stops early at the first root page met, as root pages never move.
+** No cursor may be open.
+*/
+static int incrVacuum(BtShared *pBt, int nPage){
+  Pgno nOrig = sqlite3pager_pagecount(pBt->pPager);
+  Pgno iLastPg = nOrig;
+  int nDone = 0;
+  int rc = SQLITE_OK;
+
+  assert( pBt->autoVacuum && pBt->pCursor==0 );
+  while( iLastPg>2 && (nPage<=0 || nDone<nPage)
+         && get4byte(&pBt->pPage1->aData[36])>0 ){
+    Pgno iPtrPage;
+    u8 eType;
+    if( PTRMAP_ISPAGE(pBt, iLastPg) || iLastPg==PENDING_BYTE_PAGE(pBt) ){
+      iLastPg--;
+      continue;
+    }
+    rc = ptrmapGet(pBt, iLastPg, &eType, &iPtrPage);
+    if( rc || eType==PTRMAP_ROOTPAGE ) break;
+    rc = incrVacuumStep(pBt, 0, iLastPg);
+    if( rc ) break;
+    iLastPg--;
+    nDone++;
+  }
+  while( iLastPg>1 && (PTRMAP_ISPAGE(pBt, iLastPg)
+                       || iLastPg==PENDING_BYTE_PAGE(pBt)) ){
+    iLastPg--;
+  }
+  if( rc==SQLITE_OK && iLastPg<nOrig ){
+    TRACE(("INCR-VACUUM: %d pages reclaimed, %d left\n", nDone, iLastPg));
+    rc = sqlite3pager_truncate(pBt->pPager, iLastPg);
+  }
+  return rc;
+}
+
+/*
+** Called as a transaction on a database in full auto-vacuum mode is
+** committed.  Every free page is reclaimed and the file truncated.
+**
+** Usually the pages past the final size of the file are simply moved
+** into the free pages before it.  Should a root page lie past that
+** point, pages are reclaimed one at a time from the end down to the
+** first root page instead.  When cursors are open, as they may be on
+** other connections to a shared cache, nothing is done.
+*/
+static int autoVacuumCommit(BtShared *pBt){
+  Pgno nOrig, nFree, nFin, iPg;
+  u8 *aData = pBt->pPage1->aData;
+  int rc = SQLITE_OK;
+
+  if( !pBt->autoVacuum || pBt->incrVacuum || pBt->pCursor ){
+    return SQLITE_OK;
+  }
+  nFree = get4byte(&aData[36]);
+  if( nFree==0 ) return SQLITE_OK;
+  nOrig = sqlite3pager_pagecount(pBt->pPager);
+  nFin = finalDbSize(pBt, nOrig, nFree);
+  if( nFin<1 || nFin>nOrig ) return SQLITE_CORRUPT;
+  for(iPg=nOrig; iPg>nFin; iPg--){
+    Pgno iPtrPage;
+    u8 eType;
+    if( PTRMAP_ISPAGE(pBt, iPg) || iPg==PENDING_BYTE_PAGE(pBt) ) continue;
+    rc = ptrmapGet(pBt, iPg, &eType, &iPtrPage);
+    if( rc ) return rc;
+    if( eType==PTRMAP_ROOTPAGE ){
+      return incrVacuum(pBt, 0);
+    }
+  }
+  TRACE(("AUTO-VACUUM: %d pages to %d\n", nOrig, nFin));
+  for(iPg=nOrig; rc==SQLITE_OK && iPg>nFin; iPg--){
+    rc = incrVacuumStep(pBt, nFin, iPg);
+  }
+  if( rc==SQLITE_OK ){
+    rc = sqlite3pager_write(aData);
+  }
+  if( rc==SQLITE_OK ){
+    put4byte(&aData[32], 0);
+    put4byte(&aData[36], 0);
+    rc = sqlite3pager_truncate(pBt->pPager, nFin);
+  }
+  return rc;
+}
+
+/*
+** Reclaim up to nPage free pages of the database, or all of them if
+** nPage is not positive.  A write transaction must be open and there
+** may be no open cursors.  Nothing is done unless the database is in
+** auto-vacuum mode.
+*/
+static int btreeIncrVacuum(Btree *p, int nPage){
+  BtShared *pBt = p->pBt;
+  if( p->inTrans!=TRANS_WRITE ){
+    return pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
+  }
+  if( !pBt->autoVacuum ){
+    return SQLITE_OK;
+  }
+  if( pBt->pCursor ){
+    return SQLITE_LOCKED;
+  }
+  return incrVacuum(pBt, nPage);
+}
+int sqlite3BtreeIncrVacuum(Btree *p, int nPage){
+  int rc;
+  btreeEnter(p);
+  rc = btreeIncrVacuum(p, nPage);
+  btreeLeave(p);
+  return rc;
+}
+
+/*
+** Find a page for the root of a new table in an auto-vacuum database.
+** Root pages are kept together at the start of the file so that the
+** pages moved when the file is vacuumed are never roots: the new root
+** goes on the first page that is not already a root.  Whatever is on
+** that page now is moved elsewhere.
+*/
+static int allocateRootPage(BtShared *pBt, MemPage **ppRoot, Pgno *pPgno){
+  Pgno iRoot;
+  Pgno nPage = sqlite3pager_pagecount(pBt->pPager);
+  Pgno iPtrPage;
+  u8 eType = PTRMAP_ROOTPAGE;
+  MemPage *pDest;
+  Pgno iDest;
+  int rc = SQLITE_OK;
+
+  for(iRoot=3; iRoot<=nPage; iRoot++){
+    if( PTRMAP_ISPAGE(pBt, iRoot) || iRoot==PENDING_BYTE_PAGE(pBt) ) continue;
+    rc = ptrmapGet(pBt, iRoot, &eType, &iPtrPage);
+    if( rc ) return rc;
+    if( eType!=PTRMAP_ROOTPAGE ) break;
+  }
+  if( iRoot>nPage ){
+    /* Every page is a root.  The freelist is empty and the new root
+    ** goes at the end of the file. */
+    return allocatePage(pBt, ppRoot, pPgno, 1);
+  }
+  if( eType==PTRMAP_FREEPAGE ){
+    rc = freelistRemove(pBt, iRoot);
+    if( rc==SQLITE_OK ) rc = getPage(pBt, iRoot, ppRoot);
+  }else{
+    rc = allocatePage(pBt, &pDest, &iDest, iRoot);
     if( rc ) return rc;
-    TRACE(("DELETE: table=%d delete internal from %d replace from leaf %d\n",
-       pCur->pgnoRoot, pPage->pgno, leafCur.pPage->pgno));
-    dropCell(pPage, pCur->idx, cellSizePtr(pPage, pCell));
-    pNext = findCell(leafCur.pPage, leafCur.idx);
-    szNext = cellSizePtr(leafCur.pPage, pNext);
-    assert( sizeof(tempCell)>=szNext+4 );
-    insertCell(pPage, pCur->idx, pNext-4, szNext+4, tempCell);
-    put4byte(findOverflowCell(pPage, pCur->idx), pgnoChild);
-    rc = balance(pPage);
+    rc = getPage(pBt, iRoot, ppRoot);
+    if( rc==SQLITE_OK ){
+      rc = relocatePage(pBt, *ppRoot, eType, iPtrPage, pDest);
+      if( rc ) releasePage(*ppRoot);
+    }
+    releasePage(pDest);
     if( rc ) return rc;
-    dropCell(leafCur.pPage, leafCur.idx, szNext);
-    rc = balance(leafCur.pPage);
-    releaseTempCursor(&leafCur);
-  }else{
-    TRACE(("DELETE: table=%d delete from leaf %d\n",
-       pCur->pgnoRoot, pPage->pgno));
-    dropCell(pPage, pCur->idx, cellSizePtr(pPage, pCell));
-    rc = balance(pPage);
   }
-  moveToRoot(pCur);
-  return rc;
+  if( rc ) return rc;
+  rc = sqlite3pager_write((*ppRoot)->aData);
+  if( rc ){
+    releasePage(*ppRoot);
+    return rc;
+  }
+  *pPgno = iRoot;
+  return SQLITE_OK;
 }
 
 /*
@@ -3578,33 +6595,66 @@ int sqlite3BtreeDelete(BtCursor *pCur){
 **
 **     BTREE_INTKEY|BTREE_LEAFDATA     Used for SQL tables with rowid keys
 **     BTREE_ZERODATA                  Used for SQL indices
+**
+** BTREE_PREFIX may be added to BTREE_ZERODATA to compress the keys on
+** each page against a reference key.  It is ignored for other tables.
 */
-int sqlite3BtreeCreateTable(Btree *pBt, int *piTable, int flags){
+static int btreeCreateTable(Btree *p, int *piTable, int flags){
+  BtShared *pBt = p->pBt;
   MemPage *pRoot;
   Pgno pgnoRoot;
   int rc;
-  if( pBt->inTrans!=TRANS_WRITE ){
+  if( p->inTrans!=TRANS_WRITE ){
     /* Must start a transaction first */
     return pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
   }
   if( pBt->readOnly ){
     return SQLITE_READONLY;
   }
-  rc = allocatePage(pBt, &pRoot, &pgnoRoot, 1);
+  if( (flags & (BTREE_INTKEY|BTREE_ZERODATA|BTREE_LEAFDATA))!=BTREE_ZERODATA ){
+    flags &= ~BTREE_PREFIX;
+  }
+  if( flags & BTREE_PREFIX ){
+    /* Libraries that cannot decode prefix pages must not open the file */
+    rc = raiseFileFormat(pBt, 2, 2);
+    if( rc ) return rc;
+  }
+  if( pBt->autoVacuum && pBt->pCursor==0 ){
+    rc = allocateRootPage(pBt, &pRoot, &pgnoRoot);
+  }else{
+    rc = allocatePage(pBt, &pRoot, &pgnoRoot, 1);
+  }
   if( rc ) return rc;
   assert( sqlite3pager_iswriteable(pRoot->aData) );
   zeroPage(pRoot, flags | PTF_LEAF);
   sqlite3pager_unref(pRoot->aData);
+  if( pBt->autoVacuum ){
+    rc = ptrmapPut(pBt, pgnoRoot, PTRMAP_ROOTPAGE, 0);
+    if( rc ) return rc;
+  }
+  rc = setWriteLock(p, pgnoRoot);
+  if( rc ) return rc;
   *piTable = (int)pgnoRoot;
   return SQLITE_OK;
 }
 
+/*
+** Create a new, empty table and write its root page number to *piTable.
+*/
+int sqlite3BtreeCreateTable(Btree *p, int *piTable, int flags){
+  int rc;
+  btreeEnter(p);
+  rc = btreeCreateTable(p, piTable, flags);
+  btreeLeave(p);
+  return rc;
+}
+
 /*
 ** Erase the given database page and all its children.  Return
 ** the page to the freelist.
 */
 static int clearDatabasePage(
-  Btree *pBt,           /* The BTree that contains the table */
+  BtShared *pBt,        /* The BTree that contains the table */
   Pgno pgno,            /* Page number to clear */
   MemPage *pParent,     /* Parent page.  NULL for the root */
   int freePageFlag      /* Deallocate page if true */
@@ -3649,10 +6699,11 @@ static int clearDatabasePage(
 ** read cursors on the table.  Open write cursors are moved to the
 ** root of the table.
 */
-int sqlite3BtreeClearTable(Btree *pBt, int iTable){
+static int btreeClearTable(Btree *p, int iTable){
+  BtShared *pBt = p->pBt;
   int rc;
   BtCursor *pCur;
-  if( pBt->inTrans!=TRANS_WRITE ){
+  if( p->inTrans!=TRANS_WRITE ){
     return pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
   }
   for(pCur=pBt->pCursor; pCur; pCur=pCur->pNext){
@@ -3661,13 +6712,26 @@ int sqlite3BtreeClearTable(Btree *pBt, int iTable){
       moveToRoot(pCur);
     }
   }
+  rc = setWriteLock(p, (Pgno)iTable);
+  if( rc ) return rc;
   rc = clearDatabasePage(pBt, (Pgno)iTable, 0, 0);
   if( rc ){
-    sqlite3BtreeRollback(pBt);
+    sqlite3BtreeRollback(p);
   }
   return rc;
 }
 
+/*
+** Delete all entries from the table rooted at page iTable.
+*/
+int sqlite3BtreeClearTable(Btree *p, int iTable){
+  int rc;
+  btreeEnter(p);
+  rc = btreeClearTable(p, iTable);
+  btreeLeave(p);
+  return rc;
+}
+
 /*
 ** Erase all information in a table and add the root of the table to
 ** the freelist.  Except, the root of the principle table (the one on
@@ -3676,11 +6740,12 @@ int sqlite3BtreeClearTable(Btree *pBt, int iTable){
 ** This routine will fail with SQLITE_LOCKED if there are any open
 ** cursors on the table.
 */
-int sqlite3BtreeDropTable(Btree *pBt, int iTable){
+static int btreeDropTable(Btree *p, int iTable){
+  BtShared *pBt = p->pBt;
   int rc;
   MemPage *pPage;
   BtCursor *pCur;
-  if( pBt->inTrans!=TRANS_WRITE ){
+  if( p->inTrans!=TRANS_WRITE ){
     return pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
   }
   for(pCur=pBt->pCursor; pCur; pCur=pCur->pNext){
@@ -3690,7 +6755,7 @@ int sqlite3BtreeDropTable(Btree *pBt, int iTable){
   }
   rc = getPage(pBt, (Pgno)iTable, &pPage);
   if( rc ) return rc;
-  rc = sqlite3BtreeClearTable(pBt, iTable);
+  rc = btreeClearTable(p, iTable);
   if( rc ) return rc;
   if( iTable>1 ){
     rc = freePage(pPage);
@@ -3701,38 +6766,62 @@ int sqlite3BtreeDropTable(Btree *pBt, int iTable){
   return rc;  
 }
 
+/*
+** Remove the table rooted at page iTable from the database.
+*/
+int sqlite3BtreeDropTable(Btree *p, int iTable){
+  int rc;
+  btreeEnter(p);
+  rc = btreeDropTable(p, iTable);
+  btreeLeave(p);
+  return rc;
+}
+
 
 /*
 ** Read the meta-information out of a database file.  Meta[0]
 ** is the number of free pages currently in the database.  Meta[1]
-** through meta[15] are available for use by higher layers.  Meta[0]
-** is read-only, the others are read/write.
+** through meta[13] are available for use by higher layers.  Meta[14]
+** is the auto-vacuum mode.  Meta[0] and meta[14] are read-only, the
+** others are read/write.
 ** 
 ** The schema layer numbers meta values differently.  At the schema
 ** layer (and the SetCookie and ReadCookie opcodes) the number of
 ** free pages is not visible.  So Cookie[0] is the same as Meta[1].
 */
-int sqlite3BtreeGetMeta(Btree *pBt, int idx, u32 *pMeta){
+static int btreeGetMeta(Btree *p, int idx, u32 *pMeta){
   int rc;
   unsigned char *pP1;
 
   assert( idx>=0 && idx<=15 );
-  rc = sqlite3pager_get(pBt->pPager, 1, (void**)&pP1);
+  rc = sqlite3pager_get(p->pBt->pPager, 1, (void**)&pP1);
   if( rc ) return rc;
   *pMeta = get4byte(&pP1[36 + idx*4]);
   sqlite3pager_unref(pP1);
   return SQLITE_OK;
 }
 
+/*
+** Read meta value idx into *pMeta.
+*/
+int sqlite3BtreeGetMeta(Btree *p, int idx, u32 *pMeta){
+  int rc;
+  btreeEnter(p);
+  rc = btreeGetMeta(p, idx, pMeta);
+  btreeLeave(p);
+  return rc;
+}
+
 /*
 ** Write meta-information back into the database.  Meta[0] is
 ** read-only and may not be written.
 */
-int sqlite3BtreeUpdateMeta(Btree *pBt, int idx, u32 iMeta){
+static int btreeUpdateMeta(Btree *p, int idx, u32 iMeta){
+  BtShared *pBt = p->pBt;
   unsigned char *pP1;
   int rc;
-  assert( idx>=1 && idx<=15 );
-  if( pBt->inTrans!=TRANS_WRITE ){
+  assert( idx>=1 && idx<=13 );
+  if( p->inTrans!=TRANS_WRITE ){
     return pBt->readOnly ? SQLITE_READONLY : SQLITE_ERROR;
   }
   assert( pBt->pPage1!=0 );
@@ -3743,6 +6832,17 @@ int sqlite3BtreeUpdateMeta(Btree *pBt, int idx, u32 iMeta){
   return SQLITE_OK;
 }
 
+/*
+** Change meta value idx to iMeta.
+*/
+int sqlite3BtreeUpdateMeta(Btree *p, int idx, u32 iMeta){
+  int rc;
+  btreeEnter(p);
+  rc = btreeUpdateMeta(p, idx, iMeta);
+  btreeLeave(p);
+  return rc;
+}
+
 /*
 ** Return the flag byte at the beginning of the page that the cursor
 ** is currently pointing to.
@@ -3757,7 +6857,7 @@ int sqlite3BtreeFlags(BtCursor *pCur){
 ** is used for debugging and testing only.
 */
 #ifdef SQLITE_TEST
-int sqlite3BtreePageDump(Btree *pBt, int pgno, int recursive){
+static int btreePageDump(BtShared *pBt, int pgno, int recursive){
   int rc;
   MemPage *pPage;
   int i, j, c;
@@ -3786,12 +6886,13 @@ int sqlite3BtreePageDump(Btree *pBt, int pgno, int recursive){
   pPage->leafData = (c & PTF_LEAFDATA)!=0;
   pPage->leaf = (c & PTF_LEAF)!=0;
   pPage->hasData = !(pPage->zeroData || (!pPage->leaf && pPage->leafData));
+  pPage->prefix = (c & PTF_PREFIX)!=0 && pPage->zeroData && !pPage->intKey;
   nCell = get2byte(&data[hdr+3]);
   printf("PAGE %d:  flags=0x%02x  frag=%d   parent=%d\n", pgno,
     data[hdr], data[hdr+7], 
     (pPage->isInit && pPage->pParent) ? pPage->pParent->pgno : 0);
   assert( hdr == (pgno==1 ? 100 : 0) );
-  idx = hdr + 12 - pPage->leaf*4;
+  idx = hdr + 12 - pPage->leaf*4 + pPage->prefix*2;
   for(i=0; i<nCell; i++){
     CellInfo info;
     Pgno child;
@@ -3812,7 +6913,11 @@ int sqlite3BtreePageDump(Btree *pBt, int pgno, int recursive){
     sz = info.nData;
     if( !pPage->intKey ) sz += info.nKey;
     if( sz>sizeof(payload)-1 ) sz = sizeof(payload)-1;
-    memcpy(payload, &pCell[info.nHeader], sz);
+    if( info.nShared ){
+      prefixKeyRange(pPage, &info, 0, sz, payload);
+    }else{
+      memcpy(payload, &pCell[info.nHeader], sz);
+    }
     for(j=0; j<sz; j++){
       if( payload[j]<0x20 || payload[j]>0x7f ) payload[j] = '.';
     }
@@ -3843,16 +6948,27 @@ int sqlite3BtreePageDump(Btree *pBt, int pgno, int recursive){
   if( recursive && !pPage->leaf ){
     for(i=0; i<nCell; i++){
       unsigned char *pCell = findCell(pPage, i);
-      sqlite3BtreePageDump(pBt, get4byte(pCell), 1);
+      btreePageDump(pBt, get4byte(pCell), 1);
       idx = get2byte(pCell);
     }
-    sqlite3BtreePageDump(pBt, get4byte(&data[hdr+8]), 1);
+    btreePageDump(pBt, get4byte(&data[hdr+8]), 1);
   }
   pPage->isInit = isInit;
   sqlite3pager_unref(data);
   fflush(stdout);
   return SQLITE_OK;
 }
+
+/*
+** Print a disassembly of page pgno of the database on standard output.
+*/
+int sqlite3BtreePageDump(Btree *p, int pgno, int recursive){
+  int rc;
+  btreeEnter(p);
+  rc = btreePageDump(p->pBt, pgno, recursive);
+  btreeLeave(p);
+  return rc;
+}
 #endif
 
 #ifdef SQLITE_TEST
@@ -3877,6 +6993,7 @@ int sqlite3BtreeCursorInfo(BtCursor *pCur, int *aResult){
 
   pageIntegrity(pPage);
   assert( pPage->isInit );
+  computeFreeSpace(pPage);
   aResult[0] = sqlite3pager_pagenumber(pPage->aData);
   assert( aResult[0]==pPage->pgno );
   aResult[1] = pCur->idx;
@@ -3902,27 +7019,175 @@ int sqlite3BtreeCursorInfo(BtCursor *pCur, int *aResult){
 }
 #endif
 
+/*
+** Add the pages of the subtree rooted at page pgno to *pnPage and the
+** bytes in use on them to *pnUsed.  A byte is in use unless it is part
+** of a freeblock, a fragment or the gap between the cell pointers and
+** the cell content.  Overflow pages are counted from the sizes of the
+** cells that spill onto them, without being read.
+*/
+static int fillStatPage(
+  BtShared *pBt,         /* The database file */
+  Pgno pgno,             /* Root of the subtree */
+  MemPage *pParent,      /* Parent of page pgno, or NULL for a root page */
+  int depth,             /* Depth of page pgno in its tree */
+  int *pnPage,           /* Add the number of pages here */
+  i64 *pnUsed            /* Add the bytes in use here */
+){
+  MemPage *pPage = 0;
+  int i, rc;
+  int nOvflSize = pBt->usableSize - 4;
+
+  if( depth>64 ) return SQLITE_CORRUPT;
+  rc = getAndInitPage(pBt, pgno, &pPage, pParent);
+  if( rc==SQLITE_OK ){
+    rc = computeFreeSpace(pPage);
+  }
+  if( rc ){
+    releasePage(pPage);
+    return rc;
+  }
+  *pnPage += 1;
+  *pnUsed += pBt->usableSize - pPage->nFree;
+  for(i=0; rc==SQLITE_OK && i<pPage->nCell; i++){
+    CellInfo info;
+    parseCell(pPage, i, &info);
+    if( info.iOverflow ){
+      i64 nSpill = info.nData - info.nLocal;
+      int nOvfl;
+      if( !pPage->intKey ) nSpill += info.nKey;
+      nOvfl = (nSpill + nOvflSize - 1)/nOvflSize;
+      *pnPage += nOvfl;
+      *pnUsed += nSpill + 4*nOvfl;
+    }
+    if( !pPage->leaf ){
+      rc = fillStatPage(pBt, get4byte(findCell(pPage, i)), pPage, depth+1,
+                        pnPage, pnUsed);
+    }
+  }
+  if( rc==SQLITE_OK && !pPage->leaf ){
+    rc = fillStatPage(pBt, get4byte(&pPage->aData[pPage->hdrOffset+8]),
+                      pPage, depth+1, pnPage, pnUsed);
+  }
+  releasePage(pPage);
+  return rc;
+}
+
+/*
+** Count the pages of table iTable, overflow pages included, and the
+** bytes in use on them.  Write the number of pages into *pnPage and the
+** percentage of their usable space that is in use into *prFill.  A read
+** transaction must be open.
+**
+** A database that has never been written to has no pages at all, not
+** even page 1 with the root of sqlite_master.  A table whose root page
+** is not in the file yet is reported as using no pages.
+*/
+static int btreeFillStat(Btree *p, int iTable, int *pnPage, double *prFill){
+  BtShared *pBt = p->pBt;
+  int nPage = 0;
+  i64 nUsed = 0;
+  int rc = SQLITE_OK;
+
+  if( p->inTrans==TRANS_NONE ){
+    return SQLITE_ERROR;
+  }
+  if( iTable<=sqlite3pager_pagecount(pBt->pPager) ){
+    rc = fillStatPage(pBt, iTable, 0, 0, &nPage, &nUsed);
+  }
+  *pnPage = nPage;
+  *prFill = nPage ? nUsed*100.0/((double)nPage*pBt->usableSize) : 0.0;
+  return rc;
+}
+int sqlite3BtreeFillStat(Btree *p, int iTable, int *pnPage, double *prFill){
+  int rc;
+  btreeEnter(p);
+  rc = btreeFillStat(p, iTable, pnPage, prFill);
+  btreeLeave(p);
+  return rc;
+}
+
 /*
 ** Return the pager associated with a BTree.  This routine is used for
 ** testing and debugging only.
 */
-Pager *sqlite3BtreePager(Btree *pBt){
-  return pBt->pPager;
+Pager *sqlite3BtreePager(Btree *p){
+  return p->pBt->pPager;
 }
 
+/*
+** The largest number of threads an integrity check will use.
+*/
+#ifndef SQLITE_MAX_CHECK_THREAD
+# define SQLITE_MAX_CHECK_THREAD 16
+#endif
+
+typedef struct CheckTask CheckTask;
+typedef struct CheckShare CheckShare;
+
 /*
 ** This structure is passed around through all the sanity checking routines
 ** in order to keep track of some global state information.
+**
+** When the check is spread over several threads, each thread has an
+** IntegrityCk of its own, with its own aPgRef[] bitmap and error message,
+** and all of them point to the same CheckShare.
 */
 typedef struct IntegrityCk IntegrityCk;
 struct IntegrityCk {
-  Btree *pBt;    /* The tree being checked out */
+  BtShared *pBt; /* The tree being checked out */
   Pager *pPager; /* The associated pager.  Also accessible by pBt->pPager */
   int nPage;     /* Number of pages in the database */
-  int *anRef;    /* Number of times each page is referenced */
+  u8 *aPgRef;    /* Bit N is set once page N has been referenced */
   char *zErrMsg; /* An error message.  NULL of no errors seen. */
+  CheckShare *pShare;  /* Shared by the worker threads, or NULL */
+  CheckTask *aTask;    /* Subtrees already checked by worker threads */
+  int nTask;           /* Number of entries in aTask[] */
+  int iTask;           /* Entry of aTask[] most likely to be wanted next */
+};
+
+/*
+** A subtree of the database for a worker thread to check.  The subtrees
+** are the children of the root pages of the tables.  The worker fills
+** in depth and zErrMsg, and the main thread then uses them in place of
+** walking the subtree itself.
+*/
+struct CheckTask {
+  int iPage;           /* Root of the subtree */
+  MemPage *pParent;    /* Root page of the table the subtree belongs to */
+  char zContext[100];  /* Context for error messages about iPage */
+  int depth;           /* Depth of the subtree, as checkTreePage() returns */
+  char *zErrMsg;       /* Errors found in the subtree, or NULL */
+  u8 isUsed;           /* True once the main thread has used the result */
+};
+
+/*
+** State shared by the threads of a parallel integrity check.  Worker
+** threads only read pages, but the pager and the MemPage headers are
+** not safe to use from two threads at once, so every call that fetches,
+** initializes or releases a page is made holding pMutex.  aClaim[] makes
+** sure that no two workers descend into the same tree page, which can
+** only happen if the file is corrupt.
+*/
+struct CheckShare {
+  void *pMutex;        /* Serializes use of the pager */
+  u8 *aClaim;          /* Bit N is set once a worker has taken tree page N */
+  CheckTask *aTask;    /* Subtrees to check */
+  int nTask;           /* Number of entries in aTask[] */
+  int iNext;           /* Next entry of aTask[] for a worker to take */
 };
 
+/*
+** Enter and leave the mutex that guards the pager during a parallel
+** check.  These are no-ops when the check runs on one thread.
+*/
+static void checkEnter(IntegrityCk *pCheck){
+  if( pCheck->pShare ) sqlite3OsMutexEnter(pCheck->pShare->pMutex);
+}
+static void checkLeave(IntegrityCk *pCheck){
+  if( pCheck->pShare ) sqlite3OsMutexLeave(pCheck->pShare->pMutex);
+}
+
 /*
 ** Append a message to the error message string.
 */
@@ -3953,13 +7218,50 @@ static int checkRef(IntegrityCk *pCheck, int iPage, char *zContext){
     checkAppendMsg(pCheck, zContext, zBuf);
     return 1;
   }
-  if( pCheck->anRef[iPage]==1 ){
+  if( pCheck->aPgRef[iPage/8] & (1<<(iPage&7)) ){
     char zBuf[100];
     sprintf(zBuf, "2nd reference to page %d", iPage);
     checkAppendMsg(pCheck, zContext, zBuf);
     return 1;
   }
-  return  (pCheck->anRef[iPage]++)>1;
+  pCheck->aPgRef[iPage/8] |= 1<<(iPage&7);
+  return 0;
+}
+
+/*
+** In an auto-vacuum database, check that the pointer map records page
+** iChild as being of type eType with parent iParent.
+*/
+static void checkPtrmap(
+  IntegrityCk *pCheck,  /* Integrity checking context */
+  int iChild,           /* The page to check */
+  u8 eType,             /* Expected pointer-map type */
+  int iParent,          /* Expected pointer-map parent */
+  char *zContext        /* Context for error messages */
+){
+  u8 ePtrmapType;
+  Pgno iPtrmapParent;
+  char zBuf[100];
+  int rc;
+
+  if( !pCheck->pBt->autoVacuum ) return;
+  if( iChild<3 || iChild>pCheck->nPage
+       || PTRMAP_ISPAGE(pCheck->pBt, (Pgno)iChild) ){
+    return;  /* Reported elsewhere */
+  }
+  checkEnter(pCheck);
+  rc = ptrmapGet(pCheck->pBt, (Pgno)iChild, &ePtrmapType, &iPtrmapParent);
+  checkLeave(pCheck);
+  if( rc!=SQLITE_OK ){
+    sprintf(zBuf, "Failed to read ptrmap key=%d", iChild);
+    checkAppendMsg(pCheck, zContext, zBuf);
+    return;
+  }
+  if( ePtrmapType!=eType || iPtrmapParent!=(Pgno)iParent ){
+    sprintf(zBuf, "Bad ptr map entry key=%d expected=(%d,%d) got=(%d,%d)",
+        iChild, eType, iParent, ePtrmapType, (int)iPtrmapParent);
+    checkAppendMsg(pCheck, zContext, zBuf);
+  }
 }
 
 /*
@@ -3973,7 +7275,7 @@ static void checkList(
   int N,                /* Expected number of pages in the list */
   char *zContext        /* Context for error messages */
 ){
-  int i;
+  int i, rc;
   int expected = N;
   int iFirst = iPage;
   char zMsg[100];
@@ -3986,23 +7288,35 @@ static void checkList(
       break;
     }
     if( checkRef(pCheck, iPage, zContext) ) break;
-    if( sqlite3pager_get(pCheck->pPager, (Pgno)iPage, (void**)&pOvfl) ){
+    checkEnter(pCheck);
+    rc = sqlite3pager_get(pCheck->pPager, (Pgno)iPage, (void**)&pOvfl);
+    checkLeave(pCheck);
+    if( rc ){
       sprintf(zMsg, "failed to get page %d", iPage);
       checkAppendMsg(pCheck, zContext, zMsg);
       break;
     }
     if( isFreeList ){
       int n = get4byte(&pOvfl[4]);
+      checkPtrmap(pCheck, iPage, PTRMAP_FREEPAGE, 0, zContext);
       for(i=0; i<n; i++){
-        checkRef(pCheck, get4byte(&pOvfl[8+i*4]), zContext);
+        int iLeaf = get4byte(&pOvfl[8+i*4]);
+        checkPtrmap(pCheck, iLeaf, PTRMAP_FREEPAGE, 0, zContext);
+        checkRef(pCheck, iLeaf, zContext);
       }
       N -= n;
+    }else if( N>0 ){
+      checkPtrmap(pCheck, get4byte(pOvfl), PTRMAP_OVERFLOW2, iPage, zContext);
     }
     iPage = get4byte(pOvfl);
+    checkEnter(pCheck);
     sqlite3pager_unref(pOvfl);
+    checkLeave(pCheck);
   }
 }
 
+static int checkChild(IntegrityCk*, int, MemPage*, char*);
+
 /*
 ** Do various sanity checks on a single page of a tree.  Return
 ** the tree depth.  Root pages return 0.  Parents of root pages
@@ -4037,11 +7351,11 @@ static int checkTreePage(
   int nCell;
   u8 *data;
   BtCursor cur;
-  Btree *pBt;
+  BtShared *pBt;
   int maxLocal, usableSize;
   char zMsg[100];
   char zContext[100];
-  char hit[MX_PAGE_SIZE];
+  char *hit;
 
   /* Check that the page exists
   */
@@ -4049,18 +7363,32 @@ static int checkTreePage(
   usableSize = pBt->usableSize;
   if( iPage==0 ) return 0;
   if( checkRef(pCheck, iPage, zParentContext) ) return 0;
+  checkEnter(pCheck);
+  if( pCheck->pShare ){
+    u8 *aClaim = pCheck->pShare->aClaim;
+    if( aClaim[iPage/8] & (1<<(iPage&7)) ){
+      /* Another thread has the page.  The merged bitmaps report it. */
+      checkLeave(pCheck);
+      return 0;
+    }
+    aClaim[iPage/8] |= 1<<(iPage&7);
+  }
   if( (rc = getPage(pBt, (Pgno)iPage, &pPage))!=0 ){
+    checkLeave(pCheck);
     sprintf(zMsg, "unable to get the page. error code=%d", rc);
-    checkAppendMsg(pCheck, zContext, zMsg);
+    checkAppendMsg(pCheck, zParentContext, zMsg);
     return 0;
   }
   maxLocal = pPage->leafData ? pBt->maxLeaf : pBt->maxLocal;
-  if( (rc = initPage(pPage, pParent))!=0 ){
-    sprintf(zMsg, "initPage() returns error code %d", rc);
-    checkAppendMsg(pCheck, zContext, zMsg);
+  if( (rc = initPage(pPage, pParent))!=0
+   || (rc = computeFreeSpace(pPage))!=0 ){
     releasePage(pPage);
+    checkLeave(pCheck);
+    sprintf(zMsg, "initPage() returns error code %d", rc);
+    checkAppendMsg(pCheck, zParentContext, zMsg);
     return 0;
   }
+  checkLeave(pCheck);
 
   /* Check out all the cells.
   */
@@ -4080,14 +7408,17 @@ static int checkTreePage(
     if( !pPage->intKey ) sz += info.nKey;
     if( sz>info.nLocal ){
       int nPage = (sz - info.nLocal + usableSize - 5)/(usableSize - 4);
-      checkList(pCheck, 0, get4byte(&pCell[info.iOverflow]),nPage,zContext);
+      Pgno pgnoOvfl = get4byte(&pCell[info.iOverflow]);
+      checkPtrmap(pCheck, pgnoOvfl, PTRMAP_OVERFLOW1, iPage, zContext);
+      checkList(pCheck, 0, pgnoOvfl, nPage, zContext);
     }
 
     /* Check sanity of left child page.
     */
     if( !pPage->leaf ){
       pgno = get4byte(pCell);
-      d2 = checkTreePage(pCheck,pgno,pPage,zContext,0,0,0,0);
+      checkPtrmap(pCheck, pgno, PTRMAP_BTREE, iPage, zContext);
+      d2 = checkChild(pCheck, pgno, pPage, zContext);
       if( i>0 && d2!=depth ){
         checkAppendMsg(pCheck, zContext, "Child page depth differs");
       }
@@ -4097,23 +7428,42 @@ static int checkTreePage(
   if( !pPage->leaf ){
     pgno = get4byte(&pPage->aData[pPage->hdrOffset+8]);
     sprintf(zContext, "On page %d at right child: ", iPage);
-    checkTreePage(pCheck, pgno, pPage, zContext,0,0,0,0);
+    checkPtrmap(pCheck, pgno, PTRMAP_BTREE, iPage, zContext);
+    checkChild(pCheck, pgno, pPage, zContext);
   }
  
   /* Check for complete coverage of the page
   */
+  hit = sqliteMallocRaw( usableSize );
+  if( hit==0 ){
+    checkAppendMsg(pCheck, "Out of memory checking page", 0);
+    checkEnter(pCheck);
+    releasePage(pPage);
+    checkLeave(pCheck);
+    return depth+1;
+  }
   data = pPage->aData;
   hdr = pPage->hdrOffset;
   memset(hit, 0, usableSize);
-  memset(hit, 1, get2byte(&data[hdr+5]));
+  memset(hit, 1, get2byteTop(&data[hdr+5]));
   nCell = get2byte(&data[hdr+3]);
-  cellStart = hdr + 12 - 4*pPage->leaf;
+  cellStart = pPage->cellOffset;
   for(i=0; i<nCell; i++){
     int pc = get2byte(&data[cellStart+i*2]);
     int size = cellSizePtr(pPage, &data[pc]);
     int j;
     for(j=pc+size-1; j>=pc; j--) hit[j]++;
   }
+  if( pPage->prefix && (i = get2byte(&data[cellStart-2]))>0 ){
+    int nRef;
+    if( prefixRefKey(pPage, &nRef)==0 ){
+      sprintf(zMsg, "Reference key out of range on page %d", iPage);
+      checkAppendMsg(pCheck, zMsg, 0);
+    }else{
+      int j;
+      for(j=i+nRef+1; j>=i; j--) hit[j]++;
+    }
+  }
   for(cnt=0, i=get2byte(&data[hdr+1]); i>0 && i<usableSize && cnt<10000; cnt++){
     int size = get2byte(&data[i+2]);
     int j;
@@ -4135,10 +7485,181 @@ static int checkTreePage(
     checkAppendMsg(pCheck, zMsg, 0);
   }
 
+  sqliteFree(hit);
+  checkEnter(pCheck);
   releasePage(pPage);
+  checkLeave(pCheck);
   return depth+1;
 }
 
+/*
+** Check the subtree rooted at page iPage, a child of pParent, and return
+** its depth.  If a worker thread has already checked it, the result and
+** error messages the worker recorded are used instead.
+*/
+static int checkChild(
+  IntegrityCk *pCheck,  /* Context for the sanity check */
+  int iPage,            /* Page number of the child */
+  MemPage *pParent,     /* Parent page */
+  char *zContext        /* Context for error messages */
+){
+  int i;
+  for(i=0; i<pCheck->nTask; i++){
+    CheckTask *p = &pCheck->aTask[(pCheck->iTask+i)%pCheck->nTask];
+    if( p->iPage==iPage && p->pParent==pParent && !p->isUsed ){
+      p->isUsed = 1;
+      pCheck->iTask = (pCheck->iTask+i+1)%pCheck->nTask;
+      if( p->zErrMsg ) checkAppendMsg(pCheck, p->zErrMsg, 0);
+      return p->depth;
+    }
+  }
+  return checkTreePage(pCheck, iPage, pParent, zContext, 0,0,0,0);
+}
+
+/*
+** The body of each thread of a parallel integrity check.  Subtrees are
+** taken from the shared list until none are left.
+*/
+static void *checkWorker(void *pArg){
+  IntegrityCk *pCheck = (IntegrityCk*)pArg;
+  CheckShare *pShare = pCheck->pShare;
+  for(;;){
+    CheckTask *p;
+    sqlite3OsMutexEnter(pShare->pMutex);
+    p = pShare->iNext<pShare->nTask ? &pShare->aTask[pShare->iNext++] : 0;
+    sqlite3OsMutexLeave(pShare->pMutex);
+    if( p==0 ) break;
+    pCheck->zErrMsg = 0;
+    p->depth = checkTreePage(pCheck, p->iPage, p->pParent, p->zContext,
+                             0,0,0,0);
+    p->zErrMsg = pCheck->zErrMsg;
+  }
+  pCheck->zErrMsg = 0;
+  return 0;
+}
+
+/*
+** Check the subtrees beneath the roots in aRoot[] on nThread threads,
+** the calling thread being one of them.  The results are left in
+** pCheck->aTask[] for the walk from the roots that follows, and the page
+** reference bitmaps of the threads are merged into pCheck->aPgRef[].
+** apRoot[] receives the root pages, which must stay referenced until
+** that walk is done.  Nothing is done unless at least one root has
+** children.
+*/
+static void checkParallel(
+  IntegrityCk *pCheck,  /* Context for the sanity check */
+  int *aRoot,           /* Root pages of the tables and indices */
+  int nRoot,            /* Number of entries in aRoot[] */
+  MemPage **apRoot,     /* Write the root pages here */
+  int nThread           /* Number of threads to use */
+){
+  BtShared *pBt = pCheck->pBt;
+  CheckShare sShare;
+  IntegrityCk *aWorker;
+  void *apThread[SQLITE_MAX_CHECK_THREAD];
+  int nByte = pCheck->nPage/8 + 1;
+  int nAlloc = 0;
+  int i, j, k;
+
+  /* Make a list of the children of every interior root page */
+  memset(&sShare, 0, sizeof(sShare));
+  for(i=0; i<nRoot; i++){
+    MemPage *pRoot;
+    apRoot[i] = 0;
+    if( aRoot[i]<=0 || aRoot[i]>pCheck->nPage ) continue;
+    for(j=0; j<i && aRoot[j]!=aRoot[i]; j++){}
+    if( j<i ) continue;
+    if( getPage(pBt, (Pgno)aRoot[i], &pRoot) ) continue;
+    if( initPage(pRoot, 0) ){
+      releasePage(pRoot);
+      continue;
+    }
+    apRoot[i] = pRoot;
+    if( pRoot->leaf ) continue;
+    for(j=0; j<=pRoot->nCell; j++){
+      CheckTask *p;
+      if( sShare.nTask>=nAlloc ){
+        CheckTask *aNew;
+        nAlloc = nAlloc*2 + 64;
+        aNew = sqliteRealloc(sShare.aTask, nAlloc*sizeof(CheckTask));
+        if( aNew==0 ) goto parallel_out;
+        sShare.aTask = aNew;
+      }
+      p = &sShare.aTask[sShare.nTask++];
+      memset(p, 0, sizeof(*p));
+      p->pParent = pRoot;
+      if( j<pRoot->nCell ){
+        p->iPage = get4byte(findCell(pRoot, j));
+        sprintf(p->zContext, "On tree page %d cell %d: ", aRoot[i], j);
+      }else{
+        p->iPage = get4byte(&pRoot->aData[pRoot->hdrOffset+8]);
+        sprintf(p->zContext, "On page %d at right child: ", aRoot[i]);
+      }
+    }
+  }
+  if( sShare.nTask==0 ) goto parallel_out;
+
+  /* Give each thread an IntegrityCk and a bitmap of its own */
+  if( nThread>sShare.nTask ) nThread = sShare.nTask;
+  if( nThread>SQLITE_MAX_CHECK_THREAD ) nThread = SQLITE_MAX_CHECK_THREAD;
+  sShare.pMutex = sqlite3OsMutexAlloc();
+  sShare.aClaim = sqliteMalloc( nByte );
+  aWorker = sqliteMalloc( nThread*(sizeof(IntegrityCk)+nByte) );
+  if( sShare.pMutex==0 || sShare.aClaim==0 || aWorker==0 ){
+    sqliteFree(aWorker);
+    goto parallel_out;
+  }
+  for(i=0; i<nThread; i++){
+    aWorker[i] = *pCheck;
+    aWorker[i].aPgRef = &((u8*)&aWorker[nThread])[i*nByte];
+    memcpy(aWorker[i].aPgRef, pCheck->aPgRef, nByte);
+    aWorker[i].zErrMsg = 0;
+    aWorker[i].pShare = &sShare;
+  }
+
+  /* Run the workers.  The calling thread is the first of them.  If a
+  ** thread cannot be started the others take on its share.
+  */
+  for(i=1; i<nThread; i++){
+    sqlite3OsThreadCreate(&apThread[i], checkWorker, &aWorker[i]);
+  }
+  checkWorker(&aWorker[0]);
+  for(i=1; i<nThread; i++){
+    sqlite3OsThreadJoin(apThread[i]);
+  }
+
+  /* Merge the bitmaps.  A page marked in two of them is referenced from
+  ** two subtrees.
+  */
+  for(j=0; j<nByte; j++){
+    int init = pCheck->aPgRef[j];
+    int acc = init;
+    for(i=0; i<nThread; i++){
+      int fresh = aWorker[i].aPgRef[j] & ~init;
+      int dup = fresh & acc;
+      for(k=0; dup; k++, dup>>=1){
+        if( dup & 1 ){
+          char zBuf[100];
+          sprintf(zBuf, "2nd reference to page %d", j*8+k);
+          checkAppendMsg(pCheck, zBuf, 0);
+        }
+      }
+      acc |= fresh;
+    }
+    pCheck->aPgRef[j] = acc;
+  }
+  pCheck->aTask = sShare.aTask;
+  pCheck->nTask = sShare.nTask;
+  sShare.aTask = 0;
+  sqliteFree(aWorker);
+
+parallel_out:
+  sqliteFree(sShare.aTask);
+  sqliteFree(sShare.aClaim);
+  if( sShare.pMutex ) sqlite3OsMutexFree(sShare.pMutex);
+}
+
 /*
 ** This routine does a complete check of the given BTree file.  aRoot[] is
 ** an array of pages numbers were each page number is the root page of
@@ -4148,11 +7669,22 @@ static int checkTreePage(
 ** amiss, an error message is written into memory obtained from malloc()
 ** and a pointer to that error message is returned.  The calling function
 ** is responsible for freeing the error message when it is done.
+**
+** If nThread is greater than 1, the subtrees beneath the root pages are
+** divided among that many threads, which check them while this one waits
+** and helps.  The walk from the roots then picks up their results, so
+** the same errors are found, in much the same order, either way.
 */
-char *sqlite3BtreeIntegrityCheck(Btree *pBt, int *aRoot, int nRoot){
+static char *btreeIntegrityCheck(
+  BtShared *pBt,
+  int *aRoot,
+  int nRoot,
+  int nThread
+){
   int i;
   int nRef;
   IntegrityCk sCheck;
+  MemPage **apRoot = 0;
 
   nRef = *sqlite3pager_stats(pBt->pPager);
   if( lockBtree(pBt)!=SQLITE_OK ){
@@ -4165,14 +7697,30 @@ char *sqlite3BtreeIntegrityCheck(Btree *pBt, int *aRoot, int nRoot){
     unlockBtreeIfUnused(pBt);
     return 0;
   }
-  sCheck.anRef = sqliteMallocRaw( (sCheck.nPage+1)*sizeof(sCheck.anRef[0]) );
-  for(i=0; i<=sCheck.nPage; i++){ sCheck.anRef[i] = 0; }
-  i = PENDING_BYTE/pBt->pageSize + 1;
+  sCheck.pShare = 0;
+  sCheck.aTask = 0;
+  sCheck.nTask = 0;
+  sCheck.iTask = 0;
+  sCheck.aPgRef = sqliteMalloc( sCheck.nPage/8 + 1 );
+  if( sCheck.aPgRef==0 ){
+    unlockBtreeIfUnused(pBt);
+    return sqliteStrDup("Unable to malloc memory for the page bitmap");
+  }
+  i = PENDING_BYTE_PAGE(pBt);
   if( i<=sCheck.nPage ){
-    sCheck.anRef[i] = 1;
+    sCheck.aPgRef[i/8] |= 1<<(i&7);
   }
   sCheck.zErrMsg = 0;
 
+  /* Have the worker threads check the subtrees beneath the roots
+  */
+  if( nThread>1 && nRoot>0 ){
+    apRoot = sqliteMalloc( nRoot*sizeof(MemPage*) );
+    if( apRoot ){
+      checkParallel(&sCheck, aRoot, nRoot, apRoot, nThread);
+    }
+  }
+
   /* Check the integrity of the freelist
   */
   checkList(&sCheck, 1, get4byte(&pBt->pPage1->aData[32]),
@@ -4182,13 +7730,46 @@ char *sqlite3BtreeIntegrityCheck(Btree *pBt, int *aRoot, int nRoot){
   */
   for(i=0; i<nRoot; i++){
     if( aRoot[i]==0 ) continue;
+    if( aRoot[i]>1 ){
+      checkPtrmap(&sCheck, aRoot[i], PTRMAP_ROOTPAGE, 0,
+                  "List of tree roots: ");
+    }
     checkTreePage(&sCheck, aRoot[i], 0, "List of tree roots: ", 0,0,0,0);
   }
 
-  /* Make sure every page in the file is referenced
+  /* Report anything the workers found beneath a root that the walk above
+  ** did not reach, and let go of the root pages.
+  */
+  for(i=0; i<sCheck.nTask; i++){
+    CheckTask *p = &sCheck.aTask[i];
+    if( p->zErrMsg ){
+      if( !p->isUsed ) checkAppendMsg(&sCheck, p->zErrMsg, 0);
+      sqliteFree(p->zErrMsg);
+    }
+  }
+  sqliteFree(sCheck.aTask);
+  sCheck.aTask = 0;
+  sCheck.nTask = 0;
+  if( apRoot ){
+    for(i=0; i<nRoot; i++){
+      releasePage(apRoot[i]);
+    }
+    sqliteFree(apRoot);
+  }
+
+  /* Make sure every page in the file is referenced, other than the
+  ** pointer-map pages of an auto-vacuum database, which never are.
   */
   for(i=1; i<=sCheck.nPage; i++){
-    if( sCheck.anRef[i]==0 ){
+    if( pBt->autoVacuum && i>1 && PTRMAP_ISPAGE(pBt, (Pgno)i) ){
+      if( sCheck.aPgRef[i/8] & (1<<(i&7)) ){
+        char zBuf[100];
+        sprintf(zBuf, "Pointer map page %d is referenced", i);
+        checkAppendMsg(&sCheck, zBuf, 0);
+      }
+      continue;
+    }
+    if( (sCheck.aPgRef[i/8] & (1<<(i&7)))==0 ){
       char zBuf[100];
       sprintf(zBuf, "Page %d is never used", i);
       checkAppendMsg(&sCheck, zBuf, 0);
@@ -4209,24 +7790,36 @@ char *sqlite3BtreeIntegrityCheck(Btree *pBt, int *aRoot, int nRoot){
 
   /* Clean  up and report errors.
   */
-  sqliteFree(sCheck.anRef);
+  sqliteFree(sCheck.aPgRef);
   return sCheck.zErrMsg;
 }
 
+/*
+** Check the integrity of the database file of handle p, using up to
+** nThread threads.
+*/
+char *sqlite3BtreeIntegrityCheck(Btree *p, int *aRoot, int nRoot, int nThread){
+  char *zErrMsg;
+  btreeEnter(p);
+  zErrMsg = btreeIntegrityCheck(p->pBt, aRoot, nRoot, nThread);
+  btreeLeave(p);
+  return zErrMsg;
+}
+
 /*
 ** Return the full pathname of the underlying database file.
 */
-const char *sqlite3BtreeGetFilename(Btree *pBt){
-  assert( pBt->pPager!=0 );
-  return sqlite3pager_filename(pBt->pPager);
+const char *sqlite3BtreeGetFilename(Btree *p){
+  assert( p->pBt->pPager!=0 );
+  return sqlite3pager_filename(p->pBt->pPager);
 }
 
 /*
 ** Return the pathname of the directory that contains the database file.
 */
-const char *sqlite3BtreeGetDirname(Btree *pBt){
-  assert( pBt->pPager!=0 );
-  return sqlite3pager_dirname(pBt->pPager);
+const char *sqlite3BtreeGetDirname(Btree *p){
+  assert( p->pBt->pPager!=0 );
+  return sqlite3pager_dirname(p->pBt->pPager);
 }
 
 /*
@@ -4234,9 +7827,9 @@ const char *sqlite3BtreeGetDirname(Btree *pBt){
 ** value of this routine is the same regardless of whether the journal file
 ** has been created or not.
 */
-const char *sqlite3BtreeGetJournalname(Btree *pBt){
-  assert( pBt->pPager!=0 );
-  return sqlite3pager_journalname(pBt->pPager);
+const char *sqlite3BtreeGetJournalname(Btree *p){
+  assert( p->pBt->pPager!=0 );
+  return sqlite3pager_journalname(p->pBt->pPager);
 }
 
 /*
@@ -4246,14 +7839,22 @@ const char *sqlite3BtreeGetJournalname(Btree *pBt){
 ** The size of file pBtFrom may be reduced by this operation.
 ** If anything goes wrong, the transaction on pBtFrom is rolled back.
 */
-int sqlite3BtreeCopyFile(Btree *pBtTo, Btree *pBtFrom){
+int sqlite3BtreeCopyFile(Btree *pTo, Btree *pFrom){
+  BtShared *pBtTo = pTo->pBt;
+  BtShared *pBtFrom = pFrom->pBt;
   int rc = SQLITE_OK;
   Pgno i, nPage, nToPage;
 
-  if( pBtTo->inTrans!=TRANS_WRITE || pBtFrom->inTrans!=TRANS_WRITE ){
+  if( pTo->inTrans!=TRANS_WRITE || pFrom->inTrans!=TRANS_WRITE ){
     return SQLITE_ERROR;
   }
-  if( pBtTo->pCursor ) return SQLITE_BUSY;
+  if( pBtTo->pageSize!=pBtFrom->pageSize ) return SQLITE_ERROR;
+  btreeEnter(pTo);
+  btreeEnter(pFrom);
+  if( pBtTo->pCursor ){
+    rc = SQLITE_BUSY;
+    goto copy_file_out;
+  }
   nToPage = sqlite3pager_pagecount(pBtTo->pPager);
   nPage = sqlite3pager_pagecount(pBtFrom->pPager);
   for(i=1; rc==SQLITE_OK && i<=nPage; i++){
@@ -4276,23 +7877,30 @@ int sqlite3BtreeCopyFile(Btree *pBtTo, Btree *pBtFrom){
     rc = sqlite3pager_truncate(pBtTo->pPager, nPage);
   }
   if( rc ){
-    sqlite3BtreeRollback(pBtTo);
+    sqlite3BtreeRollback(pTo);
+  }else{
+    pBtTo->autoVacuum = pBtFrom->autoVacuum;
+    pBtTo->incrVacuum = pBtFrom->incrVacuum;
   }
+
+copy_file_out:
+  btreeLeave(pFrom);
+  btreeLeave(pTo);
   return rc;  
 }
 
 /*
 ** Return non-zero if a transaction is active.
 */
-int sqlite3BtreeIsInTrans(Btree *pBt){
-  return (pBt && (pBt->inTrans==TRANS_WRITE));
+int sqlite3BtreeIsInTrans(Btree *p){
+  return (p && (p->inTrans==TRANS_WRITE));
 }
 
 /*
 ** Return non-zero if a statement transaction is active.
 */
-int sqlite3BtreeIsInStmt(Btree *pBt){
-  return (pBt && pBt->inStmt);
+int sqlite3BtreeIsInStmt(Btree *p){
+  return (p && p->inTrans==TRANS_WRITE && p->pBt->inStmt);
 }
 
 /*
@@ -4308,10 +7916,19 @@ int sqlite3BtreeIsInStmt(Btree *pBt){
 **
 ** Once this is routine has returned, the only thing required to commit
 ** the write-transaction for this database file is to delete the journal.
+**
+** A database in full auto-vacuum mode gives its free pages back to the
+** file system first.
 */
-int sqlite3BtreeSync(Btree *pBt, const char *zMaster){
-  if( pBt->inTrans==TRANS_WRITE ){
-    return sqlite3pager_sync(pBt->pPager, zMaster);
+int sqlite3BtreeSync(Btree *p, const char *zMaster){
+  int rc = SQLITE_OK;
+  if( p->inTrans==TRANS_WRITE ){
+    btreeEnter(p);
+    rc = autoVacuumCommit(p->pBt);
+    if( rc==SQLITE_OK ){
+      rc = sqlite3pager_sync(p->pBt->pPager, zMaster);
+    }
+    btreeLeave(p);
   }
-  return SQLITE_OK;
+  return rc;
 }
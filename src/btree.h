@@ -47,6 +47,13 @@ int sqlite3BtreeOpen(
 int sqlite3BtreeClose(Btree*);
 int sqlite3BtreeSetCacheSize(Btree*,int);
 int sqlite3BtreeSetSafetyLevel(Btree*,int);
+int sqlite3BtreeSetJournalMode(Btree*,int);
+int sqlite3BtreeSetGroupCommit(Btree*,int);
+int sqlite3BtreeSetCachePolicy(Btree*,int);
+i64 sqlite3BtreeSetMmapSize(Btree*,i64);
+int sqlite3BtreeSetReadAhead(Btree*,int);
+int sqlite3BtreeSetPageSize(Btree*,int);
+int sqlite3BtreeSetAutoVacuum(Btree*,int);
 int sqlite3BtreeBeginTrans(Btree*,int,int);
 int sqlite3BtreeCommit(Btree*);
 int sqlite3BtreeRollback(Btree*);
@@ -57,18 +64,26 @@ int sqlite3BtreeCreateTable(Btree*, int*, int flags);
 int sqlite3BtreeIsInTrans(Btree*);
 int sqlite3BtreeIsInStmt(Btree*);
 int sqlite3BtreeSync(Btree*, const char *zMaster);
+int sqlite3BtreeIncrVacuum(Btree*, int nPage);
 
 const char *sqlite3BtreeGetFilename(Btree *);
 const char *sqlite3BtreeGetDirname(Btree *);
 const char *sqlite3BtreeGetJournalname(Btree *);
 int sqlite3BtreeCopyFile(Btree *, Btree *);
 
+/* The auto-vacuum modes of a database.  See sqlite3BtreeSetAutoVacuum().
+*/
+#define BTREE_AUTOVACUUM_NONE  0   /* Free pages stay in the file */
+#define BTREE_AUTOVACUUM_FULL  1   /* Free pages are reclaimed at commit */
+#define BTREE_AUTOVACUUM_INCR  2   /* By sqlite3BtreeIncrVacuum() only */
+
 /* The flags parameter to sqlite3BtreeCreateTable can be the bitwise OR
 ** of the following flags:
 */
 #define BTREE_INTKEY     1    /* Table has only 64-bit signed integer keys */
 #define BTREE_ZERODATA   2    /* Table has keys only - no data */
 #define BTREE_LEAFDATA   4    /* Data stored in leaves only.  Implies INTKEY */
+#define BTREE_PREFIX    16    /* Compress keys.  Only with ZERODATA alone */
 
 int sqlite3BtreeDropTable(Btree*, int);
 int sqlite3BtreeClearTable(Btree*, int);
@@ -89,12 +104,19 @@ void sqlite3BtreeSetCompare(
   int(*)(void*,int,const void*,int,const void*),
   void*
 );
+void sqlite3BtreeSetStreamCompare(
+  BtCursor *,
+  int(*)(void*,BtCursor*,int,int,const void*,int*)
+);
 
 int sqlite3BtreeCloseCursor(BtCursor*);
 int sqlite3BtreeMoveto(BtCursor*, const void *pKey, i64 nKey, int *pRes);
 int sqlite3BtreeDelete(BtCursor*);
 int sqlite3BtreeInsert(BtCursor*, const void *pKey, i64 nKey,
                                   const void *pData, int nData);
+int sqlite3BtreeLoadBegin(BtCursor*);
+int sqlite3BtreeLoadEnd(BtCursor*);
+const void *sqlite3BtreeLoadLastKey(BtCursor*, int *pnKey);
 int sqlite3BtreeFirst(BtCursor*, int *pRes);
 int sqlite3BtreeLast(BtCursor*, int *pRes);
 int sqlite3BtreeNext(BtCursor*, int *pRes);
@@ -107,8 +129,11 @@ const void *sqlite3BtreeKeyFetch(BtCursor*, int *pAmt);
 const void *sqlite3BtreeDataFetch(BtCursor*, int *pAmt);
 int sqlite3BtreeDataSize(BtCursor*, u32 *pSize);
 int sqlite3BtreeData(BtCursor*, u32 offset, u32 amt, void*);
+int sqlite3BtreePutData(BtCursor*, u32 offset, u32 amt, void*);
+void sqlite3BtreeIncrblobCursor(BtCursor*);
 
-char *sqlite3BtreeIntegrityCheck(Btree*, int *aRoot, int nRoot);
+char *sqlite3BtreeIntegrityCheck(Btree*, int *aRoot, int nRoot, int nThread);
+int sqlite3BtreeFillStat(Btree*, int iTable, int *pnPage, double *prFill);
 struct Pager *sqlite3BtreePager(Btree*);
 
 
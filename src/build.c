@@ -150,10 +150,22 @@ Table *sqlite3FindTable(sqlite *db, const char *zName, const char *zDatabase){
 ** The difference between this routine and sqlite3FindTable()
 ** is that this routine leaves an error message in pParse->zErrMsg
 ** where sqlite3FindTable() does not.
+**
+** If the schema cannot be read (for example because another connection
+** sharing the same cache holds a write lock on sqlite_master) the error
+** from sqlite3ReadSchema() is left in pParse->rc, so that the caller sees
+** SQLITE_LOCKED rather than "no such table".
 */
 Table *sqlite3LocateTable(Parse *pParse, const char *zName, const char *zDbase){
   Table *p;
+  int rc;
 
+  rc = sqlite3ReadSchema(pParse->db, &pParse->zErrMsg);
+  if( rc!=SQLITE_OK ){
+    pParse->rc = rc;
+    pParse->nErr++;
+    return 0;
+  }
   p = sqlite3FindTable(pParse->db, zName, zDbase);
   if( p==0 ){
     if( zDbase ){
@@ -2140,7 +2152,9 @@ void sqlite3CreateIndex(
     v = sqlite3GetVdbe(pParse);
     if( v==0 ) goto exit_create_index;
     if( pTblName!=0 ){
-      sqlite3BeginWriteOperation(pParse, 0, iDb);
+      /* A statement journal is needed so that an index left half built
+      ** by a uniqueness failure can be undone inside a transaction. */
+      sqlite3BeginWriteOperation(pParse, 1, iDb);
       sqlite3OpenMasterTable(v, iDb);
     }
     sqlite3VdbeAddOp(v, OP_NewRecno, 0, 0);
@@ -2180,11 +2194,24 @@ void sqlite3CreateIndex(
       sqlite3VdbeAddOp(v, OP_Rewind, 2, lbl2);
       lbl1 = sqlite3VdbeCurrentAddr(v);
       sqlite3GenerateIndexKey(v, pIndex, 2);
-      sqlite3VdbeOp3(v, OP_IdxPut, 1, pIndex->onError!=OE_None,
-                      "indexed columns are not unique", P3_STATIC);
+      sqlite3VdbeAddOp(v, OP_Dup, 0, 0);
+      sqlite3VdbeOp3(v, OP_SortPut, 0, 0, (char*)&pIndex->keyInfo, P3_KEYINFO);
       sqlite3VdbeAddOp(v, OP_Next, 2, lbl1);
       sqlite3VdbeResolveLabel(v, lbl2);
       sqlite3VdbeAddOp(v, OP_Close, 2, 0);
+
+      /* The keys are sorted into index order and then loaded into the
+      ** new index, which is built from the leaves up with each page
+      ** written just once. */
+      sqlite3VdbeOp3(v, OP_Sort, 0, 0, (char*)&pIndex->keyInfo, P3_KEYINFO);
+      sqlite3VdbeAddOp(v, OP_BulkLoad, 1, 1);
+      lbl2 = sqlite3VdbeMakeLabel(v);
+      lbl1 = sqlite3VdbeAddOp(v, OP_SortNext, 0, lbl2);
+      sqlite3VdbeOp3(v, OP_IdxPut, 1, pIndex->onError!=OE_None,
+                      "indexed columns are not unique", P3_STATIC);
+      sqlite3VdbeAddOp(v, OP_Goto, 0, lbl1);
+      sqlite3VdbeResolveLabel(v, lbl2);
+      sqlite3VdbeAddOp(v, OP_BulkLoad, 1, 0);
       sqlite3VdbeAddOp(v, OP_Close, 1, 0);
     }
     if( pTblName!=0 ){
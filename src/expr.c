@@ -1126,6 +1126,62 @@ static void codeInteger(Vdbe *v, const char *z, int n){
   }
 }
 
+/*
+** If pExpr is a numeric literal, or the negation of one, return a new
+** sqlite3_value holding its value.  Otherwise return NULL.
+*/
+static sqlite3_value *numericLiteral(Expr *pExpr){
+  sqlite3_value *pVal;
+  char *z;
+  Token *p;
+  int neg = 0;
+  if( pExpr->op==TK_UMINUS ){
+    pExpr = pExpr->pLeft;
+    neg = 1;
+  }
+  if( pExpr==0 || (pExpr->op!=TK_INTEGER && pExpr->op!=TK_FLOAT) ){
+    return 0;
+  }
+  p = &pExpr->token;
+  z = sqlite3MPrintf("%s%.*s", neg ? "-" : "", p->n, p->z);
+  if( z==0 ) return 0;
+  pVal = sqlite3ValueNumber(z, strlen(z), pExpr->op==TK_FLOAT);
+  sqliteFree(z);
+  return pVal;
+}
+
+/*
+** Code the right-hand operand pRight of the binary operator op, then the
+** operator itself with operands p1 and p2.  Return the address of the
+** operator.  pColl is the collating sequence of a comparison, or NULL.
+**
+** A numeric literal operand is not pushed onto the stack.  It becomes P3
+** of the operator instead, which saves an instruction and a stack entry
+** each time the operator runs.  Only the right-hand operand is handled
+** this way.  The left-hand operand, and any right-hand operand that is
+** not a literal, still goes through the stack.  Comparisons never need a collating
+** sequence to compare a number.  A comparison with TEXT affinity turns
+** a number into text though, so its literal is still pushed.
+*/
+static int codeBinaryOp(
+  Parse *pParse,      /* Parsing context */
+  int op,             /* The operator: OP_Add, OP_Lt, etc. */
+  int p1, int p2,     /* P1 and P2 of the operator */
+  Expr *pRight,       /* The right-hand operand */
+  CollSeq *pColl      /* Collating sequence of a comparison, or NULL */
+){
+  Vdbe *v = pParse->pVdbe;
+  sqlite3_value *pVal = 0;
+  if( ((p1>>8)&0xFF)!=SQLITE_AFF_TEXT ){
+    pVal = numericLiteral(pRight);
+  }
+  if( pVal ){
+    return sqlite3VdbeOp3(v, op, p1, p2, (char*)pVal, P3_MEM);
+  }
+  sqlite3ExprCode(pParse, pRight);
+  return sqlite3VdbeOp3(v, op, p1, p2, (void*)pColl, P3_COLLSEQ);
+}
+
 /*
 ** Generate code into the current Vdbe to evaluate the given
 ** expression and leave the result on the top of stack.
@@ -1205,19 +1261,22 @@ void sqlite3ExprCode(Parse *pParse, Expr *pExpr){
       int p1 = binaryCompareP1(pExpr->pLeft, pExpr->pRight, 0);
       CollSeq *p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pRight);
       sqlite3ExprCode(pParse, pExpr->pLeft);
-      sqlite3ExprCode(pParse, pExpr->pRight);
-      sqlite3VdbeOp3(v, op, p1, 0, (void *)p3, P3_COLLSEQ);
+      codeBinaryOp(pParse, op, p1, 0, pExpr->pRight, p3);
       break;
     }
-    case TK_AND:
-    case TK_OR:
     case TK_PLUS:
     case TK_STAR:
     case TK_MINUS:
     case TK_REM:
-    case TK_BITAND:
-    case TK_BITOR:
     case TK_SLASH: {
+      sqlite3ExprCode(pParse, pExpr->pLeft);
+      codeBinaryOp(pParse, op, 0, 0, pExpr->pRight, 0);
+      break;
+    }
+    case TK_AND:
+    case TK_OR:
+    case TK_BITAND:
+    case TK_BITOR: {
       sqlite3ExprCode(pParse, pExpr->pLeft);
       sqlite3ExprCode(pParse, pExpr->pRight);
       sqlite3VdbeAddOp(v, op, 0, 0);
@@ -1340,15 +1399,13 @@ void sqlite3ExprCode(Parse *pParse, Expr *pExpr){
       CollSeq *p3;
       sqlite3ExprCode(pParse, pExpr->pLeft);
       sqlite3VdbeAddOp(v, OP_Dup, 0, 0);
-      sqlite3ExprCode(pParse, pExpr->pList->a[0].pExpr);
       p1 = binaryCompareP1(pExpr->pLeft, pExpr->pList->a[0].pExpr, 0);
       p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pList->a[0].pExpr);
-      sqlite3VdbeOp3(v, OP_Ge, p1, 0, (void *)p3, P3_COLLSEQ);
+      codeBinaryOp(pParse, OP_Ge, p1, 0, pExpr->pList->a[0].pExpr, p3);
       sqlite3VdbeAddOp(v, OP_Pull, 1, 0);
-      sqlite3ExprCode(pParse, pExpr->pList->a[1].pExpr);
       p1 = binaryCompareP1(pExpr->pLeft, pExpr->pList->a[1].pExpr, 0);
       p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pList->a[1].pExpr);
-      sqlite3VdbeOp3(v, OP_Le, p1, 0, (void *)p3, P3_COLLSEQ);
+      codeBinaryOp(pParse, OP_Le, p1, 0, pExpr->pList->a[1].pExpr, p3);
       sqlite3VdbeAddOp(v, OP_And, 0, 0);
       break;
     }
@@ -1494,8 +1551,7 @@ void sqlite3ExprIfTrue(Parse *pParse, Expr *pExpr, int dest, int jumpIfNull){
       int p1 = binaryCompareP1(pExpr->pLeft, pExpr->pRight, jumpIfNull);
       CollSeq *p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pRight);
       sqlite3ExprCode(pParse, pExpr->pLeft);
-      sqlite3ExprCode(pParse, pExpr->pRight);
-      sqlite3VdbeOp3(v, op, p1, dest, (void *)p3, P3_COLLSEQ);
+      codeBinaryOp(pParse, op, p1, dest, pExpr->pRight, p3);
       break;
     }
     case TK_ISNULL:
@@ -1516,15 +1572,13 @@ void sqlite3ExprIfTrue(Parse *pParse, Expr *pExpr, int dest, int jumpIfNull){
       CollSeq *p3;
       sqlite3ExprCode(pParse, pExpr->pLeft);
       sqlite3VdbeAddOp(v, OP_Dup, 0, 0);
-      sqlite3ExprCode(pParse, pExpr->pList->a[0].pExpr);
       p1 = binaryCompareP1(pExpr->pLeft, pExpr->pList->a[0].pExpr, !jumpIfNull);
       p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pList->a[0].pExpr);
-      addr = sqlite3VdbeOp3(v, OP_Lt, p1, 0, (void *)p3, P3_COLLSEQ);
+      addr = codeBinaryOp(pParse, OP_Lt, p1, 0, pExpr->pList->a[0].pExpr, p3);
 
-      sqlite3ExprCode(pParse, pExpr->pList->a[1].pExpr);
       p1 = binaryCompareP1(pExpr->pLeft, pExpr->pList->a[1].pExpr, jumpIfNull);
       p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pList->a[1].pExpr);
-      sqlite3VdbeOp3(v, OP_Le, p1, dest, (void *)p3, P3_COLLSEQ);
+      codeBinaryOp(pParse, OP_Le, p1, dest, pExpr->pList->a[1].pExpr, p3);
 
       sqlite3VdbeAddOp(v, OP_Integer, 0, 0);
       sqlite3VdbeChangeP2(v, addr, sqlite3VdbeCurrentAddr(v));
@@ -1588,8 +1642,7 @@ void sqlite3ExprIfFalse(Parse *pParse, Expr *pExpr, int dest, int jumpIfNull){
       int p1 = binaryCompareP1(pExpr->pLeft, pExpr->pRight, jumpIfNull);
       CollSeq *p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pRight);
       sqlite3ExprCode(pParse, pExpr->pLeft);
-      sqlite3ExprCode(pParse, pExpr->pRight);
-      sqlite3VdbeOp3(v, op, p1, dest, (void *)p3, P3_COLLSEQ);
+      codeBinaryOp(pParse, op, p1, dest, pExpr->pRight, p3);
       break;
     }
     case TK_ISNULL:
@@ -1610,17 +1663,15 @@ void sqlite3ExprIfFalse(Parse *pParse, Expr *pExpr, int dest, int jumpIfNull){
       CollSeq *p3;
       sqlite3ExprCode(pParse, pExpr->pLeft);
       sqlite3VdbeAddOp(v, OP_Dup, 0, 0);
-      sqlite3ExprCode(pParse, pExpr->pList->a[0].pExpr);
-      addr = sqlite3VdbeCurrentAddr(v);
       p1 = binaryCompareP1(pExpr->pLeft, pExpr->pList->a[0].pExpr, !jumpIfNull);
       p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pList->a[0].pExpr);
-      sqlite3VdbeOp3(v, OP_Ge, p1, addr+3, (void *)p3, P3_COLLSEQ);
+      addr = codeBinaryOp(pParse, OP_Ge, p1, 0, pExpr->pList->a[0].pExpr, p3);
       sqlite3VdbeAddOp(v, OP_Pop, 1, 0);
       sqlite3VdbeAddOp(v, OP_Goto, 0, dest);
-      sqlite3ExprCode(pParse, pExpr->pList->a[1].pExpr);
+      sqlite3VdbeChangeP2(v, addr, addr+3);
       p1 = binaryCompareP1(pExpr->pLeft, pExpr->pList->a[1].pExpr, jumpIfNull);
       p3 = binaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pList->a[1].pExpr);
-      sqlite3VdbeOp3(v, OP_Gt, p1, dest, (void *)p3, P3_COLLSEQ);
+      codeBinaryOp(pParse, OP_Gt, p1, dest, pExpr->pList->a[1].pExpr, p3);
       break;
     }
     default: {
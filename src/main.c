@@ -1137,6 +1137,9 @@ static int openDatabase(
   }else{
     db->nMaster = -1;   /* Size of master journal filename initially unknown */
   }
+  db->nextAutovac = -1;
+  db->nCheckThread = 1;
+  db->nSortMem = SQLITE_DEFAULT_SORT_MEMORY;
   rc = sqlite3BtreeFactory(db, zFilename, 0, MAX_PAGES, &db->aDb[0].pBt);
   if( rc!=SQLITE_OK ){
     sqlite3Error(db, rc, 0);
@@ -165,15 +165,27 @@ int sqlite3OsClose(OsFile*);
 int sqlite3OsRead(OsFile*, void*, int amt);
 int sqlite3OsWrite(OsFile*, const void*, int amt);
 int sqlite3OsSeek(OsFile*, off_t offset);
+int sqlite3OsReadAt(OsFile*, void*, int amt, off_t offset);
+int sqlite3OsWriteAt(OsFile*, const void*, int amt, off_t offset);
+int sqlite3OsWritevAt(OsFile*, void**, const int*, int nBuf, off_t offset);
 int sqlite3OsSync(OsFile*);
 int sqlite3OsTruncate(OsFile*, off_t size);
 int sqlite3OsFileSize(OsFile*, off_t *pSize);
+int sqlite3OsMmap(OsFile*, off_t nByte, void **ppMap);
+int sqlite3OsMunmap(void*, off_t nByte);
+int sqlite3OsReadAhead(OsFile*, off_t offset, off_t nByte);
 int sqlite3OsRandomSeed(char*);
 int sqlite3OsSleep(int ms);
 int sqlite3OsCurrentTime(double*);
 int sqlite3OsFileModTime(OsFile*, double*);
 void sqlite3OsEnterMutex(void);
 void sqlite3OsLeaveMutex(void);
+void *sqlite3OsMutexAlloc(void);
+void sqlite3OsMutexFree(void*);
+void sqlite3OsMutexEnter(void*);
+void sqlite3OsMutexLeave(void*);
+int sqlite3OsThreadCreate(void**, void*(*)(void*), void*);
+void *sqlite3OsThreadJoin(void*);
 char *sqlite3OsFullPathname(const char*);
 int sqlite3OsLock(OsFile*, int);
 int sqlite3OsUnlock(OsFile*, int);
@@ -20,6 +20,16 @@
 #include <time.h>
 #include <errno.h>
 #include <unistd.h>
+#ifndef SQLITE_DISABLE_MMAP
+# include <sys/mman.h>
+#endif
+#ifndef SQLITE_DISABLE_PREAD
+# include <sys/uio.h>
+# include <limits.h>
+#endif
+#ifndef IOV_MAX
+# define IOV_MAX 16
+#endif
 #ifndef O_LARGEFILE
 # define O_LARGEFILE 0
 #endif
@@ -584,6 +594,130 @@ int sqlite3OsWrite(OsFile *id, const void *pBuf, int amt){
   return SQLITE_OK;
 }
 
+/*
+** Read amt bytes starting at byte offset of a file into a buffer.  This
+** does the work of sqlite3OsSeek() followed by sqlite3OsRead() in a single
+** system call and does not move the file's read/write pointer.  Return
+** SQLITE_OK if all bytes were read and SQLITE_IOERR otherwise.
+*/
+int sqlite3OsReadAt(OsFile *id, void *pBuf, int amt, off_t offset){
+  int got;
+  SimulateIOError(SQLITE_IOERR);
+  SEEK(offset/1024 + 1);
+  TIMER_START;
+#ifndef SQLITE_DISABLE_PREAD
+  got = pread(id->h, pBuf, amt, offset);
+#else
+  lseek(id->h, offset, SEEK_SET);
+  got = read(id->h, pBuf, amt);
+#endif
+  TIMER_END;
+  TRACE4("READ    %-3d %7d %d\n", id->h, last_page, elapse);
+  SEEK(0);
+  if( got==amt ){
+    return SQLITE_OK;
+  }else{
+    return SQLITE_IOERR;
+  }
+}
+
+/*
+** Write amt bytes from a buffer into a file starting at byte offset,
+** without moving the file's read/write pointer.  Return SQLITE_OK on
+** success or some other error code on failure.
+*/
+int sqlite3OsWriteAt(OsFile *id, const void *pBuf, int amt, off_t offset){
+  int wrote = 0;
+  SimulateIOError(SQLITE_IOERR);
+  SEEK(offset/1024 + 1);
+  TIMER_START;
+#ifndef SQLITE_DISABLE_PREAD
+  while( amt>0 && (wrote = pwrite(id->h, pBuf, amt, offset))>0 ){
+    amt -= wrote;
+    offset += wrote;
+    pBuf = &((char*)pBuf)[wrote];
+  }
+#else
+  lseek(id->h, offset, SEEK_SET);
+  while( amt>0 && (wrote = write(id->h, pBuf, amt))>0 ){
+    amt -= wrote;
+    pBuf = &((char*)pBuf)[wrote];
+  }
+#endif
+  TIMER_END;
+  TRACE4("WRITE   %-3d %7d %d\n", id->h, last_page, elapse);
+  SEEK(0);
+  if( amt>0 ){
+    return SQLITE_FULL;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Write nBuf buffers into a file as a single contiguous run starting at
+** byte offset.  Buffer i is apBuf[i] and holds anBuf[i] bytes.  As many
+** buffers as possible are handed to each pwritev() call, so that a run
+** of pages costs one system call instead of one per page.  The file's
+** read/write pointer is not moved.  Return SQLITE_OK on success or some
+** other error code on failure.
+*/
+int sqlite3OsWritevAt(
+  OsFile *id,               /* File to write to */
+  void **apBuf,             /* Buffers to write, in file order */
+  const int *anBuf,         /* Size of each buffer in bytes */
+  int nBuf,                 /* Number of buffers */
+  off_t offset              /* Offset of the first byte to write */
+){
+#ifndef SQLITE_DISABLE_PREAD
+  struct iovec aIov[IOV_MAX];
+  SimulateIOError(SQLITE_IOERR);
+  while( nBuf>0 ){
+    int i, n;
+    int total = 0;
+    int wrote;
+    n = nBuf<IOV_MAX ? nBuf : IOV_MAX;
+    for(i=0; i<n; i++){
+      aIov[i].iov_base = apBuf[i];
+      aIov[i].iov_len = anBuf[i];
+      total += anBuf[i];
+    }
+    SEEK(offset/1024 + 1);
+    TIMER_START;
+    wrote = pwritev(id->h, aIov, n, offset);
+    TIMER_END;
+    TRACE5("WRITEV  %-3d %7d %d %d\n", id->h, last_page, n, elapse);
+    SEEK(0);
+    if( wrote<total ){
+      /* A short write.  Finish off the remainder one buffer at a time. */
+      int done = wrote>0 ? wrote : 0;
+      int iOfst = 0;
+      for(i=0; i<n; i++){
+        if( iOfst+anBuf[i]>done ){
+          int skip = done>iOfst ? done-iOfst : 0;
+          int rc = sqlite3OsWriteAt(id, &((char*)apBuf[i])[skip],
+                                    anBuf[i]-skip, offset+iOfst+skip);
+          if( rc!=SQLITE_OK ) return rc;
+        }
+        iOfst += anBuf[i];
+      }
+    }
+    offset += total;
+    apBuf += n;
+    anBuf += n;
+    nBuf -= n;
+  }
+  return SQLITE_OK;
+#else
+  int i;
+  for(i=0; i<nBuf; i++){
+    int rc = sqlite3OsWriteAt(id, apBuf[i], anBuf[i], offset);
+    if( rc!=SQLITE_OK ) return rc;
+    offset += anBuf[i];
+  }
+  return SQLITE_OK;
+#endif
+}
+
 /*
 ** Move the read/write pointer in a file.
 */
@@ -658,6 +792,60 @@ int sqlite3OsFileSize(OsFile *id, off_t *pSize){
   return SQLITE_OK;
 }
 
+/*
+** Map the first nByte bytes of a file into memory for reading.  The
+** mapping may extend past the current end of the file, but the caller
+** must never touch bytes that lie beyond the end of the file.  Write
+** *ppMap to point to the start of the mapping and return SQLITE_OK on
+** success.  If memory mapping is not available or fails, *ppMap is set
+** to NULL and some other error code is returned.
+*/
+int sqlite3OsMmap(OsFile *id, off_t nByte, void **ppMap){
+#ifndef SQLITE_DISABLE_MMAP
+  void *p;
+  SimulateIOError(SQLITE_IOERR);
+  p = mmap(0, nByte, PROT_READ, MAP_SHARED, id->h, 0);
+  if( p==MAP_FAILED ){
+    *ppMap = 0;
+    return SQLITE_IOERR;
+  }
+  TRACE3("MMAP    %-3d %lld\n", id->h, (long long)nByte);
+  *ppMap = p;
+  return SQLITE_OK;
+#else
+  *ppMap = 0;
+  return SQLITE_ERROR;
+#endif
+}
+
+/*
+** Release a mapping obtained from sqlite3OsMmap().
+*/
+int sqlite3OsMunmap(void *pMap, off_t nByte){
+#ifndef SQLITE_DISABLE_MMAP
+  TRACE2("MUNMAP  %lld\n", (long long)nByte);
+  if( munmap(pMap, nByte)!=0 ){
+    return SQLITE_IOERR;
+  }
+#endif
+  return SQLITE_OK;
+}
+
+/*
+** Advise the operating system that nByte bytes of the file starting at
+** the given offset will be read soon, so that it can start reading them
+** into its cache in the background.  This is only a hint.  It never
+** blocks waiting for the data and errors are ignored.
+*/
+int sqlite3OsReadAhead(OsFile *id, off_t offset, off_t nByte){
+#if defined(POSIX_FADV_WILLNEED) && !defined(SQLITE_DISABLE_READAHEAD)
+  TRACE4("READAHEAD %-3d %lld %lld\n", id->h, (long long)offset,
+         (long long)nByte);
+  posix_fadvise(id->h, offset, nByte, POSIX_FADV_WILLNEED);
+#endif
+  return SQLITE_OK;
+}
+
 /*
 ** This routine checks if there is a RESERVED lock held on the specified
 ** file by this or any other process. If such a lock is held, return
@@ -1000,6 +1188,92 @@ void sqlite3OsLeaveMutex(){
 #endif
 }
 
+/*
+** The following routines create, destroy, acquire and release a
+** recursive mutex that is separate from the single global mutex above.
+** They are used to serialize access to structures, such as a page cache
+** shared by several database connections, that are held for longer than
+** the global mutex should be.  A thread may acquire the same mutex more
+** than once provided that it releases it the same number of times.
+**
+** When SQLite is not built to be threadsafe, sqlite3OsMutexAlloc()
+** returns a non-NULL placeholder and the other routines are no-ops.
+*/
+void *sqlite3OsMutexAlloc(void){
+#ifdef SQLITE_UNIX_THREADS
+  pthread_mutexattr_t attr;
+  pthread_mutex_t *pMutex = sqliteMallocRaw( sizeof(*pMutex) );
+  if( pMutex==0 ) return 0;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(pMutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  return pMutex;
+#else
+  static int notUsed;
+  return &notUsed;
+#endif
+}
+void sqlite3OsMutexFree(void *pMutex){
+#ifdef SQLITE_UNIX_THREADS
+  if( pMutex ){
+    pthread_mutex_destroy((pthread_mutex_t*)pMutex);
+    sqliteFree(pMutex);
+  }
+#endif
+}
+void sqlite3OsMutexEnter(void *pMutex){
+#ifdef SQLITE_UNIX_THREADS
+  pthread_mutex_lock((pthread_mutex_t*)pMutex);
+#endif
+}
+void sqlite3OsMutexLeave(void *pMutex){
+#ifdef SQLITE_UNIX_THREADS
+  pthread_mutex_unlock((pthread_mutex_t*)pMutex);
+#endif
+}
+
+/*
+** Start a new thread that runs xTask(pArg) and write a handle for it
+** to *ppThread.  The handle must be passed to sqlite3OsThreadJoin(),
+** which waits for the thread to finish and returns the value xTask()
+** returned.
+**
+** SQLITE_ERROR is returned if the thread cannot be started, and always
+** when SQLite is not built to be threadsafe.  Callers are expected to
+** do the work themselves in that case.
+*/
+int sqlite3OsThreadCreate(
+  void **ppThread,
+  void *(*xTask)(void*),
+  void *pArg
+){
+#ifdef SQLITE_UNIX_THREADS
+  pthread_t *pThread = sqliteMallocRaw( sizeof(*pThread) );
+  *ppThread = 0;
+  if( pThread==0 ) return SQLITE_NOMEM;
+  if( pthread_create(pThread, 0, xTask, pArg)!=0 ){
+    sqliteFree(pThread);
+    return SQLITE_ERROR;
+  }
+  *ppThread = pThread;
+  return SQLITE_OK;
+#else
+  *ppThread = 0;
+  return SQLITE_ERROR;
+#endif
+}
+void *sqlite3OsThreadJoin(void *pThread){
+  void *pResult = 0;
+#ifdef SQLITE_UNIX_THREADS
+  if( pThread ){
+    pthread_join(*(pthread_t*)pThread, &pResult);
+    sqliteFree(pThread);
+  }
+#endif
+  return pResult;
+}
+
 /*
 ** Turn a relative pathname into a full pathname.  Return a pointer
 ** to the full pathname stored in space obtained from sqliteMalloc().
@@ -265,6 +265,50 @@ int sqlite3OsWrite(OsFile *id, const void *pBuf, int amt){
   return SQLITE_OK;
 }
 
+/*
+** Read amt bytes starting at byte offset of a file into a buffer.
+** Return SQLITE_OK if all bytes were read and SQLITE_IOERR otherwise.
+*/
+int sqlite3OsReadAt(OsFile *id, void *pBuf, int amt, off_t offset){
+  int rc = sqlite3OsSeek(id, offset);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3OsRead(id, pBuf, amt);
+  }
+  return rc;
+}
+
+/*
+** Write amt bytes from a buffer into a file starting at byte offset.
+** Return SQLITE_OK on success or some other error code on failure.
+*/
+int sqlite3OsWriteAt(OsFile *id, const void *pBuf, int amt, off_t offset){
+  int rc = sqlite3OsSeek(id, offset);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3OsWrite(id, pBuf, amt);
+  }
+  return rc;
+}
+
+/*
+** Write nBuf buffers into a file as a single contiguous run starting at
+** byte offset.  Buffer i is apBuf[i] and holds anBuf[i] bytes.  Return
+** SQLITE_OK on success or some other error code on failure.
+*/
+int sqlite3OsWritevAt(
+  OsFile *id,
+  void **apBuf,
+  const int *anBuf,
+  int nBuf,
+  off_t offset
+){
+  int i;
+  int rc = sqlite3OsSeek(id, offset);
+  for(i=0; rc==SQLITE_OK && i<nBuf; i++){
+    rc = sqlite3OsWrite(id, apBuf[i], anBuf[i]);
+  }
+  return rc;
+}
+
 /*
 ** Move the read/write pointer in a file.
 */
@@ -322,6 +366,31 @@ int sqlite3OsFileSize(OsFile *id, off_t *pSize){
   return SQLITE_OK;
 }
 
+/*
+** Memory mapping of database files is not implemented for windows.
+** The pager falls back to ordinary reads when this routine fails.
+*/
+int sqlite3OsMmap(OsFile *id, off_t nByte, void **ppMap){
+  *ppMap = 0;
+  return SQLITE_ERROR;
+}
+
+/*
+** Release a mapping obtained from sqlite3OsMmap().  Since that routine
+** never succeeds on windows, there is nothing to do.
+*/
+int sqlite3OsMunmap(void *pMap, off_t nByte){
+  return SQLITE_OK;
+}
+
+/*
+** Advise the operating system that part of the file will be read soon.
+** There is no cheap way to do this on windows, so it does nothing.
+*/
+int sqlite3OsReadAhead(OsFile *id, off_t offset, off_t nByte){
+  return SQLITE_OK;
+}
+
 /*
 ** Return true (non-zero) if we are running under WinNT, Win2K or WinXP.
 ** Return false (zero) for Win95, Win98, or WinME.
@@ -637,6 +706,113 @@ void sqlite3OsLeaveMutex(){
 #endif
 }
 
+/*
+** The following routines create, destroy, acquire and release a
+** recursive mutex that is separate from the single global mutex above.
+** They are used to serialize access to structures, such as a page cache
+** shared by several database connections, that are held for longer than
+** the global mutex should be.  A critical section may be entered more
+** than once by the thread that owns it.
+**
+** When SQLite is not built to be threadsafe, sqlite3OsMutexAlloc()
+** returns a non-NULL placeholder and the other routines are no-ops.
+*/
+void *sqlite3OsMutexAlloc(void){
+#ifdef SQLITE_W32_THREADS
+  CRITICAL_SECTION *pCs = sqliteMallocRaw( sizeof(*pCs) );
+  if( pCs==0 ) return 0;
+  InitializeCriticalSection(pCs);
+  return pCs;
+#else
+  static int notUsed;
+  return &notUsed;
+#endif
+}
+void sqlite3OsMutexFree(void *pMutex){
+#ifdef SQLITE_W32_THREADS
+  if( pMutex ){
+    DeleteCriticalSection((CRITICAL_SECTION*)pMutex);
+    sqliteFree(pMutex);
+  }
+#endif
+}
+void sqlite3OsMutexEnter(void *pMutex){
+#ifdef SQLITE_W32_THREADS
+  EnterCriticalSection((CRITICAL_SECTION*)pMutex);
+#endif
+}
+void sqlite3OsMutexLeave(void *pMutex){
+#ifdef SQLITE_W32_THREADS
+  LeaveCriticalSection((CRITICAL_SECTION*)pMutex);
+#endif
+}
+
+#ifdef SQLITE_W32_THREADS
+/*
+** A thread started by sqlite3OsThreadCreate().  Win32 thread routines
+** have a different signature, so w32ThreadMain() calls xTask() and
+** keeps what it returns for sqlite3OsThreadJoin().
+*/
+typedef struct W32Thread W32Thread;
+struct W32Thread {
+  HANDLE h;                 /* The thread */
+  void *(*xTask)(void*);    /* Routine the thread runs */
+  void *pArg;               /* Argument to xTask() */
+  void *pResult;            /* Value returned by xTask() */
+};
+static DWORD WINAPI w32ThreadMain(LPVOID pData){
+  W32Thread *p = (W32Thread*)pData;
+  p->pResult = p->xTask(p->pArg);
+  return 0;
+}
+#endif
+
+/*
+** Start a new thread that runs xTask(pArg) and write a handle for it
+** to *ppThread.  SQLITE_ERROR is returned if the thread cannot be
+** started, and always when SQLite is not built to be threadsafe.
+** sqlite3OsThreadJoin() waits for the thread and returns the value
+** that xTask() returned.
+*/
+int sqlite3OsThreadCreate(
+  void **ppThread,
+  void *(*xTask)(void*),
+  void *pArg
+){
+#ifdef SQLITE_W32_THREADS
+  DWORD id;
+  W32Thread *p = sqliteMallocRaw( sizeof(*p) );
+  *ppThread = 0;
+  if( p==0 ) return SQLITE_NOMEM;
+  p->xTask = xTask;
+  p->pArg = pArg;
+  p->pResult = 0;
+  p->h = CreateThread(0, 0, w32ThreadMain, p, 0, &id);
+  if( p->h==0 ){
+    sqliteFree(p);
+    return SQLITE_ERROR;
+  }
+  *ppThread = p;
+  return SQLITE_OK;
+#else
+  *ppThread = 0;
+  return SQLITE_ERROR;
+#endif
+}
+void *sqlite3OsThreadJoin(void *pThread){
+  void *pResult = 0;
+#ifdef SQLITE_W32_THREADS
+  W32Thread *p = (W32Thread*)pThread;
+  if( p ){
+    WaitForSingleObject(p->h, INFINITE);
+    CloseHandle(p->h);
+    pResult = p->pResult;
+    sqliteFree(p);
+  }
+#endif
+  return pResult;
+}
+
 /*
 ** Turn a relative pathname into a full pathname.  Return a pointer
 ** to the full pathname stored in space obtained from sqliteMalloc().
@@ -18,6 +18,10 @@
 ** file simultaneously, or one process from reading the database while
 ** another is writing.
 **
+** As an alternative to the rollback journal, the pager can also run in
+** write-ahead log (WAL) mode.  See the comments on pager_wal_read_log()
+** for a description of that mode.
+**
 ** @(#) $Id: pager.c,v 1.131 2004/06/16 12:01:01 danielk1977 Exp $
 */
 #include "os.h"         /* Must be first to enable large file support */
@@ -128,9 +132,10 @@ struct PgHdr {
   u8 dirty;                      /* TRUE if we need to write back changes */
   u8 needSync;                   /* Sync journal before writing this page */
   u8 alwaysRollback;             /* Disable dont_rollback() for this page */
+  u8 hot;                        /* Reloaded soon after eviction (2Q) */
   short int nRef;                /* Number of users of this page */
   PgHdr *pDirty;                 /* Dirty pages sorted by PgHdr.pgno */
-  /* SQLITE_PAGE_SIZE bytes of page data follow this header */
+  /* Pager.pageSize bytes of page data follow this header */
   /* Pager.nExtra bytes of local data follow the page data */
 };
 
@@ -151,6 +156,33 @@ struct PgHistory {
   u8 *pStmt;     /* Text as it was at the beginning of the current statement */
 };
 
+/*
+** Pages with PgHdr.nRef==0 are kept on one of two free lists, in the
+** order in which they were released.  "Hot" pages live on Pager.aFree[1]
+** and all other pages on Pager.aFree[0].  Only the 2Q replacement policy
+** ever marks a page hot, so under LRU the second list stays empty.
+**
+** Under 2Q a page is loaded cold.  When a cold page is recycled its page
+** number is remembered for a while in the "ghost" ring Pager.aGhost[]
+** (indexed by Pager.ghostIndex), and a page that is loaded again while
+** it is still remembered there comes back hot.  Pages touched only once,
+** such as those of a table scan, never become hot.
+**
+** The page cache is emptied whenever the last page reference is dropped,
+** because another process may change the file once the lock is released.
+** The 2Q history outlives it: the ghost ring is kept, and the numbers of
+** the pages that were hot are remembered in Pager.hotIndex so that they
+** come back hot when the next transaction loads them.
+**
+** Each list also remembers its first page that can be recycled without
+** first syncing the journal.
+*/
+typedef struct PgFreeList PgFreeList;
+struct PgFreeList {
+  PgHdr *pFirst, *pLast;      /* List of free pages */
+  PgHdr *pFirstSynced;        /* First free page with PgHdr.needSync==0 */
+};
+
 /*
 ** A macro used for invoking the codec if there is one
 */
@@ -166,20 +198,57 @@ struct PgHistory {
 */
 #define PGHDR_TO_DATA(P)  ((void*)(&(P)[1]))
 #define DATA_TO_PGHDR(D)  (&((PgHdr*)(D))[-1])
-#define PGHDR_TO_EXTRA(P) ((void*)&((char*)(&(P)[1]))[SQLITE_PAGE_SIZE])
+#define PGHDR_TO_EXTRA(P) ((void*)&((char*)(&(P)[1]))[(P)->pPager->pageSize])
 #define PGHDR_TO_HIST(P,PGR)  \
             ((PgHistory*)&((char*)(&(P)[1]))[(PGR)->pageSize+(PGR)->nExtra])
 
 /*
-** How big to make the hash table used for locating in-memory pages
-** by page number.
+** The initial number of buckets in the hash table used for locating
+** in-memory pages by page number.  The table doubles in size whenever
+** the cache holds more pages than there are buckets, so that chains
+** stay short however large cache_size is set.  Must be a power of two.
 */
 #define N_PG_HASH 2048
 
 /*
 ** Hash a page number
 */
-#define pager_hash(PN)  ((PN)&(N_PG_HASH-1))
+#define pager_hash(P,PN)  ((PN)&((P)->nHash-1))
+
+/*
+** All pagers in this process that have the same write-ahead log open
+** share one instance of the following structure, which lets commits
+** from different connections share a single sync of the log.  See
+** sqlite3pager_commit_wait() for the details.
+**
+** Every field except zWal and pNext is protected by pMutex.  zWal and
+** pNext, and the list of groups itself, are protected by the global
+** mutex of sqlite3OsEnterMutex().  pSyncMutex is held by the commit that
+** is syncing the log on behalf of the group, and the other committers
+** wait for it.
+**
+** Frames up to mxFrameSynced of the log whose header carries aSalt[] are
+** known to be durable.  If mxFramePending is larger, commits after frame
+** mxFrameSynced are being written or are waiting for a sync, and new
+** snapshots do not include them.  mxFrameWritten is the last frame of
+** commit number iCommit.
+*/
+typedef struct PagerGroup PagerGroup;
+struct PagerGroup {
+  char *zWal;                 /* Full name of the write-ahead log */
+  int nRef;                   /* Number of pagers using this group */
+  void *pMutex;               /* Mutex protecting the fields below */
+  void *pSyncMutex;           /* Held while a commit leads a group sync */
+  int iCommit;                /* Number of the last commit written to the log */
+  int iSynced;                /* Commits up to iCommit are durable */
+  u32 aSalt[2];               /* Salt of the log the frame numbers refer to */
+  int mxFramePending;         /* Last frame a commit has started to write */
+  int mxFrameWritten;         /* Last frame of commit number iCommit */
+  int mxFrameSynced;          /* Last frame known to be durable */
+  int nCommit;                /* Number of durable commits to the log */
+  int nSync;                  /* Number of syncs of the log for commits */
+  PagerGroup *pNext;          /* Next group in the list of all groups */
+};
 
 /*
 ** A open page cache is an instance of the following structure.
@@ -201,10 +270,19 @@ struct Pager {
   void (*xDestructor)(void*,int); /* Call this routine when freeing pages */
   void (*xReiniter)(void*,int);   /* Call this routine when reloading pages */
   int pageSize;               /* Number of bytes in a page */
+  u8 *pTmpSpace;              /* Scratch buffer of pageSize bytes */
   int nPage;                  /* Total number of in-memory pages */
   int nRef;                   /* Number of in-memory pages with PgHdr.nRef>0 */
   int mxPage;                 /* Maximum number of pages to hold in cache */
   int nHit, nMiss, nOvfl;     /* Cache hits, missing, and LRU overflows */
+  int aHit[2], aMiss[2];      /* Hits and misses under each cache policy */
+  int nCold;                  /* Number of cached pages with PgHdr.hot==0 */
+  u8 cachePolicy;             /* PAGER_CACHE_LRU or PAGER_CACHE_2Q */
+  Pgno *aGhost;               /* Ring of recently recycled cold pages */
+  int nGhost;                 /* Number of slots in aGhost[] */
+  int iGhost;                 /* Next slot of aGhost[] to overwrite */
+  Hash ghostIndex;            /* Map page number to 1 + its aGhost[] slot */
+  Hash hotIndex;              /* Pages that were hot when the cache emptied */
   void (*xCodec)(void*,void*,Pgno,int); /* Routine for en/decoding data */
   void *pCodecArg;            /* First argument to xCodec() */
   u8 journalOpen;             /* True if journal file descriptors is valid */
@@ -227,11 +305,34 @@ struct Pager {
   u8 *aInStmt;                /* One bit for each page in the database */
   int nMaster;                /* Number of bytes to reserve for master j.p */
   BusyHandler *pBusyHandler;  /* Pointer to sqlite.busyHandler */
-  PgHdr *pFirst, *pLast;      /* List of free pages */
-  PgHdr *pFirstSynced;        /* First free page with PgHdr.needSync==0 */
+  PgFreeList aFree[2];        /* Free pages: cold ones, then hot ones */
   PgHdr *pAll;                /* List of all pages */
   PgHdr *pStmt;               /* List of pages in the statement subjournal */
-  PgHdr *aHash[N_PG_HASH];    /* Hash table to map page number to PgHdr */
+  int nHash;                  /* Number of buckets in aHash[] */
+  PgHdr **aHash;              /* Hash table to map page number to PgHdr */
+  char *zWal;                 /* Name of the write-ahead log file */
+  OsFile wfd;                 /* File descriptor for the write-ahead log */
+  u8 walMode;                 /* True if PRAGMA journal_mode=WAL is in effect */
+  u8 walOpen;                 /* True if wfd is a valid file descriptor */
+  u8 useWal;                  /* True if the current snapshot uses the log */
+  int mxFrame;                /* Last commit frame in the current snapshot */
+  int walDbSize;              /* Database size in pages as of frame mxFrame */
+  u32 aWalSalt[2];            /* Salt values from the log header */
+  u32 aWalCksum[2];           /* Running checksum as of frame mxFrame */
+  u32 nCkpt;                  /* Checkpoint sequence number of the log */
+  Hash walIndex;              /* Map page number to most recent log frame */
+  void *pMap;                 /* Read-only mapping of the database file */
+  off_t nMap;                 /* Number of bytes in the mapping */
+  off_t szMap;                /* Bytes of the mapping that lie within the file */
+  off_t mxMmap;               /* Maximum mapping size set by sqlite3pager_mmap_size */
+  int nReadAhead;             /* Pages to read ahead of a scan.  0 disables */
+  Pgno iLastRead;             /* Last page read from the database file */
+  int nSeqRead;               /* Length of the current run of forward reads */
+  int nPrefetch;              /* Number of pages handed to sqlite3OsReadAhead */
+  PagerGroup *pGroup;         /* Pagers sharing the write-ahead log */
+  int nGroupWindow;           /* Milliseconds to gather a group commit */
+  int iGroupCommit;           /* Last commit whose sync was deferred, or 0 */
+  u8 walForWrite;             /* Next snapshot is for a write transaction */
 };
 
 /*
@@ -257,7 +358,7 @@ struct Pager {
 **
 ** The sanity checking information for the new journal format consists
 ** of a 32-bit checksum on each page of data.  The checksum covers both
-** the page number and the SQLITE_PAGE_SIZE bytes of data for the page.
+** the page number and the pPager->pageSize bytes of data for the page.
 ** This cksum is initialized to a 32-bit random value that appears in the
 ** journal file right after the header.  The random initializer is important,
 ** because garbage data that appears at the end of a journal is likely
@@ -267,16 +368,97 @@ struct Pager {
 ** is different for every journal, we minimize that risk.
 */
 static const unsigned char aJournalMagic[] = {
-  0xd9, 0xd5, 0x05, 0xf9, 0x20, 0xa1, 0x63, 0xd7,
+  0xd9, 0xd5, 0x05, 0xf9, 0x20, 0xa1, 0x63, 0xd8,
 };
 
 /*
 ** The size of the header and of each page in the journal is determined
 ** by the following macros.
 */
-#define JOURNAL_HDR_SZ(pPager) (24 + (pPager)->nMaster)
+#define JOURNAL_HDR_SZ(pPager) (28 + (pPager)->nMaster)
 #define JOURNAL_PG_SZ(pPager)  ((pPager->pageSize) + 8)
 
+/*
+** The write-ahead log begins with a header that holds the following
+** magic number.  The header and frame layouts are described in the
+** comments on pager_wal_read_log().
+*/
+#define WAL_MAGIC          0x377f0682
+#define WAL_VERSION        1
+
+/*
+** Sizes of the log header and of each frame header, and the byte offset
+** of frame iFrame (numbered from 1) within the log.
+*/
+#define WAL_HDR_SZ          24
+#define WAL_FRAME_HDR_SZ    24
+#define WAL_FRAME_SZ(pPager)  (WAL_FRAME_HDR_SZ + (pPager)->pageSize)
+#define WAL_FRAME_OFFSET(pPager,iFrame) \
+            (WAL_HDR_SZ + ((iFrame)-1)*(off_t)WAL_FRAME_SZ(pPager))
+
+/*
+** After a commit leaves at least this many frames in the log, the
+** committing connection tries to checkpoint the log back into the
+** database file.
+*/
+#ifndef SQLITE_WAL_AUTOCHECKPOINT
+# define SQLITE_WAL_AUTOCHECKPOINT 1000
+#endif
+
+/*
+** The default group commit window, in milliseconds.  Zero means that
+** every commit to the write-ahead log syncs the log itself.
+*/
+#ifndef SQLITE_DEFAULT_GROUP_COMMIT
+# define SQLITE_DEFAULT_GROUP_COMMIT 0
+#endif
+
+/*
+** The largest number of pages handed to the OS layer in a single vectored
+** write when dirty pages are written back to the database file or
+** appended to the write-ahead log.
+*/
+#define PAGER_MAX_RUN 64
+
+/*
+** The default value for the maximum number of bytes of a database file
+** that are read through a memory map.  Zero means that memory mapping is
+** off unless enabled with PRAGMA mmap_size.
+*/
+#ifndef SQLITE_DEFAULT_MMAP_SIZE
+# define SQLITE_DEFAULT_MMAP_SIZE 0
+#endif
+
+/*
+** The page replacement policy used by new pagers, one of the
+** PAGER_CACHE_ values from pager.h.
+*/
+#ifndef SQLITE_DEFAULT_CACHE_POLICY
+# define SQLITE_DEFAULT_CACHE_POLICY PAGER_CACHE_LRU
+#endif
+
+/*
+** Under the 2Q policy, cold pages are recycled in preference to hot ones
+** as long as at least 1/PAGER_2Q_COLD_FRACTION of the cache is cold.  A
+** scan of a large table therefore only churns that part of the cache.
+** The page numbers of the last mxPage/PAGER_2Q_GHOST_FRACTION cold pages
+** recycled are remembered.
+*/
+#define PAGER_2Q_COLD_FRACTION  4
+#define PAGER_2Q_GHOST_FRACTION 2
+
+/*
+** The default number of pages that may be read ahead of a scan (see
+** sqlite3pager_prefetch()).  PAGER_SEQ_READS forward reads, each no more
+** than PAGER_SEQ_GAP pages past the one before it, make a sequential
+** scan of the file.
+*/
+#ifndef SQLITE_DEFAULT_READAHEAD
+# define SQLITE_DEFAULT_READAHEAD 32
+#endif
+#define PAGER_SEQ_READS 3
+#define PAGER_SEQ_GAP   8
+
 
 /*
 ** Enable reference count tracking (for debugging) here:
@@ -402,41 +584,1021 @@ static void page_remove_from_stmt_list(PgHdr *pPg){
     assert( pPg->pNextStmt->pPrevStmt==pPg );
     pPg->pNextStmt->pPrevStmt = pPg->pPrevStmt;
   }
-  pPg->pNextStmt = 0;
-  pPg->pPrevStmt = 0;
-  pPg->inStmt = 0;
+  pPg->pNextStmt = 0;
+  pPg->pPrevStmt = 0;
+  pPg->inStmt = 0;
+}
+
+/*
+** Find a page in the hash table given its page number.  Return
+** a pointer to the page or NULL if not found.
+*/
+static PgHdr *pager_lookup(Pager *pPager, Pgno pgno){
+  PgHdr *p = pPager->aHash[pager_hash(pPager, pgno)];
+  while( p && p->pgno!=pgno ){
+    p = p->pNextHash;
+  }
+  return p;
+}
+
+/*
+** Double the number of buckets in the page hash table and move every
+** page into its new bucket.  If the larger table cannot be allocated,
+** the old one is kept: lookups become slower but remain correct.
+*/
+static void pager_resize_hash(Pager *pPager){
+  PgHdr **aNew;
+  PgHdr *pPg, *pNext;
+  int nNew = pPager->nHash*2;
+  int i, h;
+
+  aNew = sqliteMalloc( nNew*sizeof(PgHdr*) );
+  if( aNew==0 ) return;
+  for(i=0; i<pPager->nHash; i++){
+    for(pPg=pPager->aHash[i]; pPg; pPg=pNext){
+      pNext = pPg->pNextHash;
+      h = pPg->pgno & (nNew-1);
+      pPg->pPrevHash = 0;
+      pPg->pNextHash = aNew[h];
+      if( aNew[h] ) aNew[h]->pPrevHash = pPg;
+      aNew[h] = pPg;
+    }
+  }
+  sqliteFree(pPager->aHash);
+  pPager->aHash = aNew;
+  pPager->nHash = nNew;
+}
+
+/*
+** Append a page whose reference count has just reached zero to the end
+** of the free list for its temperature.
+*/
+static void pager_free_append(PgHdr *pPg){
+  PgFreeList *pList = &pPg->pPager->aFree[pPg->hot];
+  pPg->pNextFree = 0;
+  pPg->pPrevFree = pList->pLast;
+  pList->pLast = pPg;
+  if( pPg->pPrevFree ){
+    pPg->pPrevFree->pNextFree = pPg;
+  }else{
+    pList->pFirst = pPg;
+  }
+  if( pPg->needSync==0 && pList->pFirstSynced==0 ){
+    pList->pFirstSynced = pPg;
+  }
+}
+
+/*
+** Remove a page from the free list that it is on.  The
+** pFirstSynced pointer of that list is kept pointing at the first
+** synchronized page.
+*/
+static void pager_free_remove(PgHdr *pPg){
+  PgFreeList *pList = &pPg->pPager->aFree[pPg->hot];
+  if( pPg==pList->pFirstSynced ){
+    PgHdr *p = pPg->pNextFree;
+    while( p && p->needSync ){ p = p->pNextFree; }
+    pList->pFirstSynced = p;
+  }
+  if( pPg->pPrevFree ){
+    pPg->pPrevFree->pNextFree = pPg->pNextFree;
+  }else{
+    assert( pList->pFirst==pPg );
+    pList->pFirst = pPg->pNextFree;
+  }
+  if( pPg->pNextFree ){
+    pPg->pNextFree->pPrevFree = pPg->pPrevFree;
+  }else{
+    assert( pList->pLast==pPg );
+    pList->pLast = pPg->pPrevFree;
+  }
+  pPg->pNextFree = pPg->pPrevFree = 0;
+}
+
+/*
+** Called after the needSync flag has been cleared on every page: every
+** free page can now be recycled without a journal sync.
+*/
+static void pager_all_synced(Pager *pPager){
+  pPager->aFree[0].pFirstSynced = pPager->aFree[0].pFirst;
+  pPager->aFree[1].pFirstSynced = pPager->aFree[1].pFirst;
+}
+
+/*
+** Remember that the cold page pgno has just been recycled, forgetting
+** the oldest page in the ring if it is full.  The ring is sized when it
+** is first used, and freed by pager_ghost_clear().  Allocation failure
+** is not an error; pages just do not become hot.
+*/
+static void pager_ghost_add(Pager *pPager, Pgno pgno){
+  Pgno old;
+  int i;
+  if( pPager->aGhost==0 ){
+    int n = pPager->mxPage/PAGER_2Q_GHOST_FRACTION;
+    pPager->aGhost = sqliteMalloc( n*sizeof(Pgno) );
+    if( pPager->aGhost==0 ) return;
+    pPager->nGhost = n;
+    pPager->iGhost = 0;
+  }
+  i = pPager->iGhost;
+  old = pPager->aGhost[i];
+  if( old && (int)(long)sqlite3HashFind(&pPager->ghostIndex, 0, old)==i+1 ){
+    sqlite3HashInsert(&pPager->ghostIndex, 0, old, 0);
+  }
+  pPager->aGhost[i] = pgno;
+  sqlite3HashInsert(&pPager->ghostIndex, 0, pgno, (void*)(long)(i+1));
+  pPager->iGhost = (i+1) % pPager->nGhost;
+}
+
+/*
+** If page pgno was recently recycled while cold, or was hot when the
+** cache was last emptied, forget it and return true.  Otherwise return
+** false.
+*/
+static int pager_ghost_remove(Pager *pPager, Pgno pgno){
+  if( sqlite3HashFind(&pPager->hotIndex, 0, pgno) ){
+    sqlite3HashInsert(&pPager->hotIndex, 0, pgno, 0);
+    return 1;
+  }
+  if( sqlite3HashFind(&pPager->ghostIndex, 0, pgno)==0 ) return 0;
+  sqlite3HashInsert(&pPager->ghostIndex, 0, pgno, 0);
+  return 1;
+}
+
+/*
+** The cache is about to be emptied.  Remember which of its pages are hot
+** so that they are not demoted by the next transaction.  No more than
+** mxPage pages are remembered; if that many are already waiting to be
+** reloaded, the older ones are forgotten.
+*/
+static void pager_ghost_save_hot(Pager *pPager){
+  PgHdr *pPg;
+  if( pPager->cachePolicy!=PAGER_CACHE_2Q ) return;
+  if( sqliteHashCount(&pPager->hotIndex)+pPager->nPage-pPager->nCold
+         > pPager->mxPage ){
+    sqlite3HashClear(&pPager->hotIndex);
+  }
+  for(pPg=pPager->pAll; pPg; pPg=pPg->pNextAll){
+    if( pPg->hot ){
+      sqlite3HashInsert(&pPager->hotIndex, 0, pPg->pgno, (void*)1);
+    }
+  }
+}
+
+/*
+** Forget all recently recycled pages and free the ring that held them.
+** Also forget which pages were hot before the cache was last emptied.
+*/
+static void pager_ghost_clear(Pager *pPager){
+  sqlite3HashClear(&pPager->hotIndex);
+  sqlite3HashClear(&pPager->ghostIndex);
+  sqliteFree(pPager->aGhost);
+  pPager->aGhost = 0;
+  pPager->nGhost = 0;
+}
+
+/*
+** Return the free list from which the next page should be recycled.
+** LRU recycles the least recently released page, which is always on the
+** cold list unless the policy was recently changed.  2Q recycles cold
+** pages while they make up at least 1/PAGER_2Q_COLD_FRACTION of the
+** cache, and the least recently released hot page otherwise.
+*/
+static PgFreeList *pager_victim_list(Pager *pPager){
+  PgFreeList *aFree = pPager->aFree;
+  if( aFree[1].pFirst==0 ) return &aFree[0];
+  if( aFree[0].pFirst==0 ) return &aFree[1];
+  if( pPager->cachePolicy==PAGER_CACHE_2Q
+   && pPager->nCold*PAGER_2Q_COLD_FRACTION<pPager->mxPage ){
+    return &aFree[1];
+  }
+  return &aFree[0];
+}
+
+/*
+** Read or write a big-endian 32-bit integer from or to a memory buffer.
+*/
+static u32 get32bits(const u8 *a){
+  return (a[0]<<24) | (a[1]<<16) | (a[2]<<8) | a[3];
+}
+static void put32bits(u8 *a, u32 val){
+  a[0] = (val>>24) & 0xff;
+  a[1] = (val>>16) & 0xff;
+  a[2] = (val>>8) & 0xff;
+  a[3] = val & 0xff;
+}
+
+/*
+** Add the nByte bytes of aData to the running checksum aCksum[].  nByte
+** must be a multiple of 4.
+*/
+static void pager_wal_cksum(const u8 *aData, int nByte, u32 *aCksum){
+  u32 s1 = aCksum[0];
+  u32 s2 = aCksum[1];
+  const u8 *aEnd = &aData[nByte];
+  while( aData<aEnd ){
+    s1 += get32bits(aData);
+    s2 += s1;
+    aData += 4;
+  }
+  aCksum[0] = s1;
+  aCksum[1] = s2;
+}
+
+/*
+** Forget everything that is known about the content of the write-ahead
+** log.
+*/
+static void pager_wal_reset_index(Pager *pPager){
+  sqlite3HashClear(&pPager->walIndex);
+  pPager->mxFrame = 0;
+  pPager->walDbSize = 0;
+}
+
+/*
+** The list of all PagerGroup structures in this process.
+*/
+static PagerGroup *pGroupList = 0;
+
+/*
+** Attach pPager to the PagerGroup for its write-ahead log, creating
+** the group if this is the first pager in the process to use the log.
+*/
+static int pager_group_attach(Pager *pPager){
+  PagerGroup *pGroup;
+  if( pPager->pGroup ) return SQLITE_OK;
+  sqlite3OsEnterMutex();
+  for(pGroup=pGroupList; pGroup; pGroup=pGroup->pNext){
+    if( strcmp(pGroup->zWal, pPager->zWal)==0 ) break;
+  }
+  if( pGroup==0 ){
+    pGroup = sqliteMalloc( sizeof(*pGroup) + strlen(pPager->zWal) + 1 );
+    if( pGroup ){
+      pGroup->pMutex = sqlite3OsMutexAlloc();
+      pGroup->pSyncMutex = sqlite3OsMutexAlloc();
+      if( pGroup->pMutex==0 || pGroup->pSyncMutex==0 ){
+        if( pGroup->pMutex ) sqlite3OsMutexFree(pGroup->pMutex);
+        if( pGroup->pSyncMutex ) sqlite3OsMutexFree(pGroup->pSyncMutex);
+        sqliteFree(pGroup);
+        pGroup = 0;
+      }
+    }
+    if( pGroup ){
+      pGroup->zWal = (char*)&pGroup[1];
+      strcpy(pGroup->zWal, pPager->zWal);
+      pGroup->pNext = pGroupList;
+      pGroupList = pGroup;
+    }
+  }
+  if( pGroup ){
+    pGroup->nRef++;
+  }
+  sqlite3OsLeaveMutex();
+  if( pGroup==0 ) return SQLITE_NOMEM;
+  pPager->pGroup = pGroup;
+  return SQLITE_OK;
+}
+
+/*
+** Detach pPager from its PagerGroup.  The group is freed when its last
+** pager leaves it.
+*/
+static void pager_group_detach(Pager *pPager){
+  PagerGroup *pGroup = pPager->pGroup;
+  PagerGroup **pp;
+  if( pGroup==0 ) return;
+  pPager->pGroup = 0;
+  sqlite3OsEnterMutex();
+  if( --pGroup->nRef==0 ){
+    for(pp=&pGroupList; *pp!=pGroup; pp=&(*pp)->pNext){}
+    *pp = pGroup->pNext;
+  }else{
+    pGroup = 0;
+  }
+  sqlite3OsLeaveMutex();
+  if( pGroup ){
+    sqlite3OsMutexFree(pGroup->pMutex);
+    sqlite3OsMutexFree(pGroup->pSyncMutex);
+    sqliteFree(pGroup);
+  }
+}
+
+/*
+** Record that the log with salt aSalt is durable up to frame mxFrame and
+** that commits up to number iCommit are durable.  The caller must hold
+** pGroup->pMutex.
+*/
+static void pager_group_synced(
+  PagerGroup *pGroup,
+  int iCommit,
+  const u32 *aSalt,
+  int mxFrame
+){
+  if( iCommit>pGroup->iSynced ){
+    pGroup->iSynced = iCommit;
+  }
+  if( aSalt[0]==pGroup->aSalt[0] && aSalt[1]==pGroup->aSalt[1]
+   && mxFrame>pGroup->mxFrameSynced ){
+    pGroup->mxFrameSynced = mxFrame;
+  }
+}
+
+/*
+** Record that a commit by pPager is about to write frames up to mxFrame
+** of the log.  They are not durable until the log is next synced.
+*/
+static void pager_group_writing(Pager *pPager, int mxFrame){
+  PagerGroup *pGroup = pPager->pGroup;
+  sqlite3OsMutexEnter(pGroup->pMutex);
+  if( pGroup->aSalt[0]!=pPager->aWalSalt[0]
+   || pGroup->aSalt[1]!=pPager->aWalSalt[1] ){
+    pGroup->aSalt[0] = pPager->aWalSalt[0];
+    pGroup->aSalt[1] = pPager->aWalSalt[1];
+    pGroup->mxFrameWritten = 0;
+    pGroup->mxFrameSynced = 0;
+  }
+  pGroup->mxFramePending = mxFrame;
+  sqlite3OsMutexLeave(pGroup->pMutex);
+}
+
+/*
+** Return the number of frames at the start of the log with salt aSalt
+** that a new snapshot may include, or -1 if it may include them all.
+** Frames written by commits that are still waiting for a group commit
+** sync are left out, so that no reader sees a transaction before it is
+** durable.
+*/
+static int pager_group_limit(Pager *pPager, const u32 *aSalt){
+  PagerGroup *pGroup = pPager->pGroup;
+  int iLimit = -1;
+  if( pGroup==0 ) return -1;
+  sqlite3OsMutexEnter(pGroup->pMutex);
+  if( aSalt[0]==pGroup->aSalt[0] && aSalt[1]==pGroup->aSalt[1]
+   && pGroup->mxFrameSynced<pGroup->mxFramePending ){
+    iLimit = pGroup->mxFrameSynced;
+  }
+  sqlite3OsMutexLeave(pGroup->pMutex);
+  return iLimit;
+}
+
+/*
+** Open the write-ahead log if it is not already open.  If createFlag is
+** false and the log file does not exist, this routine is a no-op.
+*/
+static int pager_wal_open(Pager *pPager, int createFlag){
+  int rc;
+  int readOnly = 0;
+  if( pPager->walOpen ) return SQLITE_OK;
+  if( !createFlag && !sqlite3OsFileExists(pPager->zWal) ) return SQLITE_OK;
+  rc = pager_group_attach(pPager);
+  if( rc!=SQLITE_OK ) return rc;
+  rc = sqlite3OsOpenReadWrite(pPager->zWal, &pPager->wfd, &readOnly);
+  if( rc!=SQLITE_OK ) return rc;
+  if( createFlag ){
+    sqlite3OsOpenDirectory(pPager->zDirectory, &pPager->wfd);
+  }
+  pPager->walOpen = 1;
+  pPager->aWalSalt[0] = pPager->aWalSalt[1] = 0;
+  pager_wal_reset_index(pPager);
+  return SQLITE_OK;
+}
+
+/*
+** When PRAGMA journal_mode=WAL is in effect, the database file is never
+** written during a transaction and no rollback journal is used.  Instead,
+** the dirty pages of each committing transaction are appended to a
+** write-ahead log whose name is the database name with "-wal" appended,
+** and a single sync of the log makes the transaction durable.
+**
+** A reader holds a SHARED lock on the database file and reads each page
+** either from the most recent log frame that is part of its snapshot or,
+** if the log holds no copy of the page, from the database file.  A writer
+** holds only a RESERVED lock, so readers are never blocked by a commit.
+** From time to time, when no other connection holds a lock, the log is
+** checkpointed: the most recent copy of every page in the log is written
+** back into the database file and the log is truncated.
+**
+** The log file format is as follows:
+**
+**  (1)  A 24 byte header:
+**        +  4 byte magic number WAL_MAGIC.
+**        +  4 byte format version WAL_VERSION.
+**        +  4 byte database page size.
+**        +  4 byte checkpoint sequence number, one more each time the
+**           log is restarted.
+**        +  8 bytes of salt.  New salt values are chosen each time the
+**           log is restarted; see pager_wal_restart().
+**  (2)  Zero or more frames, each as follows:
+**        +  4 byte page number.
+**        +  4 byte size of the database in pages for the last frame of
+**           a transaction (a "commit frame"), or zero for other frames.
+**        +  8 bytes of salt copied from the log header.
+**        +  8 byte checksum.
+**        +  pPager->pageSize bytes of data.
+**
+** The checksum is cumulative.  It is seeded with the salt and covers the
+** first 8 bytes of the header and the data of every frame up to and
+** including the current one.  A frame is valid only if its salt matches
+** the log header and its checksum is correct, so frames left over from
+** before the last checkpoint or torn by a power failure end the log.
+** Frames after the last valid commit frame are ignored.
+**
+** Pager.walIndex maps page numbers to the most recent frame holding the
+** page, for frames 1 through Pager.mxFrame.  The index is kept across
+** transactions and is extended each time a new snapshot begins.  It is
+** rebuilt from the start of the log if the checkpoint sequence number
+** or salt in the header has changed, or if the log is now too short to
+** hold frame Pager.mxFrame, since the log has then been restarted by
+** another connection.
+**
+** This routine reads any transactions appended to the log since frame
+** Pager.mxFrame.  If doUpdate is true the new transactions are added to
+** the index.  Otherwise the log is only probed and the index is left
+** unchanged.  Either way *pnCommit is set to the number of new
+** transactions found.
+**
+** If doUpdate is 1, transactions that another pager in this process has
+** written under group commit but not yet synced are left out of the
+** index (see pager_group_limit()), and so are any written after them.
+** If the index already holds such a transaction it is rebuilt.  If
+** doUpdate is 2 every committed transaction is indexed.
+*/
+static int pager_wal_read_log(Pager *pPager, int doUpdate, int *pnCommit){
+  int rc;
+  off_t szW;                    /* Size of the log file in bytes */
+  u8 aHdr[WAL_HDR_SZ];          /* The log file header */
+  u8 *aFrame;                   /* Buffer holding one frame */
+  u32 nCkpt;                    /* Checkpoint sequence number from the header */
+  u32 aSalt[2];                 /* Salt values from the log header */
+  u32 aCksum[2];                /* Running checksum */
+  int iFrame;                   /* Number of the last frame read */
+  int iCommit;                  /* Number of the last commit frame read */
+  int iLimit = -1;              /* Read no more frames than this, if >=0 */
+  Pgno *aPgno = 0;              /* Pages in frames iCommit+1 .. iFrame */
+  int nAlloc = 0;               /* Number of slots allocated in aPgno[] */
+  int szFrame = WAL_FRAME_SZ(pPager);
+
+  *pnCommit = 0;
+  assert( pPager->walOpen );
+  rc = sqlite3OsFileSize(&pPager->wfd, &szW);
+  if( rc!=SQLITE_OK ) return rc;
+  if( szW<WAL_HDR_SZ ){
+    if( doUpdate ) pager_wal_reset_index(pPager);
+    return SQLITE_OK;
+  }
+  rc = sqlite3OsReadAt(&pPager->wfd, aHdr, WAL_HDR_SZ, 0);
+  if( rc!=SQLITE_OK ) return rc;
+  if( get32bits(aHdr)!=WAL_MAGIC || get32bits(&aHdr[4])!=WAL_VERSION ){
+    if( doUpdate ) pager_wal_reset_index(pPager);
+    return SQLITE_OK;
+  }
+  if( get32bits(&aHdr[8])!=pPager->pageSize ){
+    /* At the start of the first snapshot the cache is empty and the
+    ** page size of the database is not yet known, so the pager adopts
+    ** the page size of the log.
+    */
+    int pageSize = get32bits(&aHdr[8]);
+    if( !doUpdate || sqlite3pager_set_pagesize(pPager, pageSize)!=pageSize ){
+      return SQLITE_CORRUPT;
+    }
+  }
+  nCkpt = get32bits(&aHdr[12]);
+  aSalt[0] = get32bits(&aHdr[16]);
+  aSalt[1] = get32bits(&aHdr[20]);
+  if( doUpdate==1 ){
+    iLimit = pager_group_limit(pPager, aSalt);
+  }
+  if( pPager->mxFrame>0 && nCkpt==pPager->nCkpt
+                        && aSalt[0]==pPager->aWalSalt[0]
+                        && aSalt[1]==pPager->aWalSalt[1]
+                        && WAL_FRAME_OFFSET(pPager, pPager->mxFrame+1)<=szW
+                        && (iLimit<0 || pPager->mxFrame<=iLimit) ){
+    iFrame = pPager->mxFrame;
+    aCksum[0] = pPager->aWalCksum[0];
+    aCksum[1] = pPager->aWalCksum[1];
+  }else{
+    /* The log has been restarted since the index was built, or the
+    ** index holds a transaction that is not yet durable */
+    if( doUpdate ){
+      pager_wal_reset_index(pPager);
+      pPager->nCkpt = nCkpt;
+      pPager->aWalSalt[0] = aSalt[0];
+      pPager->aWalSalt[1] = aSalt[1];
+    }
+    iFrame = 0;
+    aCksum[0] = aSalt[0];
+    aCksum[1] = aSalt[1];
+  }
+
+  aFrame = sqliteMallocRaw( szFrame );
+  if( aFrame==0 ) return SQLITE_NOMEM;
+  iCommit = iFrame;
+  while( (iLimit<0 || iFrame<iLimit)
+      && WAL_FRAME_OFFSET(pPager, iFrame+1)+szFrame<=szW ){
+    Pgno pgno;
+    u32 nTruncate;
+    rc = sqlite3OsReadAt(&pPager->wfd, aFrame, szFrame,
+                         WAL_FRAME_OFFSET(pPager, iFrame+1));
+    if( rc!=SQLITE_OK ) break;
+    pgno = get32bits(aFrame);
+    nTruncate = get32bits(&aFrame[4]);
+    if( pgno==0 || get32bits(&aFrame[8])!=aSalt[0]
+                || get32bits(&aFrame[12])!=aSalt[1] ){
+      break;
+    }
+    pager_wal_cksum(aFrame, 8, aCksum);
+    pager_wal_cksum(&aFrame[WAL_FRAME_HDR_SZ], pPager->pageSize, aCksum);
+    if( get32bits(&aFrame[16])!=aCksum[0]
+     || get32bits(&aFrame[20])!=aCksum[1] ){
+      break;
+    }
+    if( iFrame-iCommit>=nAlloc ){
+      Pgno *aNew;
+      nAlloc = nAlloc*2 + 64;
+      aNew = sqliteRealloc(aPgno, nAlloc*sizeof(Pgno));
+      if( aNew==0 ){
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      aPgno = aNew;
+    }
+    aPgno[iFrame-iCommit] = pgno;
+    iFrame++;
+    if( nTruncate ){
+      /* Frames iCommit+1 through iFrame are a complete transaction */
+      if( doUpdate ){
+        int i;
+        for(i=iCommit+1; i<=iFrame; i++){
+          sqlite3HashInsert(&pPager->walIndex, 0, aPgno[i-iCommit-1],
+                            (void*)(long)i);
+        }
+        pPager->mxFrame = iFrame;
+        pPager->walDbSize = nTruncate;
+        pPager->aWalCksum[0] = aCksum[0];
+        pPager->aWalCksum[1] = aCksum[1];
+      }
+      iCommit = iFrame;
+      (*pnCommit)++;
+    }
+  }
+  sqliteFree(aPgno);
+  sqliteFree(aFrame);
+  if( rc==SQLITE_OK && sqlite3_malloc_failed ){
+    rc = SQLITE_NOMEM;
+  }
+  return rc;
+}
+
+/*
+** Read the content of page pgno into pBuf.  If the current snapshot
+** uses the write-ahead log and the log holds a copy of the page, the
+** most recent copy is read from the log.  Otherwise the page is read
+** from the database file.
+*/
+static int pager_read_page(Pager *pPager, Pgno pgno, void *pBuf){
+  if( pPager->useWal && pPager->mxFrame>0 ){
+    int iFrame = (int)(long)sqlite3HashFind(&pPager->walIndex, 0, pgno);
+    if( iFrame>0 ){
+      return sqlite3OsReadAt(&pPager->wfd, pBuf, pPager->pageSize,
+                          WAL_FRAME_OFFSET(pPager, iFrame)+WAL_FRAME_HDR_SZ);
+    }
+  }
+  if( (pgno-1)*(off_t)pPager->pageSize < pPager->szMap ){
+    memcpy(pBuf, &((char*)pPager->pMap)[(pgno-1)*(off_t)pPager->pageSize],
+           pPager->pageSize);
+    return SQLITE_OK;
+  }
+  return sqlite3OsReadAt(&pPager->fd, pBuf, pPager->pageSize,
+                         (pgno-1)*(off_t)pPager->pageSize);
+}
+
+/*
+** This routine is called each time page pgno is read into the cache
+** from the database file.  It keeps track of whether or not the reads
+** form a forward scan of the file.
+*/
+static void pager_track_read(Pager *pPager, Pgno pgno){
+  if( pgno>pPager->iLastRead && pgno<=pPager->iLastRead+PAGER_SEQ_GAP ){
+    pPager->nSeqRead++;
+  }else{
+    pPager->nSeqRead = 0;
+  }
+  pPager->iLastRead = pgno;
+}
+
+/*
+** Truncate the database file so that it contains nPage pages.  Any part
+** of the memory map that now lies beyond the end of the file is made
+** unavailable, since touching it would raise SIGBUS.
+*/
+static int pager_truncate_file(Pager *pPager, int nPage){
+  off_t sz = pPager->pageSize*(off_t)nPage;
+  if( pPager->szMap>sz ){
+    pPager->szMap = sz;
+  }
+  return sqlite3OsTruncate(&pPager->fd, sz);
+}
+
+/*
+** Release the memory map of the database file, if there is one.
+*/
+static void pager_mmap_release(Pager *pPager){
+  if( pPager->pMap ){
+    sqlite3OsMunmap(pPager->pMap, pPager->nMap);
+    pPager->pMap = 0;
+    pPager->nMap = 0;
+  }
+  pPager->szMap = 0;
+}
+
+/*
+** This routine is called at the start of every snapshot, after the
+** SHARED lock is obtained.  If memory mapping is enabled, the database
+** file is mapped (the first time through) and the number of bytes of
+** the mapping that may safely be read is recomputed from the size of
+** the file.  No other connection can truncate the file while the
+** SHARED lock is held.
+**
+** The mapping covers the whole of the configured maximum, even beyond
+** the end of the file, so that it need not be redone as the file grows.
+** Pages that lie past the end of the mapping are read with ordinary
+** file I/O.  If the mapping cannot be created, all pages are read with
+** ordinary file I/O.
+*/
+static void pager_mmap_begin_read(Pager *pPager){
+  off_t sz;
+  if( pPager->mxMmap<=0 ){
+    return;
+  }
+  if( pPager->pMap==0 ){
+    off_t n = pPager->mxMmap;
+    if( n<=0 || sqlite3OsMmap(&pPager->fd, n, &pPager->pMap)!=SQLITE_OK ){
+      pPager->pMap = 0;
+      return;
+    }
+    pPager->nMap = n;
+  }
+  if( sqlite3OsFileSize(&pPager->fd, &sz)!=SQLITE_OK ){
+    sz = 0;
+  }
+  if( sz>pPager->nMap ){
+    sz = pPager->nMap;
+  }
+  pPager->szMap = sz - sz%pPager->pageSize;
+}
+
+/*
+** Write a new header to the start of the write-ahead log, which begins
+** a new generation of the log.  The checkpoint sequence number is one
+** more than that of the header last read or written, and the first salt
+** value is derived from the old one, so that the header differs from
+** every earlier generation however the random salt turns out.  Any other
+** pager that still has an index of an earlier generation sees that the
+** header has changed and rebuilds it.
+**
+** The caller must hold at least a RESERVED lock and the index must be up
+** to date and empty.
+*/
+static int pager_wal_restart(Pager *pPager){
+  u8 aWalHdr[WAL_HDR_SZ];
+  u32 iSalt;
+  int rc;
+
+  assert( pPager->mxFrame==0 );
+  sqlite3Randomness(sizeof(iSalt), &iSalt);
+  pPager->nCkpt++;
+  pPager->aWalSalt[0]++;
+  pPager->aWalSalt[1] = iSalt;
+  put32bits(aWalHdr, WAL_MAGIC);
+  put32bits(&aWalHdr[4], WAL_VERSION);
+  put32bits(&aWalHdr[8], pPager->pageSize);
+  put32bits(&aWalHdr[12], pPager->nCkpt);
+  put32bits(&aWalHdr[16], pPager->aWalSalt[0]);
+  put32bits(&aWalHdr[20], pPager->aWalSalt[1]);
+  rc = sqlite3OsWriteAt(&pPager->wfd, aWalHdr, WAL_HDR_SZ, 0);
+  pPager->aWalCksum[0] = pPager->aWalSalt[0];
+  pPager->aWalCksum[1] = pPager->aWalSalt[1];
+  return rc;
+}
+
+/*
+** Copy the most recent version of every page in the write-ahead log back
+** into the database file, sync the database and truncate the log.
+**
+** The caller must hold an EXCLUSIVE lock on the database file, which
+** guarantees that no other connection is reading from the log, and the
+** log index must be up to date.
+*/
+static int pager_wal_checkpoint(Pager *pPager){
+  int rc = SQLITE_OK;
+
+  assert( pPager->walOpen );
+  assert( pPager->fd.locktype==EXCLUSIVE_LOCK );
+  if( pPager->mxFrame>0 ){
+    HashElem *pElem;
+    u8 *aData = sqliteMallocRaw( pPager->pageSize );
+    if( aData==0 ) return SQLITE_NOMEM;
+    for(pElem=sqliteHashFirst(&pPager->walIndex); pElem;
+        pElem=sqliteHashNext(pElem)){
+      Pgno pgno = sqliteHashKeysize(pElem);
+      int iFrame = (int)(long)sqliteHashData(pElem);
+      if( pgno>(unsigned)pPager->walDbSize ) continue;
+      rc = sqlite3OsReadAt(&pPager->wfd, aData, pPager->pageSize,
+                           WAL_FRAME_OFFSET(pPager, iFrame)+WAL_FRAME_HDR_SZ);
+      if( rc!=SQLITE_OK ) break;
+      TRACE2("CHECKPOINT page %d\n", pgno);
+      rc = sqlite3OsWriteAt(&pPager->fd, aData, pPager->pageSize,
+                            (pgno-1)*(off_t)pPager->pageSize);
+      if( rc!=SQLITE_OK ) break;
+    }
+    sqliteFree(aData);
+    if( rc==SQLITE_OK ){
+      rc = pager_truncate_file(pPager, pPager->walDbSize);
+    }
+    if( rc==SQLITE_OK && !pPager->noSync ){
+      rc = sqlite3OsSync(&pPager->fd);
+    }
+    if( rc!=SQLITE_OK ) return rc;
+  }
+
+  /* The database file now holds every committed transaction, so the
+  ** frames can be discarded.  The header of the next generation is left
+  ** in the log, so that a writer in another process continues the
+  ** sequence of headers rather than starting it again.  The truncation
+  ** is synced so that stale frames cannot reappear after a power failure.
+  */
+  pager_wal_reset_index(pPager);
+  rc = pager_wal_restart(pPager);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3OsTruncate(&pPager->wfd, WAL_HDR_SZ);
+  }
+  if( rc==SQLITE_OK && !pPager->noSync ){
+    rc = sqlite3OsSync(&pPager->wfd);
+  }
+  if( rc==SQLITE_OK ){
+    PagerGroup *pGroup = pPager->pGroup;
+    if( pGroup ){
+      /* Commits still waiting for a group sync are now durable in the
+      ** database file. */
+      sqlite3OsMutexEnter(pGroup->pMutex);
+      pager_group_synced(pGroup, pGroup->iCommit, pGroup->aSalt,
+                         pGroup->mxFramePending);
+      sqlite3OsMutexLeave(pGroup->pMutex);
+    }
+  }
+  return rc;
+}
+
+/*
+** This routine is called after a SHARED lock is obtained on the
+** database file, which begins a new snapshot.  If a write-ahead log
+** exists, the log index is brought up to date so that the snapshot
+** includes every transaction committed to the log.
+**
+** Transactions that are still waiting for a group commit sync are not
+** part of the snapshot, unless sqlite3pager_write_snapshot() has said
+** that the snapshot is for a write transaction.  A writer must see them,
+** since its own commit will follow them in the log.
+**
+** If the log holds committed transactions but the pager is not in WAL
+** mode, try to checkpoint the log so that the database file can be used
+** directly.  If that is not possible because other connections are
+** reading, the log continues to be used for this snapshot.
+*/
+static int pager_wal_begin_read(Pager *pPager){
+  int rc;
+  int nCommit;
+
+  pPager->useWal = 0;
+  if( pPager->tempFile ) return SQLITE_OK;
+  rc = pager_wal_open(pPager, 0);
+  if( rc==SQLITE_OK && pPager->walOpen ){
+    rc = pager_wal_read_log(pPager, pPager->walForWrite ? 2 : 1, &nCommit);
+  }
+  if( rc!=SQLITE_OK ) return rc;
+  pPager->useWal = pPager->walMode || pPager->mxFrame>0;
+  if( pPager->mxFrame>0 && !pPager->walMode && !pPager->readOnly ){
+    if( sqlite3OsLock(&pPager->fd, EXCLUSIVE_LOCK)==SQLITE_OK
+     && pager_wal_read_log(pPager, 2, &nCommit)==SQLITE_OK
+     && pager_wal_checkpoint(pPager)==SQLITE_OK ){
+      pPager->useWal = 0;
+    }
+    sqlite3OsUnlock(&pPager->fd, SHARED_LOCK);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** This routine is called after a RESERVED lock is obtained on the
+** database file at the start of a write transaction.  A write transaction
+** may only begin from the most recent snapshot, so return SQLITE_BUSY if
+** another connection has committed a transaction to the write-ahead log
+** since the current snapshot began.  If the log will be used for this
+** transaction, make sure that it is open.
+*/
+static int pager_wal_begin_write(Pager *pPager){
+  int rc;
+  int nCommit = 0;
+
+  if( pPager->tempFile ) return SQLITE_OK;
+  rc = pager_wal_open(pPager, pPager->useWal);
+  if( rc==SQLITE_OK && pPager->walOpen ){
+    rc = pager_wal_read_log(pPager, 0, &nCommit);
+    if( rc==SQLITE_OK && nCommit>0 ){
+      rc = SQLITE_BUSY;
+    }
+  }
+  return rc;
+}
+
+/*
+** Append every page on the dirty list pList to the write-ahead log,
+** marking the last frame written as a commit frame, and sync the log.
+** Pages beyond the end of the database are omitted.  Once the log is
+** synced the transaction is committed and the new frames are added to
+** the log index.
+**
+** If group commit is enabled the log is not synced here.  The commit is
+** numbered instead and the number is left in Pager.iGroupCommit, for
+** the caller to pass to sqlite3pager_commit_wait() once the write lock
+** has been released.  Either way, new snapshots of other pagers in this
+** process do not include the transaction until the sync is done.
+*/
+static int pager_wal_write_frames(Pager *pPager, PgHdr *pList){
+  int rc = SQLITE_OK;
+  int iFrame;                   /* Number of the last frame written */
+  off_t iOff;                   /* Offset of the next frame in the log */
+  u8 aHdrs[PAGER_MAX_RUN*WAL_FRAME_HDR_SZ];  /* Frame header buffers */
+  u32 aCksum[2];                /* Running checksum */
+  int nFrame = 0;               /* Number of frames to write */
+  PgHdr *p, *pLast = 0;
+
+  assert( pPager->walOpen && pPager->state>=PAGER_RESERVED );
+  for(p=pList; p; p=p->pDirty){
+    if( (int)p->pgno<=pPager->dbSize ){
+      pLast = p;
+      nFrame++;
+    }
+  }
+  if( pLast==0 ) return SQLITE_OK;
+
+  /* If the log is empty, restart it with a new header and new salt.
+  */
+  if( pPager->mxFrame==0 ){
+    rc = pager_wal_restart(pPager);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  if( !pPager->noSync ){
+    pager_group_writing(pPager, pPager->mxFrame+nFrame);
+  }
+
+  /* Append the frames.  Frames are contiguous in the log, so up to
+  ** PAGER_MAX_RUN of them at a time are written with one vectored write
+  ** of alternating frame headers and page images.
+  */
+  aCksum[0] = pPager->aWalCksum[0];
+  aCksum[1] = pPager->aWalCksum[1];
+  iOff = WAL_FRAME_OFFSET(pPager, pPager->mxFrame+1);
+  p = pList;
+  while( p ){
+    void *apBuf[PAGER_MAX_RUN*2];
+    int anBuf[PAGER_MAX_RUN*2];
+    PgHdr *pFirst = p;
+    int n = 0;
+    for(; p && n<PAGER_MAX_RUN; p=p->pDirty){
+      u8 *aHdr = &aHdrs[n*WAL_FRAME_HDR_SZ];
+      void *pData = PGHDR_TO_DATA(p);
+      if( (int)p->pgno>pPager->dbSize ) continue;
+      put32bits(aHdr, p->pgno);
+      put32bits(&aHdr[4], p==pLast ? pPager->dbSize : 0);
+      put32bits(&aHdr[8], pPager->aWalSalt[0]);
+      put32bits(&aHdr[12], pPager->aWalSalt[1]);
+      CODEC(pPager, pData, p->pgno, 6);
+      pager_wal_cksum(aHdr, 8, aCksum);
+      pager_wal_cksum(pData, pPager->pageSize, aCksum);
+      put32bits(&aHdr[16], aCksum[0]);
+      put32bits(&aHdr[20], aCksum[1]);
+      TRACE2("WAL page %d\n", p->pgno);
+      apBuf[n*2] = aHdr;
+      anBuf[n*2] = WAL_FRAME_HDR_SZ;
+      apBuf[n*2+1] = pData;
+      anBuf[n*2+1] = pPager->pageSize;
+      n++;
+    }
+    rc = sqlite3OsWritevAt(&pPager->wfd, apBuf, anBuf, n*2, iOff);
+    iOff += n*(off_t)WAL_FRAME_SZ(pPager);
+    for(; pFirst!=p; pFirst=pFirst->pDirty){
+      if( (int)pFirst->pgno>pPager->dbSize ) continue;
+      CODEC(pPager, PGHDR_TO_DATA(pFirst), pFirst->pgno, 0);
+    }
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  if( !pPager->noSync ){
+    PagerGroup *pGroup = pPager->pGroup;
+    if( pPager->nGroupWindow<=0 ){
+      TRACE2("SYNC log of %d\n", pPager->fd.h);
+      rc = sqlite3OsSync(&pPager->wfd);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+    sqlite3OsMutexEnter(pGroup->pMutex);
+    pGroup->mxFrameWritten = pPager->mxFrame+nFrame;
+    if( pPager->nGroupWindow>0 ){
+      pPager->iGroupCommit = ++pGroup->iCommit;
+    }else{
+      /* The sync also made every earlier commit in the log durable */
+      pager_group_synced(pGroup, pGroup->iCommit, pPager->aWalSalt,
+                         pPager->mxFrame+nFrame);
+      pGroup->nCommit++;
+      pGroup->nSync++;
+    }
+    sqlite3OsMutexLeave(pGroup->pMutex);
+  }
+
+  /* The transaction is committed.  Make it part of the snapshot.
+  */
+  iFrame = pPager->mxFrame;
+  for(p=pList; p; p=p->pDirty){
+    if( (int)p->pgno>pPager->dbSize ) continue;
+    iFrame++;
+    sqlite3HashInsert(&pPager->walIndex, 0, p->pgno, (void*)(long)iFrame);
+  }
+  pPager->mxFrame = iFrame;
+  pPager->walDbSize = pPager->dbSize;
+  pPager->aWalCksum[0] = aCksum[0];
+  pPager->aWalCksum[1] = aCksum[1];
+  return SQLITE_OK;
 }
 
 /*
-** Find a page in the hash table given its page number.  Return
-** a pointer to the page or NULL if not found.
+** This routine is called when a transaction has been committed to the
+** write-ahead log while the RESERVED lock is still held.  If the log has
+** grown large, or if the pager is leaving WAL mode, try to checkpoint.
+** Busy handlers are not invoked: if any other connection is reading,
+** the checkpoint is simply deferred to a later commit.
+**
+** A failed attempt to get the EXCLUSIVE lock leaves a PENDING lock
+** behind.  The caller is expected to drop back to a SHARED lock.
 */
-static PgHdr *pager_lookup(Pager *pPager, Pgno pgno){
-  PgHdr *p = pPager->aHash[pager_hash(pgno)];
-  while( p && p->pgno!=pgno ){
-    p = p->pNextHash;
+static void pager_wal_autocheckpoint(Pager *pPager){
+  if( pPager->mxFrame<SQLITE_WAL_AUTOCHECKPOINT && pPager->walMode ) return;
+  if( sqlite3OsLock(&pPager->fd, EXCLUSIVE_LOCK)==SQLITE_OK
+   && pager_wal_checkpoint(pPager)==SQLITE_OK
+   && !pPager->walMode ){
+    pPager->useWal = 0;
   }
-  return p;
+}
+
+/*
+** Close the write-ahead log.  If no other connection holds a lock on the
+** database, checkpoint the log first so that the database file is
+** complete on its own.
+*/
+static void pager_wal_close(Pager *pPager){
+  int nCommit;
+  assert( pPager->walOpen );
+  if( !pPager->readOnly
+   && sqlite3OsLock(&pPager->fd, SHARED_LOCK)==SQLITE_OK ){
+    if( sqlite3OsLock(&pPager->fd, EXCLUSIVE_LOCK)==SQLITE_OK
+     && pager_wal_read_log(pPager, 2, &nCommit)==SQLITE_OK ){
+      pager_wal_checkpoint(pPager);
+    }
+    sqlite3OsUnlock(&pPager->fd, NO_LOCK);
+  }
+  sqlite3OsClose(&pPager->wfd);
+  pPager->walOpen = 0;
+  pager_wal_reset_index(pPager);
 }
 
 /*
 ** Unlock the database and clear the in-memory cache.  This routine
 ** sets the state of the pager back to what it was when it was first
 ** opened.  Any outstanding pages are invalidated and subsequent attempts
-** to access those pages will likely result in a coredump.
+** to access those pages will likely result in a coredump.  The 2Q
+** replacement history is kept; see pager_ghost_save_hot().
+**
+** Only the hash buckets that held a page are cleared, so the cost does
+** not depend on how far the hash table has grown.  A table that grew
+** past N_PG_HASH buckets is shrunk back, since the cache is now empty.
 */
 static void pager_reset(Pager *pPager){
   PgHdr *pPg, *pNext;
+  pager_ghost_save_hot(pPager);
   for(pPg=pPager->pAll; pPg; pPg=pNext){
     pNext = pPg->pNextAll;
+    pPager->aHash[pager_hash(pPager, pPg->pgno)] = 0;
     sqliteFree(pPg);
   }
-  pPager->pFirst = 0;
-  pPager->pFirstSynced = 0;
-  pPager->pLast = 0;
+  memset(pPager->aFree, 0, sizeof(pPager->aFree));
   pPager->pAll = 0;
-  memset(pPager->aHash, 0, sizeof(pPager->aHash));
+  if( pPager->nHash>N_PG_HASH ){
+    PgHdr **aNew = sqliteRealloc(pPager->aHash, N_PG_HASH*sizeof(PgHdr*));
+    if( aNew ){
+      pPager->aHash = aNew;
+      pPager->nHash = N_PG_HASH;
+    }
+  }
   pPager->nPage = 0;
+  pPager->nCold = 0;
   if( pPager->state>=PAGER_RESERVED ){
     sqlite3pager_rollback(pPager);
   }
@@ -444,6 +1606,8 @@ static void pager_reset(Pager *pPager){
   pPager->state = PAGER_UNLOCK;
   pPager->dbSize = -1;
   pPager->nRef = 0;
+  pPager->iLastRead = 0;
+  pPager->nSeqRead = 0;
   assert( pPager->journalOpen==0 );
 }
 
@@ -479,6 +1643,13 @@ static int pager_unwritelock(Pager *pPager){
       pPg->dirty = 0;
       pPg->needSync = 0;
     }
+  }else if( pPager->useWal ){
+    for(pPg=pPager->pAll; pPg; pPg=pPg->pNextAll){
+      pPg->inJournal = 0;
+      pPg->dirty = 0;
+      pPg->needSync = 0;
+    }
+    pager_all_synced(pPager);
   }else{
     assert( pPager->dirtyCache==0 || pPager->useJournal==0 );
   }
@@ -525,11 +1696,11 @@ static int pager_playback_one_page(Pager *pPager, OsFile *jfd, int useCksum){
   PgHdr *pPg;                   /* An existing page in the cache */
   Pgno pgno;                    /* The page number of a page in journal */
   u32 cksum;                    /* Checksum used for sanity checking */
-  u8 aData[SQLITE_PAGE_SIZE];   /* Store data here */
+  u8 *aData = pPager->pTmpSpace; /* Store data here */
 
   rc = read32bits(jfd, &pgno);
   if( rc!=SQLITE_OK ) return rc;
-  rc = sqlite3OsRead(jfd, &aData, pPager->pageSize);
+  rc = sqlite3OsRead(jfd, aData, pPager->pageSize);
   if( rc!=SQLITE_OK ) return rc;
 
   /* Sanity checking on the page.  This is more important that I originally
@@ -568,8 +1739,8 @@ static int pager_playback_one_page(Pager *pPager, OsFile *jfd, int useCksum){
   assert( pPager->state>=PAGER_EXCLUSIVE || pPg );
   TRACE2("PLAYBACK page %d\n", pgno);
   if( pPager->state>=PAGER_EXCLUSIVE ){
-    sqlite3OsSeek(&pPager->fd, (pgno-1)*(off_t)SQLITE_PAGE_SIZE);
-    rc = sqlite3OsWrite(&pPager->fd, aData, SQLITE_PAGE_SIZE);
+    rc = sqlite3OsWriteAt(&pPager->fd, aData, pPager->pageSize,
+                          (pgno-1)*(off_t)pPager->pageSize);
   }
   if( pPg ){
     /* No page should ever be rolled back that is in use, except for page
@@ -666,7 +1837,7 @@ static int pager_delmaster(const char *zMaster){
           sqlite3OsClose(&journal);
           goto delmaster_out;
         }
-        if( jsz<(25+strlen(zMaster)) ){
+        if( jsz<(29+strlen(zMaster)) ){
           sqlite3OsClose(&journal);
           continue;
         }
@@ -675,7 +1846,7 @@ static int pager_delmaster(const char *zMaster){
         ** is stored. Read the master journal name into memory obtained
         ** from malloc.
         */
-        rc = sqlite3OsSeek(&journal, 20);
+        rc = sqlite3OsSeek(&journal, 24);
         if( rc!=SQLITE_OK ) goto delmaster_out;
         rc = read32bits(&journal, (u32*)&nMaster);
         if( rc!=SQLITE_OK ) goto delmaster_out;
@@ -718,20 +1889,19 @@ delmaster_out:
 static int pager_reload_cache(Pager *pPager){
   PgHdr *pPg;
   int rc = SQLITE_OK;
+  char *zBuf = (char*)pPager->pTmpSpace;
   for(pPg=pPager->pAll; pPg; pPg=pPg->pNextAll){
-    char zBuf[SQLITE_PAGE_SIZE];
     if( !pPg->dirty ) continue;
     if( (int)pPg->pgno <= pPager->origDbSize ){
-      sqlite3OsSeek(&pPager->fd, SQLITE_PAGE_SIZE*(off_t)(pPg->pgno-1));
-      rc = sqlite3OsRead(&pPager->fd, zBuf, SQLITE_PAGE_SIZE);
+      rc = pager_read_page(pPager, pPg->pgno, zBuf);
       TRACE2("REFETCH page %d\n", pPg->pgno);
       CODEC(pPager, zBuf, pPg->pgno, 2);
       if( rc ) break;
     }else{
-      memset(zBuf, 0, SQLITE_PAGE_SIZE);
+      memset(zBuf, 0, pPager->pageSize);
     }
-    if( pPg->nRef==0 || memcmp(zBuf, PGHDR_TO_DATA(pPg), SQLITE_PAGE_SIZE) ){
-      memcpy(PGHDR_TO_DATA(pPg), zBuf, SQLITE_PAGE_SIZE);
+    if( pPg->nRef==0 || memcmp(zBuf, PGHDR_TO_DATA(pPg), pPager->pageSize) ){
+      memcpy(PGHDR_TO_DATA(pPg), zBuf, pPager->pageSize);
       if( pPager->xReiniter ){
         pPager->xReiniter(PGHDR_TO_DATA(pPg), pPager->pageSize);
       }else{
@@ -759,20 +1929,21 @@ static int pager_reload_cache(Pager *pPager){
 **       sanity checksum.
 **  (4)  4 byte integer which is the number of pages to truncate the
 **       database to during a rollback.
-**  (5)  4 byte integer which is the number of bytes in the master journal
+**  (5)  4 byte integer which is the page size of the database.
+**  (6)  4 byte integer which is the number of bytes in the master journal
 **       name.  The value may be zero (indicate that there is no master
 **       journal.)
-**  (6)  N bytes of the master journal name.  The name will be nul-terminated
-**       and might be shorter than the value read from (5).  If the first byte
+**  (7)  N bytes of the master journal name.  The name will be nul-terminated
+**       and might be shorter than the value read from (6).  If the first byte
 **       of the name is \000 then there is no master journal.  The master
 **       journal name is stored in UTF-8.
-**  (7)  Zero or more pages instances, each as follows:
+**  (8)  Zero or more pages instances, each as follows:
 **        +  4 byte page number.
 **        +  pPager->pageSize bytes of data.
 **        +  4 byte checksum
 **
-** When we speak of the journal header, we mean the first 6 items above.
-** Each entry in the journal is an instance of the 7th item.
+** When we speak of the journal header, we mean the first 7 items above.
+** Each entry in the journal is an instance of the 8th item.
 **
 ** Call the value from the second bullet "nRec".  nRec is the number of
 ** valid page entries in the journal.  In most cases, you can compute the
@@ -800,6 +1971,7 @@ static int pager_playback(Pager *pPager, int useJournalSize){
   int nRec;                /* Number of Records in the journal */
   int i;                   /* Loop counter */
   Pgno mxPg = 0;           /* Size of the original file in pages */
+  u32 pageSize;            /* Page size recorded in the journal header */
   unsigned char aMagic[8]; /* A buffer to hold the magic header */
   int rc;                  /* Result code of a subroutine */
   int nMaster;             /* Number of bytes in the name of master journal */
@@ -821,7 +1993,7 @@ static int pager_playback(Pager *pPager, int useJournalSize){
   ** the database file should have still been completely unchanged.
   ** Nothing needs to be rolled back.  We can safely ignore this journal.
   */
-  if( szJ < 24 ){
+  if( szJ < 28 ){
     goto end_playback;
   }
 
@@ -836,9 +2008,6 @@ static int pager_playback(Pager *pPager, int useJournalSize){
   /* (2) Read the number of pages stored in the journal.  */
   rc = read32bits(&pPager->jfd, (u32*)&nRec);
   if( rc ) goto end_playback;
-  if( nRec==0xffffffff || useJournalSize ){
-    nRec = (szJ - JOURNAL_HDR_SZ(pPager))/JOURNAL_PG_SZ(pPager);
-  }
 
   /* (3) Read the initial value for the sanity checksum */
   rc = read32bits(&pPager->jfd, &pPager->cksumInit);
@@ -851,7 +2020,23 @@ static int pager_playback(Pager *pPager, int useJournalSize){
     goto end_playback;
   }
 
-  /* (5) and (6): Check if a master journal file is specified. If one is
+  /* (5) Read the page size.  A hot journal is played back before the
+  ** page size of the database is known, so the pager adopts the page
+  ** size of the journal.  The cache is always empty at that point.
+  */
+  rc = read32bits(&pPager->jfd, &pageSize);
+  if( rc ) goto end_playback;
+  if( pageSize!=pPager->pageSize ){
+    if( sqlite3pager_set_pagesize(pPager, pageSize)!=(int)pageSize ){
+      rc = SQLITE_CORRUPT;
+      goto end_playback;
+    }
+  }
+  if( nRec==0xffffffff || useJournalSize ){
+    nRec = (szJ - JOURNAL_HDR_SZ(pPager))/JOURNAL_PG_SZ(pPager);
+  }
+
+  /* (6) and (7): Check if a master journal file is specified. If one is
   ** specified, only proceed with the playback if it still exists. */
   rc = read32bits(&pPager->jfd, &nMaster);
   if( rc ) goto end_playback;
@@ -869,7 +2054,7 @@ static int pager_playback(Pager *pPager, int useJournalSize){
 
   /* Truncate the database file back to it's original size */
   assert( pPager->origDbSize==0 || pPager->origDbSize==mxPg );
-  rc = sqlite3OsTruncate(&pPager->fd, SQLITE_PAGE_SIZE*(off_t)mxPg);
+  rc = pager_truncate_file(pPager, mxPg);
   if( rc!=SQLITE_OK ){
     goto end_playback;
   }
@@ -938,16 +2123,19 @@ static int pager_stmt_playback(Pager *pPager){
   off_t szJ;               /* Size of the full journal */
   int nRec;                /* Number of Records */
   int i;                   /* Loop counter */
-  int rc;
+  int rc = SQLITE_OK;
 
-  /* Truncate the database back to its original size.
+  /* Truncate the database back to its original size.  In WAL mode the
+  ** database file has not been changed, so only the size is reset.
   */
-  rc = sqlite3OsTruncate(&pPager->fd, SQLITE_PAGE_SIZE*(off_t)pPager->stmtSize);
+  if( !pPager->useWal ){
+    rc = pager_truncate_file(pPager, pPager->stmtSize);
+  }
   pPager->dbSize = pPager->stmtSize;
 
   /* Figure out how many records are in the statement journal.
   */
-  assert( pPager->stmtInUse && pPager->journalOpen );
+  assert( pPager->stmtInUse && (pPager->journalOpen || pPager->useWal) );
   sqlite3OsSeek(&pPager->stfd, 0);
   nRec = pPager->stmtNRec;
   
@@ -963,8 +2151,11 @@ static int pager_stmt_playback(Pager *pPager){
   }
 
   /* Figure out how many pages need to be copied out of the transaction
-  ** journal.
+  ** journal.  There is no transaction journal in WAL mode.
   */
+  if( !pPager->journalOpen ){
+    goto end_stmt_playback;
+  }
   rc = sqlite3OsSeek(&pPager->jfd, pPager->stmtJSize);
   if( rc!=SQLITE_OK ){
     goto end_stmt_playback;
@@ -990,6 +2181,39 @@ end_stmt_playback:
   return rc;
 }
 
+/*
+** Change the page size used by the pager and resize the scratch buffer
+** to match.  This is only possible while no pages are in the cache.
+** Return SQLITE_OK on success or an error code if the page size could
+** not be changed.
+*/
+static int pager_set_pagesize(Pager *pPager, int pageSize){
+  u8 *pNew;
+  if( pageSize==pPager->pageSize ) return SQLITE_OK;
+  if( pPager->nPage>0 ) return SQLITE_ERROR;
+  pNew = sqliteMallocRaw( pageSize );
+  if( pNew==0 ) return SQLITE_NOMEM;
+  sqliteFree(pPager->pTmpSpace);
+  pPager->pTmpSpace = pNew;
+  pPager->pageSize = pageSize;
+  return SQLITE_OK;
+}
+
+/*
+** Get or set the page size.  The size must be a power of two between
+** SQLITE_MIN_PAGE_SIZE and SQLITE_MAX_PAGE_SIZE and can only be changed
+** while no pages are held in the cache.  Any other value, or a change
+** requested at any other time, leaves the page size unchanged.  The
+** page size in effect is returned.
+*/
+int sqlite3pager_set_pagesize(Pager *pPager, int pageSize){
+  if( pageSize>=SQLITE_MIN_PAGE_SIZE && pageSize<=SQLITE_MAX_PAGE_SIZE
+   && (pageSize&(pageSize-1))==0 && pPager->nRef==0 ){
+    pager_set_pagesize(pPager, pageSize);
+  }
+  return pPager->pageSize;
+}
+
 /*
 ** Change the maximum number of in-memory pages that are allowed.
 **
@@ -1009,6 +2233,7 @@ void sqlite3pager_set_cachesize(Pager *pPager, int mxPage){
     mxPage = -mxPage;
   }
   if( mxPage>10 ){
+    if( mxPage!=pPager->mxPage ) pager_ghost_clear(pPager);
     pPager->mxPage = mxPage;
   }
 }
@@ -1127,16 +2352,27 @@ int sqlite3pager_open(
     return rc;
   }
   nameLen = strlen(zFullPathname);
-  pPager = sqliteMalloc( sizeof(*pPager) + nameLen*3 + 30 );
+  pPager = sqliteMalloc( sizeof(*pPager) + nameLen*4 + 30 );
   if( pPager==0 ){
     if( tempFile ) sqlite3OsClose(&fd);
     if( zFullPathname ) sqliteFree(zFullPathname);
     return SQLITE_NOMEM;
   }
+  pPager->pTmpSpace = sqliteMallocRaw( SQLITE_PAGE_SIZE );
+  pPager->aHash = sqliteMalloc( N_PG_HASH*sizeof(PgHdr*) );
+  if( pPager->pTmpSpace==0 || pPager->aHash==0 ){
+    if( !memDb ) sqlite3OsClose(&fd);
+    sqliteFree(zFullPathname);
+    sqliteFree(pPager->pTmpSpace);
+    sqliteFree(pPager->aHash);
+    sqliteFree(pPager);
+    return SQLITE_NOMEM;
+  }
   SET_PAGER(pPager);
   pPager->zFilename = (char*)&pPager[1];
   pPager->zDirectory = &pPager->zFilename[nameLen+1];
   pPager->zJournal = &pPager->zDirectory[nameLen+1];
+  pPager->zWal = &pPager->zJournal[nameLen+9];
   strcpy(pPager->zFilename, zFullPathname);
   strcpy(pPager->zDirectory, zFullPathname);
   for(i=nameLen; i>0 && pPager->zDirectory[i-1]!='/'; i--){}
@@ -1144,6 +2380,8 @@ int sqlite3pager_open(
   strcpy(pPager->zJournal, zFullPathname);
   sqliteFree(zFullPathname);
   strcpy(&pPager->zJournal[nameLen], "-journal");
+  strcpy(pPager->zWal, pPager->zFilename);
+  strcpy(&pPager->zWal[nameLen], "-wal");
   pPager->fd = fd;
   pPager->journalOpen = 0;
   pPager->useJournal = useJournal && !memDb;
@@ -1163,12 +2401,16 @@ int sqlite3pager_open(
   pPager->readOnly = readOnly;
   pPager->needSync = 0;
   pPager->noSync = pPager->tempFile || !useJournal;
-  pPager->pFirst = 0;
-  pPager->pFirstSynced = 0;
-  pPager->pLast = 0;
   pPager->nExtra = nExtra;
   pPager->pBusyHandler = (BusyHandler *)pBusyHandler;
-  memset(pPager->aHash, 0, sizeof(pPager->aHash));
+  pPager->nHash = N_PG_HASH;
+  sqlite3HashInit(&pPager->walIndex, SQLITE_HASH_INT, 0);
+  sqlite3HashInit(&pPager->ghostIndex, SQLITE_HASH_INT, 0);
+  sqlite3HashInit(&pPager->hotIndex, SQLITE_HASH_INT, 0);
+  pPager->mxMmap = memDb ? 0 : SQLITE_DEFAULT_MMAP_SIZE;
+  pPager->nReadAhead = memDb ? 0 : SQLITE_DEFAULT_READAHEAD;
+  pPager->nGroupWindow = SQLITE_DEFAULT_GROUP_COMMIT;
+  pPager->cachePolicy = SQLITE_DEFAULT_CACHE_POLICY;
   *ppPager = pPager;
   return SQLITE_OK;
 }
@@ -1196,6 +2438,15 @@ void sqlite3pager_set_reiniter(Pager *pPager, void (*xReinit)(void*,int)){
   pPager->xReiniter = xReinit;
 }
 
+/*
+** Change the busy handler that is invoked when the database file is
+** locked by another process.  A pager that is shared by several database
+** connections invokes the handler of whichever connection is using it.
+*/
+void sqlite3pager_set_busyhandler(Pager *pPager, void *pBusyHandler){
+  pPager->pBusyHandler = (BusyHandler *)pBusyHandler;
+}
+
 /*
 ** Return the total number of pages in the disk file associated with
 ** pPager.
@@ -1206,12 +2457,16 @@ int sqlite3pager_pagecount(Pager *pPager){
   if( pPager->dbSize>=0 ){
     return pPager->dbSize;
   }
+  if( pPager->useWal && pPager->mxFrame>0 && pPager->state!=PAGER_UNLOCK ){
+    pPager->dbSize = pPager->walDbSize;
+    return pPager->dbSize;
+  }
   if( sqlite3OsFileSize(&pPager->fd, &n)!=SQLITE_OK ){
     pPager->errMask |= PAGER_ERR_DISK;
     return 0;
   }
-  n /= SQLITE_PAGE_SIZE;
-  if( !pPager->memDb && n==PENDING_BYTE/SQLITE_PAGE_SIZE ){
+  n /= pPager->pageSize;
+  if( !pPager->memDb && n==PENDING_BYTE/pPager->pageSize ){
     n++;
   }
   if( pPager->state!=PAGER_UNLOCK ){
@@ -1233,27 +2488,8 @@ static int syncJournal(Pager*, const char*);
 static void unlinkPage(PgHdr *pPg){
   Pager *pPager = pPg->pPager;
 
-  /* Keep the pFirstSynced pointer pointing at the first synchronized page */
-  if( pPg==pPager->pFirstSynced ){
-    PgHdr *p = pPg->pNextFree;
-    while( p && p->needSync ){ p = p->pNextFree; }
-    pPager->pFirstSynced = p;
-  }
-
   /* Unlink from the freelist */
-  if( pPg->pPrevFree ){
-    pPg->pPrevFree->pNextFree = pPg->pNextFree;
-  }else{
-    assert( pPager->pFirst==pPg );
-    pPager->pFirst = pPg->pNextFree;
-  }
-  if( pPg->pNextFree ){
-    pPg->pNextFree->pPrevFree = pPg->pPrevFree;
-  }else{
-    assert( pPager->pLast==pPg );
-    pPager->pLast = pPg->pPrevFree;
-  }
-  pPg->pNextFree = pPg->pPrevFree = 0;
+  pager_free_remove(pPg);
 
   /* Unlink from the pgno hash table */
   if( pPg->pNextHash ){
@@ -1262,7 +2498,7 @@ static void unlinkPage(PgHdr *pPg){
   if( pPg->pPrevHash ){
     pPg->pPrevHash->pNextHash = pPg->pNextHash;
   }else{
-    int h = pager_hash(pPg->pgno);
+    int h = pager_hash(pPager, pPg->pgno);
     assert( pPager->aHash[h]==pPg );
     pPager->aHash[h] = pPg->pNextHash;
   }
@@ -1289,6 +2525,7 @@ static void memoryTruncate(Pager *pPager){
     }else{
       *ppPg = pPg->pNextAll;
       unlinkPage(pPg);
+      if( !pPg->hot ) pPager->nCold--;
       sqliteFree(pPg);
       pPager->nPage--;
     }
@@ -1315,11 +2552,50 @@ int sqlite3pager_truncate(Pager *pPager, Pgno nPage){
     memoryTruncate(pPager);
     return SQLITE_OK;
   }
+  if( pPager->useWal ){
+    /* The database file is truncated by the next checkpoint */
+    pPager->dbSize = nPage;
+    return SQLITE_OK;
+  }
+  if( pPager->journalOpen ){
+    /* A rollback must be able to restore every page cut off the end of
+    ** the file.  Write those that are not yet in the journal to it. */
+    Pgno i;
+    for(i=nPage+1; (int)i<=pPager->origDbSize && (int)i<=pPager->dbSize; i++){
+      void *pData;
+      if( pPager->aInJournal && (pPager->aInJournal[i/8] & (1<<(i&7))) ){
+        continue;
+      }
+      rc = sqlite3pager_get(pPager, i, &pData);
+      if( rc!=SQLITE_OK ) return rc;
+      rc = sqlite3pager_write(pData);
+      sqlite3pager_unref(pData);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+  }
   rc = syncJournal(pPager, 0);
   if( rc!=SQLITE_OK ){
     return rc;
   }
-  rc = sqlite3OsTruncate(&pPager->fd, SQLITE_PAGE_SIZE*(off_t)nPage);
+
+  /* Shortening the file changes it, so from here on a rollback has to
+  ** play the journal back.  Take the EXCLUSIVE lock that says so.
+  */
+  if( pPager->state<PAGER_EXCLUSIVE ){
+    int busy = 1;
+    do {
+      rc = sqlite3OsLock(&pPager->fd, EXCLUSIVE_LOCK);
+    }while( rc==SQLITE_BUSY && 
+        pPager->pBusyHandler && 
+        pPager->pBusyHandler->xFunc && 
+        pPager->pBusyHandler->xFunc(pPager->pBusyHandler->pArg, busy++)
+    );
+    if( rc!=SQLITE_OK ){
+      return rc;
+    }
+    pPager->state = PAGER_EXCLUSIVE;
+  }
+  rc = pager_truncate_file(pPager, nPage);
   if( rc==SQLITE_OK ){
     pPager->dbSize = nPage;
   }
@@ -1371,6 +2647,11 @@ int sqlite3pager_close(Pager *pPager){
     pNext = pPg->pNextAll;
     sqliteFree(pPg);
   }
+  if( pPager->walOpen ){
+    pager_wal_close(pPager);
+  }
+  pager_group_detach(pPager);
+  pager_mmap_release(pPager);
   if( !pPager->memDb ){
     sqlite3OsClose(&pPager->fd);
   }
@@ -1387,6 +2668,9 @@ int sqlite3pager_close(Pager *pPager){
     sqliteFree(pPager->zJournal);
     sqliteFree(pPager->zDirectory);
   }
+  sqliteFree(pPager->pTmpSpace);
+  sqliteFree(pPager->aHash);
+  pager_ghost_clear(pPager);
   sqliteFree(pPager);
   return SQLITE_OK;
 }
@@ -1411,21 +2695,7 @@ Pgno sqlite3pager_pagenumber(void *pData){
 static void _page_ref(PgHdr *pPg){
   if( pPg->nRef==0 ){
     /* The page is currently on the freelist.  Remove it. */
-    if( pPg==pPg->pPager->pFirstSynced ){
-      PgHdr *p = pPg->pNextFree;
-      while( p && p->needSync ){ p = p->pNextFree; }
-      pPg->pPager->pFirstSynced = p;
-    }
-    if( pPg->pPrevFree ){
-      pPg->pPrevFree->pNextFree = pPg->pNextFree;
-    }else{
-      pPg->pPager->pFirst = pPg->pNextFree;
-    }
-    if( pPg->pNextFree ){
-      pPg->pNextFree->pPrevFree = pPg->pPrevFree;
-    }else{
-      pPg->pPager->pLast = pPg->pPrevFree;
-    }
+    pager_free_remove(pPg);
     pPg->pPager->nRef++;
   }
   pPg->nRef++;
@@ -1514,7 +2784,7 @@ static int syncJournal(Pager *pPager, const char *zMaster){
         /* Write the name of the master journal file if one is specified */
         if( zMaster ){
           assert( strlen(zMaster)<pPager->nMaster );
-          rc = sqlite3OsSeek(&pPager->jfd, 20);
+          rc = sqlite3OsSeek(&pPager->jfd, 28);
           if( rc ) return rc;
           rc = sqlite3OsWrite(&pPager->jfd, zMaster, strlen(zMaster)+1);
           if( rc ) return rc;
@@ -1535,7 +2805,7 @@ static int syncJournal(Pager *pPager, const char *zMaster){
     for(pPg=pPager->pAll; pPg; pPg=pPg->pNextAll){
       pPg->needSync = 0;
     }
-    pPager->pFirstSynced = pPager->pFirst;
+    pager_all_synced(pPager);
   }
 
 #ifndef NDEBUG
@@ -1547,7 +2817,8 @@ static int syncJournal(Pager *pPager, const char *zMaster){
     for(pPg=pPager->pAll; pPg; pPg=pPg->pNextAll){
       assert( pPg->needSync==0 );
     }
-    assert( pPager->pFirstSynced==pPager->pFirst );
+    assert( pPager->aFree[0].pFirstSynced==pPager->aFree[0].pFirst );
+    assert( pPager->aFree[1].pFirstSynced==pPager->aFree[1].pFirst );
   }
 #endif
 
@@ -1595,23 +2866,100 @@ static int pager_write_pagelist(PgHdr *pList){
   }
   pPager->state = PAGER_EXCLUSIVE;
 
+  /* Write the pages in runs of consecutive page numbers.  When the list
+  ** is sorted, as it is at commit, each run goes to the disk with a
+  ** single vectored write.  Pages past the end of a database that has
+  ** been truncated during the transaction are dropped, not written.
+  */
   while( pList ){
-    assert( pList->dirty );
-    sqlite3OsSeek(&pPager->fd, (pList->pgno-1)*(off_t)SQLITE_PAGE_SIZE);
-    CODEC(pPager, PGHDR_TO_DATA(pList), pList->pgno, 6);
-    TRACE2("STORE page %d\n", pList->pgno);
-    rc = sqlite3OsWrite(&pPager->fd, PGHDR_TO_DATA(pList), SQLITE_PAGE_SIZE);
-    CODEC(pPager, PGHDR_TO_DATA(pList), pList->pgno, 0);
+    void *apData[PAGER_MAX_RUN];  /* Page images in the current run */
+    int anData[PAGER_MAX_RUN];    /* Size of each entry in apData[] */
+    PgHdr *p;
+    PgHdr *pEnd;                  /* First page past the run */
+    int n = 0;
+    if( pPager->dbSize>=0 && pList->pgno>(unsigned)pPager->dbSize ){
+      pList->dirty = 0;
+      pList = pList->pDirty;
+      continue;
+    }
+    for(p=pList; p && n<PAGER_MAX_RUN; p=p->pDirty){
+      assert( p->dirty );
+      if( n>0 && p->pgno!=pList->pgno+n ) break;
+      if( pPager->dbSize>=0 && p->pgno>(unsigned)pPager->dbSize ) break;
+      CODEC(pPager, PGHDR_TO_DATA(p), p->pgno, 6);
+      TRACE2("STORE page %d\n", p->pgno);
+      apData[n] = PGHDR_TO_DATA(p);
+      anData[n] = pPager->pageSize;
+      n++;
+    }
+    pEnd = p;
+    rc = sqlite3OsWritevAt(&pPager->fd, apData, anData, n,
+                           (pList->pgno-1)*(off_t)pPager->pageSize);
+    for(p=pList; p!=pEnd; p=p->pDirty){
+      CODEC(pPager, PGHDR_TO_DATA(p), p->pgno, 0);
+      if( rc==SQLITE_OK ) p->dirty = 0;
+    }
     if( rc ) return rc;
-    pList->dirty = 0;
-    pList = pList->pDirty;
+    pList = pEnd;
   }
   return SQLITE_OK;
 }
 
 /*
-** Collect every dirty page into a dirty list and
-** return a pointer to the head of that list.  All pages are
+** Merge two lists of pages connected by PgHdr.pDirty and in ascending
+** page number order into a single list.
+*/
+static PgHdr *pager_merge_pagelist(PgHdr *pA, PgHdr *pB){
+  PgHdr result, *pTail;
+  pTail = &result;
+  while( pA && pB ){
+    if( pA->pgno<pB->pgno ){
+      pTail->pDirty = pA;
+      pTail = pA;
+      pA = pA->pDirty;
+    }else{
+      pTail->pDirty = pB;
+      pTail = pB;
+      pB = pB->pDirty;
+    }
+  }
+  pTail->pDirty = pA ? pA : pB;
+  return result.pDirty;
+}
+
+/*
+** Sort a list of pages connected by PgHdr.pDirty into ascending page
+** number order, so that pages can be written back sequentially and
+** adjacent pages coalesced into a single write.  This is a bottom-up
+** merge sort: a[i] holds a sorted list of 2**i pages, or is NULL.
+*/
+static PgHdr *pager_sort_pagelist(PgHdr *pIn){
+  PgHdr *a[32], *p;
+  int i;
+  memset(a, 0, sizeof(a));
+  while( pIn ){
+    p = pIn;
+    pIn = p->pDirty;
+    p->pDirty = 0;
+    for(i=0; i<ArraySize(a)-1 && a[i]; i++){
+      p = pager_merge_pagelist(a[i], p);
+      a[i] = 0;
+    }
+    if( a[i] ){
+      p = pager_merge_pagelist(a[i], p);
+    }
+    a[i] = p;
+  }
+  p = 0;
+  for(i=0; i<ArraySize(a); i++){
+    p = pager_merge_pagelist(a[i], p);
+  }
+  return p;
+}
+
+/*
+** Collect every dirty page into a dirty list and return a pointer to
+** the head of that list, sorted by page number.  All pages are
 ** collected even if they are still in use.
 */
 static PgHdr *pager_get_all_dirty_pages(Pager *pPager){
@@ -1623,7 +2971,7 @@ static PgHdr *pager_get_all_dirty_pages(Pager *pPager){
       pList = p;
     }
   }
-  return pList;
+  return pager_sort_pagelist(pList);
 }
 
 /*
@@ -1722,6 +3070,37 @@ int sqlite3pager_get(Pager *pPager, Pgno pgno, void **ppPage){
          return rc;
        }
     }
+
+    /* A write transaction may only begin from the most recent snapshot.
+    ** If this snapshot is for one, take the RESERVED lock before the
+    ** write-ahead log is read, so that no other connection can commit
+    ** in between and make sqlite3pager_begin() fail with SQLITE_BUSY.
+    */
+    if( pPager->walForWrite && !pPager->readOnly ){
+      busy = 1;
+      do {
+        rc = sqlite3OsLock(&pPager->fd, RESERVED_LOCK);
+      }while( rc==SQLITE_BUSY && 
+          pPager->pBusyHandler && 
+          pPager->pBusyHandler->xFunc && 
+          pPager->pBusyHandler->xFunc(pPager->pBusyHandler->pArg, busy++)
+      );
+      if( rc!=SQLITE_OK ){
+        sqlite3OsUnlock(&pPager->fd, NO_LOCK);
+        pPager->state = PAGER_UNLOCK;
+        return rc;
+      }
+    }
+
+    /* Bring the write-ahead log index up to date for the new snapshot.
+    */
+    rc = pager_wal_begin_read(pPager);
+    if( rc!=SQLITE_OK ){
+      sqlite3OsUnlock(&pPager->fd, NO_LOCK);
+      pPager->state = PAGER_UNLOCK;
+      return rc;
+    }
+    pager_mmap_begin_read(pPager);
     pPg = 0;
   }else{
     /* Search for page in cache */
@@ -1734,9 +3113,16 @@ int sqlite3pager_get(Pager *pPager, Pgno pgno, void **ppPage){
     /* The requested page is not in the page cache. */
     int h;
     pPager->nMiss++;
-    if( pPager->nPage<pPager->mxPage || pPager->pFirst==0 || pPager->memDb ){
-      /* Create a new page */
-      pPg = sqliteMallocRaw( sizeof(*pPg) + SQLITE_PAGE_SIZE 
+    pPager->aMiss[pPager->cachePolicy]++;
+    if( pPager->nPage<pPager->mxPage || pPager->memDb
+     || (pPager->aFree[0].pFirst==0 && pPager->aFree[1].pFirst==0)
+     || (pPager->useWal && pPager->aFree[0].pFirstSynced==0
+                        && pPager->aFree[1].pFirstSynced==0) ){
+      /* Create a new page.  In WAL mode, dirty pages cannot be written
+      ** until commit and so are marked needSync to keep them from being
+      ** recycled.  If every free page is dirty, the cache must grow.
+      */
+      pPg = sqliteMallocRaw( sizeof(*pPg) + pPager->pageSize 
                               + sizeof(u32) + pPager->nExtra
                               + pPager->memDb*sizeof(PgHistory) );
       if( pPg==0 ){
@@ -1754,11 +3140,21 @@ int sqlite3pager_get(Pager *pPager, Pgno pgno, void **ppPage){
       pPg->pNextAll = pPager->pAll;
       pPager->pAll = pPg;
       pPager->nPage++;
+      pPager->nCold++;
+      if( pPager->nPage>pPager->nHash ){
+        pager_resize_hash(pPager);
+      }
     }else{
       /* Find a page to recycle.  Try to locate a page that does not
-      ** require us to do an fsync() on the journal.
+      ** require us to do an fsync() on the journal, preferring the free
+      ** list chosen by the replacement policy.
       */
-      pPg = pPager->pFirstSynced;
+      PgFreeList *pList = pager_victim_list(pPager);
+      pPg = pList->pFirstSynced;
+      if( pPg==0 ){
+        pPg = pPager->aFree[0].pFirstSynced;
+        if( pPg==0 ) pPg = pPager->aFree[1].pFirstSynced;
+      }
 
       /* If we could not find a page that does not require an fsync()
       ** on the journal file then fsync the journal file.  This is a
@@ -1771,7 +3167,7 @@ int sqlite3pager_get(Pager *pPager, Pgno pgno, void **ppPage){
           sqlite3pager_rollback(pPager);
           return SQLITE_IOERR;
         }
-        pPg = pPager->pFirst;
+        pPg = pList->pFirst;
       }
       assert( pPg->nRef==0 );
 
@@ -1803,9 +3199,20 @@ int sqlite3pager_get(Pager *pPager, Pgno pgno, void **ppPage){
       /* Unlink the old page from the free list and the hash table
       */
       unlinkPage(pPg);
+      if( pPg->hot ){
+        pPg->hot = 0;
+        pPager->nCold++;
+      }else if( pPager->cachePolicy==PAGER_CACHE_2Q ){
+        pager_ghost_add(pPager, pPg->pgno);
+      }
       pPager->nOvfl++;
     }
     pPg->pgno = pgno;
+    if( pPager->cachePolicy==PAGER_CACHE_2Q
+     && pager_ghost_remove(pPager, pgno) ){
+      pPg->hot = 1;
+      pPager->nCold--;
+    }
     if( pPager->aInJournal && (int)pgno<=pPager->origDbSize ){
       sqlite3CheckMemory(pPager->aInJournal, pgno/8);
       assert( pPager->journalOpen );
@@ -1825,7 +3232,7 @@ int sqlite3pager_get(Pager *pPager, Pgno pgno, void **ppPage){
     pPg->nRef = 1;
     REFINFO(pPg);
     pPager->nRef++;
-    h = pager_hash(pgno);
+    h = pager_hash(pPager, pgno);
     pPg->pNextHash = pPager->aHash[h];
     pPager->aHash[h] = pPg;
     if( pPg->pNextHash ){
@@ -1842,28 +3249,29 @@ int sqlite3pager_get(Pager *pPager, Pgno pgno, void **ppPage){
       return rc;
     }
     if( pPager->dbSize<(int)pgno ){
-      memset(PGHDR_TO_DATA(pPg), 0, SQLITE_PAGE_SIZE);
+      memset(PGHDR_TO_DATA(pPg), 0, pPager->pageSize);
     }else{
       int rc;
       assert( pPager->memDb==0 );
-      sqlite3OsSeek(&pPager->fd, (pgno-1)*(off_t)SQLITE_PAGE_SIZE);
-      rc = sqlite3OsRead(&pPager->fd, PGHDR_TO_DATA(pPg), SQLITE_PAGE_SIZE);
+      rc = pager_read_page(pPager, pgno, PGHDR_TO_DATA(pPg));
+      pager_track_read(pPager, pgno);
       TRACE2("FETCH page %d\n", pPg->pgno);
       CODEC(pPager, PGHDR_TO_DATA(pPg), pPg->pgno, 3);
       if( rc!=SQLITE_OK ){
         off_t fileSize;
         if( sqlite3OsFileSize(&pPager->fd,&fileSize)!=SQLITE_OK
-               || fileSize>=pgno*SQLITE_PAGE_SIZE ){
+               || fileSize>=pgno*pPager->pageSize ){
           sqlite3pager_unref(PGHDR_TO_DATA(pPg));
           return rc;
         }else{
-          memset(PGHDR_TO_DATA(pPg), 0, SQLITE_PAGE_SIZE);
+          memset(PGHDR_TO_DATA(pPg), 0, pPager->pageSize);
         }
       }
     }
   }else{
     /* The requested page is in the page cache. */
     pPager->nHit++;
+    pPager->aHit[pPager->cachePolicy]++;
     page_ref(pPg);
   }
   *ppPage = PGHDR_TO_DATA(pPg);
@@ -1919,17 +3327,7 @@ int sqlite3pager_unref(void *pData){
   if( pPg->nRef==0 ){
     Pager *pPager;
     pPager = pPg->pPager;
-    pPg->pNextFree = 0;
-    pPg->pPrevFree = pPager->pLast;
-    pPager->pLast = pPg;
-    if( pPg->pPrevFree ){
-      pPg->pPrevFree->pNextFree = pPg;
-    }else{
-      pPager->pFirst = pPg;
-    }
-    if( pPg->needSync==0 && pPager->pFirstSynced==0 ){
-      pPager->pFirstSynced = pPg;
-    }
+    pager_free_append(pPg);
     if( pPager->xDestructor ){
       pPager->xDestructor(pData, pPager->pageSize);
     }
@@ -1991,6 +3389,7 @@ static int pager_open_journal(Pager *pPager){
   ** - 4 bytes: Number of records in journal, or -1 no-sync mode is on.
   ** - 4 bytes: Magic used for page checksums.
   ** - 4 bytes: Initial database page count.
+  ** - 4 bytes: Page size.
   ** - 4 bytes: Number of bytes reserved for master journal ptr (nMaster)
   ** - nMaster bytes: Space for a master journal pointer.
   */
@@ -2005,11 +3404,14 @@ static int pager_open_journal(Pager *pPager){
   if( rc==SQLITE_OK ){
     rc = write32bits(&pPager->jfd, pPager->dbSize);
   }
+  if( rc==SQLITE_OK ){
+    rc = write32bits(&pPager->jfd, pPager->pageSize);
+  }
   if( rc==SQLITE_OK ){
     rc = write32bits(&pPager->jfd, pPager->nMaster);
   }
   if( rc==SQLITE_OK ){
-    sqlite3OsSeek(&pPager->jfd, 24 + pPager->nMaster - 1);
+    sqlite3OsSeek(&pPager->jfd, 28 + pPager->nMaster - 1);
     rc = sqlite3OsWrite(&pPager->jfd, "\000", 1);
   }
   if( pPager->stmtAutoopen && rc==SQLITE_OK ){
@@ -2071,11 +3473,19 @@ int sqlite3pager_begin(void *pData, int nMaster){
       if( rc!=SQLITE_OK ){
         return rc;
       }
+      rc = pager_wal_begin_write(pPager);
+      if( rc!=SQLITE_OK ){
+        sqlite3OsUnlock(&pPager->fd, SHARED_LOCK);
+        return rc;
+      }
       pPager->nMaster = nMaster;
       pPager->state = PAGER_RESERVED;
       pPager->dirtyCache = 0;
       TRACE3("TRANSACTION %d nMaster=%d\n", pPager->fd.h, nMaster);
-      if( pPager->useJournal && !pPager->tempFile ){
+      if( pPager->useWal ){
+        sqlite3pager_pagecount(pPager);
+        pPager->origDbSize = pPager->dbSize;
+      }else if( pPager->useJournal && !pPager->tempFile ){
         rc = pager_open_journal(pPager);
       }
     }
@@ -2136,18 +3546,25 @@ int sqlite3pager_write(void *pData){
     return rc;
   }
   assert( pPager->state>=PAGER_RESERVED );
-  if( !pPager->journalOpen && pPager->useJournal ){
+  if( !pPager->journalOpen && pPager->useJournal && !pPager->useWal ){
     rc = pager_open_journal(pPager);
     if( rc!=SQLITE_OK ) return rc;
   }
-  assert( pPager->journalOpen || !pPager->useJournal );
+  assert( pPager->journalOpen || !pPager->useJournal || pPager->useWal );
   pPager->dirtyCache = 1;
 
   /* The transaction journal now exists and we have a RESERVED or an
   ** EXCLUSIVE lock on the main database file.  Write the current page to
   ** the transaction journal if it is not there already.
+  **
+  ** In WAL mode the original page content remains in the database file
+  ** or log until commit, so nothing is journalled.  The page is marked
+  ** needSync so that it will not be recycled before it is committed.
   */
-  if( !pPg->inJournal && (pPager->useJournal || pPager->memDb) ){
+  if( pPager->useWal ){
+    pPg->inJournal = 1;
+    pPg->needSync = 1;
+  }else if( !pPg->inJournal && (pPager->useJournal || pPager->memDb) ){
     if( (int)pPg->pgno <= pPager->origDbSize ){
       int szPg;
       u32 saved;
@@ -2163,8 +3580,8 @@ int sqlite3pager_write(void *pData){
       }else{
         u32 cksum = pager_cksum(pPager, pPg->pgno, pData);
         saved = *(u32*)PGHDR_TO_EXTRA(pPg);
-        store32bits(cksum, pPg, SQLITE_PAGE_SIZE);
-        szPg = SQLITE_PAGE_SIZE+8;
+        store32bits(cksum, pPg, pPager->pageSize);
+        szPg = pPager->pageSize+8;
         store32bits(pPg->pgno, pPg, -4);
         CODEC(pPager, pData, pPg->pgno, 7);
         rc = sqlite3OsWrite(&pPager->jfd, &((char*)pData)[-4], szPg);
@@ -2213,7 +3630,7 @@ int sqlite3pager_write(void *pData){
     }else{
       store32bits(pPg->pgno, pPg, -4);
       CODEC(pPager, pData, pPg->pgno, 7);
-      rc = sqlite3OsWrite(&pPager->stfd, ((char*)pData)-4, SQLITE_PAGE_SIZE+4);
+      rc = sqlite3OsWrite(&pPager->stfd, ((char*)pData)-4, pPager->pageSize+4);
       TRACE2("STMT-JOURNAL page %d\n", pPg->pgno);
       CODEC(pPager, pData, pPg->pgno, 0);
       if( rc!=SQLITE_OK ){
@@ -2261,7 +3678,7 @@ int sqlite3pager_overwrite(Pager *pPager, Pgno pgno, void *pData){
   if( rc==SQLITE_OK ){
     rc = sqlite3pager_write(pPage);
     if( rc==SQLITE_OK ){
-      memcpy(pPage, pData, SQLITE_PAGE_SIZE);
+      memcpy(pPage, pData, pPager->pageSize);
     }
     sqlite3pager_unref(pPage);
   }
@@ -2413,7 +3830,7 @@ int sqlite3pager_commit(Pager *pPager){
     pPager->dbSize = -1;
     return rc;
   }
-  assert( pPager->journalOpen );
+  assert( pPager->journalOpen || pPager->useWal );
 #if 0
   rc = syncJournal(pPager, 0);
   if( rc!=SQLITE_OK ){
@@ -2431,6 +3848,9 @@ int sqlite3pager_commit(Pager *pPager){
   if( rc!=SQLITE_OK ){
     goto commit_abort;
   }
+  if( pPager->useWal ){
+    pager_wal_autocheckpoint(pPager);
+  }
   rc = pager_unwritelock(pPager);
   pPager->dbSize = -1;
   return rc;
@@ -2445,6 +3865,91 @@ commit_abort:
   return rc;
 }
 
+/*
+** Return the number of the most recent commit by this pager whose sync
+** of the write-ahead log was deferred by group commit, and forget it.
+** Zero is returned if there is no such commit.
+*/
+int sqlite3pager_commit_id(Pager *pPager){
+  int iCommit = pPager->iGroupCommit;
+  pPager->iGroupCommit = 0;
+  return iCommit;
+}
+
+/*
+** Wait until commit number iCommit, as returned by
+** sqlite3pager_commit_id(), is durable.
+**
+** Under group commit, a transaction is appended to the write-ahead log
+** and the write lock released without syncing the log, so that other
+** connections can append their own transactions right away.  Each
+** committer then calls this routine and takes the sync mutex of the
+** group.  The first to get it becomes the leader.  It sleeps for the
+** group commit window, to give other commits a chance to join the
+** group, and then syncs the log once on behalf of every commit that was
+** written before the sync began.  The other committers block on the
+** sync mutex meanwhile.  When they get it in turn, most find that their
+** commit is already durable; one written too late for the last sync
+** leads the next.  Syncing any descriptor of the log makes all data
+** written to it durable, so pagers that do not share a cache can still
+** share a sync.
+**
+** Only pagers in the same process are grouped, and only their new
+** snapshots are kept from seeing a commit before it is durable.  Readers
+** in other processes, and write transactions, which must build on every
+** commit in the log, may see it as soon as it is written.  If the sync
+** fails, an error is returned although the transaction is in the log and
+** may yet survive.
+*/
+int sqlite3pager_commit_wait(Pager *pPager, int iCommit){
+  PagerGroup *pGroup = pPager->pGroup;
+  int rc = SQLITE_OK;
+  int iLast;
+  int mxFrame;
+  u32 aSalt[2];
+
+  if( iCommit==0 ) return SQLITE_OK;
+  assert( pGroup!=0 && pPager->walOpen );
+  sqlite3OsMutexEnter(pGroup->pSyncMutex);
+  sqlite3OsMutexEnter(pGroup->pMutex);
+  if( pGroup->iSynced<iCommit ){
+    sqlite3OsMutexLeave(pGroup->pMutex);
+    if( pPager->nGroupWindow>0 ){
+      sqlite3OsSleep(pPager->nGroupWindow);
+    }
+    sqlite3OsMutexEnter(pGroup->pMutex);
+    iLast = pGroup->iCommit;
+    mxFrame = pGroup->mxFrameWritten;
+    aSalt[0] = pGroup->aSalt[0];
+    aSalt[1] = pGroup->aSalt[1];
+    sqlite3OsMutexLeave(pGroup->pMutex);
+    TRACE3("SYNC log of %d for commits up to %d\n", pPager->fd.h, iLast);
+    rc = sqlite3OsSync(&pPager->wfd);
+    sqlite3OsMutexEnter(pGroup->pMutex);
+    if( rc==SQLITE_OK ){
+      pager_group_synced(pGroup, iLast, aSalt, mxFrame);
+      pGroup->nSync++;
+    }
+  }
+  if( rc==SQLITE_OK ){
+    pGroup->nCommit++;
+  }
+  sqlite3OsMutexLeave(pGroup->pMutex);
+  sqlite3OsMutexLeave(pGroup->pSyncMutex);
+  return rc;
+}
+
+/*
+** Say whether the next snapshot begun by the pager is for a write
+** transaction.  Such a snapshot is taken under a RESERVED lock, so that
+** it is the most recent, and includes transactions that are still
+** waiting for a group commit sync.  See sqlite3pager_get() and
+** pager_wal_begin_read().
+*/
+void sqlite3pager_write_snapshot(Pager *pPager, int isWrite){
+  pPager->walForWrite = isWrite!=0;
+}
+
 /*
 ** Rollback all changes.  The database falls back to PAGER_SHARED mode.
 ** All in-memory cache pages revert to their original data contents.
@@ -2497,6 +4002,23 @@ int sqlite3pager_rollback(Pager *pPager){
     return SQLITE_OK;
   }
 
+  if( pPager->useWal ){
+    /* In WAL mode neither the database file nor the log has been changed,
+    ** so only the cache needs to be restored.
+    */
+    int rc2;
+    rc = SQLITE_OK;
+    if( pPager->dirtyCache && pPager->state>=PAGER_RESERVED ){
+      rc = pager_reload_cache(pPager);
+    }
+    rc2 = pager_unwritelock(pPager);
+    if( rc==SQLITE_OK ){
+      rc = rc2;
+    }
+    pPager->dbSize = -1;
+    return rc;
+  }
+
   if( !pPager->dirtyCache || !pPager->journalOpen ){
     rc = pager_unwritelock(pPager);
     pPager->dbSize = -1;
@@ -2539,7 +4061,7 @@ int sqlite3pager_isreadonly(Pager *pPager){
 ** This routine is used for testing and analysis only.
 */
 int *sqlite3pager_stats(Pager *pPager){
-  static int a[9];
+  static int a[16];
   a[0] = pPager->nRef;
   a[1] = pPager->nPage;
   a[2] = pPager->mxPage;
@@ -2549,6 +4071,13 @@ int *sqlite3pager_stats(Pager *pPager){
   a[6] = pPager->nHit;
   a[7] = pPager->nMiss;
   a[8] = pPager->nOvfl;
+  a[9] = pPager->aHit[PAGER_CACHE_LRU];
+  a[10] = pPager->aMiss[PAGER_CACHE_LRU];
+  a[11] = pPager->aHit[PAGER_CACHE_2Q];
+  a[12] = pPager->aMiss[PAGER_CACHE_2Q];
+  a[13] = pPager->nPrefetch;
+  a[14] = pPager->pGroup ? pPager->pGroup->nCommit : 0;
+  a[15] = pPager->pGroup ? pPager->pGroup->nSync : 0;
   return a;
 }
 
@@ -2569,24 +4098,26 @@ int sqlite3pager_stmt_begin(Pager *pPager){
     pPager->stmtSize = pPager->dbSize;
     return SQLITE_OK;
   }
-  if( !pPager->journalOpen ){
+  if( !pPager->journalOpen && !pPager->useWal ){
     pPager->stmtAutoopen = 1;
     return SQLITE_OK;
   }
-  assert( pPager->journalOpen );
+  assert( pPager->journalOpen || pPager->useWal );
   pPager->aInStmt = sqliteMalloc( pPager->dbSize/8 + 1 );
   if( pPager->aInStmt==0 ){
     sqlite3OsLock(&pPager->fd, SHARED_LOCK);
     return SQLITE_NOMEM;
   }
+  if( pPager->journalOpen ){
 #ifndef NDEBUG
-  rc = sqlite3OsFileSize(&pPager->jfd, &pPager->stmtJSize);
-  if( rc ) goto stmt_begin_failed;
-  assert( pPager->stmtJSize == 
-    pPager->nRec*JOURNAL_PG_SZ(pPager) + JOURNAL_HDR_SZ(pPager) );
+    rc = sqlite3OsFileSize(&pPager->jfd, &pPager->stmtJSize);
+    if( rc ) goto stmt_begin_failed;
+    assert( pPager->stmtJSize == 
+      pPager->nRec*JOURNAL_PG_SZ(pPager) + JOURNAL_HDR_SZ(pPager) );
 #endif
-  pPager->stmtJSize =
-     pPager->nRec*JOURNAL_PG_SZ(pPager) + JOURNAL_HDR_SZ(pPager);
+    pPager->stmtJSize =
+       pPager->nRec*JOURNAL_PG_SZ(pPager) + JOURNAL_HDR_SZ(pPager);
+  }
   pPager->stmtSize = pPager->dbSize;
   if( !pPager->stmtOpen ){
     rc = sqlite3pager_opentemp(zTemp, &pPager->stfd);
@@ -2752,11 +4283,28 @@ int sqlite3pager_sync(Pager *pPager, const char *zMaster){
   */
   if( pPager->state!=PAGER_SYNCED && !pPager->memDb && pPager->dirtyCache ){
     PgHdr *pPg;
-    assert( pPager->journalOpen );
+    assert( pPager->journalOpen || pPager->useWal );
 
     rc = pager_incr_changecounter(pPager);
     if( rc!=SQLITE_OK ) goto sync_exit;
 
+    if( pPager->useWal ){
+      /* Append the dirty pages to the write-ahead log.  The database file
+      ** is not touched and there is no journal to sync.  zMaster is
+      ** ignored, as WAL mode does not take part in master journals.
+      */
+      pPg = pager_get_all_dirty_pages(pPager);
+      rc = pager_wal_write_frames(pPager, pPg);
+      if( rc!=SQLITE_OK ) goto sync_exit;
+      for(pPg=pPager->pAll; pPg; pPg=pPg->pNextAll){
+        pPg->dirty = 0;
+        pPg->needSync = 0;
+      }
+      pager_all_synced(pPager);
+      pPager->state = PAGER_SYNCED;
+      goto sync_exit;
+    }
+
     /* Sync the journal file */
     rc = syncJournal(pPager, zMaster);
     if( rc!=SQLITE_OK ) goto sync_exit;
@@ -2778,6 +4326,151 @@ sync_exit:
   return rc;
 }
 
+/*
+** Get or set the journaling mode of the pager.  eMode is one of
+** PAGER_JOURNALMODE_DELETE or PAGER_JOURNALMODE_WAL, or a negative value
+** to leave the mode unchanged.  The mode in effect is returned.
+**
+** WAL mode is not available for in-memory or temporary databases, or
+** for databases opened without a journal.  A change of mode takes effect
+** when the next snapshot begins.  After leaving WAL mode, an existing log
+** continues to be used until it can be checkpointed.
+*/
+int sqlite3pager_journal_mode(Pager *pPager, int eMode){
+  if( eMode>=0 && !pPager->memDb && !pPager->tempFile && pPager->useJournal ){
+    pPager->walMode = eMode==PAGER_JOURNALMODE_WAL;
+  }
+  return pPager->walMode ? PAGER_JOURNALMODE_WAL : PAGER_JOURNALMODE_DELETE;
+}
+
+/*
+** Return true if the current transaction of the pager reads from and
+** commits to the write-ahead log.
+*/
+int sqlite3pager_uses_wal(Pager *pPager){
+  return pPager->useWal;
+}
+
+/*
+** Commit the next write transaction through a rollback journal, straight
+** into the database file, even though the pager is in WAL mode.  This is
+** only done if the current snapshot holds no frames of the log, and this
+** routine is a no-op otherwise.  It must be called before
+** sqlite3pager_begin().  Later snapshots use the log again.
+*/
+void sqlite3pager_journal_once(Pager *pPager){
+  if( pPager->state==PAGER_SHARED && pPager->mxFrame==0 ){
+    pPager->useWal = 0;
+  }
+}
+
+/*
+** Get or set the group commit window of the pager, in milliseconds.
+** Zero turns group commit off and a negative value leaves the setting
+** unchanged.  The setting in effect is returned.  Group commit is only
+** used for commits to the write-ahead log.
+*/
+int sqlite3pager_group_commit(Pager *pPager, int nMs){
+  if( nMs>=0 && !pPager->memDb && !pPager->tempFile ){
+    pPager->nGroupWindow = nMs;
+  }
+  return pPager->nGroupWindow;
+}
+
+/*
+** Get or set the page replacement policy of the pager.  ePolicy is one of
+** PAGER_CACHE_LRU or PAGER_CACHE_2Q, or a negative value to leave the
+** policy unchanged.  The policy in effect is returned.
+**
+** When switching back to LRU, hot pages are demoted so that they are
+** recycled in the same way as all other pages.
+*/
+int sqlite3pager_cache_policy(Pager *pPager, int ePolicy){
+  if( ePolicy==PAGER_CACHE_LRU && pPager->cachePolicy!=PAGER_CACHE_LRU ){
+    PgHdr *pPg;
+    for(pPg=pPager->pAll; pPg; pPg=pPg->pNextAll){
+      if( !pPg->hot ) continue;
+      if( pPg->nRef==0 ){
+        pager_free_remove(pPg);
+        pPg->hot = 0;
+        pager_free_append(pPg);
+      }else{
+        pPg->hot = 0;
+      }
+    }
+    pPager->nCold = pPager->nPage;
+    pager_ghost_clear(pPager);
+  }
+  if( ePolicy==PAGER_CACHE_LRU || ePolicy==PAGER_CACHE_2Q ){
+    pPager->cachePolicy = ePolicy;
+  }
+  return pPager->cachePolicy;
+}
+
+/*
+** Get or set the maximum number of bytes of the database file that are
+** read through a memory map rather than with read().  Zero disables
+** memory mapping and a negative value leaves the setting unchanged.
+** The setting in effect is returned.
+**
+** Memory mapping is not used for in-memory databases.  Any existing
+** mapping is released here and a new one is created when the next
+** snapshot begins.
+*/
+i64 sqlite3pager_mmap_size(Pager *pPager, i64 nByte){
+  if( nByte>=0 && !pPager->memDb ){
+    if( nByte!=pPager->mxMmap ){
+      pager_mmap_release(pPager);
+    }
+    pPager->mxMmap = nByte;
+  }
+  return pPager->mxMmap;
+}
+
+/*
+** Get or set the maximum number of pages that are read ahead of a scan.
+** Zero disables read-ahead and a negative value leaves the setting
+** unchanged.  The setting in effect is returned.
+*/
+int sqlite3pager_readahead(Pager *pPager, int nPage){
+  if( nPage>=0 && !pPager->memDb ){
+    pPager->nReadAhead = nPage;
+  }
+  return pPager->nReadAhead;
+}
+
+/*
+** Hint that the nPage pages starting with page pgno are likely to be
+** needed soon.  Unless they are already in the cache, the operating
+** system is asked to start reading them in the background, so that a
+** scan finds them in memory instead of waiting for the disk.  The btree
+** layer calls this during scans, when it knows which pages come next
+** even though they may be scattered across the file.
+**
+** Nothing is done for pages a short way ahead of a sequential scan of
+** the file.  The operating system already reads ahead of sequential
+** reads by itself, with a larger window than ours, and a hint for those
+** pages only interferes with that.  Nothing is done either when
+** read-ahead is disabled.
+*/
+void sqlite3pager_prefetch(Pager *pPager, Pgno pgno, int nPage){
+  Pgno iLast = pgno+nPage-1;
+  if( pPager->nReadAhead<=0 || pPager->state==PAGER_UNLOCK ) return;
+  if( pPager->nSeqRead>=PAGER_SEQ_READS-1 && pgno>pPager->iLastRead
+       && pgno<=pPager->iLastRead+pPager->nReadAhead ){
+    return;
+  }
+  if( pPager->dbSize>=0 && iLast>(Pgno)pPager->dbSize ){
+    iLast = pPager->dbSize;
+  }
+  while( pgno<=iLast && pager_lookup(pPager, pgno)!=0 ) pgno++;
+  while( iLast>=pgno && pager_lookup(pPager, iLast)!=0 ) iLast--;
+  if( pgno>iLast ) return;
+  sqlite3OsReadAhead(&pPager->fd, (pgno-1)*(off_t)pPager->pageSize,
+                     (iLast-pgno+1)*(off_t)pPager->pageSize);
+  pPager->nPrefetch += iLast-pgno+1;
+}
+
 #ifdef SQLITE_DEBUG
 /*
 ** Return the current state of the file lock for the given pager.
@@ -17,22 +17,29 @@
 */
 
 /*
-** The size of a page.
+** The default size of a page for new databases.
 **
-** You can change this value to another (reasonable) value you want.
-** It need not be a power of two, though the interface to the disk
-** will likely be faster if it is.
+** You can change this value to another power of two between
+** SQLITE_MIN_PAGE_SIZE and SQLITE_MAX_PAGE_SIZE.  Existing databases
+** keep the page size recorded in their header.
 **
 ** Experiments show that a page size of 1024 gives the best speed
-** for common usages.  The speed differences for different sizes
-** such as 512, 2048, 4096, an so forth, is minimal.  Note, however,
-** that changing the page size results in a completely imcompatible
-** file format.
+** for common usages.  Tables with large rows benefit from larger
+** pages, which reduce the depth of the btree and the length of
+** overflow chains.
 */
 #ifndef SQLITE_PAGE_SIZE
 #define SQLITE_PAGE_SIZE 1024
 #endif
 
+/*
+** The page size of a database is chosen when the database is created
+** (see PRAGMA page_size).  Every page size is a power of two between
+** the following limits.
+*/
+#define SQLITE_MIN_PAGE_SIZE 512
+#define SQLITE_MAX_PAGE_SIZE 65536
+
 /*
 ** Number of extra bytes of data allocated at the end of each page and
 ** stored on disk but not used by the higher level btree layer.  Changing
@@ -65,6 +72,20 @@ typedef unsigned int Pgno;
 */
 typedef struct Pager Pager;
 
+/*
+** Allowed values for the second argument to sqlite3pager_journal_mode().
+*/
+#define PAGER_JOURNALMODE_QUERY   -1  /* Leave the journal mode unchanged */
+#define PAGER_JOURNALMODE_DELETE   0  /* Rollback journal, deleted on commit */
+#define PAGER_JOURNALMODE_WAL      1  /* Write-ahead log */
+
+/*
+** Allowed values for the second argument to sqlite3pager_cache_policy().
+*/
+#define PAGER_CACHE_QUERY  -1  /* Leave the replacement policy unchanged */
+#define PAGER_CACHE_LRU     0  /* Recycle the least recently used page */
+#define PAGER_CACHE_2Q      1  /* Scan-resistant two-queue replacement */
+
 /*
 ** See source code comments for a detailed description of the following
 ** routines:
@@ -74,6 +95,7 @@ int sqlite3pager_open(Pager **ppPager, const char *zFilename,
                      void *pBusyHandler);
 void sqlite3pager_set_destructor(Pager*, void(*)(void*,int));
 void sqlite3pager_set_reiniter(Pager*, void(*)(void*,int));
+void sqlite3pager_set_busyhandler(Pager*, void*);
 void sqlite3pager_set_cachesize(Pager*, int);
 int sqlite3pager_close(Pager *pPager);
 int sqlite3pager_get(Pager *pPager, Pgno pgno, void **ppPage);
@@ -88,6 +110,9 @@ int sqlite3pager_pagecount(Pager*);
 int sqlite3pager_truncate(Pager*,Pgno);
 int sqlite3pager_begin(void*,int);
 int sqlite3pager_commit(Pager*);
+int sqlite3pager_commit_id(Pager*);
+int sqlite3pager_commit_wait(Pager*, int);
+void sqlite3pager_write_snapshot(Pager*, int);
 int sqlite3pager_sync(Pager*,const char *zMaster);
 int sqlite3pager_rollback(Pager*);
 int sqlite3pager_isreadonly(Pager*);
@@ -103,6 +128,15 @@ const char *sqlite3pager_dirname(Pager*);
 const char *sqlite3pager_journalname(Pager*);
 int sqlite3pager_rename(Pager*, const char *zNewName);
 void sqlite3pager_set_codec(Pager*,void(*)(void*,void*,Pgno,int),void*);
+int sqlite3pager_journal_mode(Pager*, int);
+int sqlite3pager_uses_wal(Pager*);
+void sqlite3pager_journal_once(Pager*);
+int sqlite3pager_group_commit(Pager*, int);
+int sqlite3pager_cache_policy(Pager*, int);
+i64 sqlite3pager_mmap_size(Pager*, i64);
+int sqlite3pager_readahead(Pager*, int);
+void sqlite3pager_prefetch(Pager*, Pgno, int);
+int sqlite3pager_set_pagesize(Pager*, int);
 
 #ifdef SQLITE_DEBUG
 int sqlite3pager_lockstate(Pager*);
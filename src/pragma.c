@@ -88,6 +88,48 @@ static int getTempStore(const char *z){
   }
 }
 
+/*
+** Interpret the given string as a journal mode.  Return 1 for WAL and
+** 0 for DELETE or an unrecognized string.
+*/
+static int getJournalMode(const char *z){
+  if( sqlite3StrICmp(z, "wal")==0 ){
+    return 1;
+  }else{
+    return 0;
+  }
+}
+
+/*
+** Interpret the given string as a page replacement policy name.  Return
+** 1 for "2q" and 0 for anything else, which selects LRU.
+*/
+static int getCachePolicy(const char *z){
+  if( sqlite3StrICmp(z, "2q")==0 ){
+    return 1;
+  }else{
+    return 0;
+  }
+}
+
+/*
+** Interpret the given string as an auto-vacuum mode.  Return one of the
+** BTREE_AUTOVACUUM_ values, or -1 for an unrecognized string.
+*/
+static int getAutoVacuum(const char *z){
+  if( z[0]>='0' && z[0]<='2' && z[1]==0 ){
+    return z[0] - '0';
+  }else if( sqlite3StrICmp(z, "none")==0 ){
+    return BTREE_AUTOVACUUM_NONE;
+  }else if( sqlite3StrICmp(z, "full")==0 ){
+    return BTREE_AUTOVACUUM_FULL;
+  }else if( sqlite3StrICmp(z, "incremental")==0 ){
+    return BTREE_AUTOVACUUM_INCR;
+  }else{
+    return -1;
+  }
+}
+
 /*
 ** If the TEMP database is open, close it and mark the database schema
 ** as needing reloading.  This must be done when using the TEMP_STORE
@@ -124,6 +166,7 @@ static int flagPragma(Parse *pParse, const char *zLeft, const char *zRight){
     { "vdbe_trace",               SQLITE_VdbeTrace     },
     { "sql_trace",                SQLITE_SqlTrace      },
     { "vdbe_listing",             SQLITE_VdbeListing   },
+    { "prefix_compression",       SQLITE_PrefixKeys    },
 #if 1  /* FIX ME:  Remove the following pragmas */
     { "full_column_names",        SQLITE_FullColNames  },
     { "short_column_names",       SQLITE_ShortColNames },
@@ -374,6 +417,350 @@ void sqlite3Pragma(Parse *pParse, Token *pLeft, Token *pRight, int minusFlag){
     }
   }else
 
+  /*
+  **   PRAGMA journal_mode
+  **   PRAGMA journal_mode='DELETE'|WAL
+  **
+  ** Return or set the journaling mode of the main database.  In WAL mode
+  ** committed pages are appended to a write-ahead log and copied back into
+  ** the database file by periodic checkpoints, so that readers are not
+  ** blocked by writers.  The first form returns the mode in effect, which
+  ** is always DELETE for in-memory and temporary databases.  The setting is
+  ** not stored in the database file, but a write in WAL mode raises the
+  ** file format versions in the header so that libraries without WAL
+  ** support cannot open the database.  (DELETE is a keyword and so must
+  ** be quoted.)
+  */
+  if( sqlite3StrICmp(zLeft,"journal_mode")==0 ){
+    static VdbeOpList getJrnl[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    int eMode = -1;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    if( pRight->z!=pLeft->z ){
+      eMode = getJournalMode(zRight);
+    }
+    eMode = sqlite3BtreeSetJournalMode(db->aDb[0].pBt, eMode);
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "journal_mode", P3_STATIC);
+      sqlite3VdbeOp3(v, OP_String8, 0, 0, eMode ? "wal" : "delete", P3_STATIC);
+      sqlite3VdbeAddOpList(v, ArraySize(getJrnl), getJrnl);
+    }
+  }else
+
+  /*
+  **   PRAGMA group_commit
+  **   PRAGMA group_commit=N
+  **
+  ** Return or set the group commit window of the main database, in
+  ** milliseconds.  When N is greater than zero, a transaction committed
+  ** to the write-ahead log waits up to N milliseconds for transactions
+  ** from other connections in the same process, and then a single sync
+  ** of the log makes them all durable.  Zero, the default, syncs the log
+  ** once for every commit.  The window has no effect outside WAL mode.
+  ** The first form returns the window in effect.
+  */
+  if( sqlite3StrICmp(zLeft,"group_commit")==0 ){
+    static VdbeOpList getGroupCommit[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    int nMs = -1;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    if( pRight->z!=pLeft->z ){
+      nMs = atoi(zRight);
+      if( nMs<0 ) nMs = 0;
+    }
+    nMs = sqlite3BtreeSetGroupCommit(db->aDb[0].pBt, nMs);
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "group_commit", P3_STATIC);
+      sqlite3VdbeAddOp(v, OP_Integer, nMs, 0);
+      sqlite3VdbeAddOpList(v, ArraySize(getGroupCommit), getGroupCommit);
+    }
+  }else
+
+  /*
+  **   PRAGMA cache_policy
+  **   PRAGMA cache_policy=LRU|'2Q'
+  **
+  ** Return or set the page replacement policy of the main database's
+  ** page cache.  LRU, the default, recycles the least recently used page.
+  ** 2Q only keeps a page in the cache for long if it is used again after
+  ** being released, so that a scan through a large table does not push
+  ** frequently used pages such as index interior nodes out of the cache.
+  ** The first form returns the policy in effect.  The setting is not stored
+  ** in the database file.  (2Q must be quoted.)
+  */
+  if( sqlite3StrICmp(zLeft,"cache_policy")==0 ){
+    static VdbeOpList getPolicy[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    int ePolicy = -1;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    if( pRight->z!=pLeft->z ){
+      ePolicy = getCachePolicy(zRight);
+    }
+    ePolicy = sqlite3BtreeSetCachePolicy(db->aDb[0].pBt, ePolicy);
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "cache_policy", P3_STATIC);
+      sqlite3VdbeOp3(v, OP_String8, 0, 0, ePolicy ? "2q" : "lru", P3_STATIC);
+      sqlite3VdbeAddOpList(v, ArraySize(getPolicy), getPolicy);
+    }
+  }else
+
+  /*
+  **   PRAGMA mmap_size
+  **   PRAGMA mmap_size=N
+  **
+  ** Return or set the maximum number of bytes of the main database file
+  ** that are read through a memory map instead of with read() calls.
+  ** Zero, the default, turns memory mapping off.  The first form returns
+  ** the setting in effect, which is always zero for in-memory databases.
+  */
+  if( sqlite3StrICmp(zLeft,"mmap_size")==0 ){
+    static VdbeOpList getMmap[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    i64 nByte = -1;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    if( pRight->z!=pLeft->z ){
+      sqlite3atoi64(zRight, &nByte);
+      if( nByte<0 ) nByte = 0;
+    }
+    nByte = sqlite3BtreeSetMmapSize(db->aDb[0].pBt, nByte);
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "mmap_size", P3_STATIC);
+      sqlite3VdbeOp3(v, OP_Integer, 0, 0,
+                     sqlite3MPrintf("%lld", nByte), P3_DYNAMIC);
+      sqlite3VdbeAddOpList(v, ArraySize(getMmap), getMmap);
+    }
+  }else
+
+  /*
+  **   PRAGMA read_ahead
+  **   PRAGMA read_ahead=N
+  **
+  ** Return or set the number of pages of the main database file that are
+  ** read ahead once a scan is detected.  Zero turns read-ahead off.  The
+  ** first form returns the setting in effect, which is always zero for
+  ** in-memory databases.
+  */
+  if( sqlite3StrICmp(zLeft,"read_ahead")==0 ){
+    static VdbeOpList getReadAhead[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    int nPage = -1;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    if( pRight->z!=pLeft->z ){
+      nPage = atoi(zRight);
+      if( nPage<0 ) nPage = 0;
+    }
+    nPage = sqlite3BtreeSetReadAhead(db->aDb[0].pBt, nPage);
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "read_ahead", P3_STATIC);
+      sqlite3VdbeAddOp(v, OP_Integer, nPage, 0);
+      sqlite3VdbeAddOpList(v, ArraySize(getReadAhead), getReadAhead);
+    }
+  }else
+
+  /*
+  **   PRAGMA page_size
+  **   PRAGMA page_size=N
+  **
+  ** Return or set the page size of the main database.  The page size is
+  ** fixed when the first table is created, so the second form only has
+  ** an effect on a database that is still empty.  N must be a power of
+  ** two between 512 and 65536.  The first form returns the page size in
+  ** effect.
+  */
+  if( sqlite3StrICmp(zLeft,"page_size")==0 ){
+    static VdbeOpList getPageSize[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    int size = 0;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    if( pRight->z!=pLeft->z ){
+      size = atoi(zRight);
+    }
+    size = sqlite3BtreeSetPageSize(db->aDb[0].pBt, size);
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "page_size", P3_STATIC);
+      sqlite3VdbeAddOp(v, OP_Integer, size, 0);
+      sqlite3VdbeAddOpList(v, ArraySize(getPageSize), getPageSize);
+    }
+  }else
+
+  /*
+  **   PRAGMA auto_vacuum
+  **   PRAGMA auto_vacuum=NONE|FULL|INCREMENTAL
+  **
+  ** Return or set the auto-vacuum mode of the main database.  In FULL
+  ** mode the pages freed by a transaction are given back to the file
+  ** system when it commits, and the file shrinks.  In INCREMENTAL mode
+  ** they stay on the freelist until PRAGMA incremental_vacuum is run.
+  ** The mode is recorded in the database file when the first table is
+  ** created.  For a database that already has tables, the new mode
+  ** takes effect at the next VACUUM.  The first form returns the mode in
+  ** effect as a number, 0 for NONE, 1 for FULL and 2 for INCREMENTAL.
+  ** In-memory databases are never auto-vacuumed.
+  */
+  if( sqlite3StrICmp(zLeft,"auto_vacuum")==0 ){
+    static VdbeOpList getAutoVac[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    int eMode = -1;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    if( pRight->z!=pLeft->z ){
+      eMode = getAutoVacuum(zRight);
+      if( eMode>=0 ) db->nextAutovac = eMode;
+    }
+    eMode = sqlite3BtreeSetAutoVacuum(db->aDb[0].pBt, eMode);
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "auto_vacuum", P3_STATIC);
+      sqlite3VdbeAddOp(v, OP_Integer, eMode, 0);
+      sqlite3VdbeAddOpList(v, ArraySize(getAutoVac), getAutoVac);
+    }
+  }else
+
+  /*
+  **   PRAGMA incremental_vacuum
+  **   PRAGMA incremental_vacuum=N
+  **
+  ** Give up to N free pages of the main database back to the file system,
+  ** or all of them if N is omitted or not positive.  Pages at the end of
+  ** the file are moved into free pages nearer its start and the file is
+  ** truncated.  This does nothing unless the database is in auto-vacuum
+  ** mode.
+  */
+  if( sqlite3StrICmp(zLeft,"incremental_vacuum")==0 ){
+    int nPage = 0;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    if( pRight->z!=pLeft->z ){
+      nPage = atoi(zRight);
+      if( nPage<0 ) nPage = 0;
+    }
+    sqlite3BeginWriteOperation(pParse, 0, 0);
+    sqlite3VdbeAddOp(v, OP_IncrVacuum, 0, nPage);
+    sqlite3EndWriteOperation(pParse);
+  }else
+
+  /*
+  **   PRAGMA check_threads
+  **   PRAGMA check_threads=N
+  **
+  ** Return or set the number of threads PRAGMA integrity_check uses to
+  ** walk the b-trees of each database file.  The default of 1 does the
+  ** whole check on the calling thread.  Builds that are not threadsafe
+  ** always use one thread, whatever the setting.
+  */
+  if( sqlite3StrICmp(zLeft,"check_threads")==0 ){
+    static VdbeOpList getCheckThreads[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "check_threads", P3_STATIC);
+      sqlite3VdbeAddOp(v, OP_Integer, db->nCheckThread, 0);
+      sqlite3VdbeAddOpList(v, ArraySize(getCheckThreads), getCheckThreads);
+    }else{
+      int n = atoi(zRight);
+      db->nCheckThread = n<1 ? 1 : n;
+    }
+  }else
+
+  /*
+  **   PRAGMA sort_memory
+  **   PRAGMA sort_memory=N
+  **
+  ** Return or set the number of KiB of rows that ORDER BY and CREATE
+  ** INDEX may keep in memory while sorting.  Beyond that the rows are
+  ** written to a temporary file in sorted runs that are merged once all
+  ** rows are in.  Zero means no limit: nothing is written to disk.  The
+  ** setting applies to statements that start sorting after it is made.
+  */
+  if( sqlite3StrICmp(zLeft,"sort_memory")==0 ){
+    static VdbeOpList getSortMemory[] = {
+      { OP_Callback,    1, 0,        0},
+    };
+    if( pRight->z==pLeft->z ){
+      sqlite3VdbeSetNumCols(v, 1);
+      sqlite3VdbeSetColName(v, 0, "sort_memory", P3_STATIC);
+      sqlite3VdbeAddOp(v, OP_Integer, db->nSortMem, 0);
+      sqlite3VdbeAddOpList(v, ArraySize(getSortMemory), getSortMemory);
+    }else{
+      int n = atoi(zRight);
+      db->nSortMem = n<0 ? 0 : n;
+    }
+  }else
+
+  /*
+  **   PRAGMA fill_factor
+  **
+  ** Return one row for each table and index: its name, the number of
+  ** pages it uses, overflow pages included, and the percentage of the
+  ** usable space on those pages that holds data.
+  */
+  if( sqlite3StrICmp(zLeft, "fill_factor")==0 ){
+    int i;
+    if( SQLITE_OK!=sqlite3ReadSchema(pParse->db, &pParse->zErrMsg) ){
+      pParse->nErr++;
+      goto pragma_out;
+    }
+    sqlite3VdbeSetNumCols(v, 3);
+    sqlite3VdbeSetColName(v, 0, "name", P3_STATIC);
+    sqlite3VdbeSetColName(v, 1, "pages", P3_STATIC);
+    sqlite3VdbeSetColName(v, 2, "fill", P3_STATIC);
+    for(i=0; i<db->nDb; i++){
+      HashElem *x;
+      if( db->aDb[i].pBt==0 ) continue;
+      sqlite3CodeVerifySchema(pParse, i);
+      for(x=sqliteHashFirst(&db->aDb[i].tblHash); x; x=sqliteHashNext(x)){
+        Table *pTab = sqliteHashData(x);
+        Index *pIdx;
+        if( pTab->tnum==0 ) continue;
+        sqlite3VdbeOp3(v, OP_String8, 0, 0, pTab->zName, 0);
+        sqlite3VdbeAddOp(v, OP_FillStat, pTab->tnum, i);
+        sqlite3VdbeAddOp(v, OP_Callback, 3, 0);
+        for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+          if( pIdx->tnum==0 ) continue;
+          sqlite3VdbeOp3(v, OP_String8, 0, 0, pIdx->zName, 0);
+          sqlite3VdbeAddOp(v, OP_FillStat, pIdx->tnum, i);
+          sqlite3VdbeAddOp(v, OP_Callback, 3, 0);
+        }
+      }
+    }
+  }else
+
 #ifndef NDEBUG
   if( sqlite3StrICmp(zLeft, "trigger_overhead_test")==0 ){
     if( getBoolean(zRight) ){
@@ -307,17 +307,71 @@ static void sqliteAggregateInfoReset(Parse *pParse){
   pParse->useAgg = 0;
 }
 
+/*
+** Allocate a KeyInfo structure that compares sorter keys made from the
+** terms of the ORDER BY clause pOrderBy.  Return NULL if malloc() fails.
+*/
+static KeyInfo *orderByKeyInfo(Parse *pParse, ExprList *pOrderBy){
+  int nCol = pOrderBy->nExpr;
+  KeyInfo *pInfo;
+  int i;
+
+  pInfo = sqliteMalloc( sizeof(*pInfo) + nCol*(sizeof(CollSeq*)+1) );
+  if( pInfo==0 ) return 0;
+  pInfo->aSortOrder = (char*)&pInfo->aColl[nCol];
+  pInfo->nField = nCol;
+  for(i=0; i<nCol; i++){
+    /* If a collation sequence was specified explicity, then it
+    ** is stored in pOrderBy->a[i].zName. Otherwise, use the default
+    ** collation type for the expression.
+    */
+    pInfo->aColl[i] = sqlite3ExprCollSeq(pParse, pOrderBy->a[i].pExpr);
+    if( !pInfo->aColl[i] ){
+      pInfo->aColl[i] = pParse->db->pDfltColl;
+    }
+    pInfo->aSortOrder[i] = pOrderBy->a[i].sortOrder;
+  }
+  return pInfo;
+}
+
+/*
+** Return the number of rows at the front of the sorted results of
+** SELECT p that generateSortTail() can ever output to eDest, or 0 if
+** there is no such limit.  Rows beyond LIMIT+OFFSET are never output,
+** and a scalar subquery stops after the first row past the OFFSET.
+*/
+static int sorterBound(Select *p, int eDest){
+  int nOffset = p->iOffset>=0 ? p->nOffset : 0;
+  int nBound = 0;
+  if( eDest==SRT_Sorter ) return 0;
+  if( p->iLimit>=0 && p->nLimit>0 ){
+    nBound = p->nLimit + nOffset;
+  }
+  if( eDest==SRT_Mem && (nBound<=0 || nBound>nOffset+1) ){
+    nBound = nOffset + 1;
+  }
+  return nBound>0 ? nBound : 0;
+}
+
 /*
 ** Insert code into "v" that will push the record on the top of the
-** stack into the sorter.
+** stack into the sorter.  If the results of SELECT p are limited, the
+** sorter is told how many rows to keep.
 */
-static void pushOntoSorter(Parse *pParse, Vdbe *v, ExprList *pOrderBy){
+static void pushOntoSorter(
+  Parse *pParse,         /* Parser context */
+  Select *p,             /* The SELECT being coded */
+  Vdbe *v,               /* Generate code into this VM */
+  ExprList *pOrderBy,    /* The ORDER BY clause */
+  int eDest              /* Where the sorted rows will go */
+){
   int i;
   for(i=0; i<pOrderBy->nExpr; i++){
     sqlite3ExprCode(pParse, pOrderBy->a[i].pExpr);
   }
   sqlite3VdbeAddOp(v, OP_MakeRecord, pOrderBy->nExpr, 0);
-  sqlite3VdbeAddOp(v, OP_SortPut, 0, 0);
+  sqlite3VdbeOp3(v, OP_SortPut, sorterBound(p, eDest), 0,
+                 (char*)orderByKeyInfo(pParse, pOrderBy), P3_KEYINFO_HANDOFF);
 }
 
 /*
@@ -412,7 +466,7 @@ static int selectInnerLoop(
     case SRT_TempTable: {
       sqlite3VdbeAddOp(v, OP_MakeRecord, nColumn, 0);
       if( pOrderBy ){
-        pushOntoSorter(pParse, v, pOrderBy);
+        pushOntoSorter(pParse, p, v, pOrderBy, eDest);
       }else{
         sqlite3VdbeAddOp(v, OP_NewRecno, iParm, 0);
         sqlite3VdbeAddOp(v, OP_Pull, 1, 0);
@@ -447,7 +501,7 @@ static int selectInnerLoop(
       sqlite3VdbeAddOp(v, OP_Pop, 1, 0);
       addr2 = sqlite3VdbeAddOp(v, OP_Goto, 0, 0);
       if( pOrderBy ){
-        pushOntoSorter(pParse, v, pOrderBy);
+        pushOntoSorter(pParse, p, v, pOrderBy, eDest);
       }else{
         char const *affStr;
         char aff = (iParm>>16)&0xFF;
@@ -468,7 +522,7 @@ static int selectInnerLoop(
     case SRT_Mem: {
       assert( nColumn==1 );
       if( pOrderBy ){
-        pushOntoSorter(pParse, v, pOrderBy);
+        pushOntoSorter(pParse, p, v, pOrderBy, eDest);
       }else{
         sqlite3VdbeAddOp(v, OP_MemStore, iParm, 1);
         sqlite3VdbeAddOp(v, OP_Goto, 0, iBreak);
@@ -482,7 +536,7 @@ static int selectInnerLoop(
     case SRT_Sorter: {
       if( pOrderBy ){
         sqlite3VdbeAddOp(v, OP_MakeRecord, nColumn, 0);
-        pushOntoSorter(pParse, v, pOrderBy);
+        pushOntoSorter(pParse, p, v, pOrderBy, eDest);
       }else{
         assert( eDest==SRT_Callback );
         sqlite3VdbeAddOp(v, OP_Callback, nColumn, 0);
@@ -496,7 +550,7 @@ static int selectInnerLoop(
     case SRT_Subroutine: {
       if( pOrderBy ){
         sqlite3VdbeAddOp(v, OP_MakeRecord, nColumn, 0);
-        pushOntoSorter(pParse, v, pOrderBy);
+        pushOntoSorter(pParse, p, v, pOrderBy, eDest);
       }else{
         sqlite3VdbeAddOp(v, OP_Gosub, 0, iParm);
       }
@@ -535,28 +589,10 @@ static void generateSortTail(
   int end2 = sqlite3VdbeMakeLabel(v);
   int addr;
   KeyInfo *pInfo;
-  ExprList *pOrderBy;
-  int nCol, i;
-  sqlite *db = pParse->db;
 
   if( eDest==SRT_Sorter ) return;
-  pOrderBy = p->pOrderBy;
-  nCol = pOrderBy->nExpr;
-  pInfo = sqliteMalloc( sizeof(*pInfo) + nCol*(sizeof(CollSeq*)+1) );
+  pInfo = orderByKeyInfo(pParse, p->pOrderBy);
   if( pInfo==0 ) return;
-  pInfo->aSortOrder = (char*)&pInfo->aColl[nCol];
-  pInfo->nField = nCol;
-  for(i=0; i<nCol; i++){
-    /* If a collation sequence was specified explicity, then it
-    ** is stored in pOrderBy->a[i].zName. Otherwise, use the default
-    ** collation type for the expression.
-    */
-    pInfo->aColl[i] = sqlite3ExprCollSeq(pParse, pOrderBy->a[i].pExpr);
-    if( !pInfo->aColl[i] ){
-      pInfo->aColl[i] = db->pDfltColl;
-    }
-    pInfo->aSortOrder[i] = pOrderBy->a[i].sortOrder;
-  }
   sqlite3VdbeOp3(v, OP_Sort, 0, 0, (char*)pInfo, P3_KEYINFO_HANDOFF);
   addr = sqlite3VdbeAddOp(v, OP_SortNext, 0, end1);
   if( p->iOffset>=0 ){
@@ -1296,6 +1332,35 @@ static CollSeq *multiSelectCollSeq(Parse *pParse, Select *p, int iCol){
   return pRet;
 }
 
+/*
+** Attach to each term of the ORDER BY clause of compound SELECT p the
+** collating sequence it sorts by: the one named in the term, or else
+** that of the result column it refers to.  This has to happen before
+** the rows are coded into the sorter, because OP_SortPut compares keys
+** as it goes once the sorter spills to disk.
+*/
+static void multiSelectOrderByColl(Parse *pParse, Select *p){
+  int i;
+  if( p->pEList->nExpr!=p->pPrior->pEList->nExpr ){
+    /* An error is reported once the SELECTs have been coded */
+    return;
+  }
+  for(i=0; i<p->pOrderBy->nExpr; i++){
+    Expr *pExpr = p->pOrderBy->a[i].pExpr;
+    char *zName = p->pOrderBy->a[i].zName;
+    assert( pExpr->op==TK_COLUMN && pExpr->iColumn<p->pEList->nExpr );
+    assert( !pExpr->pColl );
+    if( zName ){
+      pExpr->pColl = sqlite3LocateCollSeq(pParse, zName, -1);
+    }else{
+      pExpr->pColl = multiSelectCollSeq(pParse, p, pExpr->iColumn);
+      if( !pExpr->pColl ){
+        pExpr->pColl = pParse->db->pDfltColl;
+      }
+    }
+  }
+}
+
 /*
 ** This routine is called to process a query that is really the union
 ** or intersection of two or more separate queries.
@@ -1484,6 +1549,9 @@ static int multiSelect(
         }
         iBreak = sqlite3VdbeMakeLabel(v);
         iCont = sqlite3VdbeMakeLabel(v);
+        if( p->pOrderBy ){
+          multiSelectOrderByColl(pParse, p);
+        }
         sqlite3VdbeAddOp(v, OP_Rewind, unionTab, iBreak);
         computeLimitRegisters(pParse, p);
         iStart = sqlite3VdbeCurrentAddr(v);
@@ -1564,6 +1632,9 @@ static int multiSelect(
       }
       iBreak = sqlite3VdbeMakeLabel(v);
       iCont = sqlite3VdbeMakeLabel(v);
+      if( p->pOrderBy ){
+        multiSelectOrderByColl(pParse, p);
+      }
       sqlite3VdbeAddOp(v, OP_Rewind, tab1, iBreak);
       computeLimitRegisters(pParse, p);
       iStart = sqlite3VdbeAddOp(v, OP_FullKey, tab1, 0);
@@ -1617,17 +1688,6 @@ static int multiSelect(
     }
 
     if( p->pOrderBy ){
-      for(i=0; i<p->pOrderBy->nExpr; i++){
-        Expr *pExpr = p->pOrderBy->a[i].pExpr;
-        char *zName = p->pOrderBy->a[i].zName;
-        assert( pExpr->op==TK_COLUMN && pExpr->iColumn<nCol );
-        assert( !pExpr->pColl );
-        if( zName ){
-          pExpr->pColl = sqlite3LocateCollSeq(pParse, zName, -1);
-        }else{
-          pExpr->pColl = pKeyInfo->aColl[pExpr->iColumn];
-        }
-      }
       generateSortTail(pParse, p, v, p->pEList->nExpr, eDest, iParm);
     }
 
@@ -29,6 +29,15 @@
 #define MAX_PAGES   2000
 #define TEMP_PAGES   500
 
+/*
+** The default number of KiB of records the sorter behind ORDER BY and
+** CREATE INDEX holds in memory before it writes them out in sorted runs
+** to a temporary file.  Changed at run-time with PRAGMA sort_memory.
+*/
+#ifndef SQLITE_DEFAULT_SORT_MEMORY
+# define SQLITE_DEFAULT_SORT_MEMORY 8192
+#endif
+
 /*
 ** If the following macro is set to 1, then NULL values are considered
 ** distinct for the SELECT DISTINCT statement and for UNION or EXCEPT
@@ -162,14 +171,15 @@ extern const int sqlite3one;
 /*
 ** The maximum number of bytes of data that can be put into a single
 ** row of a single table.  The upper bound on this limit is
-** 9223372036854775808 bytes (or 2**63).  We have arbitrarily set the
-** limit to just 1MB here because the overflow page chain is inefficient
-** for really big records and we want to discourage people from thinking that 
-** multi-megabyte records are OK.  If your needs are different, you can
-** change this define and recompile to increase or decrease the record
-** size.
+** 9223372036854775808 bytes (or 2**63).  We have set the limit to 1GB
+** here, which keeps every offset into a record within an int.  Cursors
+** remember the overflow pages of the row they point to, and the
+** sqlite3_blob_read() and sqlite3_blob_write() APIs reach any part of a
+** large value without loading the rest, so multi-megabyte records are
+** practical.  If your needs are different, you can change this define
+** and recompile to increase or decrease the record size.
 */
-#define MAX_BYTES_PER_ROW  1048576
+#define MAX_BYTES_PER_ROW  1073741824
 
 /*
 ** If memory allocation problems are found, recompile with
@@ -387,8 +397,11 @@ struct sqlite {
   u8 safety_level;              /* How aggressive at synching data to disk */
   u8 want_to_close;             /* Close after all VDBEs are deallocated */
   u8 temp_store;                /* 1=file, 2=memory, 0=compile-time default */
+  signed char nextAutovac;      /* Auto-vacuum mode for next VACUUM. -1=same */
   int next_cookie;              /* Next value of aDb[0].schema_cookie */
   int cache_size;               /* Number of pages to use in the cache */
+  int nCheckThread;             /* Threads used by PRAGMA integrity_check */
+  int nSortMem;                 /* KiB held by a sorter.  0 for no limit */
   int nTable;                   /* Number of tables in the database */
   BusyHandler busyHandler;      /* Busy callback */
   void *pCommitArg;             /* Argument to xCommitCallback() */   
@@ -457,6 +470,7 @@ struct sqlite {
                                           /*   result set is empty */
 #define SQLITE_SqlTrace       0x00000200  /* Debug print SQL as it executes */
 #define SQLITE_VdbeListing    0x00000400  /* Debug listings of VDBE programs */
+#define SQLITE_PrefixKeys     0x00000800  /* New indices compress their keys */
 
 /*
 ** Possible values for the sqlite.magic field.
@@ -1413,4 +1427,5 @@ int sqlite3ValueBytes(sqlite3_value*, u8);
 void sqlite3ValueSetStr(sqlite3_value*, int, const void *,u8, void(*)(void*));
 void sqlite3ValueFree(sqlite3_value*);
 sqlite3_value *sqlite3ValueNew();
+sqlite3_value *sqlite3ValueNumber(const char *, int, int);
 sqlite3_value *sqlite3GetTransientValue(sqlite *db);
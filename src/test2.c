@@ -268,10 +268,11 @@ static int pager_stats(
   }
   if( Tcl_GetInt(interp, argv[1], (int*)&pPager) ) return TCL_ERROR;
   a = sqlite3pager_stats(pPager);
-  for(i=0; i<9; i++){
+  for(i=0; i<16; i++){
     static char *zName[] = {
       "ref", "page", "max", "size", "state", "err",
-      "hit", "miss", "ovfl",
+      "hit", "miss", "ovfl", "lru_hit", "lru_miss", "2q_hit", "2q_miss",
+      "prefetch", "commit", "log_sync",
     };
     char zBuf[100];
     Tcl_AppendElement(interp, zName[i]);
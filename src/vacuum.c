@@ -140,18 +140,33 @@ int sqlite3RunVacuum(char **pzErrMsg, sqlite *db){
   zSql = 0;
   if( rc!=SQLITE_OK ) goto end_of_vacuum;
 
+  /* The pages of the temporary database are copied over the main database
+  ** one for one, so both must use the same page size.
+  */
+  sqlite3BtreeSetPageSize(db->aDb[db->nDb-1].pBt,
+                          sqlite3BtreeSetPageSize(db->aDb[0].pBt, 0));
+
+  /* The copy is built in the auto-vacuum mode of the main database, or
+  ** in the mode last asked for by PRAGMA auto_vacuum, since the mode of
+  ** a database that is not empty can only be changed by rebuilding it.
+  */
+  sqlite3BtreeSetAutoVacuum(db->aDb[db->nDb-1].pBt,
+      db->nextAutovac>=0 ? db->nextAutovac
+                         : sqlite3BtreeSetAutoVacuum(db->aDb[0].pBt, -1));
+
   /* Begin a transaction */
   rc = execSql(db, "BEGIN;");
   if( rc!=SQLITE_OK ) goto end_of_vacuum;
 
   /* Query the schema of the main database. Create a mirror schema
-  ** in the temporary database.
+  ** in the temporary database.  Indices are created later, after the
+  ** tables have been filled.
   */
   rc = execExecSql(db, 
       "SELECT 'CREATE ' || type || ' vacuum_db.' || "
       "substr(sql, length(type)+9, 1000000) "
       "FROM sqlite_master "
-      "WHERE type != 'trigger' AND sql IS NOT NULL "
+      "WHERE type != 'trigger' AND type != 'index' AND sql IS NOT NULL "
       "ORDER BY (type != 'table');" 
   );
   if( rc!=SQLITE_OK ) goto end_of_vacuum;
@@ -168,6 +183,18 @@ int sqlite3RunVacuum(char **pzErrMsg, sqlite *db){
   );
   if( rc!=SQLITE_OK ) goto end_of_vacuum;
 
+  /* Create the indices now that the tables hold their data.  Each index
+  ** is then built in one pass from its sorted keys rather than growing
+  ** one entry at a time as the rows are copied.
+  */
+  rc = execExecSql(db, 
+      "SELECT 'CREATE ' || type || ' vacuum_db.' || "
+      "substr(sql, length(type)+9, 1000000) "
+      "FROM sqlite_master "
+      "WHERE type = 'index' AND sql IS NOT NULL;" 
+  );
+  if( rc!=SQLITE_OK ) goto end_of_vacuum;
+
   /* Copy the triggers from the main database to the temporary database.
   ** This was deferred before in case the triggers interfered with copying
   ** the data. It's possible the indices should be deferred until this
@@ -237,39 +237,6 @@ static void popStack(Mem **ppTos, int N){
   *ppTos = pTos;
 }
 
-/*
-** The parameters are pointers to the head of two sorted lists
-** of Sorter structures.  Merge these two lists together and return
-** a single sorted list.  This routine forms the core of the merge-sort
-** algorithm.
-**
-** In the case of a tie, left sorts in front of right.
-*/
-static Sorter *Merge(Sorter *pLeft, Sorter *pRight, KeyInfo *pKeyInfo){
-  Sorter sHead;
-  Sorter *pTail;
-  pTail = &sHead;
-  pTail->pNext = 0;
-  while( pLeft && pRight ){
-    int c = sqlite3VdbeRecordCompare(pKeyInfo, pLeft->nKey, pLeft->zKey,
-                                     pRight->nKey, pRight->zKey);
-    if( c<=0 ){
-      pTail->pNext = pLeft;
-      pLeft = pLeft->pNext;
-    }else{
-      pTail->pNext = pRight;
-      pRight = pRight->pNext;
-    }
-    pTail = pTail->pNext;
-  }
-  if( pLeft ){
-    pTail->pNext = pLeft;
-  }else if( pRight ){
-    pTail->pNext = pRight;
-  }
-  return sHead.pNext;
-}
-
 /*
 ** Allocate cursor number iCur.  Return a pointer to it.  Return NULL
 ** if we run out of memory.
@@ -459,6 +426,46 @@ __inline__ unsigned long long int hwtime(void){
 #define CHECK_FOR_INTERRUPT \
    if( db->flags & SQLITE_Interrupt ) goto abort_due_to_interrupt;
 
+/*
+** When VDBE_COMPUTED_GOTO is defined, sqlite3VdbeExec() finds the code
+** for each instruction through a table of label addresses (a GCC
+** extension) rather than through the switch statement.  The table,
+** VDBE_JUMP_TABLE, is written into opcodes.h by the same script that
+** numbers the opcodes, so its entries are always in opcode order.  The
+** VDBE_LABEL() macro that follows each "case OP_xxx:" below defines the
+** label the table refers to.  Other compilers use the switch.
+**
+** Most instructions end with VDBE_NEXT rather than "break".  In a
+** build that uses the table, VDBE_NEXT moves to the next instruction
+** and jumps straight to its code, so that each opcode has its own
+** indirect jump for the branch predictor instead of all of them sharing
+** the one at the top of the loop.  It falls back to "break" whenever
+** the top or bottom of the loop has work to do: after an error, while
+** a progress callback is registered, and always in builds with the
+** debugging, profiling or test code of the loop compiled in.
+*/
+#if defined(VDBE_COMPUTED_GOTO) && !defined(__GNUC__)
+# undef VDBE_COMPUTED_GOTO
+#endif
+#ifdef VDBE_COMPUTED_GOTO
+# define VDBE_LABEL(X)  L_##X:
+#else
+# define VDBE_LABEL(X)
+#endif
+#if defined(VDBE_COMPUTED_GOTO) && defined(NDEBUG) \
+      && !defined(VDBE_PROFILE) && !defined(SQLITE_TEST)
+# ifndef SQLITE_OMIT_PROGRESS_CALLBACK
+#  define VDBE_CAN_THREAD  (rc==SQLITE_OK && db->xProgress==0)
+# else
+#  define VDBE_CAN_THREAD  (rc==SQLITE_OK)
+# endif
+# define VDBE_NEXT \
+    if( VDBE_CAN_THREAD ){ pOp = &p->aOp[++pc]; goto *aJump[pOp->opcode]; } \
+    break
+#else
+# define VDBE_NEXT  break
+#endif
+
 
 /*
 ** Execute as much of a VDBE program as we can then return.
@@ -500,6 +507,9 @@ int sqlite3VdbeExec(
   sqlite *db = p->db;        /* The database */
   Mem *pTos;                 /* Top entry in the operand stack */
   char zBuf[100];            /* Space to sprintf() an integer */
+#ifdef VDBE_COMPUTED_GOTO
+  static void *aJump[] = { VDBE_JUMP_TABLE };  /* Code for each opcode */
+#endif
 #ifdef VDBE_PROFILE
   unsigned long long start;  /* CPU clock count at start of opcode */
   int origPc;                /* Program counter at start of opcode */
@@ -569,6 +579,10 @@ int sqlite3VdbeExec(
     }
 #endif
 
+#ifdef VDBE_COMPUTED_GOTO
+    assert( pOp->opcode<ArraySize(aJump) );
+    goto *aJump[pOp->opcode];
+#endif
     switch( pOp->opcode ){
 
 /*****************************************************************************
@@ -606,10 +620,10 @@ int sqlite3VdbeExec(
 ** the one at index P2 from the beginning of
 ** the program.
 */
-case OP_Goto: {
+case OP_Goto: VDBE_LABEL(Goto) {
   CHECK_FOR_INTERRUPT;
   pc = pOp->p2 - 1;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode:  Gosub * P2 *
@@ -622,7 +636,7 @@ case OP_Goto: {
 ** the return address stack will fill up and processing will abort
 ** with a fatal error.
 */
-case OP_Gosub: {
+case OP_Gosub: VDBE_LABEL(Gosub) {
   if( p->returnDepth>=sizeof(p->returnStack)/sizeof(p->returnStack[0]) ){
     sqlite3SetString(&p->zErrMsg, "return address stack overflow", (char*)0);
     p->rc = SQLITE_INTERNAL;
@@ -630,7 +644,7 @@ case OP_Gosub: {
   }
   p->returnStack[p->returnDepth++] = pc+1;
   pc = pOp->p2 - 1;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode:  Return * * *
@@ -639,7 +653,7 @@ case OP_Gosub: {
 ** OP_Gosub.  If an OP_Return has occurred for all OP_Gosubs, then
 ** processing aborts with a fatal error.
 */
-case OP_Return: {
+case OP_Return: VDBE_LABEL(Return) {
   if( p->returnDepth<=0 ){
     sqlite3SetString(&p->zErrMsg, "return address stack underflow", (char*)0);
     p->rc = SQLITE_INTERNAL;
@@ -647,7 +661,7 @@ case OP_Return: {
   }
   p->returnDepth--;
   pc = p->returnStack[p->returnDepth] - 1;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode:  Halt P1 P2 *
@@ -667,7 +681,7 @@ case OP_Return: {
 ** every program.  So a jump past the last instruction of the program
 ** is the same as executing Halt.
 */
-case OP_Halt: {
+case OP_Halt: VDBE_LABEL(Halt) {
   p->magic = VDBE_MAGIC_HALT;
   p->pTos = pTos;
   if( pOp->p1!=SQLITE_OK ){
@@ -689,7 +703,7 @@ case OP_Halt: {
 ** then it is assumed to be a string representation of the same integer.
 ** If P1 is zero and P3 is not zero, then the value is derived from P3.
 */
-case OP_Integer: {
+case OP_Integer: VDBE_LABEL(Integer) {
   pTos++;
   if( pOp->p3==0 ){
     pTos->flags = MEM_Int;
@@ -701,21 +715,21 @@ case OP_Integer: {
     pTos->enc = SQLITE_UTF8;
     Integerify(pTos, 0);
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Real * * P3
 **
 ** The string value P3 is converted to a real and pushed on to the stack.
 */
-case OP_Real: {
+case OP_Real: VDBE_LABEL(Real) {
   pTos++;
   pTos->flags = MEM_Str|MEM_Static|MEM_Term;
   pTos->z = pOp->p3;
   pTos->n = strlen(pTos->z);
   pTos->enc = SQLITE_UTF8;
   Realify(pTos, 0);
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: String8 * * P3
@@ -723,7 +737,7 @@ case OP_Real: {
 ** P3 points to a nul terminated UTF-8 string. This opcode is transformed
 ** into an OP_String before it is executed for the first time.
 */
-case OP_String8: {
+case OP_String8: VDBE_LABEL(String8) {
   pOp->opcode = OP_String;
 
   if( db->enc!=SQLITE_UTF8 && pOp->p3 ){
@@ -749,7 +763,7 @@ case OP_String8: {
 ** NULL is pushed onto the stack. P3 is assumed to be a nul terminated
 ** string encoded with the database native encoding.
 */
-case OP_String: {
+case OP_String: VDBE_LABEL(String) {
   pTos++;
   if( pOp->p3 ){
     pTos->flags = MEM_Str|MEM_Static|MEM_Term;
@@ -763,7 +777,7 @@ case OP_String: {
   }else{
     pTos->flags = MEM_Null;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: HexBlob * * P3
@@ -774,7 +788,7 @@ case OP_String: {
 ** The first time this instruction executes, in transforms
 ** itself into a 'Blob' opcode with a binary blob as P3.
 */
-case OP_HexBlob: {
+case OP_HexBlob: VDBE_LABEL(HexBlob) {
   pOp->opcode = OP_Blob;
   pOp->p1 = strlen(pOp->p3)/2;
   if( pOp->p1 ){
@@ -805,10 +819,10 @@ case OP_HexBlob: {
 ** the blob as P3. This opcode is transformed to an OP_Blob
 ** before execution (within the sqlite3_prepare() function).
 */
-case OP_Blob: {
+case OP_Blob: VDBE_LABEL(Blob) {
   pTos++;
   sqlite3VdbeMemSetStr(pTos, pOp->p3, pOp->p1, 0, 0);
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Variable P1 * *
@@ -820,7 +834,7 @@ case OP_Blob: {
 ** right beginning with 1.  The values of variables are set using the
 ** sqlite3_bind() API.
 */
-case OP_Variable: {
+case OP_Variable: VDBE_LABEL(Variable) {
   int j = pOp->p1 - 1;
   assert( j>=0 && j<p->nVar );
 
@@ -831,7 +845,7 @@ case OP_Variable: {
     pTos->flags &= ~(MEM_Dyn|MEM_Ephem|MEM_Short);
     pTos->flags |= MEM_Static;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Utf16le_8 * * *
@@ -839,9 +853,9 @@ case OP_Variable: {
 ** The element on the top of the stack must be a little-endian UTF-16
 ** encoded string. It is translated in-place to UTF-8.
 */
-case OP_Utf16le_8: {
+case OP_Utf16le_8: VDBE_LABEL(Utf16le_8) {
   rc = SQLITE_INTERNAL;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Utf16be_8 * * *
@@ -849,9 +863,9 @@ case OP_Utf16le_8: {
 ** The element on the top of the stack must be a big-endian UTF-16
 ** encoded string. It is translated in-place to UTF-8.
 */
-case OP_Utf16be_8: {
+case OP_Utf16be_8: VDBE_LABEL(Utf16be_8) {
   rc = SQLITE_INTERNAL;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Utf8_16be * * *
@@ -859,9 +873,9 @@ case OP_Utf16be_8: {
 ** The element on the top of the stack must be a UTF-8 encoded
 ** string. It is translated to big-endian UTF-16.
 */
-case OP_Utf8_16be: {
+case OP_Utf8_16be: VDBE_LABEL(Utf8_16be) {
   rc = SQLITE_INTERNAL;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Utf8_16le * * *
@@ -869,9 +883,9 @@ case OP_Utf8_16be: {
 ** The element on the top of the stack must be a UTF-8 encoded
 ** string. It is translated to little-endian UTF-16.
 */
-case OP_Utf8_16le: {
+case OP_Utf8_16le: VDBE_LABEL(Utf8_16le) {
   rc = SQLITE_INTERNAL;
-  break;
+  VDBE_NEXT;
 }
 
 /*
@@ -881,20 +895,20 @@ case OP_Utf8_16le: {
 ** string. Every second byte is exchanged, so as to translate
 ** the string from little-endian to big-endian or vice versa.
 */
-case OP_UtfSwab: {
+case OP_UtfSwab: VDBE_LABEL(UtfSwab) {
   rc = SQLITE_INTERNAL;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Pop P1 * *
 **
 ** P1 elements are popped off of the top of stack and discarded.
 */
-case OP_Pop: {
+case OP_Pop: VDBE_LABEL(Pop) {
   assert( pOp->p1>=0 );
   popStack(&pTos, pOp->p1);
   assert( pTos>=&p->aStack[-1] );
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Dup P1 P2 *
@@ -912,7 +926,7 @@ case OP_Pop: {
 **
 ** Also see the Pull instruction.
 */
-case OP_Dup: {
+case OP_Dup: VDBE_LABEL(Dup) {
   Mem *pFrom = &pTos[-pOp->p1];
   assert( pFrom<=pTos && pFrom>=p->aStack );
   pTos++;
@@ -934,7 +948,7 @@ case OP_Dup: {
       pTos->flags |= MEM_Dyn|MEM_Term;
     }
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Pull P1 * *
@@ -947,11 +961,12 @@ case OP_Dup: {
 **
 ** See also the Dup instruction.
 */
-case OP_Pull: {
+case OP_Pull: VDBE_LABEL(Pull) {
   Mem *pFrom = &pTos[-pOp->p1];
   int i;
   Mem ts;
 
+  Deephemeralize(pFrom);
   ts = *pFrom;
   Deephemeralize(pTos);
   for(i=0; i<pOp->p1; i++, pFrom++){
@@ -970,7 +985,7 @@ case OP_Pull: {
     assert( pTos->z==pTos[-pOp->p1].zShort );
     pTos->z = pTos->zShort;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Push P1 * *
@@ -979,7 +994,7 @@ case OP_Pull: {
 ** stack (P1==0 is the top of the stack) with the value
 ** of the top of the stack.  Then pop the top of the stack.
 */
-case OP_Push: {
+case OP_Push: VDBE_LABEL(Push) {
   Mem *pTo = &pTos[-pOp->p1];
 
   assert( pTo>=p->aStack );
@@ -991,7 +1006,7 @@ case OP_Push: {
     pTo->z = pTo->zShort;
   }
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Callback P1 * *
@@ -1000,7 +1015,7 @@ case OP_Push: {
 ** invoke the callback function using the newly formed array as the
 ** 3rd parameter.
 */
-case OP_Callback: {
+case OP_Callback: VDBE_LABEL(Callback) {
   int i;
   assert( p->nResColumn==pOp->p1 );
 
@@ -1030,7 +1045,7 @@ case OP_Callback: {
 ** makes a copy of the top stack element into memory obtained
 ** from sqliteMalloc().
 */
-case OP_Concat: {
+case OP_Concat: VDBE_LABEL(Concat) {
   char *zNew;
   int nByte;
   int nField;
@@ -1109,7 +1124,7 @@ case OP_Concat: {
     pTos->enc = db->enc;
     pTos->z = zNew;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Add * * *
@@ -1158,12 +1173,22 @@ case OP_Concat: {
 ** function before the division.  Division by zero returns NULL.
 ** If either operand is NULL, the result is NULL.
 */
-case OP_Add:
-case OP_Subtract:
-case OP_Multiply:
-case OP_Divide:
-case OP_Remainder: {
-  Mem *pNos = &pTos[-1];
+case OP_Add: VDBE_LABEL(Add)
+case OP_Subtract: VDBE_LABEL(Subtract)
+case OP_Multiply: VDBE_LABEL(Multiply)
+case OP_Divide: VDBE_LABEL(Divide)
+case OP_Remainder: VDBE_LABEL(Remainder) {
+  Mem *pNos;
+  if( pOp->p3type==P3_MEM ){
+    /* The right-hand operand is the constant number in P3.  Push it, just
+    ** as the instruction that this one replaces would have done. */
+    Mem *pConst = (Mem*)pOp->p3;
+    pTos++;
+    pTos->flags = pConst->flags;
+    pTos->i = pConst->i;
+    pTos->r = pConst->r;
+  }
+  pNos = &pTos[-1];
   assert( pNos>=p->aStack );
   if( ((pTos->flags | pNos->flags) & MEM_Null)!=0 ){
     Release(pTos);
@@ -1230,7 +1255,7 @@ divide_by_zero:
   pTos--;
   Release(pTos);
   pTos->flags = MEM_Null;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: CollSeq * * P3
@@ -1244,9 +1269,9 @@ divide_by_zero:
 ** to retrieve the collation sequence set by this opcode is not available
 ** publicly, only to user functions defined in func.c.
 */
-case OP_CollSeq: {
+case OP_CollSeq: VDBE_LABEL(CollSeq) {
   assert( pOp->p3type==P3_COLLSEQ );
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Function P1 P2 P3
@@ -1264,7 +1289,7 @@ case OP_CollSeq: {
 **
 ** See also: AggFunc
 */
-case OP_Function: {
+case OP_Function: VDBE_LABEL(Function) {
   int i;
   Mem *pArg;
   sqlite3_context ctx;
@@ -1335,7 +1360,7 @@ case OP_Function: {
        (pTos->flags & MEM_Str)!=0 ? pTos->z : "user function error", (char*)0);
     rc = SQLITE_ERROR;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: BitAnd * * *
@@ -1366,10 +1391,10 @@ case OP_Function: {
 ** right by N bits where N is the second element on the stack.
 ** If either operand is NULL, the result is NULL.
 */
-case OP_BitAnd:
-case OP_BitOr:
-case OP_ShiftLeft:
-case OP_ShiftRight: {
+case OP_BitAnd: VDBE_LABEL(BitAnd)
+case OP_BitOr: VDBE_LABEL(BitOr)
+case OP_ShiftLeft: VDBE_LABEL(ShiftLeft)
+case OP_ShiftRight: VDBE_LABEL(ShiftRight) {
   Mem *pNos = &pTos[-1];
   int a, b;
 
@@ -1403,7 +1428,7 @@ case OP_ShiftRight: {
   Release(pTos);
   pTos->i = a;
   pTos->flags = MEM_Int;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: AddImm  P1 * *
@@ -1413,11 +1438,11 @@ case OP_ShiftRight: {
 **
 ** To force the top of the stack to be an integer, just add 0.
 */
-case OP_AddImm: {
+case OP_AddImm: VDBE_LABEL(AddImm) {
   assert( pTos>=p->aStack );
   Integerify(pTos, db->enc);
   pTos->i += pOp->p1;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ForceInt P1 P2 *
@@ -1430,7 +1455,7 @@ case OP_AddImm: {
 ** current value if P1==0, or to the least integer that is strictly
 ** greater than its current value if P1==1.
 */
-case OP_ForceInt: {
+case OP_ForceInt: VDBE_LABEL(ForceInt) {
   int v;
   assert( pTos>=p->aStack );
   if( (pTos->flags & (MEM_Int|MEM_Real))==0 && ((pTos->flags & MEM_Str)==0 
@@ -1451,7 +1476,7 @@ case OP_ForceInt: {
   Release(pTos);
   pTos->i = v;
   pTos->flags = MEM_Int;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: MustBeInt P1 P2 *
@@ -1465,7 +1490,7 @@ case OP_ForceInt: {
 ** P1 is 1, then the stack is popped.  In all other cases, the depth
 ** of the stack is unchanged.
 */
-case OP_MustBeInt: {
+case OP_MustBeInt: VDBE_LABEL(MustBeInt) {
   assert( pTos>=p->aStack );
   if( pTos->flags & MEM_Int ){
     /* Do nothing */
@@ -1510,7 +1535,7 @@ mismatch:
     if( pOp->p1 ) popStack(&pTos, 1);
     pc = pOp->p2 - 1;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Eq P1 P2 P3
@@ -1538,7 +1563,10 @@ mismatch:
 ** NULL if either operand was NULL.
 **
 ** If P3 is not NULL it is a pointer to a collating sequence (a CollSeq
-** structure) that defines how to compare text.
+** structure) that defines how to compare text.  Or P3 may be a constant
+** number (P3_MEM).  Then only one element is popped from the stack and
+** it is compared against P3, as if P3 had been on the top of the stack.
+** The comparison of a number never needs a collating sequence.
 */
 /* Opcode: Ne P1 P2 P3
 **
@@ -1570,26 +1598,39 @@ mismatch:
 ** the 2nd element down on the stack is greater than or equal to the
 ** top of the stack.  See the Eq opcode for additional information.
 */
-case OP_Eq:
-case OP_Ne:
-case OP_Lt:
-case OP_Le:
-case OP_Gt:
-case OP_Ge: {
-  Mem *pNos;
+case OP_Eq: VDBE_LABEL(Eq)
+case OP_Ne: VDBE_LABEL(Ne)
+case OP_Lt: VDBE_LABEL(Lt)
+case OP_Le: VDBE_LABEL(Le)
+case OP_Gt: VDBE_LABEL(Gt)
+case OP_Ge: VDBE_LABEL(Ge) {
+  Mem *pNos;          /* Left-hand operand */
+  Mem *pRight;        /* Right-hand operand */
+  int nPop;           /* Number of operands taken from the stack */
   int flags;
   int res;
   char affinity;
+  CollSeq *pColl = 0;
 
-  pNos = &pTos[-1];
-  flags = pTos->flags|pNos->flags;
+  if( pOp->p3type==P3_MEM ){
+    pRight = (Mem*)pOp->p3;
+    pNos = pTos;
+    nPop = 1;
+  }else{
+    pRight = pTos;
+    pNos = &pTos[-1];
+    nPop = 2;
+    assert( pOp->p3type==P3_COLLSEQ || pOp->p3==0 );
+    pColl = (CollSeq*)pOp->p3;
+  }
+  flags = pRight->flags|pNos->flags;
 
   /* If either value is a NULL P2 is not zero, take the jump if the least
   ** significant byte of P1 is true. If P2 is zero, then push a NULL onto
   ** the stack.
   */
   if( flags&MEM_Null ){
-    popStack(&pTos, 2);
+    popStack(&pTos, nPop);
     if( pOp->p2 ){
       if( (pOp->p1&0xFF) ) pc = pOp->p2-1;
     }else{
@@ -1599,14 +1640,17 @@ case OP_Ge: {
     break;
   }
 
+  /* A constant operand is never given TEXT affinity (see codeBinaryOp()
+  ** in expr.c), so applying the affinity to it leaves it a number and
+  ** no memory is allocated.
+  */
   affinity = (pOp->p1>>8)&0xFF;
   if( affinity ){
     applyAffinity(pNos, affinity, db->enc);
-    applyAffinity(pTos, affinity, db->enc);
+    applyAffinity(pRight, affinity, db->enc);
   }
 
-  assert( pOp->p3type==P3_COLLSEQ || pOp->p3==0 );
-  res = sqlite3MemCompare(pNos, pTos, (CollSeq*)pOp->p3);
+  res = sqlite3MemCompare(pNos, pRight, pColl);
   switch( pOp->opcode ){
     case OP_Eq:    res = res==0;     break;
     case OP_Ne:    res = res!=0;     break;
@@ -1616,7 +1660,7 @@ case OP_Ge: {
     default:       res = res>=0;     break;
   }
 
-  popStack(&pTos, 2);
+  popStack(&pTos, nPop);
   if( pOp->p2 ){
     if( res ){
       pc = pOp->p2-1;
@@ -1626,7 +1670,7 @@ case OP_Ge: {
     pTos->flags = MEM_Int;
     pTos->i = res;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: And * * *
@@ -1641,8 +1685,8 @@ case OP_Ge: {
 ** two values and push the resulting boolean value back onto the
 ** stack. 
 */
-case OP_And:
-case OP_Or: {
+case OP_And: VDBE_LABEL(And)
+case OP_Or: VDBE_LABEL(Or) {
   Mem *pNos = &pTos[-1];
   int v1, v2;    /* 0==TRUE, 1==FALSE, 2==UNKNOWN or NULL */
 
@@ -1674,7 +1718,7 @@ case OP_Or: {
     pTos->i = v1==0;
     pTos->flags = MEM_Int;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Negative * * *
@@ -1689,8 +1733,8 @@ case OP_Or: {
 ** with its absolute value. If the top of the stack is NULL
 ** its value is unchanged.
 */
-case OP_Negative:
-case OP_AbsValue: {
+case OP_Negative: VDBE_LABEL(Negative)
+case OP_AbsValue: VDBE_LABEL(AbsValue) {
   assert( pTos>=p->aStack );
   if( pTos->flags & MEM_Real ){
     Release(pTos);
@@ -1714,7 +1758,7 @@ case OP_AbsValue: {
     }
     pTos->flags = MEM_Real;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Not * * *
@@ -1723,14 +1767,14 @@ case OP_AbsValue: {
 ** with its complement.  If the top of the stack is NULL its value
 ** is unchanged.
 */
-case OP_Not: {
+case OP_Not: VDBE_LABEL(Not) {
   assert( pTos>=p->aStack );
   if( pTos->flags & MEM_Null ) break;  /* Do nothing to NULLs */
   Integerify(pTos, db->enc);
   Release(pTos);
   pTos->i = !pTos->i;
   pTos->flags = MEM_Int;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: BitNot * * *
@@ -1739,14 +1783,14 @@ case OP_Not: {
 ** with its ones-complement.  If the top of the stack is NULL its
 ** value is unchanged.
 */
-case OP_BitNot: {
+case OP_BitNot: VDBE_LABEL(BitNot) {
   assert( pTos>=p->aStack );
   if( pTos->flags & MEM_Null ) break;  /* Do nothing to NULLs */
   Integerify(pTos, db->enc);
   Release(pTos);
   pTos->i = ~pTos->i;
   pTos->flags = MEM_Int;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Noop * * *
@@ -1754,8 +1798,8 @@ case OP_BitNot: {
 ** Do nothing.  This instruction is often useful as a jump
 ** destination.
 */
-case OP_Noop: {
-  break;
+case OP_Noop: VDBE_LABEL(Noop) {
+  VDBE_NEXT;
 }
 
 /* Opcode: If P1 P2 *
@@ -1778,8 +1822,8 @@ case OP_Noop: {
 ** If the value popped of the stack is NULL, then take the jump if P1
 ** is true and fall through if P1 is false.
 */
-case OP_If:
-case OP_IfNot: {
+case OP_If: VDBE_LABEL(If)
+case OP_IfNot: VDBE_LABEL(IfNot) {
   int c;
   assert( pTos>=p->aStack );
   if( pTos->flags & MEM_Null ){
@@ -1798,7 +1842,7 @@ case OP_IfNot: {
   Release(pTos);
   pTos--;
   if( c ) pc = pOp->p2-1;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: IsNull P1 P2 *
@@ -1807,7 +1851,7 @@ case OP_IfNot: {
 ** to P2.  Pop the stack P1 times if P1>0.   If P1<0 leave the stack
 ** unchanged.
 */
-case OP_IsNull: {
+case OP_IsNull: VDBE_LABEL(IsNull) {
   int i, cnt;
   Mem *pTerm;
   cnt = pOp->p1;
@@ -1821,7 +1865,7 @@ case OP_IsNull: {
     }
   }
   if( pOp->p1>0 ) popStack(&pTos, cnt);
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: NotNull P1 P2 *
@@ -1830,7 +1874,7 @@ case OP_IsNull: {
 ** stack if P1 times if P1 is greater than zero.  If P1 is less than
 ** zero then leave the stack unchanged.
 */
-case OP_NotNull: {
+case OP_NotNull: VDBE_LABEL(NotNull) {
   int i, cnt;
   cnt = pOp->p1;
   if( cnt<0 ) cnt = -cnt;
@@ -1838,7 +1882,7 @@ case OP_NotNull: {
   for(i=0; i<cnt && (pTos[1+i-cnt].flags & MEM_Null)==0; i++){}
   if( i>=cnt ) pc = pOp->p2-1;
   if( pOp->p1>0 ) popStack(&pTos, cnt);
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: SetNumColumns P1 P2 *
@@ -1848,11 +1892,11 @@ case OP_NotNull: {
 **
 ** This opcode sets the number of columns for cursor P1 to P2.
 */
-case OP_SetNumColumns: {
+case OP_SetNumColumns: VDBE_LABEL(SetNumColumns) {
   assert( (pOp->p1)<p->nCursor );
   assert( p->apCsr[pOp->p1]!=0 );
   p->apCsr[pOp->p1]->nField = pOp->p2;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: IdxColumn P1 * *
@@ -1877,8 +1921,8 @@ case OP_SetNumColumns: {
 ** stack.  The column value is not copied. The number of columns in the
 ** record is stored on the stack just above the record itself.
 */
-case OP_IdxColumn:
-case OP_Column: {
+case OP_IdxColumn: VDBE_LABEL(IdxColumn)
+case OP_Column: VDBE_LABEL(Column) {
   int payloadSize;   /* Number of bytes in the record */
   int p1 = pOp->p1;  /* P1 value of the opcode */
   int p2 = pOp->p2;  /* column number to retrieve */
@@ -2082,7 +2126,7 @@ case OP_Column: {
   if( !pC ){
     sqliteFree(aType);
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode MakeRecord P1 P2 P3
@@ -2119,7 +2163,7 @@ case OP_Column: {
 **
 ** If P3 is NULL then all index fields have the affinity NONE.
 */
-case OP_MakeRecord: {
+case OP_MakeRecord: VDBE_LABEL(MakeRecord) {
   /* Assuming the record contains N fields, the record format looks
   ** like this:
   **
@@ -2258,7 +2302,7 @@ case OP_MakeRecord: {
   if( jumpIfNull && containsNull ){
     pc = jumpIfNull - 1;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Statement P1 * *
@@ -2273,7 +2317,7 @@ case OP_MakeRecord: {
 ** database file has an index of 0 and the file used for temporary tables
 ** has an index of 1.
 */
-case OP_Statement: {
+case OP_Statement: VDBE_LABEL(Statement) {
   int i = pOp->p1;
   Btree *pBt;
   if( i>=0 && i<db->nDb && (pBt = db->aDb[i].pBt) && !(db->autoCommit) ){
@@ -2282,7 +2326,7 @@ case OP_Statement: {
       rc = sqlite3BtreeBeginStmt(pBt);
     }
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: AutoCommit P1 P2 *
@@ -2290,7 +2334,7 @@ case OP_Statement: {
 ** Set the database auto-commit flag to P1 (1 or 0). If P2 is true, roll
 ** back any currently active btree transactions.
 */
-case OP_AutoCommit: {
+case OP_AutoCommit: VDBE_LABEL(AutoCommit) {
   u8 i = pOp->p1;
   u8 rollback = pOp->p2;
 
@@ -2311,7 +2355,7 @@ case OP_AutoCommit: {
          
     rc = SQLITE_ERROR;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Transaction P1 P2 *
@@ -2333,7 +2377,7 @@ case OP_AutoCommit: {
 **
 ** If P2 is zero, then a read-lock is obtained on the database file.
 */
-case OP_Transaction: {
+case OP_Transaction: VDBE_LABEL(Transaction) {
   int i = pOp->p1;
   Btree *pBt;
 
@@ -2355,7 +2399,7 @@ case OP_Transaction: {
       goto abort_due_to_error;
     }
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ReadCookie P1 P2 *
@@ -2370,7 +2414,7 @@ case OP_Transaction: {
 ** must be started or there must be an open cursor) before
 ** executing this instruction.
 */
-case OP_ReadCookie: {
+case OP_ReadCookie: VDBE_LABEL(ReadCookie) {
   int iMeta;
   assert( pOp->p2<SQLITE_N_BTREE_META );
   assert( pOp->p1>=0 && pOp->p1<db->nDb );
@@ -2386,7 +2430,7 @@ case OP_ReadCookie: {
   pTos++;
   pTos->i = iMeta;
   pTos->flags = MEM_Int;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: SetCookie P1 P2 *
@@ -2399,7 +2443,7 @@ case OP_ReadCookie: {
 **
 ** A transaction must be started before executing this opcode.
 */
-case OP_SetCookie: {
+case OP_SetCookie: VDBE_LABEL(SetCookie) {
   assert( pOp->p2<SQLITE_N_BTREE_META );
   assert( pOp->p1>=0 && pOp->p1<db->nDb );
   assert( db->aDb[pOp->p1].pBt!=0 );
@@ -2409,7 +2453,7 @@ case OP_SetCookie: {
   rc = sqlite3BtreeUpdateMeta(db->aDb[pOp->p1].pBt, 1+pOp->p2, (int)pTos->i);
   Release(pTos);
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: VerifyCookie P1 P2 *
@@ -2428,7 +2472,7 @@ case OP_SetCookie: {
 ** to be executed (to establish a read lock) before this opcode is
 ** invoked.
 */
-case OP_VerifyCookie: {
+case OP_VerifyCookie: VDBE_LABEL(VerifyCookie) {
   int iMeta;
   assert( pOp->p1>=0 && pOp->p1<db->nDb );
   rc = sqlite3BtreeGetMeta(db->aDb[pOp->p1].pBt, 1, &iMeta);
@@ -2436,7 +2480,7 @@ case OP_VerifyCookie: {
     sqlite3SetString(&p->zErrMsg, "database schema has changed", (char*)0);
     rc = SQLITE_SCHEMA;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: OpenRead P1 P2 P3
@@ -2481,8 +2525,8 @@ case OP_VerifyCookie: {
 **
 ** See also OpenRead.
 */
-case OP_OpenRead:
-case OP_OpenWrite: {
+case OP_OpenRead: VDBE_LABEL(OpenRead)
+case OP_OpenWrite: VDBE_LABEL(OpenWrite) {
   int i = pOp->p1;
   int p2 = pOp->p2;
   int wrFlag;
@@ -2537,6 +2581,10 @@ case OP_OpenWrite: {
       int flags = sqlite3BtreeFlags(pCur->pCursor);
       pCur->intKey = (flags & BTREE_INTKEY)!=0;
       pCur->zeroData = (flags & BTREE_ZERODATA)!=0;
+      if( pCur->pKeyInfo ){
+        sqlite3BtreeSetStreamCompare(pCur->pCursor,
+                                     sqlite3VdbeRecordCompareCursor);
+      }
       break;
     }
     case SQLITE_EMPTY: {
@@ -2547,7 +2595,7 @@ case OP_OpenWrite: {
       goto abort_due_to_error;
     }
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: OpenTemp P1 * P3
@@ -2568,7 +2616,7 @@ case OP_OpenWrite: {
 ** whereas "Temporary" in the context of CREATE TABLE means for the duration
 ** of the connection to the database.  Same word; different meanings.
 */
-case OP_OpenTemp: {
+case OP_OpenTemp: VDBE_LABEL(OpenTemp) {
   int i = pOp->p1;
   Cursor *pCx;
   assert( i>=0 );
@@ -2594,6 +2642,10 @@ case OP_OpenTemp: {
         assert( pgno==MASTER_ROOT+1 );
         rc = sqlite3BtreeCursor(pCx->pBt, pgno, 1, sqlite3VdbeRecordCompare,
             pOp->p3, &pCx->pCursor);
+        if( rc==SQLITE_OK ){
+          sqlite3BtreeSetStreamCompare(pCx->pCursor,
+                                       sqlite3VdbeRecordCompareCursor);
+        }
         pCx->pKeyInfo = (KeyInfo*)pOp->p3;
         pCx->pKeyInfo->enc = p->db->enc;
         pCx->pIncrKey = &pCx->pKeyInfo->incrKey;
@@ -2604,7 +2656,7 @@ case OP_OpenTemp: {
       pCx->pIncrKey = &pCx->bogusIncrKey;
     }
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: OpenPseudo P1 * *
@@ -2617,7 +2669,7 @@ case OP_OpenTemp: {
 ** A pseudo-table created by this opcode is useful for holding the
 ** NEW or OLD tables in a trigger.
 */
-case OP_OpenPseudo: {
+case OP_OpenPseudo: VDBE_LABEL(OpenPseudo) {
   int i = pOp->p1;
   Cursor *pCx;
   assert( i>=0 );
@@ -2626,7 +2678,7 @@ case OP_OpenPseudo: {
   pCx->nullRow = 1;
   pCx->pseudoTable = 1;
   pCx->pIncrKey = &pCx->bogusIncrKey;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Close P1 * *
@@ -2634,13 +2686,13 @@ case OP_OpenPseudo: {
 ** Close a cursor previously opened as P1.  If P1 is not
 ** currently open, this instruction is a no-op.
 */
-case OP_Close: {
+case OP_Close: VDBE_LABEL(Close) {
   int i = pOp->p1;
   if( i>=0 && i<p->nCursor ){
     sqlite3VdbeFreeCursor(p->apCsr[i]);
     p->apCsr[i] = 0;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: MoveGe P1 P2 *
@@ -2683,10 +2735,10 @@ case OP_Close: {
 **
 ** See also: Found, NotFound, Distinct, MoveGt, MoveGe, MoveLt
 */
-case OP_MoveLt:
-case OP_MoveLe:
-case OP_MoveGe:
-case OP_MoveGt: {
+case OP_MoveLt: VDBE_LABEL(MoveLt)
+case OP_MoveLe: VDBE_LABEL(MoveLe)
+case OP_MoveGe: VDBE_LABEL(MoveGe)
+case OP_MoveGt: VDBE_LABEL(MoveGt) {
   int i = pOp->p1;
   Cursor *pC;
 
@@ -2749,7 +2801,7 @@ case OP_MoveGt: {
   }
   Release(pTos);
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Distinct P1 P2 *
@@ -2785,9 +2837,9 @@ case OP_MoveGt: {
 **
 ** See also: Distinct, Found, MoveTo, NotExists, IsUnique
 */
-case OP_Distinct:
-case OP_NotFound:
-case OP_Found: {
+case OP_Distinct: VDBE_LABEL(Distinct)
+case OP_NotFound: VDBE_LABEL(NotFound)
+case OP_Found: VDBE_LABEL(Found) {
   int i = pOp->p1;
   int alreadyExists = 0;
   Cursor *pC;
@@ -2812,7 +2864,7 @@ case OP_Found: {
     Release(pTos);
     pTos--;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: IsUnique P1 P2 *
@@ -2836,7 +2888,7 @@ case OP_Found: {
 **
 ** See also: Distinct, NotFound, NotExists, Found
 */
-case OP_IsUnique: {
+case OP_IsUnique: VDBE_LABEL(IsUnique) {
   int i = pOp->p1;
   Mem *pNos = &pTos[-1];
   Cursor *pCx;
@@ -2913,7 +2965,7 @@ case OP_IsUnique: {
     pTos->i = v;
     pTos->flags = MEM_Int;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: NotExists P1 P2 *
@@ -2929,7 +2981,7 @@ case OP_IsUnique: {
 **
 ** See also: Distinct, Found, MoveTo, NotFound, IsUnique
 */
-case OP_NotExists: {
+case OP_NotExists: VDBE_LABEL(NotExists) {
   int i = pOp->p1;
   Cursor *pC;
   BtCursor *pCrsr;
@@ -2954,7 +3006,7 @@ case OP_NotExists: {
   }
   Release(pTos);
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: NewRecno P1 * *
@@ -2964,7 +3016,7 @@ case OP_NotExists: {
 ** table that cursor P1 points to.  The new record number is pushed 
 ** onto the stack.
 */
-case OP_NewRecno: {
+case OP_NewRecno: VDBE_LABEL(NewRecno) {
   int i = pOp->p1;
   i64 v = 0;
   Cursor *pC;
@@ -3063,7 +3115,7 @@ case OP_NewRecno: {
   pTos++;
   pTos->i = v;
   pTos->flags = MEM_Int;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: PutIntKey P1 P2 *
@@ -3091,8 +3143,8 @@ case OP_NewRecno: {
 **
 ** P1 may not be a pseudo-table opened using the OpenPseudo opcode.
 */
-case OP_PutIntKey:
-case OP_PutStrKey: {
+case OP_PutIntKey: VDBE_LABEL(PutIntKey)
+case OP_PutStrKey: VDBE_LABEL(PutStrKey) {
   Mem *pNos = &pTos[-1];
   int i = pOp->p1;
   Cursor *pC;
@@ -3165,7 +3217,7 @@ case OP_PutStrKey: {
     pC->cacheValid = 0;
   }
   popStack(&pTos, 2);
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Delete P1 P2 *
@@ -3183,7 +3235,7 @@ case OP_PutStrKey: {
 **
 ** If P1 is a pseudo-table, then this instruction is a no-op.
 */
-case OP_Delete: {
+case OP_Delete: VDBE_LABEL(Delete) {
   int i = pOp->p1;
   Cursor *pC;
   assert( i>=0 && i<p->nCursor );
@@ -3197,7 +3249,7 @@ case OP_Delete: {
   }
   if( pOp->p2 & OPFLAG_NCHANGE ) db->nChange++;
   if( pOp->p2 & OPFLAG_CSCHANGE ) db->csChange++;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: SetCounts * * *
@@ -3205,10 +3257,10 @@ case OP_Delete: {
 ** Called at end of statement.  Updates lsChange (last statement change count)
 ** and resets csChange (current statement change count) to 0.
 */
-case OP_SetCounts: {
+case OP_SetCounts: VDBE_LABEL(SetCounts) {
   db->lsChange=db->csChange;
   db->csChange=0;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: KeyAsData P1 P2 *
@@ -3218,14 +3270,14 @@ case OP_SetCounts: {
 ** data off of the key rather than the data.  This is used for
 ** processing compound selects.
 */
-case OP_KeyAsData: {
+case OP_KeyAsData: VDBE_LABEL(KeyAsData) {
   int i = pOp->p1;
   Cursor *pC;
   assert( i>=0 && i<p->nCursor );
   pC = p->apCsr[i];
   assert( pC!=0 );
   pC->keyAsData = pOp->p2;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: RowData P1 * *
@@ -3246,8 +3298,8 @@ case OP_KeyAsData: {
 ** If the cursor is not pointing to a valid row, a NULL is pushed
 ** onto the stack.
 */
-case OP_RowKey:
-case OP_RowData: {
+case OP_RowKey: VDBE_LABEL(RowKey)
+case OP_RowData: VDBE_LABEL(RowData) {
   int i = pOp->p1;
   Cursor *pC;
   int n;
@@ -3295,7 +3347,7 @@ case OP_RowData: {
   }else{
     pTos->flags = MEM_Null;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Recno P1 * *
@@ -3305,7 +3357,7 @@ case OP_RowData: {
 ** file P1.  The sequential scan should have been started using the 
 ** Next opcode.
 */
-case OP_Recno: {
+case OP_Recno: VDBE_LABEL(Recno) {
   int i = pOp->p1;
   Cursor *pC;
   i64 v;
@@ -3329,7 +3381,7 @@ case OP_Recno: {
   }
   pTos->i = v;
   pTos->flags = MEM_Int;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: FullKey P1 * *
@@ -3343,7 +3395,7 @@ case OP_Recno: {
 **
 ** This opcode may not be used on a pseudo-table.
 */
-case OP_FullKey: {
+case OP_FullKey: VDBE_LABEL(FullKey) {
   int i = pOp->p1;
   BtCursor *pCrsr;
   Cursor *pC;
@@ -3377,7 +3429,7 @@ case OP_FullKey: {
     pTos->z = z;
     pTos->n = amt;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: NullRow P1 * *
@@ -3386,7 +3438,7 @@ case OP_FullKey: {
 ** that occur while the cursor is on the null row will always push 
 ** a NULL onto the stack.
 */
-case OP_NullRow: {
+case OP_NullRow: VDBE_LABEL(NullRow) {
   int i = pOp->p1;
   Cursor *pC;
 
@@ -3395,7 +3447,7 @@ case OP_NullRow: {
   assert( pC!=0 );
   pC->nullRow = 1;
   pC->recnoIsValid = 0;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Last P1 P2 *
@@ -3406,7 +3458,7 @@ case OP_NullRow: {
 ** If P2 is 0 or if the table or index is not empty, fall through
 ** to the following instruction.
 */
-case OP_Last: {
+case OP_Last: VDBE_LABEL(Last) {
   int i = pOp->p1;
   Cursor *pC;
   BtCursor *pCrsr;
@@ -3426,7 +3478,7 @@ case OP_Last: {
   }else{
     pC->nullRow = 0;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Rewind P1 P2 *
@@ -3437,7 +3489,7 @@ case OP_Last: {
 ** If P2 is 0 or if the table or index is not empty, fall through
 ** to the following instruction.
 */
-case OP_Rewind: {
+case OP_Rewind: VDBE_LABEL(Rewind) {
   int i = pOp->p1;
   Cursor *pC;
   BtCursor *pCrsr;
@@ -3458,7 +3510,7 @@ case OP_Rewind: {
   if( res && pOp->p2>0 ){
     pc = pOp->p2 - 1;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Next P1 P2 *
@@ -3477,8 +3529,8 @@ case OP_Rewind: {
 ** to the following instruction.  But if the cursor backup was successful,
 ** jump immediately to P2.
 */
-case OP_Prev:
-case OP_Next: {
+case OP_Prev: VDBE_LABEL(Prev)
+case OP_Next: VDBE_LABEL(Next) {
   Cursor *pC;
   BtCursor *pCrsr;
 
@@ -3505,7 +3557,7 @@ case OP_Next: {
     pC->nullRow = 1;
   }
   pC->recnoIsValid = 0;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: IdxPut P1 P2 P3
@@ -3519,7 +3571,7 @@ case OP_Next: {
 ** is rolled back.  If P3 is not null, then it becomes part of the
 ** error message returned with the SQLITE_CONSTRAINT.
 */
-case OP_IdxPut: {
+case OP_IdxPut: VDBE_LABEL(IdxPut) {
   int i = pOp->p1;
   Cursor *pC;
   BtCursor *pCrsr;
@@ -3530,7 +3582,22 @@ case OP_IdxPut: {
   if( (pCrsr = (pC = p->apCsr[i])->pCursor)!=0 ){
     int nKey = pTos->n;
     const char *zKey = pTos->z;
-    if( pOp->p2 ){
+    if( pOp->p2 && pC->bulkLoad ){
+      int nPrior;
+      const u8 *zPrior = sqlite3BtreeLoadLastKey(pCrsr, &nPrior);
+
+      /* Entries are loaded in key order, so any entry with the same
+      ** indexed values must be the one loaded just before this one. */
+      if( zPrior && sqlite3VdbeRecordCompare(pC->pKeyInfo,
+              nPrior - sqlite3VdbeIdxRowidLen(nPrior, zPrior), zPrior,
+              nKey - sqlite3VdbeIdxRowidLen(nKey, zKey), zKey)==0 ){
+        rc = SQLITE_CONSTRAINT;
+        if( pOp->p3 && pOp->p3[0] ){
+          sqlite3SetString(&p->zErrMsg, pOp->p3, (char*)0);
+        }
+        goto abort_due_to_error;
+      }
+    }else if( pOp->p2 ){
       int res;
       int len;
    
@@ -3563,7 +3630,36 @@ case OP_IdxPut: {
   }
   Release(pTos);
   pTos--;
-  break;
+  VDBE_NEXT;
+}
+
+/* Opcode: BulkLoad P1 P2 *
+**
+** If P2 is 1, put cursor P1, which must be open for writing on an
+** empty table or index, into bulk-load mode.  Entries written through
+** the cursor must then come in ascending key order.  They are packed
+** onto pages one after another instead of being inserted one at a time.
+** No other operation may be used on the cursor until bulk-load mode is
+** ended.
+**
+** If P2 is 0, end bulk-load mode on cursor P1 and complete the b-tree.
+*/
+case OP_BulkLoad: VDBE_LABEL(BulkLoad) {
+  int i = pOp->p1;
+  Cursor *pC;
+  assert( i>=0 && i<p->nCursor );
+  assert( p->apCsr[i]!=0 );
+  if( (pC = p->apCsr[i])->pCursor!=0 ){
+    if( pOp->p2 ){
+      rc = sqlite3BtreeLoadBegin(pC->pCursor);
+    }else{
+      rc = sqlite3BtreeLoadEnd(pC->pCursor);
+    }
+    if( rc!=SQLITE_OK ) goto abort_due_to_error;
+    pC->bulkLoad = pOp->p2!=0;
+    pC->cacheValid = 0;
+  }
+  VDBE_NEXT;
 }
 
 /* Opcode: IdxDelete P1 * *
@@ -3571,7 +3667,7 @@ case OP_IdxPut: {
 ** The top of the stack is an index key built using the MakeIdxKey opcode.
 ** This opcode removes that entry from the index.
 */
-case OP_IdxDelete: {
+case OP_IdxDelete: VDBE_LABEL(IdxDelete) {
   int i = pOp->p1;
   Cursor *pC;
   BtCursor *pCrsr;
@@ -3590,7 +3686,7 @@ case OP_IdxDelete: {
   }
   Release(pTos);
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: IdxRecno P1 * *
@@ -3601,7 +3697,7 @@ case OP_IdxDelete: {
 **
 ** See also: Recno, MakeIdxKey.
 */
-case OP_IdxRecno: {
+case OP_IdxRecno: VDBE_LABEL(IdxRecno) {
   int i = pOp->p1;
   BtCursor *pCrsr;
   Cursor *pC;
@@ -3659,7 +3755,7 @@ case OP_IdxRecno: {
   }else{
     pTos->flags = MEM_Null;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: IdxGT P1 P2 *
@@ -3706,9 +3802,9 @@ case OP_IdxRecno: {
 ** an epsilon prior to the comparison.  This makes the opcode work
 ** like IdxLE.
 */
-case OP_IdxLT:
-case OP_IdxGT:
-case OP_IdxGE: {
+case OP_IdxLT: VDBE_LABEL(IdxLT)
+case OP_IdxGT: VDBE_LABEL(IdxGT)
+case OP_IdxGE: VDBE_LABEL(IdxGE) {
   int i= pOp->p1;
   BtCursor *pCrsr;
   Cursor *pC;
@@ -3740,7 +3836,7 @@ case OP_IdxGE: {
   }
   Release(pTos);
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: IdxIsNull P1 P2 *
@@ -3752,7 +3848,7 @@ case OP_IdxGE: {
 **
 ** The index entry is always popped from the stack.
 */
-case OP_IdxIsNull: {
+case OP_IdxIsNull: VDBE_LABEL(IdxIsNull) {
   int i = pOp->p1;
   int k, n;
   const char *z;
@@ -3772,7 +3868,7 @@ case OP_IdxIsNull: {
   }
   Release(pTos);
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Destroy P1 P2 *
@@ -3786,9 +3882,9 @@ case OP_IdxIsNull: {
 **
 ** See also: Clear
 */
-case OP_Destroy: {
+case OP_Destroy: VDBE_LABEL(Destroy) {
   rc = sqlite3BtreeDropTable(db->aDb[pOp->p2].pBt, pOp->p1);
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Clear P1 P2 *
@@ -3803,9 +3899,40 @@ case OP_Destroy: {
 **
 ** See also: Destroy
 */
-case OP_Clear: {
+case OP_Clear: VDBE_LABEL(Clear) {
   rc = sqlite3BtreeClearTable(db->aDb[pOp->p2].pBt, pOp->p1);
-  break;
+  VDBE_NEXT;
+}
+
+/* Opcode: IncrVacuum P1 P2 *
+**
+** Give up to P2 free pages of database P1 back to the file system, or
+** all of its free pages if P2 is zero.  This is a no-op unless the
+** database is in auto-vacuum mode.  A write transaction must be open.
+*/
+case OP_IncrVacuum: VDBE_LABEL(IncrVacuum) {
+  rc = sqlite3BtreeIncrVacuum(db->aDb[pOp->p1].pBt, pOp->p2);
+  VDBE_NEXT;
+}
+
+/* Opcode: FillStat P1 P2 *
+**
+** Count the pages of the table or index whose root page is P1 in
+** database P2, and how full they are.  Push the number of pages onto
+** the stack, then the percentage of their usable space that holds
+** data.  A read transaction must be open on the database.
+*/
+case OP_FillStat: VDBE_LABEL(FillStat) {
+  int nPage = 0;
+  double rFill = 0.0;
+  rc = sqlite3BtreeFillStat(db->aDb[pOp->p2].pBt, pOp->p1, &nPage, &rFill);
+  pTos++;
+  pTos->flags = MEM_Int;
+  pTos->i = nPage;
+  pTos++;
+  pTos->flags = MEM_Real;
+  pTos->r = rFill;
+  VDBE_NEXT;
 }
 
 /* Opcode: CreateTable * P2 P3
@@ -3831,10 +3958,13 @@ case OP_Clear: {
 ** auxiliary database file if P2==1.  Push the page number of the
 ** root page of the new index onto the stack.
 **
+** If "PRAGMA prefix_compression" is on, the pages of the new index
+** store their keys compressed against a reference key on each page.
+**
 ** See documentation on OP_CreateTable for additional information.
 */
-case OP_CreateIndex:
-case OP_CreateTable: {
+case OP_CreateIndex: VDBE_LABEL(CreateIndex)
+case OP_CreateTable: VDBE_LABEL(CreateTable) {
   int pgno;
   int flags;
   assert( pOp->p3!=0 && pOp->p3type==P3_POINTER );
@@ -3845,6 +3975,9 @@ case OP_CreateTable: {
     flags = BTREE_LEAFDATA|BTREE_INTKEY;
   }else{
     flags = BTREE_ZERODATA;
+    if( db->flags & SQLITE_PrefixKeys ){
+      flags |= BTREE_PREFIX;
+    }
   }
   rc = sqlite3BtreeCreateTable(db->aDb[pOp->p2].pBt, &pgno, flags);
   pTos++;
@@ -3856,7 +3989,7 @@ case OP_CreateTable: {
   }else{
     pTos->flags = MEM_Null;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: IntegrityCk * P2 *
@@ -3874,7 +4007,7 @@ case OP_CreateTable: {
 **
 ** This opcode is used for testing purposes only.
 */
-case OP_IntegrityCk: {
+case OP_IntegrityCk: VDBE_LABEL(IntegrityCk) {
   int nRoot;
   int *aRoot;
   int j;
@@ -3893,7 +4026,8 @@ case OP_IntegrityCk: {
   aRoot[j] = 0;
   popStack(&pTos, nRoot);
   pTos++;
-  z = sqlite3BtreeIntegrityCheck(db->aDb[pOp->p2].pBt, aRoot, nRoot);
+  z = sqlite3BtreeIntegrityCheck(db->aDb[pOp->p2].pBt, aRoot, nRoot,
+                                 db->nCheckThread);
   if( z==0 || z[0]==0 ){
     if( z ) sqliteFree(z);
     pTos->z = "ok";
@@ -3908,7 +4042,7 @@ case OP_IntegrityCk: {
   pTos->enc = SQLITE_UTF8;
   sqlite3VdbeChangeEncoding(pTos, db->enc);
   sqliteFree(aRoot);
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ListWrite * * *
@@ -3916,7 +4050,7 @@ case OP_IntegrityCk: {
 ** Write the integer on the top of the stack
 ** into the temporary storage list.
 */
-case OP_ListWrite: {
+case OP_ListWrite: VDBE_LABEL(ListWrite) {
   Keylist *pKeylist;
   assert( pTos>=p->aStack );
   pKeylist = p->pList;
@@ -3933,14 +4067,14 @@ case OP_ListWrite: {
   pKeylist->aKey[pKeylist->nUsed++] = pTos->i;
   Release(pTos);
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ListRewind * * *
 **
 ** Rewind the temporary buffer back to the beginning.
 */
-case OP_ListRewind: {
+case OP_ListRewind: VDBE_LABEL(ListRewind) {
   /* What this opcode codes, really, is reverse the order of the
   ** linked list of Keylist structures so that they are read out
   ** in the same order that they were read in. */
@@ -3953,7 +4087,7 @@ case OP_ListRewind: {
     pRev = pTop;
   }
   p->pList = pRev;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ListRead * P2 *
@@ -3962,7 +4096,7 @@ case OP_ListRewind: {
 ** and push it onto the stack.  If the storage buffer is empty, 
 ** push nothing but instead jump to P2.
 */
-case OP_ListRead: {
+case OP_ListRead: VDBE_LABEL(ListRead) {
   Keylist *pKeylist;
   CHECK_FOR_INTERRUPT;
   pKeylist = p->pList;
@@ -3980,19 +4114,19 @@ case OP_ListRead: {
   }else{
     pc = pOp->p2 - 1;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ListReset * * *
 **
 ** Reset the temporary storage buffer so that it holds nothing.
 */
-case OP_ListReset: {
+case OP_ListReset: VDBE_LABEL(ListReset) {
   if( p->pList ){
     sqlite3VdbeKeylistFree(p->pList);
     p->pList = 0;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ListPush * * * 
@@ -4000,7 +4134,7 @@ case OP_ListReset: {
 ** Save the current Vdbe list such that it can be restored by a ListPop
 ** opcode. The list is empty after this is executed.
 */
-case OP_ListPush: {
+case OP_ListPush: VDBE_LABEL(ListPush) {
   p->keylistStackDepth++;
   assert(p->keylistStackDepth > 0);
   p->keylistStack = sqliteRealloc(p->keylistStack, 
@@ -4008,7 +4142,7 @@ case OP_ListPush: {
   if( p->keylistStack==0 ) goto no_mem;
   p->keylistStack[p->keylistStackDepth - 1] = p->pList;
   p->pList = 0;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ListPop * * * 
@@ -4016,7 +4150,7 @@ case OP_ListPush: {
 ** Restore the Vdbe list to the state it was in when ListPush was last
 ** executed.
 */
-case OP_ListPop: {
+case OP_ListPop: VDBE_LABEL(ListPop) {
   assert(p->keylistStackDepth > 0);
   p->keylistStackDepth--;
   sqlite3VdbeKeylistFree(p->pList);
@@ -4026,7 +4160,7 @@ case OP_ListPop: {
     sqliteFree(p->keylistStack);
     p->keylistStack = 0;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ContextPush * * * 
@@ -4035,7 +4169,7 @@ case OP_ListPop: {
 ** opcode. The context stores the last insert row id, the last statement change
 ** count, and the current statement change count.
 */
-case OP_ContextPush: {
+case OP_ContextPush: VDBE_LABEL(ContextPush) {
   p->contextStackDepth++;
   assert(p->contextStackDepth > 0);
   p->contextStack = sqliteRealloc(p->contextStack, 
@@ -4044,7 +4178,7 @@ case OP_ContextPush: {
   p->contextStack[p->contextStackDepth - 1].lastRowid = p->db->lastRowid;
   p->contextStack[p->contextStackDepth - 1].lsChange = p->db->lsChange;
   p->contextStack[p->contextStackDepth - 1].csChange = p->db->csChange;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: ContextPop * * * 
@@ -4053,7 +4187,7 @@ case OP_ContextPush: {
 ** executed. The context stores the last insert row id, the last statement
 ** change count, and the current statement change count.
 */
-case OP_ContextPop: {
+case OP_ContextPop: VDBE_LABEL(ContextPop) {
   assert(p->contextStackDepth > 0);
   p->contextStackDepth--;
   p->db->lastRowid = p->contextStack[p->contextStackDepth].lastRowid;
@@ -4063,73 +4197,54 @@ case OP_ContextPop: {
     sqliteFree(p->contextStack);
     p->contextStack = 0;
   }
-  break;
+  VDBE_NEXT;
 }
 
-/* Opcode: SortPut * * *
+/* Opcode: SortPut P1 * P3
 **
 ** The TOS is the key and the NOS is the data.  Pop both from the stack
 ** and put them on the sorter.  The key and data should have been
-** made using SortMakeKey and SortMakeRec, respectively.
+** made using SortMakeKey and SortMakeRec, respectively.  P3 is a
+** pointer to a KeyInfo structure describing the key, which the sorter
+** needs when it runs out of memory and has to write what it holds to a
+** temporary file in sorted order.  It must compare keys the same way as
+** the KeyInfo of the OP_Sort that follows.
+**
+** If P1 is greater than zero, no more than the first P1 elements of the
+** sorted output will be read, as for ORDER BY with a LIMIT.  The sorter
+** then holds on to just the P1 elements that sort first.
 */
-case OP_SortPut: {
+case OP_SortPut: VDBE_LABEL(SortPut) {
   Mem *pNos = &pTos[-1];
-  Sorter *pSorter;
+  KeyInfo *pKeyInfo = (KeyInfo*)pOp->p3;
   assert( pNos>=p->aStack );
-  if( Dynamicify(pTos, db->enc) ) goto no_mem;
-  pSorter = sqliteMallocRaw( sizeof(Sorter) );
-  if( pSorter==0 ) goto no_mem;
-  pSorter->pNext = p->pSort;
-  p->pSort = pSorter;
-  assert( pTos->flags & MEM_Dyn );
-  pSorter->nKey = pTos->n;
-  pSorter->zKey = pTos->z;
-  pSorter->data.flags = MEM_Null;
-  rc = sqlite3VdbeMemMove(&pSorter->data, pNos);
+  Stringify(pTos, db->enc);
+  if( pKeyInfo ){
+    pKeyInfo->enc = db->enc;
+  }
+  rc = sqlite3VdbeSorterWrite(p, pKeyInfo, pOp->p1, pTos, pNos);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
   if( rc!=SQLITE_OK ) goto abort_due_to_error;
-  Deephemeralize(&pSorter->data);
-  pTos -= 2;
-  break;
+  popStack(&pTos, 2);
+  VDBE_NEXT;
 }
 
 /* Opcode: Sort * * P3
 **
-** Sort all elements on the sorter.  The algorithm is a
-** mergesort.  The P3 argument is a pointer to a KeyInfo structure
-** that describes the keys to be sorted.
+** Sort all elements on the sorter.  The P3 argument is a pointer to a
+** KeyInfo structure that describes the keys to be sorted.
+**
+** Elements still in memory are sorted in place.  If some were written
+** to the temporary file by OP_SortPut, this sets up a merge of those
+** sorted runs and the in-memory elements for OP_SortNext to read.
 */
-case OP_Sort: {
-  int i;
+case OP_Sort: VDBE_LABEL(Sort) {
   KeyInfo *pKeyInfo = (KeyInfo*)pOp->p3;
-  Sorter *pElem;
-  Sorter *apSorter[NSORT];
   pKeyInfo->enc = p->db->enc;
-  for(i=0; i<NSORT; i++){
-    apSorter[i] = 0;
-  }
-  while( p->pSort ){
-    pElem = p->pSort;
-    p->pSort = pElem->pNext;
-    pElem->pNext = 0;
-    for(i=0; i<NSORT-1; i++){
-    if( apSorter[i]==0 ){
-        apSorter[i] = pElem;
-        break;
-      }else{
-        pElem = Merge(apSorter[i], pElem, pKeyInfo);
-        apSorter[i] = 0;
-      }
-    }
-    if( i>=NSORT-1 ){
-      apSorter[NSORT-1] = Merge(apSorter[NSORT-1],pElem, pKeyInfo);
-    }
-  }
-  pElem = 0;
-  for(i=0; i<NSORT; i++){
-    pElem = Merge(apSorter[i], pElem, pKeyInfo);
-  }
-  p->pSort = pElem;
-  break;
+  rc = sqlite3VdbeSorterSort(p, pKeyInfo);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+  if( rc!=SQLITE_OK ) goto abort_due_to_error;
+  VDBE_NEXT;
 }
 
 /* Opcode: SortNext * P2 *
@@ -4138,31 +4253,31 @@ case OP_Sort: {
 ** stack, then remove the element from the sorter.  If the sorter
 ** is empty, push nothing on the stack and instead jump immediately 
 ** to instruction P2.
+**
+** A string or blob pushed by this opcode points into the sorter's own
+** buffers and is only good until the next OP_SortNext or OP_SortReset.
 */
-case OP_SortNext: {
-  Sorter *pSorter = p->pSort;
+case OP_SortNext: VDBE_LABEL(SortNext) {
+  int isEof;
   CHECK_FOR_INTERRUPT;
-  if( pSorter!=0 ){
-    p->pSort = pSorter->pNext;
+  rc = sqlite3VdbeSorterNext(p, &pTos[1], &isEof);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+  if( rc!=SQLITE_OK ) goto abort_due_to_error;
+  if( !isEof ){
     pTos++;
-    pTos->flags = MEM_Null;
-    rc = sqlite3VdbeMemMove(pTos, &pSorter->data);
-    assert( rc==SQLITE_OK );
-    sqliteFree(pSorter->zKey);
-    sqliteFree(pSorter);
   }else{
     pc = pOp->p2 - 1;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: SortReset * * *
 **
 ** Remove any elements that remain on the sorter.
 */
-case OP_SortReset: {
+case OP_SortReset: VDBE_LABEL(SortReset) {
   sqlite3VdbeSorterReset(p);
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: MemStore P1 P2 *
@@ -4175,7 +4290,7 @@ case OP_SortReset: {
 ** stack is popped once if P2 is 1.  If P2 is zero, then
 ** the original data remains on the stack.
 */
-case OP_MemStore: {
+case OP_MemStore: VDBE_LABEL(MemStore) {
   int i = pOp->p1;
   Mem *pMem;
   assert( pTos>=p->aStack );
@@ -4219,7 +4334,7 @@ case OP_MemStore: {
     Release(pTos);
     pTos--;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: MemLoad P1 * *
@@ -4231,7 +4346,7 @@ case OP_MemStore: {
 ** location is subsequently changed (using OP_MemStore) then the
 ** value pushed onto the stack will change too.
 */
-case OP_MemLoad: {
+case OP_MemLoad: VDBE_LABEL(MemLoad) {
   int i = pOp->p1;
   assert( i>=0 && i<p->nMem );
   pTos++;
@@ -4241,7 +4356,7 @@ case OP_MemLoad: {
     pTos->flags |= MEM_Ephem;
     pTos->flags &= ~(MEM_Dyn|MEM_Static|MEM_Short);
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: MemIncr P1 P2 *
@@ -4253,7 +4368,7 @@ case OP_MemLoad: {
 ** This instruction throws an error if the memory cell is not initially
 ** an integer.
 */
-case OP_MemIncr: {
+case OP_MemIncr: VDBE_LABEL(MemIncr) {
   int i = pOp->p1;
   Mem *pMem;
   assert( i>=0 && i<p->nMem );
@@ -4263,7 +4378,7 @@ case OP_MemIncr: {
   if( pOp->p2>0 && pMem->i>0 ){
      pc = pOp->p2 - 1;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: AggReset * P2 P3
@@ -4272,7 +4387,7 @@ case OP_MemIncr: {
 ** Future aggregator elements will contain P2 values each and be sorted
 ** using the KeyInfo structure pointed to by P3.
 */
-case OP_AggReset: {
+case OP_AggReset: VDBE_LABEL(AggReset) {
   assert( !pOp->p3 || pOp->p3type==P3_KEYINFO );
   rc = sqlite3VdbeAggReset(db, &p->agg, (KeyInfo *)pOp->p3);
   if( rc!=SQLITE_OK ){
@@ -4281,7 +4396,7 @@ case OP_AggReset: {
   p->agg.nMem = pOp->p2;
   p->agg.apFunc = sqliteMalloc( p->agg.nMem*sizeof(p->agg.apFunc[0]) );
   if( p->agg.apFunc==0 ) goto no_mem;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: AggInit * P2 P3
@@ -4290,11 +4405,11 @@ case OP_AggReset: {
 ** The aggregate will operate out of aggregate column P2.
 ** P3 is a pointer to the FuncDef structure for the function.
 */
-case OP_AggInit: {
+case OP_AggInit: VDBE_LABEL(AggInit) {
   int i = pOp->p2;
   assert( i>=0 && i<p->agg.nMem );
   p->agg.apFunc[i] = (FuncDef*)pOp->p3;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: AggFunc * P2 P3
@@ -4308,7 +4423,7 @@ case OP_AggInit: {
 ** Ideally, this index would be another parameter, but there are
 ** no free parameters left.  The integer is popped from the stack.
 */
-case OP_AggFunc: {
+case OP_AggFunc: VDBE_LABEL(AggFunc) {
   int n = pOp->p2;
   int i;
   Mem *pMem, *pRec;
@@ -4350,7 +4465,7 @@ case OP_AggFunc: {
   if( ctx.isError ){
     rc = SQLITE_ERROR;
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: AggFocus * P2 *
@@ -4367,7 +4482,7 @@ case OP_AggFunc: {
 ** zero or more AggNext operations.  You must not execute an AggFocus
 ** in between an AggNext and an AggReset.
 */
-case OP_AggFocus: {
+case OP_AggFocus: VDBE_LABEL(AggFocus) {
   char *zKey;
   int nKey;
   int res;
@@ -4394,7 +4509,7 @@ case OP_AggFocus: {
   }
   Release(pTos);
   pTos--;
-  break; 
+  VDBE_NEXT;
 }
 
 /* Opcode: AggSet * P2 *
@@ -4402,7 +4517,7 @@ case OP_AggFocus: {
 ** Move the top of the stack into the P2-th field of the current
 ** aggregate.  String values are duplicated into new memory.
 */
-case OP_AggSet: {
+case OP_AggSet: VDBE_LABEL(AggSet) {
   AggElem *pFocus;
   int i = pOp->p2;
   Mem *pMem;
@@ -4421,7 +4536,7 @@ case OP_AggSet: {
     pMem->z = pMem->zShort;
   }
   pTos--;
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: AggGet * P2 *
@@ -4430,7 +4545,7 @@ case OP_AggSet: {
 ** of the current aggregate.  Strings are not duplicated so
 ** string values will be ephemeral.
 */
-case OP_AggGet: {
+case OP_AggGet: VDBE_LABEL(AggGet) {
   AggElem *pFocus;
   Mem *pMem;
   int i = pOp->p2;
@@ -4449,7 +4564,7 @@ case OP_AggGet: {
   if( pTos->flags&MEM_Str ){
     sqlite3VdbeChangeEncoding(pTos, db->enc);
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: AggNext * P2 *
@@ -4464,7 +4579,7 @@ case OP_AggGet: {
 ** zero or more AggNext operations.  You must not execute an AggFocus
 ** in between an AggNext and an AggReset.
 */
-case OP_AggNext: {
+case OP_AggNext: VDBE_LABEL(AggNext) {
   int res;
   CHECK_FOR_INTERRUPT;
   if( p->agg.searching==0 ){
@@ -4510,7 +4625,7 @@ case OP_AggNext: {
       }
     }
   }
-  break;
+  VDBE_NEXT;
 }
 
 /* Opcode: Vacuum * * *
@@ -4519,20 +4634,20 @@ case OP_AggNext: {
 ** machines to be created and run.  It may not be called from within
 ** a transaction.
 */
-case OP_Vacuum: {
+case OP_Vacuum: VDBE_LABEL(Vacuum) {
   if( sqlite3SafetyOff(db) ) goto abort_due_to_misuse; 
   rc = sqlite3RunVacuum(&p->zErrMsg, db);
   if( sqlite3SafetyOn(db) ) goto abort_due_to_misuse;
-  break;
+  VDBE_NEXT;
 }
 
 /* An other opcode is illegal...
 */
-default: {
+default: VDBE_LABEL(default) {
   sqlite3_snprintf(sizeof(zBuf),zBuf,"%d",pOp->opcode);
   sqlite3SetString(&p->zErrMsg, "unknown opcode ", zBuf, (char*)0);
   rc = SQLITE_INTERNAL;
-  break;
+  VDBE_NEXT;
 }
 
 /*****************************************************************************
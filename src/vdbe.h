@@ -72,6 +72,14 @@ typedef struct VdbeOpList VdbeOpList;
 #define P3_FUNCDEF  (-5)  /* P3 is a pointer to a FuncDef structure */
 #define P3_KEYINFO  (-6)  /* P3 is a pointer to a KeyInfo structure */
 #define P3_VDBEFUNC (-7)  /* P3 is a pointer to a VdbeFunc structure */
+#define P3_MEM      (-8)  /* P3 is a constant operand, a sqlite3_value */
+
+/*
+** The virtual machine is a stack machine and all operands normally come
+** from the stack.  P3_MEM is the one exception.  The arithmetic and
+** comparison opcodes accept a numeric constant right-hand operand in P3
+** instead of on the top of the stack.  See codeBinaryOp() in expr.c.
+*/
 
 /* When adding a P3 argument using P3_KEYINFO, a copy of the KeyInfo structure
 ** is made.  That copy is freed when the Vdbe is finalized.  But if the
@@ -73,6 +73,7 @@ struct Cursor {
   Bool deferredMoveto;  /* A call to sqlite3BtreeMoveto() is needed */
   Bool intKey;          /* True if the table requires integer keys */
   Bool zeroData;        /* True if table contains keys only - no data */
+  Bool bulkLoad;        /* True if the btree cursor is in bulk-load mode */
   u8 bogusIncrKey;      /* Something for pIncrKey to point to if pKeyInfo==0 */
   i64 movetoTarget;     /* Argument to the deferred sqlite3BtreeMoveto() */
   Btree *pBt;           /* Separate file holding temporary table */
@@ -127,21 +128,10 @@ struct Mem {
 typedef struct Mem Mem;
 
 /*
-** A sorter builds a list of elements to be sorted.  Each element of
-** the list is an instance of the following structure.
+** The sorter behind OP_SortPut, OP_Sort and OP_SortNext.  Its contents
+** are private to vdbesort.c.
 */
-typedef struct Sorter Sorter;
-struct Sorter {
-  int nKey;           /* Number of bytes in the key */
-  char *zKey;         /* The key by which we will sort */
-  Mem data;
-  Sorter *pNext;      /* Next in the list */
-};
-
-/* 
-** Number of buckets used for merge-sort.  
-*/
-#define NSORT 30
+typedef struct VdbeSorter VdbeSorter;
 
 /* One or more of the following flags are set to indicate the validOK
 ** representations of the value stored in the Mem struct.
@@ -305,7 +295,7 @@ struct Vdbe {
   Mem *aColName;      /* Column names to return */
   int nCursor;        /* Number of slots in apCsr[] */
   Cursor **apCsr;     /* One element of this array for each open cursor */
-  Sorter *pSort;      /* A linked list of objects to be sorted */
+  VdbeSorter *pSorter; /* Rows being sorted for ORDER BY or CREATE INDEX */
   FILE *pFile;        /* At most one open file handler */
   int nField;         /* Number of file fields */
   char **azField;     /* Data for each file field */
@@ -351,6 +341,9 @@ struct Vdbe {
 ** Function prototypes
 */
 void sqlite3VdbeFreeCursor(Cursor*);
+int sqlite3VdbeSorterWrite(Vdbe*, KeyInfo*, int, Mem*, Mem*);
+int sqlite3VdbeSorterSort(Vdbe*, KeyInfo*);
+int sqlite3VdbeSorterNext(Vdbe*, Mem*, int*);
 void sqlite3VdbeSorterReset(Vdbe*);
 int sqlite3VdbeAggReset(sqlite *, Agg *, KeyInfo *);
 void sqlite3VdbeKeylistFree(Keylist*);
@@ -369,6 +362,7 @@ int sqlite3VdbeIdxKeyCompare(Cursor*, int , const unsigned char*, int*);
 int sqlite3VdbeIdxRowid(BtCursor *, i64 *);
 int sqlite3MemCompare(const Mem*, const Mem*, const CollSeq*);
 int sqlite3VdbeRecordCompare(void*,int,const void*,int, const void*);
+int sqlite3VdbeRecordCompareCursor(void*,BtCursor*,int,int,const void*,int*);
 int sqlite3VdbeIdxRowidLen(int,const u8*);
 int sqlite3VdbeExec(Vdbe*);
 int sqlite3VdbeList(Vdbe*);
@@ -473,6 +473,16 @@ static char *displayP3(Op *pOp, char *zTemp, int nTemp){
       zP3 = zTemp;
       break;
     }
+    case P3_MEM: {
+      Mem *pMem = (Mem*)pOp->p3;
+      if( pMem->flags & MEM_Int ){
+        sprintf(zTemp, "const(%lld)", pMem->i);
+      }else{
+        sprintf(zTemp, "const(%.15g)", pMem->r);
+      }
+      zP3 = zTemp;
+      break;
+    }
     case P3_FUNCDEF: {
       FuncDef *pDef = (FuncDef*)pOp->p3;
       char zNum[30];
@@ -597,6 +607,358 @@ int sqlite3VdbeList(
   return rc;
 }
 
+/*
+** Free the P3 operand of an instruction, and its comment, if the
+** instruction owns them.
+*/
+static void freeOp(Op *pOp){
+  if( pOp->p3type==P3_DYNAMIC || pOp->p3type==P3_KEYINFO ){
+    sqliteFree(pOp->p3);
+  }
+  if( pOp->p3type==P3_MEM ){
+    sqlite3ValueFree((sqlite3_value*)pOp->p3);
+  }
+  if( pOp->p3type==P3_VDBEFUNC ){
+    int j;
+    VdbeFunc *pVdbeFunc = (VdbeFunc *)pOp->p3;
+    for(j=0; j<pVdbeFunc->nAux; j++){
+      struct AuxData *pAuxData = &pVdbeFunc->apAux[j];
+      if( pAuxData->pAux && pAuxData->xDelete ){
+        pAuxData->xDelete(pAuxData->pAux);
+      }
+    }
+    sqliteFree(pVdbeFunc);
+  }
+#ifndef NDEBUG
+  sqliteFree(pOp->zComment);
+#endif
+}
+
+#ifndef SQLITE_OMIT_PEEPHOLE
+/*
+** Flags that optimizeProgram() keeps for each instruction.
+*/
+#define OPT_TARGET  0x01   /* Some live instruction jumps here */
+#define OPT_LIVE    0x02   /* Reachable from the first instruction */
+#define OPT_DROP    0x04   /* Left out of the optimized program */
+#define OPT_HOIST   0x08   /* Part of a constant moved out of its loop */
+#define OPT_LOOP    0x10   /* Inside the body of some loop */
+
+/*
+** Return the address that instruction pOp may jump to, or -1 if it
+** never jumps.  Every jump goes to the address in P2.  Most opcodes only
+** jump when P2 is not zero, so a zero P2 is taken to mean "no jump" for
+** all of them.  The one true jump to address zero, a loop around the
+** whole program, still works when it is left as it is.
+*/
+static int jumpTarget(Op *pOp){
+  switch( pOp->opcode ){
+    case OP_Goto:      case OP_Gosub:     case OP_ForceInt:
+    case OP_MustBeInt: case OP_Eq:        case OP_Ne:
+    case OP_Lt:        case OP_Le:        case OP_Gt:
+    case OP_Ge:        case OP_If:        case OP_IfNot:
+    case OP_IsNull:    case OP_NotNull:   case OP_MoveLt:
+    case OP_MoveLe:    case OP_MoveGe:    case OP_MoveGt:
+    case OP_Distinct:  case OP_NotFound:  case OP_Found:
+    case OP_IsUnique:  case OP_NotExists: case OP_Last:
+    case OP_Rewind:    case OP_Prev:      case OP_Next:
+    case OP_IdxLT:     case OP_IdxGT:     case OP_IdxGE:
+    case OP_IdxIsNull: case OP_ListRead:  case OP_SortNext:
+    case OP_MemIncr:   case OP_AggFocus:  case OP_AggNext: {
+      return pOp->p2>0 ? pOp->p2 : -1;
+    }
+    case OP_MakeRecord: {
+      /* The high byte of P2 is a flag.  See OP_MakeRecord in vdbe.c. */
+      int addr = pOp->p2 & 0x00FFFFFF;
+      return addr>0 ? addr : -1;
+    }
+  }
+  return -1;
+}
+
+/*
+** Change the jump address of instruction pOp, one for which
+** jumpTarget() returns an address, to addr.
+*/
+static void setJumpTarget(Op *pOp, int addr){
+  if( pOp->opcode==OP_MakeRecord ){
+    pOp->p2 = (pOp->p2 & 0xFF000000) | addr;
+  }else{
+    pOp->p2 = addr;
+  }
+}
+
+/*
+** Return true if control never passes from pOp to the instruction
+** that follows it.
+*/
+static int isBarrier(Op *pOp){
+  return pOp->opcode==OP_Goto || pOp->opcode==OP_Halt
+      || pOp->opcode==OP_Return;
+}
+
+/*
+** Return true if instruction pOp computes a value from constants and
+** its operands alone, so that it gives the same result wherever in the
+** program it runs and has no other effect.  Each such instruction pushes
+** one value.  The number of values it pops is written to *pnPop.
+**
+** OP_Variable counts as constant because the values of variables can
+** only change between runs of the program.  OP_Function does not, since
+** nothing says whether a function such as random() returns the same
+** value every time.
+*/
+static int isConstantOp(Op *pOp, int *pnPop){
+  switch( pOp->opcode ){
+    case OP_Integer:  case OP_Real:     case OP_String8:
+    case OP_String:   case OP_HexBlob:  case OP_Blob:
+    case OP_Variable: {
+      *pnPop = 0;
+      return 1;
+    }
+    case OP_Negative: case OP_AbsValue: case OP_Not:
+    case OP_BitNot: {
+      *pnPop = 1;
+      return 1;
+    }
+    case OP_BitAnd:   case OP_BitOr:    case OP_ShiftLeft:
+    case OP_ShiftRight: case OP_And:    case OP_Or: {
+      *pnPop = 2;
+      return 1;
+    }
+    case OP_Eq:       case OP_Ne:       case OP_Lt:
+    case OP_Le:       case OP_Gt:       case OP_Ge: {
+      if( pOp->p2 ) return 0;
+      *pnPop = pOp->p3type==P3_MEM ? 1 : 2;
+      return 1;
+    }
+    case OP_Add:      case OP_Subtract: case OP_Multiply:
+    case OP_Divide:   case OP_Remainder: {
+      *pnPop = pOp->p3type==P3_MEM ? 1 : 2;
+      return 1;
+    }
+    case OP_Concat: {
+      if( pOp->p2 || pOp->p1<1 ) return 0;
+      *pnPop = pOp->p1;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+** Make the program of VDBE p smaller and quicker without changing what
+** it does.  This is done once, just before the program first runs, so
+** EXPLAIN lists the program in the form that actually runs.
+**
+**   *  A jump to an OP_Goto is sent straight on to where the OP_Goto
+**      goes.
+**
+**   *  Instructions that can never be reached are removed, together
+**      with OP_Noop, "Pop 0", OP_Dup followed by "Pop 1", and any
+**      OP_Goto that only skips over instructions removed already.
+**      Adjacent OP_Pops are merged.
+**
+**   *  A run of instructions inside a loop that computes one value from
+**      constants only (see isConstantOp()) is moved to the start of the
+**      program.  There it is computed once and saved in a new memory
+**      cell, and the loop loads the value from that cell instead.
+**
+** Then the program is renumbered and every jump corrected.  If memory
+** cannot be had the program is left as it is, apart from jumps that
+** have been shortened.
+*/
+static void optimizeProgram(Vdbe *p){
+  int nOp = p->nOp;     /* Number of instructions before optimizing */
+  Op *aOp = p->aOp;     /* The program before optimizing */
+  Op *aNew;             /* The optimized program */
+  int nAlloc;           /* Number of slots in aNew[] */
+  u8 *aFlag;            /* OPT_* flags for each instruction */
+  int *aMap;            /* New address of each old instruction */
+  int *aStart;          /* First instruction of each hoisted constant */
+  int *aEnd;            /* Last instruction of each hoisted constant */
+  int nHoist = 0;       /* Number of hoisted constants */
+  int iMem = 0;         /* First memory cell not used by the program */
+  int i, j, k, n;
+
+  if( nOp<2 || aOp==0 || sqlite3_malloc_failed ) return;
+
+  /* Each hoisted constant adds an OP_MemStore after it and leaves an
+  ** OP_MemLoad in its place, two instructions more.  It is at least two
+  ** instructions long, so the new program has at most 2*nOp of them.
+  */
+  nAlloc = nOp*2;
+  aNew = sqliteMallocRaw( nAlloc*sizeof(Op) );
+  aMap = sqliteMallocRaw( (nOp+1)*3*sizeof(int) + nOp );
+  if( aNew==0 || aMap==0 ){
+    sqliteFree(aNew);
+    sqliteFree(aMap);
+    return;
+  }
+  aStart = &aMap[nOp+1];
+  aEnd = &aStart[nOp+1];
+  aFlag = (u8*)&aEnd[nOp+1];
+  memset(aFlag, 0, nOp);
+
+  /* Send jumps that land on an OP_Goto straight to its destination.
+  ** The count stops a loop of OP_Gotos from hanging this routine.
+  */
+  for(i=0; i<nOp; i++){
+    int iTo = jumpTarget(&aOp[i]);
+    for(n=0; iTo>=0 && iTo<nOp && n<10; n++){
+      Op *pTo = &aOp[iTo];
+      if( pTo->opcode!=OP_Goto || pTo->p2<=0 || pTo->p2==iTo ) break;
+      iTo = pTo->p2;
+      setJumpTarget(&aOp[i], iTo);
+    }
+  }
+
+  /* Find the instructions that can be reached, and the jump targets
+  ** among them.  aMap[] serves as the stack of addresses still to visit.
+  ** The OP_Halt at the end of the program is always kept, as
+  ** sqlite3VdbeMakeReady() looks for it.
+  */
+  n = 0;
+  aMap[n++] = 0;
+  aFlag[0] = OPT_LIVE;
+  while( n>0 ){
+    int iTo;
+    i = aMap[--n];
+    iTo = jumpTarget(&aOp[i]);
+    if( iTo>=0 && iTo<nOp ){
+      aFlag[iTo] |= OPT_TARGET;
+      if( (aFlag[iTo] & OPT_LIVE)==0 ){
+        aFlag[iTo] |= OPT_LIVE;
+        aMap[n++] = iTo;
+      }
+    }
+    if( i+1<nOp && !isBarrier(&aOp[i]) && (aFlag[i+1] & OPT_LIVE)==0 ){
+      aFlag[i+1] |= OPT_LIVE;
+      aMap[n++] = i+1;
+    }
+  }
+  aFlag[nOp-1] |= OPT_LIVE;
+
+  /* Drop dead code and instructions that do nothing.
+  */
+  for(i=0; i<nOp; i++){
+    Op *pOp = &aOp[i];
+    if( (aFlag[i] & OPT_LIVE)==0 || pOp->opcode==OP_Noop
+     || (pOp->opcode==OP_Pop && pOp->p1==0) ){
+      aFlag[i] |= OPT_DROP;
+      continue;
+    }
+    if( i+1<nOp && (aFlag[i+1] & OPT_TARGET)==0 && pOp[1].opcode==OP_Pop ){
+      if( pOp->opcode==OP_Dup && pOp[1].p1>0 ){
+        aFlag[i] |= OPT_DROP;
+        pOp[1].p1--;
+      }else if( pOp->opcode==OP_Pop ){
+        aFlag[i] |= OPT_DROP;
+        pOp[1].p1 += pOp->p1;
+      }
+    }
+  }
+  for(i=nOp-1; i>=0; i--){
+    int iTo = jumpTarget(&aOp[i]);
+    if( aOp[i].opcode!=OP_Goto || (aFlag[i] & OPT_DROP) ) continue;
+    if( iTo<=i || iTo>=nOp ) continue;
+    for(j=i+1; j<iTo && (aFlag[j] & OPT_DROP); j++){}
+    if( j==iTo ) aFlag[i] |= OPT_DROP;
+  }
+
+  /* Mark the bodies of loops, the code between a jump backwards and its
+  ** target.  Then look in them for constants to hoist.  A constant may
+  ** start at a jump target, as its first instruction becomes the
+  ** OP_MemLoad, but no other part of it may be one.
+  */
+  for(i=0; i<nOp; i++){
+    int iTo = jumpTarget(&aOp[i]);
+    if( (aFlag[i] & OPT_DROP)==0 && iTo>=0 && iTo<=i ){
+      for(j=iTo; j<=i; j++) aFlag[j] |= OPT_LOOP;
+    }
+  }
+  for(i=0; i<nOp; i++){
+    int nDepth = 0;
+    int iLast = -1;
+    for(j=i; j<nOp; j++){
+      int nPop;
+      if( (aFlag[j] & (OPT_LOOP|OPT_DROP))!=OPT_LOOP ) break;
+      if( j>i && (aFlag[j] & OPT_TARGET) ) break;
+      if( !isConstantOp(&aOp[j], &nPop) || nPop>nDepth ) break;
+      nDepth += 1 - nPop;
+      if( nDepth==1 && j>i ) iLast = j;
+    }
+    if( iLast>0 ){
+      aStart[nHoist] = i;
+      aEnd[nHoist] = iLast;
+      nHoist++;
+      for(j=i; j<=iLast; j++) aFlag[j] |= OPT_HOIST;
+      i = iLast;
+    }
+  }
+  if( nHoist>0 ){
+    for(i=0; i<nOp; i++){
+      int op = aOp[i].opcode;
+      if( (op==OP_MemStore || op==OP_MemLoad || op==OP_MemIncr)
+       && aOp[i].p1>=iMem ){
+        iMem = aOp[i].p1+1;
+      }
+    }
+  }
+
+  /* Write out the new program.  The hoisted constants come first, each
+  ** followed by an OP_MemStore.  aMap[] is -1 for instructions that are
+  ** not copied, until the loop after this one fills it in.
+  */
+  k = 0;
+  for(n=0; n<nHoist; n++){
+    for(i=aStart[n]; i<=aEnd[n]; i++){
+      aNew[k++] = aOp[i];
+    }
+    memset(&aNew[k], 0, sizeof(Op));
+    aNew[k].opcode = OP_MemStore;
+    aNew[k].p1 = iMem+n;
+    aNew[k].p2 = 1;
+    k++;
+  }
+  for(i=0, n=0; i<nOp; i++){
+    aMap[i] = -1;
+    if( aFlag[i] & OPT_DROP ){
+      freeOp(&aOp[i]);
+    }else if( aFlag[i] & OPT_HOIST ){
+      if( n<nHoist && i==aStart[n] ){
+        aMap[i] = k;
+        memset(&aNew[k], 0, sizeof(Op));
+        aNew[k].opcode = OP_MemLoad;
+        aNew[k].p1 = iMem+n;
+        k++;
+        n++;
+      }
+    }else{
+      aMap[i] = k;
+      aNew[k++] = aOp[i];
+    }
+  }
+  assert( k<=nAlloc );
+  aMap[nOp] = k;
+  for(i=nOp-1; i>=0; i--){
+    if( aMap[i]<0 ) aMap[i] = aMap[i+1];
+  }
+  for(i=0; i<k; i++){
+    int iTo = jumpTarget(&aNew[i]);
+    if( iTo>=0 && iTo<=nOp ){
+      setJumpTarget(&aNew[i], aMap[iTo]);
+    }
+  }
+
+  sqliteFree(aMap);
+  sqliteFree(p->aOp);
+  p->aOp = aNew;
+  p->nOp = k;
+  p->nOpAlloc = nAlloc;
+}
+#endif /* SQLITE_OMIT_PEEPHOLE */
+
 /*
 ** Prepare a virtual machine for execution.  This involves things such
 ** as allocating stack space and initializing the program counter.
@@ -627,6 +989,9 @@ void sqlite3VdbeMakeReady(
   ** Allocation all the stack space we will ever need.
   */
   if( p->aStack==0 ){
+#ifndef SQLITE_OMIT_PEEPHOLE
+    optimizeProgram(p);
+#endif
     p->nVar = nVar;
     assert( nVar>=0 );
     n = isExplain ? 10 : p->nOp;
@@ -677,19 +1042,6 @@ void sqlite3VdbeMakeReady(
 }
 
 
-/*
-** Remove any elements that remain on the sorter for the VDBE given.
-*/
-void sqlite3VdbeSorterReset(Vdbe *p){
-  while( p->pSort ){
-    Sorter *pSorter = p->pSort;
-    p->pSort = pSorter->pNext;
-    sqliteFree(pSorter->zKey);
-    sqlite3VdbeMemRelease(&pSorter->data);
-    sqliteFree(pSorter);
-  }
-}
-
 /*
 ** Reset an Agg structure.  Delete all its contents.
 **
@@ -785,6 +1137,7 @@ int sqlite3VdbeAggReset(sqlite *db, Agg *pAgg, KeyInfo *pKeyInfo){
     rc = sqlite3BtreeCursor(pAgg->pBtree, pAgg->nTab, 1,
         sqlite3VdbeRecordCompare, pKeyInfo, &pAgg->pCsr);
     if( rc!=SQLITE_OK ) return rc;
+    sqlite3BtreeSetStreamCompare(pAgg->pCsr, sqlite3VdbeRecordCompareCursor);
   }else{
     if( pAgg->pBtree ){
       sqlite3BtreeClose(pAgg->pBtree);
@@ -1354,24 +1707,7 @@ void sqlite3VdbeDelete(Vdbe *p){
     p->nOp = 0;
   }
   for(i=0; i<p->nOp; i++){
-    Op *pOp = &p->aOp[i];
-    if( pOp->p3type==P3_DYNAMIC || pOp->p3type==P3_KEYINFO ){
-      sqliteFree(pOp->p3);
-    }
-    if( pOp->p3type==P3_VDBEFUNC ){
-      int j;
-      VdbeFunc *pVdbeFunc = (VdbeFunc *)pOp->p3;
-      for(j=0; j<pVdbeFunc->nAux; j++){
-        struct AuxData *pAuxData = &pVdbeFunc->apAux[j];
-        if( pAuxData->pAux && pAuxData->xDelete ){
-          pAuxData->xDelete(pAuxData->pAux);
-        }
-      }
-      sqliteFree(pVdbeFunc);
-    }
-#ifndef NDEBUG
-    sqliteFree(pOp->zComment);
-#endif
+    freeOp(&p->aOp[i]);
   }
   for(i=0; i<p->nVar; i++){
     sqlite3VdbeMemRelease(&p->apVar[i]);
@@ -1603,6 +1939,39 @@ int sqlite3VdbeSerialGet(
   return len;
 }
 
+/*
+** Finish a comparison of two records.  rc is the result of comparing
+** field i, or zero if every field compared so far was equal and one of
+** the records ran out of fields.  d1 and d2 are the offsets just past
+** the last field read from each record.
+*/
+static int recordCompareFinish(
+  KeyInfo *pKeyInfo,
+  int rc, int i,
+  u32 d1, int nKey1,
+  u32 d2, int nKey2
+){
+  /* One of the keys ran out of fields, but all the fields up to that point
+  ** were equal. If the incrKey flag is true, then the second key is
+  ** treated as larger.
+  */
+  if( rc==0 ){
+    if( pKeyInfo->incrKey ){
+      rc = -1;
+    }else if( d1<nKey1 ){
+      rc = 1;
+    }else if( d2<nKey2 ){
+      rc = -1;
+    }
+  }
+
+  if( pKeyInfo->aSortOrder && i<pKeyInfo->nField && pKeyInfo->aSortOrder[i] ){
+    rc = -rc;
+  }
+
+  return rc;
+}
+
 /*
 ** This function compares the two table rows or index records specified by 
 ** {nKey1, pKey1} and {nKey2, pKey2}, returning a negative, zero
@@ -1661,26 +2030,102 @@ int sqlite3VdbeRecordCompare(
     }
     i++;
   }
+  return recordCompareFinish(pKeyInfo, rc, i, d1, nKey1, d2, nKey2);
+}
 
-  /* One of the keys ran out of fields, but all the fields up to that point
-  ** were equal. If the incrKey flag is true, then the second key is
-  ** treated as larger.
-  */
-  if( rc==0 ){
-    if( pKeyInfo->incrKey ){
-      rc = -1;
-    }else if( d1<nKey1 ){
-      rc = 1;
-    }else if( d2<nKey2 ){
-      rc = -1;
-    }
-  }
+/*
+** Compare the key of the entry that pCur points to, which is nKey1 bytes
+** long, with the record {nKey2, pKey2}, and write the result to *pRes
+** as sqlite3VdbeRecordCompare() would return it.
+**
+** The btree layer uses this in place of sqlite3VdbeRecordCompare() when
+** the key of the entry spills onto overflow pages.  Rather than copying
+** the whole key into one buffer first, the fields are read one at a time
+** as the comparison reaches them: in place when they are on the btree
+** page, otherwise by copying just that field.  The comparison usually
+** ends at the first field or two, long before the overflow pages.
+**
+** SQLITE_OK is returned, or an error code if the key cannot be read.
+*/
+int sqlite3VdbeRecordCompareCursor(
+  void *userData,
+  BtCursor *pCur,
+  int nKey1,
+  int nKey2, const void *pKey2,
+  int *pRes
+){
+  KeyInfo *pKeyInfo = (KeyInfo*)userData;
+  u32 d1, d2;          /* Offset into aKey[] of next data element */
+  u32 idx1, idx2;      /* Offset into aKey[] of next header element */
+  u32 szHdr1, szHdr2;  /* Number of bytes in header */
+  int i = 0;
+  int nField;
+  int rc = 0;
+  int avail;           /* Bytes of the first key on the btree page */
+  const unsigned char *aKey1;
+  const unsigned char *aHdr1;
+  const unsigned char *aKey2 = (const unsigned char *)pKey2;
 
-  if( pKeyInfo->aSortOrder && i<pKeyInfo->nField && pKeyInfo->aSortOrder[i] ){
-    rc = -rc;
+  Mem mem1;
+  Mem mem2;
+  Mem sHdr;            /* Copy of the header of key 1, if it spills */
+  Mem sField;          /* Copy of a field of key 1 that spills */
+  mem1.enc = pKeyInfo->enc;
+  mem2.enc = pKeyInfo->enc;
+  sHdr.flags = 0;
+  sField.flags = 0;
+
+  aKey1 = (const unsigned char *)sqlite3BtreeKeyFetch(pCur, &avail);
+  if( aKey1==0 ){
+    return SQLITE_NOMEM;
+  }
+  idx1 = sqlite3GetVarint32(aKey1, &szHdr1);
+  aHdr1 = aKey1;
+  if( szHdr1>avail ){
+    int rc2 = sqlite3VdbeMemFromBtree(pCur, 0, szHdr1, 1, &sHdr);
+    if( rc2!=SQLITE_OK ) return rc2;
+    aHdr1 = (const unsigned char *)sHdr.z;
   }
+  d1 = szHdr1;
+  idx2 = sqlite3GetVarint32(pKey2, &szHdr2);
+  d2 = szHdr2;
+  nField = pKeyInfo->nField;
+  while( idx1<szHdr1 && idx2<szHdr2 ){
+    u32 serial_type1;
+    u32 serial_type2;
+    int len1;
 
-  return rc;
+    idx1 += sqlite3GetVarint32(&aHdr1[idx1], &serial_type1);
+    len1 = sqlite3VdbeSerialTypeLen(serial_type1);
+    if( d1>=nKey1 && len1>0 ) break;
+    idx2 += sqlite3GetVarint32(&aKey2[idx2], &serial_type2);
+    if( d2>=nKey2 && sqlite3VdbeSerialTypeLen(serial_type2)>0 ) break;
+
+    if( d1+len1<=avail ){
+      d1 += sqlite3VdbeSerialGet(&aKey1[d1], serial_type1, &mem1);
+    }else{
+      int rc2 = sqlite3VdbeMemFromBtree(pCur, d1, len1, 1, &sField);
+      if( rc2!=SQLITE_OK ){
+        sqlite3VdbeMemRelease(&sHdr);
+        return rc2;
+      }
+      d1 += sqlite3VdbeSerialGet(sField.z, serial_type1, &mem1);
+    }
+    d2 += sqlite3VdbeSerialGet(&aKey2[d2], serial_type2, &mem2);
+
+    rc = sqlite3MemCompare(&mem1, &mem2, i<nField ? pKeyInfo->aColl[i] : 0);
+    sqlite3VdbeMemRelease(&mem1);
+    sqlite3VdbeMemRelease(&mem2);
+    sqlite3VdbeMemRelease(&sField);
+    sField.flags = 0;
+    if( rc!=0 ){
+      break;
+    }
+    i++;
+  }
+  sqlite3VdbeMemRelease(&sHdr);
+  *pRes = recordCompareFinish(pKeyInfo, rc, i, d1, nKey1, d2, nKey2);
+  return SQLITE_OK;
 }
 
 /*
@@ -1721,8 +2166,16 @@ int sqlite3VdbeIdxRowid(BtCursor *pCur, i64 *rowid){
     return rc;
   }
   sqlite3GetVarint32(m.z, &szHdr);
+  if( szHdr<2 || szHdr>m.n ){
+    sqlite3VdbeMemRelease(&m);
+    return SQLITE_CORRUPT;
+  }
   sqlite3GetVarint32(&m.z[szHdr-1], &typeRowid);
   lenRowid = sqlite3VdbeSerialTypeLen(typeRowid);
+  if( lenRowid>m.n-szHdr ){
+    sqlite3VdbeMemRelease(&m);
+    return SQLITE_CORRUPT;
+  }
   sqlite3VdbeSerialGet(&m.z[m.n-lenRowid], typeRowid, &v);
   *rowid = v.i;
   sqlite3VdbeMemRelease(&m);
@@ -0,0 +1,344 @@
+/*
+** 2004 October 12
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains code used to implement incremental BLOB I/O: the
+** sqlite3_blob_open(), sqlite3_blob_read(), sqlite3_blob_write(),
+** sqlite3_blob_bytes() and sqlite3_blob_close() APIs.
+**
+** A handle is a small VDBE program that starts a transaction, opens a
+** cursor on the table and moves it to the row, then stops as if it had
+** a row of results to return.  The value is accessed through the btree
+** cursor of that program until the handle is closed, at which point the
+** program is finalized like any other statement.
+*/
+#include "sqliteInt.h"
+#include "vdbeInt.h"
+
+/*
+** Valid sqlite3_blob* handles point to an instance of this structure.
+*/
+struct sqlite3_blob {
+  sqlite *db;             /* The associated database */
+  Vdbe *pStmt;            /* Statement holding the cursor open */
+  BtCursor *pCsr;         /* Cursor pointing at the row */
+  int iOffset;            /* Offset of the value within the row's data */
+  int nByte;              /* Size of the value in bytes */
+  u8 wrFlag;              /* True if the value may be overwritten */
+};
+
+/*
+** The program run by every handle.  The database number, the root page
+** of the table and the expected schema cookie are filled in for each
+** table, and OP_OpenRead becomes OP_OpenWrite for a writable handle.
+** The rowid is passed as variable ?1.
+*/
+static const VdbeOpList openBlob[] = {
+  { OP_Transaction,  0, 0,  0},   /* 0: Read or write transaction */
+  { OP_VerifyCookie, 0, 0,  0},   /* 1: Check the schema is current */
+  { OP_Integer,      0, 0,  0},   /* 2: Database number */
+  { OP_OpenRead,     0, 0,  0},   /* 3: Open cursor 0 on the table */
+  { OP_Variable,     1, 0,  0},   /* 4: Push the rowid */
+  { OP_NotExists,    0, 7,  0},   /* 5: Move to the row, or halt */
+  { OP_Callback,     0, 0,  0},   /* 6: Stop with the cursor on the row */
+  { OP_Close,        0, 0,  0},   /* 7 */
+  { OP_Halt,         0, 0,  0},   /* 8 */
+};
+
+/*
+** Find the value of column iCol in the record that pCsr points to.  On
+** success, set *piOffset and *pnByte to its offset within the record and
+** its size, and *pType to its serial type.
+*/
+static int blobLocate(
+  BtCursor *pCsr,
+  int iCol,
+  int *piOffset,
+  int *pnByte,
+  u32 *pType
+){
+  u32 nPayload;     /* Bytes in the record */
+  u32 szHdr;        /* Bytes in the record header */
+  u32 iType = 0;    /* Serial type of the current column */
+  int offset;       /* Offset of the current column's value */
+  int idx;          /* Offset of the current serial type in the header */
+  int i;
+  int avail;
+  const u8 *zData;
+  Mem sMem;
+  int rc;
+
+  sqlite3BtreeDataSize(pCsr, &nPayload);
+  if( nPayload==0 ){
+    return SQLITE_CORRUPT;
+  }
+  zData = (const u8*)sqlite3BtreeDataFetch(pCsr, &avail);
+  idx = sqlite3GetVarint32(zData, &szHdr);
+  if( szHdr>nPayload ){
+    return SQLITE_CORRUPT;
+  }
+
+  /* The header is nearly always on the main page.  If not, copy it. */
+  sMem.flags = 0;
+  if( avail<(int)szHdr ){
+    rc = sqlite3VdbeMemFromBtree(pCsr, 0, szHdr, 0, &sMem);
+    if( rc!=SQLITE_OK ) return rc;
+    zData = (const u8*)sMem.z;
+  }
+
+  /* A record may hold fewer columns than the table if columns were
+  ** added by later versions of the schema.  The missing ones are NULL.
+  */
+  offset = szHdr;
+  for(i=0; i<=iCol && idx<(int)szHdr; i++){
+    if( i>0 ) offset += sqlite3VdbeSerialTypeLen(iType);
+    idx += sqlite3GetVarint32(&zData[idx], &iType);
+  }
+  sqlite3VdbeMemRelease(&sMem);
+  if( i<=iCol ){
+    iType = 0;
+  }
+  if( offset+sqlite3VdbeSerialTypeLen(iType)>nPayload ){
+    return SQLITE_CORRUPT;
+  }
+  *piOffset = offset;
+  *pnByte = sqlite3VdbeSerialTypeLen(iType);
+  *pType = iType;
+  return SQLITE_OK;
+}
+
+/*
+** Open a blob handle.
+*/
+int sqlite3_blob_open(
+  sqlite3 *db,            /* The database connection */
+  const char *zDb,        /* The attached database containing the value */
+  const char *zTable,     /* The table containing the value */
+  const char *zColumn,    /* The column containing the value */
+  long long int iRow,     /* The row containing the value */
+  int flags,              /* True to open for writing */
+  sqlite3_blob **ppBlob   /* OUT: the handle */
+){
+  int nAttempt;           /* Number of times the schema has changed */
+  int iCol;               /* Index of zColumn in the table */
+  Vdbe *v = 0;
+  Table *pTab;
+  char *zErr = 0;
+  int rc;
+
+  *ppBlob = 0;
+  for(nAttempt=0; ; nAttempt++){
+    Cursor *pC;
+    sqlite3_blob *pBlob;
+    u32 iType;
+
+    if( sqlite3SafetyOn(db) ){
+      return SQLITE_MISUSE;
+    }
+    rc = sqlite3ReadSchema(db, &zErr);
+    if( rc!=SQLITE_OK ){
+      sqlite3SafetyOff(db);
+      break;
+    }
+    pTab = sqlite3FindTable(db, zTable, zDb);
+    if( pTab==0 || pTab->pSelect ){
+      if( pTab ){
+        sqlite3SetString(&zErr, "cannot open view: ", zTable, (char*)0);
+      }else if( zDb ){
+        sqlite3SetString(&zErr, "no such table: ", zDb, ".", zTable,
+                         (char*)0);
+      }else{
+        sqlite3SetString(&zErr, "no such table: ", zTable, (char*)0);
+      }
+      sqlite3SafetyOff(db);
+      rc = SQLITE_ERROR;
+      break;
+    }
+    for(iCol=0; iCol<pTab->nCol; iCol++){
+      if( sqlite3StrICmp(pTab->aCol[iCol].zName, zColumn)==0 ) break;
+    }
+    if( iCol==pTab->nCol ){
+      sqlite3SetString(&zErr, "no such column: \"", zColumn, "\"", (char*)0);
+      rc = SQLITE_ERROR;
+    }else if( flags && pTab->readOnly ){
+      sqlite3SetString(&zErr, "table ", zTable, " may not be modified",
+                       (char*)0);
+      rc = SQLITE_ERROR;
+    }else if( flags ){
+      /* The entries of an index are not updated by sqlite3_blob_write(),
+      ** so a column that is indexed may not be written.
+      */
+      Index *pIdx;
+      int j;
+      for(pIdx=pTab->pIndex; pIdx && rc==SQLITE_OK; pIdx=pIdx->pNext){
+        for(j=0; j<pIdx->nColumn; j++){
+          if( pIdx->aiColumn[j]==iCol ){
+            sqlite3SetString(&zErr, "cannot open indexed column for writing",
+                             (char*)0);
+            rc = SQLITE_ERROR;
+            break;
+          }
+        }
+      }
+    }
+    if( rc!=SQLITE_OK ){
+      sqlite3SafetyOff(db);
+      break;
+    }
+
+    v = sqlite3VdbeCreate(db);
+    if( v ){
+      int iDb = pTab->iDb;
+      sqlite3VdbeAddOpList(v, sizeof(openBlob)/sizeof(openBlob[0]), openBlob);
+      sqlite3VdbeChangeP1(v, 0, iDb);
+      sqlite3VdbeChangeP2(v, 0, flags!=0);
+      if( iDb==1 ){
+        sqlite3VdbeGetOp(v, 1)->opcode = OP_Noop;
+      }else{
+        sqlite3VdbeChangeP1(v, 1, iDb);
+        sqlite3VdbeChangeP2(v, 1, db->aDb[iDb].schema_cookie);
+      }
+      sqlite3VdbeChangeP1(v, 2, iDb);
+      if( flags ){
+        sqlite3VdbeGetOp(v, 3)->opcode = OP_OpenWrite;
+      }
+      sqlite3VdbeChangeP2(v, 3, pTab->tnum);
+      sqlite3VdbeMakeReady(v, 1, 0);
+    }
+    if( sqlite3SafetyOff(db) || sqlite3_malloc_failed ){
+      rc = sqlite3_malloc_failed ? SQLITE_NOMEM : SQLITE_MISUSE;
+      goto blob_open_out;
+    }
+
+    sqlite3_bind_int64((sqlite3_stmt*)v, 1, iRow);
+    rc = sqlite3_step((sqlite3_stmt*)v);
+    if( rc!=SQLITE_ROW ){
+      rc = sqlite3_finalize((sqlite3_stmt*)v);
+      v = 0;
+      if( rc==SQLITE_OK ){
+        char zBuf[30];
+        sprintf(zBuf, "%lld", iRow);
+        sqlite3SetString(&zErr, "no such rowid: ", zBuf, (char*)0);
+        rc = SQLITE_ERROR;
+        break;
+      }
+      /* sqlite3_finalize() has left its error message in db.  If the
+      ** schema had changed, it has been reset and is read again.
+      */
+      if( rc!=SQLITE_SCHEMA || nAttempt>=5 ) return rc;
+      continue;
+    }
+
+    pC = v->apCsr[0];
+    if( pC->pCursor==0 ){
+      sqlite3SetString(&zErr, "no such rowid", (char*)0);
+      rc = SQLITE_ERROR;
+      goto blob_open_out;
+    }
+    pBlob = sqliteMalloc( sizeof(*pBlob) );
+    if( pBlob==0 ){
+      rc = SQLITE_NOMEM;
+      goto blob_open_out;
+    }
+    rc = blobLocate(pC->pCursor, iCol, &pBlob->iOffset, &pBlob->nByte, &iType);
+    if( rc==SQLITE_OK && iType<12 ){
+      sqlite3SetString(&zErr, "cannot open value of type ",
+          iType==0 ? "null" : iType==7 ? "real" : "integer", (char*)0);
+      rc = SQLITE_ERROR;
+    }
+    if( rc!=SQLITE_OK ){
+      sqliteFree(pBlob);
+      goto blob_open_out;
+    }
+    pBlob->db = db;
+    pBlob->pStmt = v;
+    pBlob->pCsr = pC->pCursor;
+    pBlob->wrFlag = flags!=0;
+    sqlite3BtreeIncrblobCursor(pBlob->pCsr);
+    *ppBlob = pBlob;
+    sqlite3Error(db, SQLITE_OK, 0);
+    return SQLITE_OK;
+  }
+
+blob_open_out:
+  if( v ){
+    sqlite3_finalize((sqlite3_stmt*)v);
+  }
+  if( zErr ){
+    sqlite3Error(db, rc, "%s", zErr);
+    sqliteFree(zErr);
+  }else{
+    sqlite3Error(db, rc, 0);
+  }
+  return rc;
+}
+
+/*
+** Close a blob handle that was previously created using
+** sqlite3_blob_open().
+*/
+int sqlite3_blob_close(sqlite3_blob *pBlob){
+  Vdbe *v = pBlob->pStmt;
+  sqliteFree(pBlob);
+  return sqlite3_finalize((sqlite3_stmt*)v);
+}
+
+/*
+** Read or write n bytes of the value at iOffset, depending on whether
+** xCall is sqlite3BtreeData() or sqlite3BtreePutData().
+*/
+static int blobReadWrite(
+  sqlite3_blob *pBlob,
+  void *z,
+  int n,
+  int iOffset,
+  int (*xCall)(BtCursor*, u32, u32, void*)
+){
+  sqlite *db = pBlob->db;
+  int rc;
+
+  if( n<0 || iOffset<0 || iOffset+n>pBlob->nByte ){
+    sqlite3Error(db, SQLITE_ERROR, 0);
+    return SQLITE_ERROR;
+  }
+  if( sqlite3SafetyOn(db) ){
+    return SQLITE_MISUSE;
+  }
+  rc = xCall(pBlob->pCsr, iOffset+pBlob->iOffset, n, z);
+  sqlite3SafetyOff(db);
+  sqlite3Error(db, rc, 0);
+  return rc;
+}
+
+/*
+** Read data from a blob handle.
+*/
+int sqlite3_blob_read(sqlite3_blob *pBlob, void *z, int n, int iOffset){
+  return blobReadWrite(pBlob, z, n, iOffset, sqlite3BtreeData);
+}
+
+/*
+** Write data to a blob handle.
+*/
+int sqlite3_blob_write(sqlite3_blob *pBlob, const void *z, int n, int iOffset){
+  if( !pBlob->wrFlag ){
+    sqlite3Error(pBlob->db, SQLITE_READONLY, 0);
+    return SQLITE_READONLY;
+  }
+  return blobReadWrite(pBlob, (void*)z, n, iOffset, sqlite3BtreePutData);
+}
+
+/*
+** Query a blob handle for the size of the data.
+*/
+int sqlite3_blob_bytes(sqlite3_blob *pBlob){
+  return pBlob->nByte;
+}
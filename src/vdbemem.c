@@ -629,6 +629,31 @@ sqlite3_value* sqlite3ValueNew(){
   return p;
 }
 
+/*
+** Return a new sqlite3_value holding the numeric literal in z[0..n-1].
+** The value is a real if isReal is true or the literal is an integer too
+** large for 64 bits, and an integer otherwise.  NULL is returned if a
+** malloc() fails.
+*/
+sqlite3_value *sqlite3ValueNumber(const char *z, int n, int isReal){
+  Mem *p = sqlite3ValueNew();
+  char *zNum = sqliteStrNDup(z, n);
+  if( p==0 || zNum==0 ){
+    sqliteFree(zNum);
+    sqlite3ValueFree(p);
+    return 0;
+  }
+  if( !isReal && sqlite3FitsIn64Bits(zNum) ){
+    i64 v;
+    sqlite3atoi64(zNum, &v);
+    sqlite3VdbeMemSetInt64(p, v);
+  }else{
+    sqlite3VdbeMemSetDouble(p, sqlite3AtoF(zNum, 0));
+  }
+  sqliteFree(zNum);
+  return p;
+}
+
 void sqlite3ValueSetStr(
   sqlite3_value *v, 
   int n, 
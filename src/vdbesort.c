@@ -0,0 +1,888 @@
+/*
+** 2004 November 3
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains the sorter used by the OP_SortPut, OP_Sort,
+** OP_SortNext and OP_SortReset opcodes to implement ORDER BY and to
+** build indices.
+**
+** Records are appended to a single contiguous buffer as they arrive.
+** When the buffer reaches the memory budget set by PRAGMA sort_memory,
+** its records are sorted and written out as a "run" to a temporary
+** file, and the buffer is reused for the next batch.  OP_Sort sorts the
+** records still in memory and, if any runs were written, prepares a
+** k-way merge of the runs and the in-memory records which OP_SortNext
+** then steps through one record at a time.  If there are more runs than
+** can be read at once within the budget, groups of runs are first merged
+** into longer runs until few enough remain.
+**
+** When the statement has a LIMIT, OP_SortPut tells the sorter how many
+** records will be read back.  The sorter then keeps only that many, in
+** a heap ordered so that the record that sorts last is on top, and any
+** later record that sorts after it is dropped without being copied.
+**
+** Records with equal keys come out in the reverse of the order in which
+** they were inserted, as they did from the linked-list sorter this code
+** replaced.
+*/
+#include "sqliteInt.h"
+#include "os.h"
+#include "vdbeInt.h"
+
+typedef struct SortRecord SortRecord;
+typedef struct SortRun SortRun;
+typedef struct SortReader SortReader;
+typedef struct SortMerger SortMerger;
+typedef struct SortWriter SortWriter;
+
+/*
+** Each record begins with the following header.  The header is followed
+** by the nKey bytes of the key, then the nData bytes of the string or
+** blob representation of the data (if it has one), then two zero bytes
+** so that text of any encoding is nul-terminated.  The whole record is
+** padded to a multiple of 8 bytes.  Records are written to the temporary
+** file in exactly this form.
+*/
+struct SortRecord {
+  int nKey;           /* Number of bytes in the key */
+  int nData;          /* Number of bytes of string or blob data */
+  i64 i;              /* Integer value of the data */
+  double r;           /* Real value of the data */
+  u16 flags;          /* MEM_Null, MEM_Str, MEM_Int, MEM_Real and MEM_Blob */
+  u8 type;            /* Mem.type of the data */
+  u8 enc;             /* Mem.enc of the data */
+  u8 isDead;          /* True if dropped from a top-N sort */
+};
+
+#define ROUND8(x)         (((x)+7)&~7)
+#define recordSize(K,D)   ROUND8(sizeof(SortRecord)+(K)+(D)+2)
+#define recordKey(P)      ((char*)&(P)[1])
+#define recordData(P)     (&recordKey(P)[(P)->nKey])
+
+/*
+** Bounds on the size of the buffer used to read each run during a merge.
+** The number of runs merged at once is the memory budget divided by
+** SORTER_MIN_READ.  Runs are written through a buffer of SORTER_WRITE
+** bytes.
+*/
+#define SORTER_MIN_READ    4096
+#define SORTER_MAX_READ    262144
+#define SORTER_WRITE       65536
+
+/*
+** A sorted run of records stored in the temporary file.
+*/
+struct SortRun {
+  off_t iStart;       /* Offset of the first record */
+  off_t iEnd;         /* Offset of the first byte past the last record */
+};
+
+/*
+** A reader delivers the records of one sorted sequence in order.  The
+** sequence is either a run in the temporary file, read through aBuf[],
+** or the sorted records still held in the sorter's own buffer (when
+** aMem is not NULL).  pRec is the current record, or NULL at EOF.
+*/
+struct SortReader {
+  SortRecord *pRec;   /* Current record.  NULL at EOF */
+  char *aMem;         /* Records held in memory, or NULL for a file run */
+  int *aOff;          /* Offsets into aMem[] in sorted order */
+  int nOff;           /* Number of entries in aOff[] */
+  int iOff;           /* Index of the next entry of aOff[] */
+  char *aBuf;         /* Buffer holding part of a file run */
+  int nBuf;           /* Bytes allocated for aBuf[] */
+  int nAvail;         /* Bytes of aBuf[] holding data from the file */
+  int iBuf;           /* Offset of pRec within aBuf[] */
+  off_t iRead;        /* File offset of the next byte to read */
+  off_t iEnd;         /* File offset of the end of the run */
+};
+
+/*
+** A k-way merge.  aHeap[] holds the indices of the readers that are not
+** at EOF, arranged as a binary heap with the reader whose record sorts
+** first in aHeap[0].
+*/
+struct SortMerger {
+  int nReader;        /* Number of readers */
+  SortReader *aReader; /* The readers */
+  int nHeap;          /* Number of entries in aHeap[] */
+  int *aHeap;         /* Heap of indices into aReader[] */
+};
+
+/*
+** Buffered output to the temporary file.
+*/
+struct SortWriter {
+  char *aBuf;         /* Buffer of SORTER_WRITE bytes */
+  int nUsed;          /* Bytes of aBuf[] not yet written */
+  off_t iOff;         /* File offset at which aBuf[] will be written */
+};
+
+/*
+** The sorter of a single VDBE.
+*/
+struct VdbeSorter {
+  KeyInfo *pKeyInfo;  /* How to compare keys */
+  int mxMem;          /* Bytes held before a run is written.  0 for no limit */
+  int nBound;         /* Records needed for a top-N sort.  0 for all */
+  int nDead;          /* Bytes of aBuf[] used by records a top-N sort dropped */
+  char *aBuf;         /* Records not yet written to a run */
+  int nBuf;           /* Bytes of aBuf[] in use */
+  int nBufAlloc;      /* Bytes allocated for aBuf[] */
+  int *aOff;          /* Offset in aBuf[] of each record */
+  int nRec;           /* Number of records in aBuf[] */
+  int nOffAlloc;      /* Slots allocated for aOff[] */
+  u8 isOpen;          /* True if fd is open */
+  u8 isSorted;        /* True once sqlite3VdbeSorterSort() has run */
+  u8 isPending;       /* True if aHeap[0] of the merger was returned */
+  OsFile fd;          /* Temporary file holding the runs */
+  off_t iEof;         /* Bytes written to fd */
+  int nRun;           /* Number of runs in fd */
+  int nRunAlloc;      /* Slots allocated for aRun[] */
+  SortRun *aRun;      /* The runs in fd, oldest first */
+  SortMerger merger;  /* Merge read by sqlite3VdbeSorterNext() */
+};
+
+/*
+** Compare two records.  Records with equal keys compare according to
+** iA and iB, so that the record with the larger of the two sorts first.
+*/
+static int recordCompare(
+  KeyInfo *pKeyInfo,
+  SortRecord *pA, int iA,
+  SortRecord *pB, int iB
+){
+  int c = sqlite3VdbeRecordCompare(pKeyInfo, pA->nKey, recordKey(pA),
+                                   pB->nKey, recordKey(pB));
+  if( c==0 ){
+    c = iA<iB ? 1 : -1;
+  }
+  return c;
+}
+
+/*
+** Sort the offsets in pSorter->aOff[] into the order of the records
+** they refer to, using a bottom-up merge sort.  Records added later sort
+** ahead of earlier records with the same key, since they lie at larger
+** offsets.
+*/
+static int sortBuffer(VdbeSorter *pSorter){
+  int n = pSorter->nRec;
+  char *aBuf = pSorter->aBuf;
+  int *aSrc = pSorter->aOff;
+  int *aDst;
+  int *aTmp;
+  int w;
+
+  if( n<2 ) return SQLITE_OK;
+  aTmp = aDst = sqliteMallocRaw( n*sizeof(int) );
+  if( aTmp==0 ) return SQLITE_NOMEM;
+  for(w=1; w<n; w*=2){
+    int lo;
+    for(lo=0; lo<n; lo+=2*w){
+      int mid = lo+w<n ? lo+w : n;
+      int hi = lo+2*w<n ? lo+2*w : n;
+      int i = lo, j = mid, k = lo;
+      while( i<mid && j<hi ){
+        SortRecord *pA = (SortRecord*)&aBuf[aSrc[i]];
+        SortRecord *pB = (SortRecord*)&aBuf[aSrc[j]];
+        if( recordCompare(pSorter->pKeyInfo, pA, aSrc[i], pB, aSrc[j])<=0 ){
+          aDst[k++] = aSrc[i++];
+        }else{
+          aDst[k++] = aSrc[j++];
+        }
+      }
+      while( i<mid ) aDst[k++] = aSrc[i++];
+      while( j<hi ) aDst[k++] = aSrc[j++];
+    }
+    aDst = aSrc;
+    aSrc = aDst==aTmp ? pSorter->aOff : aTmp;
+  }
+  if( aSrc!=pSorter->aOff ){
+    memcpy(pSorter->aOff, aSrc, n*sizeof(int));
+  }
+  sqliteFree(aTmp);
+  return SQLITE_OK;
+}
+
+/*
+** Write n bytes from z through writer pWriter.
+*/
+static int writerPut(
+  VdbeSorter *pSorter,
+  SortWriter *pWriter,
+  const char *z,
+  int n
+){
+  int rc = SQLITE_OK;
+  if( pWriter->nUsed+n>SORTER_WRITE && pWriter->nUsed>0 ){
+    rc = sqlite3OsWriteAt(&pSorter->fd, pWriter->aBuf, pWriter->nUsed,
+                          pWriter->iOff);
+    pWriter->iOff += pWriter->nUsed;
+    pWriter->nUsed = 0;
+  }
+  if( rc==SQLITE_OK ){
+    if( n>SORTER_WRITE ){
+      rc = sqlite3OsWriteAt(&pSorter->fd, z, n, pWriter->iOff);
+      pWriter->iOff += n;
+    }else{
+      memcpy(&pWriter->aBuf[pWriter->nUsed], z, n);
+      pWriter->nUsed += n;
+    }
+  }
+  return rc;
+}
+
+/*
+** Make sure there is room in aRun[] for one more run.
+*/
+static int sorterGrowRuns(VdbeSorter *pSorter){
+  if( pSorter->nRun>=pSorter->nRunAlloc ){
+    int nNew = pSorter->nRunAlloc ? pSorter->nRunAlloc*2 : 16;
+    SortRun *aNew = sqliteRealloc(pSorter->aRun, nNew*sizeof(SortRun));
+    if( aNew==0 ) return SQLITE_NOMEM;
+    pSorter->aRun = aNew;
+    pSorter->nRunAlloc = nNew;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Start writing a new run at the end of the temporary file, opening the
+** file first if this is the first run.
+*/
+static int writerOpen(VdbeSorter *pSorter, SortWriter *pWriter){
+  int rc;
+  if( !pSorter->isOpen ){
+    char zFile[SQLITE_TEMPNAME_SIZE];
+    int cnt = 8;
+    do{
+      cnt--;
+      sqlite3OsTempFileName(zFile);
+      rc = sqlite3OsOpenExclusive(zFile, &pSorter->fd, 1);
+    }while( cnt>0 && rc!=SQLITE_OK );
+    if( rc!=SQLITE_OK ) return rc;
+    pSorter->isOpen = 1;
+  }
+  rc = sorterGrowRuns(pSorter);
+  if( rc!=SQLITE_OK ) return rc;
+  pWriter->aBuf = sqliteMallocRaw( SORTER_WRITE );
+  if( pWriter->aBuf==0 ) return SQLITE_NOMEM;
+  pWriter->nUsed = 0;
+  pWriter->iOff = pSorter->iEof;
+  return SQLITE_OK;
+}
+
+/*
+** Finish the run started by writerOpen() and append it to aRun[].  If
+** rc is not SQLITE_OK the run is abandoned.
+*/
+static int writerClose(VdbeSorter *pSorter, SortWriter *pWriter, int rc){
+  if( rc==SQLITE_OK && pWriter->nUsed>0 ){
+    rc = sqlite3OsWriteAt(&pSorter->fd, pWriter->aBuf, pWriter->nUsed,
+                          pWriter->iOff);
+    pWriter->iOff += pWriter->nUsed;
+  }
+  if( rc==SQLITE_OK ){
+    SortRun *pRun = &pSorter->aRun[pSorter->nRun++];
+    pRun->iStart = pSorter->iEof;
+    pRun->iEnd = pWriter->iOff;
+    pSorter->iEof = pWriter->iOff;
+  }
+  sqliteFree(pWriter->aBuf);
+  pWriter->aBuf = 0;
+  return rc;
+}
+
+/*
+** Sort the records in the buffer and write them to the temporary file
+** as a new run.  The buffer is left empty.
+*/
+static int sorterSpill(VdbeSorter *pSorter){
+  SortWriter writer;
+  int rc, i;
+
+  rc = sortBuffer(pSorter);
+  if( rc==SQLITE_OK ){
+    rc = writerOpen(pSorter, &writer);
+    for(i=0; rc==SQLITE_OK && i<pSorter->nRec; i++){
+      SortRecord *pRec = (SortRecord*)&pSorter->aBuf[pSorter->aOff[i]];
+      rc = writerPut(pSorter, &writer, (char*)pRec,
+                     recordSize(pRec->nKey, pRec->nData));
+    }
+    if( writer.aBuf ){
+      rc = writerClose(pSorter, &writer, rc);
+    }
+  }
+  pSorter->nBuf = 0;
+  pSorter->nRec = 0;
+  return rc;
+}
+
+/*
+** Move reader pReader on to its next record.  The previous record, if
+** any, may be overwritten.
+*/
+static int readerNext(VdbeSorter *pSorter, SortReader *pReader){
+  if( pReader->aMem ){
+    if( pReader->iOff<pReader->nOff ){
+      int iOff = pReader->aOff[pReader->iOff++];
+      pReader->pRec = (SortRecord*)&pReader->aMem[iOff];
+    }else{
+      pReader->pRec = 0;
+    }
+    return SQLITE_OK;
+  }
+  if( pReader->pRec ){
+    pReader->iBuf += recordSize(pReader->pRec->nKey, pReader->pRec->nData);
+    pReader->pRec = 0;
+  }
+  while( 1 ){
+    int nLeft = pReader->nAvail - pReader->iBuf;
+    int nNeed = sizeof(SortRecord);
+    int nRead;
+    int rc;
+    if( nLeft>=nNeed ){
+      SortRecord *pRec = (SortRecord*)&pReader->aBuf[pReader->iBuf];
+      nNeed = recordSize(pRec->nKey, pRec->nData);
+      if( nLeft>=nNeed ){
+        pReader->pRec = pRec;
+        return SQLITE_OK;
+      }
+    }
+    if( pReader->iRead>=pReader->iEnd ){
+      return nLeft==0 ? SQLITE_OK : SQLITE_CORRUPT;
+    }
+    memmove(pReader->aBuf, &pReader->aBuf[pReader->iBuf], nLeft);
+    pReader->iBuf = 0;
+    pReader->nAvail = nLeft;
+    if( nNeed>pReader->nBuf ){
+      char *aNew = sqliteRealloc(pReader->aBuf, nNeed);
+      if( aNew==0 ) return SQLITE_NOMEM;
+      pReader->aBuf = aNew;
+      pReader->nBuf = nNeed;
+    }
+    nRead = pReader->nBuf - nLeft;
+    if( nRead>pReader->iEnd - pReader->iRead ){
+      nRead = pReader->iEnd - pReader->iRead;
+    }
+    rc = sqlite3OsReadAt(&pSorter->fd, &pReader->aBuf[nLeft], nRead,
+                         pReader->iRead);
+    if( rc!=SQLITE_OK ) return rc;
+    pReader->iRead += nRead;
+    pReader->nAvail += nRead;
+  }
+}
+
+/*
+** Return true if the current record of reader iA sorts before that of
+** reader iB.  On a tie the reader with the larger index, which holds
+** the records added later, goes first.
+*/
+static int readerLess(VdbeSorter *pSorter, SortMerger *pMerger, int iA, int iB){
+  SortRecord *pA = pMerger->aReader[iA].pRec;
+  SortRecord *pB = pMerger->aReader[iB].pRec;
+  return recordCompare(pSorter->pKeyInfo, pA, iA, pB, iB)<0;
+}
+
+/*
+** Restore the heap property of pMerger->aHeap[] after the reader in slot
+** i has moved on to a later record.
+*/
+static void mergerSiftDown(VdbeSorter *pSorter, SortMerger *pMerger, int i){
+  int *aHeap = pMerger->aHeap;
+  int n = pMerger->nHeap;
+  while( 1 ){
+    int iMin = i;
+    int iChild = 2*i+1;
+    int t;
+    if( iChild<n && readerLess(pSorter, pMerger, aHeap[iChild], aHeap[iMin]) ){
+      iMin = iChild;
+    }
+    iChild++;
+    if( iChild<n && readerLess(pSorter, pMerger, aHeap[iChild], aHeap[iMin]) ){
+      iMin = iChild;
+    }
+    if( iMin==i ) break;
+    t = aHeap[i];
+    aHeap[i] = aHeap[iMin];
+    aHeap[iMin] = t;
+    i = iMin;
+  }
+}
+
+/*
+** Move the reader at the top of the heap on to its next record.
+*/
+static int mergerStep(VdbeSorter *pSorter, SortMerger *pMerger){
+  SortReader *pReader = &pMerger->aReader[pMerger->aHeap[0]];
+  int rc = readerNext(pSorter, pReader);
+  if( rc==SQLITE_OK ){
+    if( pReader->pRec==0 ){
+      pMerger->aHeap[0] = pMerger->aHeap[--pMerger->nHeap];
+    }
+    mergerSiftDown(pSorter, pMerger, 0);
+  }
+  return rc;
+}
+
+/*
+** Free the buffers of a merger.
+*/
+static void mergerClear(SortMerger *pMerger){
+  int i;
+  for(i=0; i<pMerger->nReader; i++){
+    sqliteFree(pMerger->aReader[i].aBuf);
+  }
+  sqliteFree(pMerger->aReader);
+  sqliteFree(pMerger->aHeap);
+  memset(pMerger, 0, sizeof(*pMerger));
+}
+
+/*
+** Set up pMerger to merge the nRun runs starting at aRun[iRun], followed
+** by the records in the sorter's buffer if useMem is true.
+*/
+static int mergerInit(
+  VdbeSorter *pSorter,
+  SortMerger *pMerger,
+  int iRun,
+  int nRun,
+  int useMem
+){
+  int nReader = nRun + (useMem!=0);
+  int nBuf;
+  int i, rc = SQLITE_OK;
+
+  memset(pMerger, 0, sizeof(*pMerger));
+  if( nReader==0 ) return SQLITE_OK;
+  pMerger->aReader = sqliteMalloc( nReader*sizeof(SortReader) );
+  pMerger->aHeap = sqliteMallocRaw( nReader*sizeof(int) );
+  if( pMerger->aReader==0 || pMerger->aHeap==0 ){
+    mergerClear(pMerger);
+    return SQLITE_NOMEM;
+  }
+  pMerger->nReader = nReader;
+  nBuf = nRun>0 ? pSorter->mxMem/nRun : 0;
+  if( nBuf<SORTER_MIN_READ ) nBuf = SORTER_MIN_READ;
+  if( nBuf>SORTER_MAX_READ ) nBuf = SORTER_MAX_READ;
+  for(i=0; i<nReader && rc==SQLITE_OK; i++){
+    SortReader *pReader = &pMerger->aReader[i];
+    if( i<nRun ){
+      SortRun *pRun = &pSorter->aRun[iRun+i];
+      pReader->aBuf = sqliteMallocRaw( nBuf );
+      if( pReader->aBuf==0 ){
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      pReader->nBuf = nBuf;
+      pReader->iRead = pRun->iStart;
+      pReader->iEnd = pRun->iEnd;
+    }else{
+      pReader->aMem = pSorter->aBuf;
+      pReader->aOff = pSorter->aOff;
+      pReader->nOff = pSorter->nRec;
+    }
+    rc = readerNext(pSorter, pReader);
+    if( rc==SQLITE_OK && pReader->pRec ){
+      pMerger->aHeap[pMerger->nHeap++] = i;
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    mergerClear(pMerger);
+    return rc;
+  }
+  for(i=pMerger->nHeap/2-1; i>=0; i--){
+    mergerSiftDown(pSorter, pMerger, i);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Merge groups of up to nFanIn adjacent runs into single runs until no
+** more than nFanIn runs remain.  Merging only neighbours keeps the runs
+** in the order in which their records were added, which the tie-break
+** between runs depends on.
+*/
+static int sorterMergeRuns(VdbeSorter *pSorter, int nFanIn){
+  int rc = SQLITE_OK;
+  while( rc==SQLITE_OK && pSorter->nRun>nFanIn ){
+    int nOld = pSorter->nRun;
+    int nNew = 0;
+    int iRun;
+    for(iRun=0; rc==SQLITE_OK && iRun<nOld; iRun+=nFanIn){
+      int n = nOld-iRun<nFanIn ? nOld-iRun : nFanIn;
+      if( n==1 ){
+        rc = sorterGrowRuns(pSorter);
+        if( rc!=SQLITE_OK ) break;
+        pSorter->aRun[pSorter->nRun++] = pSorter->aRun[iRun];
+      }else{
+        SortMerger merger;
+        SortWriter writer;
+        rc = mergerInit(pSorter, &merger, iRun, n, 0);
+        if( rc!=SQLITE_OK ) break;
+        rc = writerOpen(pSorter, &writer);
+        while( rc==SQLITE_OK && merger.nHeap>0 ){
+          SortRecord *pRec = merger.aReader[merger.aHeap[0]].pRec;
+          rc = writerPut(pSorter, &writer, (char*)pRec,
+                         recordSize(pRec->nKey, pRec->nData));
+          if( rc==SQLITE_OK ){
+            rc = mergerStep(pSorter, &merger);
+          }
+        }
+        if( writer.aBuf ){
+          rc = writerClose(pSorter, &writer, rc);
+        }
+        mergerClear(&merger);
+      }
+      nNew++;
+    }
+    if( rc==SQLITE_OK ){
+      memmove(pSorter->aRun, &pSorter->aRun[nOld], nNew*sizeof(SortRun));
+      pSorter->nRun = nNew;
+    }
+  }
+  return rc;
+}
+
+/*
+** Copy a record made from pKey and pData to the end of the buffer,
+** growing it if necessary, and write its offset into *piOff.  Room is
+** also made in aOff[] for one more entry, but aOff[] is not changed.
+*/
+static int sorterAppend(
+  VdbeSorter *pSorter,
+  Mem *pKey,
+  Mem *pData,
+  int *piOff
+){
+  SortRecord *pRec;
+  int nData = 0;
+  int n;
+
+  if( pData->flags & (MEM_Str|MEM_Blob) ){
+    nData = pData->n;
+  }
+  n = recordSize(pKey->n, nData);
+  if( pSorter->nBuf+n>pSorter->nBufAlloc ){
+    int nNew = pSorter->nBufAlloc ? pSorter->nBufAlloc*2 : 4096;
+    char *aNew;
+    while( nNew<pSorter->nBuf+n ) nNew *= 2;
+    if( pSorter->mxMem>0 && nNew>pSorter->mxMem
+     && pSorter->nBuf+n<=pSorter->mxMem ){
+      nNew = pSorter->mxMem;
+    }
+    aNew = sqliteRealloc(pSorter->aBuf, nNew);
+    if( aNew==0 ) return SQLITE_NOMEM;
+    pSorter->aBuf = aNew;
+    pSorter->nBufAlloc = nNew;
+  }
+  if( pSorter->nRec>=pSorter->nOffAlloc ){
+    int nNew = pSorter->nOffAlloc ? pSorter->nOffAlloc*2 : 64;
+    int *aNew = sqliteRealloc(pSorter->aOff, nNew*sizeof(int));
+    if( aNew==0 ) return SQLITE_NOMEM;
+    pSorter->aOff = aNew;
+    pSorter->nOffAlloc = nNew;
+  }
+
+  pRec = (SortRecord*)&pSorter->aBuf[pSorter->nBuf];
+  pRec->nKey = pKey->n;
+  pRec->nData = nData;
+  pRec->i = pData->i;
+  pRec->r = pData->r;
+  pRec->flags = pData->flags & (MEM_Null|MEM_Str|MEM_Int|MEM_Real|MEM_Blob);
+  pRec->type = pData->type;
+  pRec->enc = pData->enc;
+  pRec->isDead = 0;
+  memcpy(recordKey(pRec), pKey->z, pKey->n);
+  if( nData ){
+    memcpy(recordData(pRec), pData->z, nData);
+  }
+  recordData(pRec)[nData] = 0;
+  recordData(pRec)[nData+1] = 0;
+  *piOff = pSorter->nBuf;
+  pSorter->nBuf += n;
+  return SQLITE_OK;
+}
+
+/*
+** The following routines maintain aOff[0..nRec-1] as a binary heap for
+** a top-N sort, with the record that sorts last in aOff[0].
+*/
+static int heapAfter(VdbeSorter *pSorter, int iA, int iB){
+  SortRecord *pA = (SortRecord*)&pSorter->aBuf[iA];
+  SortRecord *pB = (SortRecord*)&pSorter->aBuf[iB];
+  return recordCompare(pSorter->pKeyInfo, pA, iA, pB, iB)>0;
+}
+static void heapSiftUp(VdbeSorter *pSorter, int i){
+  int *aOff = pSorter->aOff;
+  while( i>0 ){
+    int iParent = (i-1)/2;
+    int t;
+    if( !heapAfter(pSorter, aOff[i], aOff[iParent]) ) break;
+    t = aOff[i];
+    aOff[i] = aOff[iParent];
+    aOff[iParent] = t;
+    i = iParent;
+  }
+}
+static void heapSiftDown(VdbeSorter *pSorter, int i){
+  int *aOff = pSorter->aOff;
+  int n = pSorter->nRec;
+  while( 1 ){
+    int iMax = i;
+    int iChild = 2*i+1;
+    int t;
+    if( iChild<n && heapAfter(pSorter, aOff[iChild], aOff[iMax]) ){
+      iMax = iChild;
+    }
+    iChild++;
+    if( iChild<n && heapAfter(pSorter, aOff[iChild], aOff[iMax]) ){
+      iMax = iChild;
+    }
+    if( iMax==i ) break;
+    t = aOff[i];
+    aOff[i] = aOff[iMax];
+    aOff[iMax] = t;
+    i = iMax;
+  }
+}
+
+/*
+** Squeeze the records dropped from a top-N sort out of the buffer.  The
+** records that remain keep their relative order, so later records still
+** lie at larger offsets, and the heap is rebuilt over their new offsets.
+*/
+static void sorterCompact(VdbeSorter *pSorter){
+  char *aBuf = pSorter->aBuf;
+  int iRead = 0;
+  int iWrite = 0;
+  int n = 0;
+  int i;
+  while( iRead<pSorter->nBuf ){
+    SortRecord *pRec = (SortRecord*)&aBuf[iRead];
+    int sz = recordSize(pRec->nKey, pRec->nData);
+    if( !pRec->isDead ){
+      if( iWrite<iRead ){
+        memmove(&aBuf[iWrite], pRec, sz);
+      }
+      pSorter->aOff[n++] = iWrite;
+      iWrite += sz;
+    }
+    iRead += sz;
+  }
+  assert( n==pSorter->nRec );
+  pSorter->nBuf = iWrite;
+  pSorter->nDead = 0;
+  for(i=n/2-1; i>=0; i--){
+    heapSiftDown(pSorter, i);
+  }
+}
+
+/*
+** Add a record to a sorter that only needs to return its first nBound
+** records.  The nBound best records seen so far are kept in a heap, and
+** a new record either displaces the worst of them or is thrown away.
+** Records with equal keys are returned newest first, so a new record
+** displaces a kept one whose key is no smaller.
+**
+** If the kept records outgrow the memory budget, the sorter gives up on
+** the bound and carries on as an ordinary sort of the records it has.
+*/
+static int sorterWriteBounded(VdbeSorter *pSorter, Mem *pKey, Mem *pData){
+  int iOff;
+  int rc;
+
+  if( pSorter->nRec>=pSorter->nBound ){
+    SortRecord *pTop = (SortRecord*)&pSorter->aBuf[pSorter->aOff[0]];
+    if( sqlite3VdbeRecordCompare(pSorter->pKeyInfo, pKey->n, pKey->z,
+                                 pTop->nKey, recordKey(pTop))>0 ){
+      return SQLITE_OK;
+    }
+  }
+  rc = sorterAppend(pSorter, pKey, pData, &iOff);
+  if( rc!=SQLITE_OK ) return rc;
+  if( pSorter->nRec>=pSorter->nBound ){
+    SortRecord *pTop = (SortRecord*)&pSorter->aBuf[pSorter->aOff[0]];
+    pTop->isDead = 1;
+    pSorter->nDead += recordSize(pTop->nKey, pTop->nData);
+    pSorter->aOff[0] = iOff;
+    heapSiftDown(pSorter, 0);
+  }else{
+    pSorter->aOff[pSorter->nRec++] = iOff;
+    heapSiftUp(pSorter, pSorter->nRec-1);
+  }
+
+  if( pSorter->nDead*2>pSorter->nBuf ){
+    sorterCompact(pSorter);
+  }
+  if( pSorter->mxMem>0 && pSorter->nBuf - pSorter->nDead
+        + pSorter->nRec*sizeof(int)>pSorter->mxMem ){
+    if( pSorter->nDead ){
+      sorterCompact(pSorter);
+    }
+    pSorter->nBound = 0;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Add a record to the sorter of VDBE p.  pKey is the key, which must be
+** a string or blob, and pData is the value that sqlite3VdbeSorterNext()
+** will later return for it.  Keys are compared using pKeyInfo.  If
+** pKeyInfo is NULL, the records are kept in memory until they are
+** sorted, whatever the budget.
+**
+** If nBound is greater than zero, only the first nBound records of the
+** sorted output will be read.  The sorter is then free to drop any
+** record once nBound others are known to sort ahead of it.
+*/
+int sqlite3VdbeSorterWrite(
+  Vdbe *p,
+  KeyInfo *pKeyInfo,
+  int nBound,
+  Mem *pKey,
+  Mem *pData
+){
+  VdbeSorter *pSorter = p->pSorter;
+  int iOff;
+  int rc;
+
+  assert( pKey->flags & (MEM_Str|MEM_Blob) );
+  if( pSorter==0 ){
+    pSorter = p->pSorter = sqliteMalloc( sizeof(VdbeSorter) );
+    if( pSorter==0 ) return SQLITE_NOMEM;
+    pSorter->mxMem = p->db->nSortMem*1024;
+    pSorter->nBound = nBound;
+  }
+  assert( !pSorter->isSorted );
+  if( pKeyInfo ){
+    pSorter->pKeyInfo = pKeyInfo;
+  }
+  if( pSorter->nBound>0 && pSorter->pKeyInfo ){
+    return sorterWriteBounded(pSorter, pKey, pData);
+  }
+
+  if( pSorter->mxMem>0 && pSorter->nRec>0 && pSorter->pKeyInfo ){
+    int nData = (pData->flags & (MEM_Str|MEM_Blob)) ? pData->n : 0;
+    if( pSorter->nBuf + recordSize(pKey->n, nData)
+          + (pSorter->nRec+1)*sizeof(int)>pSorter->mxMem ){
+      rc = sorterSpill(pSorter);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+  }
+  rc = sorterAppend(pSorter, pKey, pData, &iOff);
+  if( rc==SQLITE_OK ){
+    pSorter->aOff[pSorter->nRec++] = iOff;
+  }
+  return rc;
+}
+
+/*
+** Sort the records added to the sorter of VDBE p, comparing keys with
+** pKeyInfo, and prepare to return them through sqlite3VdbeSorterNext().
+*/
+int sqlite3VdbeSorterSort(Vdbe *p, KeyInfo *pKeyInfo){
+  VdbeSorter *pSorter = p->pSorter;
+  int nFanIn;
+  int rc;
+
+  if( pSorter==0 ) return SQLITE_OK;
+  assert( !pSorter->isSorted );
+  pSorter->pKeyInfo = pKeyInfo;
+  nFanIn = pSorter->mxMem/SORTER_MIN_READ;
+  if( nFanIn<2 ) nFanIn = 2;
+  if( pSorter->nRun+(pSorter->nRec>0)>nFanIn ){
+    rc = SQLITE_OK;
+    if( pSorter->nRec>0 ){
+      rc = sorterSpill(pSorter);
+    }
+    if( rc==SQLITE_OK ){
+      rc = sorterMergeRuns(pSorter, nFanIn);
+    }
+  }else{
+    rc = sortBuffer(pSorter);
+  }
+  if( rc!=SQLITE_OK ) return rc;
+  rc = mergerInit(pSorter, &pSorter->merger, 0, pSorter->nRun,
+                  pSorter->nRec>0);
+  if( rc==SQLITE_OK ){
+    pSorter->isSorted = 1;
+    pSorter->isPending = 0;
+  }
+  return rc;
+}
+
+/*
+** Write the next record of the sorter of VDBE p into *pOut, or set *pEof
+** if there are no more.  Any string or blob in *pOut is MEM_Ephem and
+** remains valid only until the next call to this routine or to
+** sqlite3VdbeSorterReset().
+*/
+int sqlite3VdbeSorterNext(Vdbe *p, Mem *pOut, int *pEof){
+  VdbeSorter *pSorter = p->pSorter;
+  SortMerger *pMerger;
+  SortRecord *pRec;
+
+  if( pSorter==0 || !pSorter->isSorted ){
+    *pEof = 1;
+    return SQLITE_OK;
+  }
+  pMerger = &pSorter->merger;
+  if( pSorter->isPending ){
+    int rc = mergerStep(pSorter, pMerger);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  if( pMerger->nHeap==0 ){
+    pSorter->isPending = 0;
+    *pEof = 1;
+    return SQLITE_OK;
+  }
+  pSorter->isPending = 1;
+  *pEof = 0;
+  pRec = pMerger->aReader[pMerger->aHeap[0]].pRec;
+  pOut->flags = pRec->flags;
+  pOut->type = pRec->type;
+  pOut->enc = pRec->enc;
+  pOut->i = pRec->i;
+  pOut->r = pRec->r;
+  pOut->xDel = 0;
+  if( pRec->flags & (MEM_Str|MEM_Blob) ){
+    pOut->z = recordData(pRec);
+    pOut->n = pRec->nData;
+    pOut->flags |= MEM_Ephem;
+    if( pRec->flags & MEM_Str ){
+      pOut->flags |= MEM_Term;
+    }
+  }else{
+    pOut->z = 0;
+    pOut->n = 0;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Delete the sorter of VDBE p, together with any records it holds and
+** its temporary file.
+*/
+void sqlite3VdbeSorterReset(Vdbe *p){
+  VdbeSorter *pSorter = p->pSorter;
+  if( pSorter==0 ) return;
+  mergerClear(&pSorter->merger);
+  if( pSorter->isOpen ){
+    sqlite3OsClose(&pSorter->fd);
+  }
+  sqliteFree(pSorter->aRun);
+  sqliteFree(pSorter->aOff);
+  sqliteFree(pSorter->aBuf);
+  sqliteFree(pSorter);
+  p->pSorter = 0;
+}
@@ -0,0 +1,177 @@
+/*
+** A micro-benchmark for sqlite3BtreeMoveto().  It builds a table with
+** integer keys and an index-style table with blob keys in an in-memory
+** database, then looks up every key once in ascending order and once in
+** random order through a single cursor.  For each run it reports the
+** time per lookup, the number of pages fetched from the pager and, for
+** the blob keys, the number of calls to the key comparison function.
+**
+** Lookups in ascending order mostly land on the leaf the cursor already
+** points to, or beneath its parent, and need not descend from the root.
+**
+** Build it against the object files of the library, for example:
+**
+**     gcc -O2 -Isrc -I. tool/movetobench.c <library objects> -lpthread
+**
+** Usage:  movetobench ?N-ROWS?
+*/
+#include "sqliteInt.h"
+#include "btree.h"
+#include "pager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/*
+** The number of times the key comparison function has been called.
+*/
+static int nCompare = 0;
+
+/*
+** Compare two blob keys with memcmp(), counting the calls.
+*/
+static int countingCompare(
+  void *NotUsed,
+  int n1, const void *p1,
+  int n2, const void *p2
+){
+  int c = memcmp(p1, p2, n1<n2 ? n1 : n2);
+  nCompare++;
+  return c ? c : n1-n2;
+}
+
+/*
+** Return the current time in microseconds.
+*/
+static double now(void){
+  struct timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec*1000000.0 + t.tv_usec;
+}
+
+/*
+** Return the number of pages fetched from the pager so far.
+*/
+static int pagesFetched(Btree *pBt){
+  int *a = sqlite3pager_stats(sqlite3BtreePager(pBt));
+  return a[6] + a[7];
+}
+
+/*
+** Write the blob key for row i into zKey[] and return its length.
+*/
+static int makeKey(int i, char *zKey){
+  sprintf(zKey, "key-%010d-padding", i);
+  return strlen(zKey);
+}
+
+/*
+** Look up each of the nRow keys in aOrder[] through cursor pCur and
+** report the cost.  Returns non-zero on error.
+*/
+static int runLookups(
+  Btree *pBt,
+  BtCursor *pCur,
+  int intKey,
+  int *aOrder,
+  int nRow,
+  const char *zLabel
+){
+  char zKey[50];
+  double tStart, tElapsed;
+  int nPage, i, rc, res;
+
+  nCompare = 0;
+  nPage = pagesFetched(pBt);
+  tStart = now();
+  for(i=0; i<nRow; i++){
+    if( intKey ){
+      rc = sqlite3BtreeMoveto(pCur, 0, aOrder[i], &res);
+    }else{
+      rc = sqlite3BtreeMoveto(pCur, zKey, makeKey(aOrder[i], zKey), &res);
+    }
+    if( rc!=SQLITE_OK || res!=0 ){
+      fprintf(stderr, "lookup of %d failed: rc=%d res=%d\n", aOrder[i], rc, res);
+      return 1;
+    }
+  }
+  tElapsed = now() - tStart;
+  nPage = pagesFetched(pBt) - nPage;
+  printf("%-6s %-9s %7.1f ns/lookup  %5.2f pages/lookup",
+         intKey ? "intkey" : "blob", zLabel, tElapsed*1000.0/nRow,
+         (double)nPage/nRow);
+  if( !intKey ){
+    printf("  %5.2f compares/lookup", (double)nCompare/nRow);
+  }
+  printf("\n");
+  return 0;
+}
+
+/*
+** Build a table of nRow entries, with integer keys if intKey is true or
+** blob keys otherwise, and time sorted and random lookups on it.
+*/
+static int runOne(int intKey, int nRow){
+  Btree *pBt;
+  BtCursor *pCur;
+  int *aOrder;
+  char zKey[50];
+  int iTable, i, rc;
+  unsigned int x = 1;
+
+  rc = sqlite3BtreeOpen(":memory:", &pBt, 2000, BTREE_MEMORY, 0);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "cannot open btree: %d\n", rc);
+    return 1;
+  }
+  sqlite3BtreeSetCacheSize(pBt, nRow);
+  rc = sqlite3BtreeBeginTrans(pBt, 1, 0);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3BtreeCreateTable(pBt, &iTable,
+             intKey ? BTREE_INTKEY|BTREE_LEAFDATA : BTREE_ZERODATA);
+  }
+  if( rc==SQLITE_OK ){
+    rc = sqlite3BtreeCursor(pBt, iTable, 1, intKey ? 0 : countingCompare,
+                            0, &pCur);
+  }
+  for(i=0; rc==SQLITE_OK && i<nRow; i++){
+    if( intKey ){
+      rc = sqlite3BtreeInsert(pCur, 0, i, "data", 4);
+    }else{
+      rc = sqlite3BtreeInsert(pCur, zKey, makeKey(i, zKey), 0, 0);
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "cannot build the table: %d\n", rc);
+    sqlite3BtreeClose(pBt);
+    return 1;
+  }
+
+  aOrder = malloc( nRow*sizeof(int) );
+  for(i=0; i<nRow; i++) aOrder[i] = i;
+  rc = runLookups(pBt, pCur, intKey, aOrder, nRow, "sorted");
+  for(i=nRow-1; i>0; i--){
+    int j, t;
+    x = x*1103515245 + 12345;
+    j = (x>>8)%(i+1);
+    t = aOrder[i];
+    aOrder[i] = aOrder[j];
+    aOrder[j] = t;
+  }
+  if( rc==0 ){
+    rc = runLookups(pBt, pCur, intKey, aOrder, nRow, "random");
+  }
+  free(aOrder);
+  sqlite3BtreeCloseCursor(pCur);
+  sqlite3BtreeRollback(pBt);
+  sqlite3BtreeClose(pBt);
+  return rc;
+}
+
+int main(int argc, char **argv){
+  int nRow = 200000;
+  if( argc>1 ) nRow = atoi(argv[1]);
+  if( runOne(1, nRow) ) return 1;
+  if( runOne(0, nRow) ) return 1;
+  return 0;
+}
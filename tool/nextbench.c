@@ -0,0 +1,162 @@
+/*
+** A micro-benchmark for sqlite3BtreeNext().  It builds a table with
+** integer keys and an index-style table with blob keys in an in-memory
+** database, deletes every seventh entry so that most pages carry a few
+** freeblocks, and then walks each table from end to end several times
+** with sqlite3BtreeFirst() and sqlite3BtreeNext(), reading the size and
+** the locally stored part of each entry as the VDBE would.  All pages
+** stay in the cache, so the figures measure the cost of moving between
+** cells and pages rather than I/O.
+**
+** Every step off the end of a leaf releases that leaf and loads the
+** next, which puts the new page through initPage().  Build it against
+** the object files of the library, for example:
+**
+**     gcc -O2 -Isrc -I. tool/nextbench.c <library objects> -lpthread
+**
+** Usage:  nextbench ?N-ROWS? ?N-PASSES?
+*/
+#include "sqliteInt.h"
+#include "btree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/*
+** Compare two blob keys with memcmp().
+*/
+static int blobCompare(
+  void *NotUsed,
+  int n1, const void *p1,
+  int n2, const void *p2
+){
+  int c = memcmp(p1, p2, n1<n2 ? n1 : n2);
+  return c ? c : n1-n2;
+}
+
+/*
+** Return the current time in microseconds.
+*/
+static double now(void){
+  struct timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec*1000000.0 + t.tv_usec;
+}
+
+/*
+** Write the blob key for row i into zKey[] and return its length.
+*/
+static int makeKey(int i, char *zKey){
+  sprintf(zKey, "key-%010d-padding", i);
+  return strlen(zKey);
+}
+
+/*
+** Walk the table pCur is open on nPass times and report the time per
+** entry.  Returns non-zero on error.
+*/
+static int runScans(BtCursor *pCur, int intKey, int nExpect, int nPass){
+  double tStart, tElapsed;
+  int nEntry = 0;
+  int sum = 0;
+  int i, rc, res;
+
+  tStart = now();
+  for(i=0; i<nPass; i++){
+    int n = 0;
+    rc = sqlite3BtreeFirst(pCur, &res);
+    while( rc==SQLITE_OK && res==0 ){
+      i64 nKey;
+      u32 nData;
+      int amt;
+      const u8 *z;
+      sqlite3BtreeKeySize(pCur, &nKey);
+      sqlite3BtreeDataSize(pCur, &nData);
+      if( intKey ){
+        z = sqlite3BtreeDataFetch(pCur, &amt);
+      }else{
+        z = sqlite3BtreeKeyFetch(pCur, &amt);
+      }
+      sum += z[amt-1] + (int)nKey + nData;
+      n++;
+      rc = sqlite3BtreeNext(pCur, &res);
+    }
+    if( rc!=SQLITE_OK || n!=nExpect ){
+      fprintf(stderr, "scan failed: rc=%d entries=%d expected=%d\n",
+              rc, n, nExpect);
+      return 1;
+    }
+    nEntry += n;
+  }
+  tElapsed = now() - tStart;
+  printf("%-6s %7.1f ns/entry  (%d entries, checksum %d)\n",
+         intKey ? "intkey" : "blob", tElapsed*1000.0/nEntry, nEntry, sum);
+  return 0;
+}
+
+/*
+** Build a table of nRow entries, with integer keys if intKey is true or
+** blob keys otherwise, thin it out and time full scans of what is left.
+*/
+static int runOne(int intKey, int nRow, int nPass){
+  Btree *pBt;
+  BtCursor *pCur;
+  char zKey[50];
+  int iTable, i, rc, res;
+  int nLeft = nRow;
+
+  rc = sqlite3BtreeOpen(":memory:", &pBt, 2000, BTREE_MEMORY, 0);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "cannot open btree: %d\n", rc);
+    return 1;
+  }
+  sqlite3BtreeSetCacheSize(pBt, nRow);
+  rc = sqlite3BtreeBeginTrans(pBt, 1, 0);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3BtreeCreateTable(pBt, &iTable,
+             intKey ? BTREE_INTKEY|BTREE_LEAFDATA : BTREE_ZERODATA);
+  }
+  if( rc==SQLITE_OK ){
+    rc = sqlite3BtreeCursor(pBt, iTable, 1, intKey ? 0 : blobCompare,
+                            0, &pCur);
+  }
+  for(i=0; rc==SQLITE_OK && i<nRow; i++){
+    if( intKey ){
+      rc = sqlite3BtreeInsert(pCur, 0, i, "some row data", 13);
+    }else{
+      rc = sqlite3BtreeInsert(pCur, zKey, makeKey(i, zKey), 0, 0);
+    }
+  }
+  for(i=3; rc==SQLITE_OK && i<nRow; i+=7){
+    if( intKey ){
+      rc = sqlite3BtreeMoveto(pCur, 0, i, &res);
+    }else{
+      rc = sqlite3BtreeMoveto(pCur, zKey, makeKey(i, zKey), &res);
+    }
+    if( rc==SQLITE_OK && res==0 ){
+      rc = sqlite3BtreeDelete(pCur);
+      nLeft--;
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "cannot build the table: %d\n", rc);
+    sqlite3BtreeClose(pBt);
+    return 1;
+  }
+
+  rc = runScans(pCur, intKey, nLeft, nPass);
+  sqlite3BtreeCloseCursor(pCur);
+  sqlite3BtreeRollback(pBt);
+  sqlite3BtreeClose(pBt);
+  return rc;
+}
+
+int main(int argc, char **argv){
+  int nRow = 200000;
+  int nPass = 20;
+  if( argc>1 ) nRow = atoi(argv[1]);
+  if( argc>2 ) nPass = atoi(argv[2]);
+  if( runOne(1, nRow, nPass) ) return 1;
+  if( runOne(0, nRow, nPass) ) return 1;
+  return 0;
+}
@@ -0,0 +1,83 @@
+/*
+** A micro-benchmark for the page cache.  It fills an in-memory pager
+** with N pages and then measures the average time taken by
+** sqlite3pager_get() and sqlite3pager_unref() for pages that are
+** already in the cache, for cache sizes from 1000 pages up to a
+** given maximum (one million by default).
+**
+** Build it against the object files of the library, for example:
+**
+**     gcc -O2 -Isrc -I. tool/pagerbench.c <library objects> -lpthread
+**
+** Usage:  pagerbench ?MAX-PAGES? ?LOOKUPS?
+*/
+#include "sqliteInt.h"
+#include "pager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/*
+** Return the current time in microseconds.
+*/
+static double now(void){
+  struct timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec*1000000.0 + t.tv_usec;
+}
+
+/*
+** Fill a cache with nPage pages, then time nLookup cache hits at
+** pseudo-random page numbers.  Returns non-zero on error.
+*/
+static int run_one(int nPage, int nLookup){
+  Pager *pPager;
+  void *pPage;
+  unsigned int x = 1;
+  double tStart, tElapsed;
+  int i, rc;
+
+  rc = sqlite3pager_open(&pPager, ":memory:", nPage, 0, 1, 0);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "cannot open pager: %d\n", rc);
+    return 1;
+  }
+  sqlite3pager_set_pagesize(pPager, SQLITE_MIN_PAGE_SIZE);
+  sqlite3pager_set_cachesize(pPager, nPage);
+  for(i=1; i<=nPage; i++){
+    rc = sqlite3pager_get(pPager, i, &pPage);
+    if( rc!=SQLITE_OK ){
+      fprintf(stderr, "cannot load page %d: %d\n", i, rc);
+      sqlite3pager_close(pPager);
+      return 1;
+    }
+    sqlite3pager_unref(pPage);
+  }
+
+  tStart = now();
+  for(i=0; i<nLookup; i++){
+    x = x*1103515245 + 12345;
+    sqlite3pager_get(pPager, 1 + (x>>8)%nPage, &pPage);
+    sqlite3pager_unref(pPage);
+  }
+  tElapsed = now() - tStart;
+
+  printf("%8d pages: %7.1f ns per hit (%d hits, %d misses)\n",
+         nPage, tElapsed*1000.0/nLookup,
+         sqlite3pager_stats(pPager)[6], sqlite3pager_stats(pPager)[7]);
+  sqlite3pager_close(pPager);
+  return 0;
+}
+
+int main(int argc, char **argv){
+  int mxPage = 1000000;
+  int nLookup = 2000000;
+  int nPage;
+
+  if( argc>1 ) mxPage = atoi(argv[1]);
+  if( argc>2 ) nLookup = atoi(argv[2]);
+  for(nPage=1000; nPage<=mxPage; nPage*=10){
+    if( run_one(nPage, nLookup) ) return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+/*
+** A micro-benchmark for the instruction dispatch of sqlite3VdbeExec().
+** It fills a table of small integers in an in-memory database and then
+** runs
+**
+**     SELECT count(*) FROM t WHERE c1<>-1 AND c2<>-1 ... AND cK<>-1
+**
+** for K from 1 to 4.  No value is ever -1, so every row runs the whole
+** loop:  one OP_Column and one OP_Eq for each term, then the OP_Integer
+** and OP_AggFunc for count(*) and the OP_Next that moves on.  Each extra
+** term adds two instructions per row, so the growth in time from K=1 to
+** K=4 divided by six instructions per row is the cost of a cheap
+** instruction, dispatch included, with the cursor and aggregate overhead
+** taken out.  The fastest of N-PASSES runs of each query is reported, to
+** keep other work on the machine out of the figures.
+**
+** Build it once against library objects compiled as usual and once with
+** -DVDBE_COMPUTED_GOTO to compare the two kinds of dispatch.  Compile
+** the library with -DNDEBUG both times, since without it each
+** instruction still returns to the top of the loop for the debugging
+** checks there:
+**
+**     gcc -O2 -Isrc -I. tool/vdbebench.c <library objects> -lpthread
+**
+** Usage:  vdbebench ?N-ROWS? ?N-PASSES?
+*/
+#include "sqlite3.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/*
+** Return the current time in microseconds.
+*/
+static double now(void){
+  struct timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec*1000000.0 + t.tv_usec;
+}
+
+/*
+** Run zSql, which must return a single integer, and write that integer
+** into *pRes.  Returns an SQLite error code.
+*/
+static int runQuery(sqlite3 *db, const char *zSql, int *pRes){
+  sqlite3_stmt *pStmt;
+  int rc;
+  rc = sqlite3_prepare(db, zSql, -1, &pStmt, 0);
+  if( rc!=SQLITE_OK ) return rc;
+  while( (rc = sqlite3_step(pStmt))==SQLITE_ROW ){
+    *pRes = sqlite3_column_int(pStmt, 0);
+  }
+  return sqlite3_finalize(pStmt);
+}
+
+/*
+** Build the table, with nRow rows of four integer columns.
+*/
+static int fillTable(sqlite3 *db, int nRow){
+  sqlite3_stmt *pStmt;
+  int i, rc;
+  rc = sqlite3_exec(db,
+      "CREATE TABLE t(c1 INTEGER, c2 INTEGER, c3 INTEGER, c4 INTEGER);"
+      "BEGIN;", 0, 0, 0);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3_prepare(db, "INSERT INTO t VALUES(?,?,?,?)", -1, &pStmt, 0);
+  }
+  for(i=0; rc==SQLITE_OK && i<nRow; i++){
+    sqlite3_bind_int(pStmt, 1, i%100);
+    sqlite3_bind_int(pStmt, 2, i%7);
+    sqlite3_bind_int(pStmt, 3, i%1000);
+    sqlite3_bind_int(pStmt, 4, i);
+    sqlite3_step(pStmt);
+    rc = sqlite3_reset(pStmt);
+  }
+  if( rc==SQLITE_OK ){
+    sqlite3_finalize(pStmt);
+    rc = sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+  }
+  return rc;
+}
+
+int main(int argc, char **argv){
+  sqlite3 *db;
+  int nRow = 200000;
+  int nPass = 20;
+  double aTime[5];
+  char zSql[200];
+  int k, i, rc;
+
+  if( argc>1 ) nRow = atoi(argv[1]);
+  if( argc>2 ) nPass = atoi(argv[2]);
+  rc = sqlite3_open(":memory:", &db);
+  if( rc==SQLITE_OK ) rc = fillTable(db, nRow);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "cannot build the table: %s\n", sqlite3_errmsg(db));
+    return 1;
+  }
+
+  for(k=1; k<=4; k++){
+    double tStart;
+    int n = 0;
+    strcpy(zSql, "SELECT count(*) FROM t WHERE c1<>-1");
+    for(i=2; i<=k; i++){
+      sprintf(&zSql[strlen(zSql)], " AND c%d<>-1", i);
+    }
+    aTime[k] = 0.0;
+    for(i=0; i<nPass; i++){
+      double tElapsed;
+      tStart = now();
+      rc = runQuery(db, zSql, &n);
+      tElapsed = (now() - tStart)*1000.0/nRow;
+      if( rc!=SQLITE_OK || n!=nRow ){
+        fprintf(stderr, "query failed: rc=%d count=%d\n", rc, n);
+        return 1;
+      }
+      if( i==0 || tElapsed<aTime[k] ) aTime[k] = tElapsed;
+    }
+    printf("%d term%s  %7.2f ns/row\n", k, k==1 ? " " : "s", aTime[k]);
+  }
+  printf("per instruction  %5.2f ns\n", (aTime[4] - aTime[1])/6.0);
+  sqlite3_close(db);
+  return 0;
+}
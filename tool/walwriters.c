@@ -0,0 +1,129 @@
+/*
+** A test of concurrent writers to a database in write-ahead log mode.
+** Several processes insert rows into the same table, one row per
+** transaction, while the log is checkpointed and restarted underneath
+** them.  When they are done the table must hold every row that was
+** reported as committed.  The exit status is non-zero if any insert
+** failed or if the final row count is wrong.
+**
+** Build it against the object files of the library, for example:
+**
+**     gcc -O2 -Isrc -I. tool/walwriters.c <library objects> -lpthread
+**
+** Usage:  walwriters ?DATABASE? ?PROCESSES? ?ROWS? ?GROUP-COMMIT-MS?
+**
+** If GROUP-COMMIT-MS is greater than zero, every writer runs with
+** PRAGMA group_commit set to that many milliseconds.
+*/
+#include "sqlite3.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/*
+** Run zSql against db.  Print an error message and return the error
+** code if it fails.
+*/
+static int exec_sql(sqlite3 *db, const char *zWho, const char *zSql){
+  char *zErr = 0;
+  int rc = sqlite3_exec(db, zSql, 0, 0, &zErr);
+  if( rc!=SQLITE_OK ){
+    fprintf(stderr, "%s: %s: rc=%d %s\n", zWho, zSql, rc, zErr ? zErr : "");
+    sqlite3_free(zErr);
+  }
+  return rc;
+}
+
+/*
+** Open the database in WAL mode with a generous busy timeout.
+*/
+static sqlite3 *open_db(const char *zDb, const char *zWho, int nGroup){
+  sqlite3 *db;
+  char zSql[100];
+  if( sqlite3_open(zDb, &db)!=SQLITE_OK ){
+    fprintf(stderr, "%s: cannot open %s\n", zWho, zDb);
+    exit(1);
+  }
+  sqlite3_busy_timeout(db, 60000);
+  exec_sql(db, zWho, "PRAGMA journal_mode=WAL");
+  sprintf(zSql, "PRAGMA group_commit=%d", nGroup>0 ? nGroup : 0);
+  exec_sql(db, zWho, zSql);
+  return db;
+}
+
+/*
+** The body of writer process iProc.  Insert nRow rows and return the
+** number of inserts that failed.
+*/
+static int writer(const char *zDb, int iProc, int nRow, int nGroup){
+  sqlite3 *db;
+  char zWho[20];
+  char zSql[100];
+  int i, nErr = 0;
+
+  sprintf(zWho, "p%d", iProc);
+  db = open_db(zDb, zWho, nGroup);
+  for(i=0; i<nRow; i++){
+    sprintf(zSql, "INSERT INTO t VALUES(%d,%d)", iProc, i);
+    if( exec_sql(db, zWho, zSql)!=SQLITE_OK ) nErr++;
+  }
+  sqlite3_close(db);
+  return nErr;
+}
+
+/*
+** Callback that stores the count(*) result.
+*/
+static int count_cb(void *pArg, int nCol, char **azVal, char **azCol){
+  *(int*)pArg = azVal[0] ? atoi(azVal[0]) : -1;
+  return 0;
+}
+
+int main(int argc, char **argv){
+  const char *zDb = "walwriters.db";
+  int nProc = 3;
+  int nRow = 600;
+  int nGroup = 0;
+  int nFailed = 0;
+  int nCount = -1;
+  char zWal[1000];
+  sqlite3 *db;
+  int i;
+
+  if( argc>1 ) zDb = argv[1];
+  if( argc>2 ) nProc = atoi(argv[2]);
+  if( argc>3 ) nRow = atoi(argv[3]);
+  if( argc>4 ) nGroup = atoi(argv[4]);
+  unlink(zDb);
+  sprintf(zWal, "%.900s-wal", zDb);
+  unlink(zWal);
+
+  db = open_db(zDb, "main", 0);
+  if( exec_sql(db, "main", "CREATE TABLE t(a,b)") ) return 1;
+  sqlite3_close(db);
+
+  for(i=0; i<nProc; i++){
+    pid_t pid = fork();
+    if( pid<0 ){
+      perror("fork");
+      return 1;
+    }
+    if( pid==0 ){
+      exit(writer(zDb, i, nRow, nGroup)>0);
+    }
+  }
+  for(i=0; i<nProc; i++){
+    int status;
+    if( wait(&status)<0 || !WIFEXITED(status) || WEXITSTATUS(status)!=0 ){
+      nFailed++;
+    }
+  }
+
+  db = open_db(zDb, "main", 0);
+  sqlite3_exec(db, "SELECT count(*) FROM t", count_cb, &nCount, 0);
+  sqlite3_close(db);
+  printf("%d writers failed, %d rows of %d\n", nFailed, nCount, nProc*nRow);
+  return nFailed>0 || nCount!=nProc*nRow;
+}